@@ -9,6 +9,7 @@ class CalibratorAccumulate : public Calibrator {
       CalibratorAccumulate(Variable::Type iVariable, const Options& iOptions);
       static std::string description();
       std::string name() const {return "accumulate";};
+      bool usesVariable(Variable::Type iVariable) const {return iVariable == mInputVariable || iVariable == mOutputVariable;};
       bool requiresParameterFile() const { return false;};
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
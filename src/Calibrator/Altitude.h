@@ -10,6 +10,7 @@ class CalibratorAltitude : public Calibrator {
       CalibratorAltitude(const Options& iOptions);
       static std::string description();
       std::string name() const {return "altitude";};
+      bool usesVariable(Variable::Type iVariable) const {return false;};
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
 };
@@ -17,9 +17,6 @@ bool CalibratorBct::calibrateCore(File& iFile, const ParameterFile* iParameterFi
    int nLon = iFile.getNumLon();
    int nEns = iFile.getNumEns();
    int nTime = iFile.getNumTime();
-   vec2 lats = iFile.getLats();
-   vec2 lons = iFile.getLons();
-   vec2 elevs = iFile.getElevs();
 
    // Loop over offsets
    for(int t = 0; t < nTime; t++) {
@@ -28,15 +25,14 @@ bool CalibratorBct::calibrateCore(File& iFile, const ParameterFile* iParameterFi
 
       Field& field = *iFile.getField(mMainPredictor, t);
 
-      Parameters parameters;
-      if(!iParameterFile->isLocationDependent())
-         parameters = iParameterFile->getParameters(t);
+      std::vector<int> parameterIndices;
+      std::vector<Parameters> parameterSets;
+      iParameterFile->getParameters(t, iFile, parameterIndices, parameterSets);
 
       #pragma omp parallel for reduction(+:numInvalidRaw, numInvalidCal)
       for(int i = 0; i < nLat; i++) {
          for(int j = 0; j < nLon; j++) {
-            if(iParameterFile->isLocationDependent())
-               parameters = iParameterFile->getParameters(t, Location(lats[i][j], lons[i][j], elevs[i][j]));
+            const Parameters& parameters = parameterSets[parameterIndices[i*nLon + j]];
 
             // Compute ensemble mean
             float ensMean = 0;
@@ -17,6 +17,7 @@ class CalibratorBct : public Calibrator {
 
       static std::string description();
       std::string name() const {return "bct";};
+      bool usesVariable(Variable::Type iVariable) const {return iVariable == mMainPredictor;};
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
       Variable::Type mMainPredictor;
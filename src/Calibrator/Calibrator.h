@@ -4,6 +4,7 @@
 #include <vector>
 #include "../Scheme.h"
 #include "../Parameters.h"
+#include "../Variable.h"
 
 typedef std::vector<float> Ens;
 typedef std::pair<float,Ens> ObsEns;
@@ -38,6 +39,10 @@ class Calibrator : public Scheme {
 
       // Does this calibrator require a parameter file?
       virtual bool requiresParameterFile() const { return true;};
+
+      //! Does the calibrator read or change the values of iVariable? Calibrators that do not
+      //! override this are assumed to use every variable.
+      virtual bool usesVariable(Variable::Type iVariable) const {return true;};
    protected:
       virtual bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const = 0;
    private:
@@ -9,6 +9,7 @@ class CalibratorCloud : public Calibrator {
       CalibratorCloud(Variable::Type iVariable, const Options& iOptions);
       static std::string description();
       std::string name() const {return "cloud";};
+      bool usesVariable(Variable::Type iVariable) const {return iVariable == mPrecipType || iVariable == mCloudType;};
       bool requiresParameterFile() const { return false;};
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
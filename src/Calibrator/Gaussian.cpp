@@ -25,23 +25,19 @@ bool CalibratorGaussian::calibrateCore(File& iFile, const ParameterFile* iParame
    int nLon = iFile.getNumLon();
    int nEns = iFile.getNumEns();
    int nTime = iFile.getNumTime();
-   vec2 lats = iFile.getLats();
-   vec2 lons = iFile.getLons();
-   vec2 elevs = iFile.getElevs();
 
    // Loop over offsets
    for(int t = 0; t < nTime; t++) {
       Field& field = *iFile.getField(mMainPredictor, t);
 
-      Parameters parameters;
-      if(!iParameterFile->isLocationDependent())
-         parameters = iParameterFile->getParameters(t);
+      std::vector<int> parameterIndices;
+      std::vector<Parameters> parameterSets;
+      iParameterFile->getParameters(t, iFile, parameterIndices, parameterSets);
 
       #pragma omp parallel for
       for(int i = 0; i < nLat; i++) {
          for(int j = 0; j < nLon; j++) {
-            if(iParameterFile->isLocationDependent())
-               parameters = iParameterFile->getParameters(t, Location(lats[i][j], lons[i][j], elevs[i][j]));
+            const Parameters& parameters = parameterSets[parameterIndices[i*nLon + j]];
 
             // Compute model variables
             float total2 = 0;
@@ -23,6 +23,7 @@ class CalibratorGaussian : public Calibrator {
 
       static std::string description();
       std::string name() const {return "gaussian";};
+      bool usesVariable(Variable::Type iVariable) const {return iVariable == mMainPredictor;};
       Parameters train(const std::vector<ObsEns>& iData) const;
    private:
       static double my_f(const gsl_vector *v, void *params);
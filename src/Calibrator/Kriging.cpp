@@ -3,7 +3,9 @@
 #include "../Parameters.h"
 #include "../File/File.h"
 #include "../Downscaler/Downscaler.h"
+#include "../KDTree.h"
 #include <math.h>
+#include <algorithm>
 
 CalibratorKriging::CalibratorKriging(Variable::Type iVariable, const Options& iOptions):
       Calibrator(iOptions),
@@ -193,13 +195,43 @@ bool CalibratorKriging::calibrateCore(File& iFile, const ParameterFile* iParamet
    for(int ii = 0; ii < N; ii++) {
       matrix[ii].resize(N,0);
    }
+
+   // Put the stations in a tree, so that only stations within the radius of influence of a point
+   // need to be checked. The tree uses great-circle distances whereas calcCovar can use the
+   // equirectangular approximation, so search a slightly larger radius and let calcCovar make the
+   // final decision. The approximation deteriorates for large distances, in which case all
+   // stations are checked.
+   float searchRadius = mRadius * 1.1 + 1000;
+   if(mRadius > 100000)
+      searchRadius = Util::pi * Util::radiusEarth;
+   vec2 obsLats(N, std::vector<float>(1, Util::MV));
+   vec2 obsLons(N, std::vector<float>(1, Util::MV));
+   std::vector<float> obsLatsFlat(N), obsLonsFlat(N);
+   bool hasValidObs = false;
+   for(int ii = 0; ii < N; ii++) {
+      obsLats[ii][0] = obsLocations[ii].lat();
+      obsLons[ii][0] = obsLocations[ii].lon();
+      obsLatsFlat[ii] = obsLocations[ii].lat();
+      obsLonsFlat[ii] = obsLocations[ii].lon();
+      if(Util::isValid(obsLats[ii][0]) && Util::isValid(obsLons[ii][0]))
+         hasValidObs = true;
+   }
+   KDTree obsTree;
+   if(hasValidObs)
+      obsTree.build(obsLats, obsLons);
+
+   std::vector<int> offsets, indices;
+   obsTree.getNeighboursWithin(obsLatsFlat, obsLonsFlat, searchRadius, offsets, indices);
    for(int ii = 0; ii < N; ii++) {
       Location iloc = obsLocations[ii];
       // The diagonal is 1, since the distance from a point to itself
       // is 0, therefore its weight is 1.
       matrix[ii][ii] = 1;
       // The matrix is symmetric, so only compute one of the halves
-      for(int jj = ii+1; jj < N; jj++) {
+      for(int k = offsets[ii]; k < offsets[ii+1]; k++) {
+         int jj = indices[k];
+         if(jj <= ii)
+            continue;
          Location jloc = obsLocations[jj];
          // Improve conditioning of matrix when you have two or more stations
          // that are very close
@@ -235,6 +267,15 @@ bool CalibratorKriging::calibrateCore(File& iFile, const ParameterFile* iParamet
       Sindex[i].resize(nLon);
    }
 
+   std::vector<float> gridLats(nLat*nLon), gridLons(nLat*nLon);
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         gridLats[i*nLon + j] = lats[i][j];
+         gridLons[i*nLon + j] = lons[i][j];
+      }
+   }
+   obsTree.getNeighboursWithin(gridLats, gridLons, searchRadius, offsets, indices);
+
    #pragma omp parallel for
    for(int i = 0; i < nLat; i++) {
       for(int j = 0; j < nLon; j++) {
@@ -242,7 +283,12 @@ bool CalibratorKriging::calibrateCore(File& iFile, const ParameterFile* iParamet
          float lon = lons[i][j];
          float elev = elevs[i][j];
          const Location gridPoint(lat, lon, elev);
-         for(int ii = 0; ii < N; ii++) {
+         // Check the nearby stations in their original order
+         int k = i*nLon + j;
+         std::vector<int> candidates(indices.begin() + offsets[k], indices.begin() + offsets[k+1]);
+         std::sort(candidates.begin(), candidates.end());
+         for(int c = 0; c < candidates.size(); c++) {
+            int ii = candidates[c];
             Location obsPoint = obsLocations[ii];
             float covar = calcCovar(obsPoint, gridPoint);
             if(covar > 0) {
@@ -17,6 +17,7 @@ class CalibratorKriging : public Calibrator {
       };
       //! Compute the bias at the training point
       Parameters train(const std::vector<ObsEns>& iData) const;
+      bool usesVariable(Variable::Type iVariable) const {return iVariable == mVariable || iVariable == mAuxVariable;};
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
 
@@ -4,6 +4,7 @@
 #include <boost/math/distributions/gamma.hpp>
 #include "../Util.h"
 #include "../File/File.h"
+#include "../IntegralImage.h"
 CalibratorNeighbourhood::CalibratorNeighbourhood(Variable::Type iVariable, const Options& iOptions):
       Calibrator(iOptions),
       mRadius(3),
@@ -52,16 +53,54 @@ CalibratorNeighbourhood::CalibratorNeighbourhood(Variable::Type iVariable, const
    }
 }
 
+namespace {
+   // Counts the number of values of each rank within a window, using a Fenwick tree, so that
+   // values can be added, removed and the n-th smallest found in O(log(number of ranks))
+   class RankCounter {
+      public:
+         RankCounter(int iNumRanks) : mTree(iNumRanks+1, 0), mTotal(0), mStep(1) {
+            while(2*mStep <= iNumRanks)
+               mStep *= 2;
+         };
+         void add(int iRank, int iCount) {
+            for(int k = iRank + 1; k < mTree.size(); k += k & -k)
+               mTree[k] += iCount;
+            mTotal += iCount;
+         };
+         int size() const {
+            return mTotal;
+         };
+         // Rank of the iN-th smallest value (starting at 0)
+         int find(int iN) const {
+            int pos = 0;
+            for(int step = mStep; step > 0; step /= 2) {
+               if(pos + step < mTree.size() && mTree[pos + step] <= iN) {
+                  pos += step;
+                  iN -= mTree[pos];
+               }
+            }
+            return pos;
+         };
+      private:
+         std::vector<int> mTree;
+         int mTotal;
+         int mStep;
+   };
+}
+
 bool CalibratorNeighbourhood::calibrateCore(File& iFile, const ParameterFile* iParameterFile) const {
    int nLat = iFile.getNumLat();
    int nLon = iFile.getNumLon();
    int nEns = iFile.getNumEns();
    int nTime = iFile.getNumTime();
 
+   std::vector<float> values(nLat*nLon);
+   std::vector<float> output(nLat*nLon);
+
    // Loop over offsets
    for(int t = 0; t < nTime; t++) {
       Field& precip = *iFile.getField(mVariable, t);
-      Field precipRaw = precip;
+      float* data = precip.getData();
 
       int radius = mRadius;
       if(iParameterFile != NULL) {
@@ -71,33 +110,167 @@ bool CalibratorNeighbourhood::calibrateCore(File& iFile, const ParameterFile* iP
          radius = iParameterFile->getParameters(t)[0];
       }
 
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            for(int e = 0; e < nEns; e++) {
-               // Put neighbourhood into vector
-               std::vector<float> neighbourhood;
-               int Ni = std::min(nLat-1, i+radius) - std::max(0, i-radius) + 1;
-               int Nj = std::min(nLon-1, j+radius) - std::max(0, j-radius) + 1;
-               assert(Ni > 0);
-               assert(Nj > 0);
-               neighbourhood.resize(Ni*Nj, Util::MV);
-               int index = 0;
-               for(int ii = std::max(0, i-radius); ii <= std::min(nLat-1, i+radius); ii++) {
-                  for(int jj = std::max(0, j-radius); jj <= std::min(nLon-1, j+radius); jj++) {
-                     float value = precipRaw(ii,jj,e);
-                     assert(index < Ni*Nj);
-                     neighbourhood[index] = value;
-                     index++;
-                  }
+      // Process one member at a time, so that the calibrated values can be written in place
+      for(int e = 0; e < nEns; e++) {
+         for(int n = 0; n < nLat*nLon; n++) {
+            values[n] = data[n*nEns + e];
+         }
+         calculateStat(values, nLat, nLon, radius, output);
+         for(int n = 0; n < nLat*nLon; n++) {
+            data[n*nEns + e] = output[n];
+         }
+      }
+   }
+   return true;
+}
+
+void CalibratorNeighbourhood::calculateStat(const std::vector<float>& iValues, int iNumLat, int iNumLon, int iRadius, std::vector<float>& iOutput) const {
+   if(mStatType == Util::StatTypeQuantile && (mQuantile == 0 || mQuantile == 1)) {
+      std::vector<float> min, max;
+      Util::getWindowMinMax(iValues, iNumLat, iNumLon, iRadius, min, max);
+      if(mQuantile == 0)
+         iOutput = min;
+      else
+         iOutput = max;
+   }
+   else if(mStatType == Util::StatTypeQuantile) {
+      calculateQuantile(iValues, iNumLat, iNumLon, iRadius, iOutput);
+   }
+   else {
+      calculateMoment(iValues, iNumLat, iNumLon, iRadius, iOutput);
+   }
+}
+
+void CalibratorNeighbourhood::calculateMoment(const std::vector<float>& iValues, int iNumLat, int iNumLon, int iRadius, std::vector<float>& iOutput) const {
+   int N = iNumLat * iNumLon;
+   // Values are shifted by their mean to reduce round-off errors when subtracting large sums
+   double ref = 0;
+   int numValid = 0;
+   for(int n = 0; n < N; n++) {
+      if(Util::isValid(iValues[n])) {
+         ref += iValues[n];
+         numValid++;
+      }
+   }
+   if(numValid > 0)
+      ref /= numValid;
+   std::vector<double> valid(N, 0), x(N, 0), x2(N, 0);
+   for(int n = 0; n < N; n++) {
+      if(Util::isValid(iValues[n])) {
+         valid[n] = 1;
+         x[n] = iValues[n] - ref;
+         x2[n] = x[n] * x[n];
+      }
+   }
+   IntegralImage count(valid, iNumLat, iNumLon);
+   IntegralImage sum(x, iNumLat, iNumLon);
+   IntegralImage sum2;
+   if(mStatType == Util::StatTypeStd)
+      sum2.build(x2, iNumLat, iNumLon);
+
+   // Constant neighbourhoods (e.g. areas without precipitation) are detected using the range, so
+   // that these get exact values
+   std::vector<float> min, max;
+   Util::getWindowMinMax(iValues, iNumLat, iNumLon, iRadius, min, max);
+
+   iOutput.resize(N);
+   #pragma omp parallel for
+   for(int i = 0; i < iNumLat; i++) {
+      for(int j = 0; j < iNumLon; j++) {
+         int n = i*iNumLon + j;
+         int startI = i - iRadius;
+         int startJ = j - iRadius;
+         int endI = i + iRadius;
+         int endJ = j + iRadius;
+         double counter = count.getSum(startI, startJ, endI, endJ);
+         float value = Util::MV;
+         if(counter > 0) {
+            if(min[n] == max[n]) {
+               value = mStatType == Util::StatTypeStd ? 0 : min[n];
+            }
+            else {
+               double mean = sum.getSum(startI, startJ, endI, endJ) / counter;
+               if(mStatType == Util::StatTypeStd) {
+                  double var = sum2.getSum(startI, startJ, endI, endJ) / counter - mean*mean;
+                  value = sqrt(std::max(var, 0.0));
+               }
+               else {
+                  value = mean + ref;
                }
-               assert(index == Ni*Nj);
-               precip(i,j,e) = Util::calculateStat(neighbourhood, mStatType, mQuantile);
+            }
+         }
+         iOutput[n] = value;
+      }
+   }
+}
+
+void CalibratorNeighbourhood::calculateQuantile(const std::vector<float>& iValues, int iNumLat, int iNumLon, int iRadius, std::vector<float>& iOutput) const {
+   int N = iNumLat * iNumLon;
+   // Replace each value by its rank among the distinct valid values (-1 if missing)
+   std::vector<float> sorted;
+   sorted.reserve(N);
+   for(int n = 0; n < N; n++) {
+      if(Util::isValid(iValues[n]))
+         sorted.push_back(iValues[n]);
+   }
+   std::sort(sorted.begin(), sorted.end());
+   sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+   std::vector<int> ranks(N, -1);
+   for(int n = 0; n < N; n++) {
+      if(Util::isValid(iValues[n]))
+         ranks[n] = std::lower_bound(sorted.begin(), sorted.end(), iValues[n]) - sorted.begin();
+   }
+
+   iOutput.resize(N);
+   #pragma omp parallel
+   {
+      RankCounter counter(sorted.size());
+      #pragma omp for
+      for(int i = 0; i < iNumLat; i++) {
+         int startI = std::max(0, i - iRadius);
+         int endI = std::min(iNumLat - 1, i + iRadius);
+         for(int j = -iRadius; j < iNumLon; j++) {
+            // Move the window one column to the right
+            int add = j + iRadius;
+            int remove = j - iRadius - 1;
+            for(int ii = startI; ii <= endI; ii++) {
+               if(add < iNumLon && ranks[ii*iNumLon + add] >= 0)
+                  counter.add(ranks[ii*iNumLon + add], 1);
+               if(remove >= 0 && ranks[ii*iNumLon + remove] >= 0)
+                  counter.add(ranks[ii*iNumLon + remove], -1);
+            }
+            if(j < 0)
+               continue;
+
+            // Interpolate between order statistics in the same way as Util::calculateStat
+            int num = counter.size();
+            float value = Util::MV;
+            if(num > 0) {
+               int lowerIndex = floor(mQuantile * (num-1));
+               int upperIndex = ceil(mQuantile * (num-1));
+               float lowerValue = sorted[counter.find(lowerIndex)];
+               float upperValue = sorted[counter.find(upperIndex)];
+               if(lowerIndex == upperIndex) {
+                  value = lowerValue;
+               }
+               else {
+                  float lowerQuantile = (float) lowerIndex / (num-1);
+                  float upperQuantile = (float) upperIndex / (num-1);
+                  float f = (mQuantile - lowerQuantile)/(upperQuantile - lowerQuantile);
+                  value = lowerValue + (upperValue - lowerValue) * f;
+               }
+            }
+            iOutput[i*iNumLon + j] = value;
+         }
+         // Empty the window before the next row
+         for(int ii = startI; ii <= endI; ii++) {
+            for(int jj = std::max(0, iNumLon - 1 - iRadius); jj < iNumLon; jj++) {
+               if(ranks[ii*iNumLon + jj] >= 0)
+                  counter.add(ranks[ii*iNumLon + jj], -1);
             }
          }
       }
    }
-   return true;
 }
 
 int CalibratorNeighbourhood::getRadius() const {
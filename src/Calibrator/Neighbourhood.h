@@ -13,10 +13,18 @@ class CalibratorNeighbourhood : public Calibrator {
       CalibratorNeighbourhood(Variable::Type iVariable, const Options& iOptions);
       static std::string description();
       std::string name() const {return "neighbourhood";};
+      bool usesVariable(Variable::Type iVariable) const {return iVariable == mVariable;};
       int getRadius() const;
       bool requiresParameterFile() const { return false;};
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
+      //! Compute the statistic within +- iRadius of each point in the iNumLat*iNumLon grid iValues
+      //! (longitude index varying fastest)
+      void calculateStat(const std::vector<float>& iValues, int iNumLat, int iNumLon, int iRadius, std::vector<float>& iOutput) const;
+      //! Compute mean or standard deviation using integral images
+      void calculateMoment(const std::vector<float>& iValues, int iNumLat, int iNumLon, int iRadius, std::vector<float>& iOutput) const;
+      //! Compute the quantile by sliding a histogram of the ranks of the values along each row
+      void calculateQuantile(const std::vector<float>& iValues, int iNumLat, int iNumLon, int iRadius, std::vector<float>& iOutput) const;
       Variable::Type mVariable;
       int mRadius;
       Util::StatType mStatType;
@@ -18,8 +18,6 @@ bool CalibratorPhase::calibrateCore(File& iFile, const ParameterFile* iParameter
    int nLat = iFile.getNumLat();
    int nLon = iFile.getNumLon();
    int nEns = iFile.getNumEns();
-   vec2 lats = iFile.getLats();
-   vec2 lons = iFile.getLons();
    int nTime = iFile.getNumTime();
    iFile.initNewVariable(Variable::Phase);
    vec2 elevs = iFile.getElevs();
@@ -27,11 +25,9 @@ bool CalibratorPhase::calibrateCore(File& iFile, const ParameterFile* iParameter
 
    // Loop over offsets
    for(int t = 0; t < nTime; t++) {
-      Parameters par;
-      if(!iParameterFile->isLocationDependent())
-         par = iParameterFile->getParameters(t);
-      float snowSleetThreshold = par[0];
-      float sleetRainThreshold = par[1];
+      std::vector<int> parameterIndices;
+      std::vector<Parameters> parameterSets;
+      iParameterFile->getParameters(t, iFile, parameterIndices, parameterSets);
       const FieldPtr temp = iFile.getField(Variable::T, t);
       const FieldPtr precip = iFile.getField(Variable::Precip, t);
       FieldPtr phase = iFile.getField(Variable::Phase, t);
@@ -48,8 +44,13 @@ bool CalibratorPhase::calibrateCore(File& iFile, const ParameterFile* iParameter
       for(int i = 0; i < nLat; i++) {
          for(int j = 0; j < nLon; j++) {
             float currElev = elevs[i][j];
-            if(iParameterFile->isLocationDependent())
-               par = iParameterFile->getParameters(t, Location(lats[i][j], lons[i][j], currElev));
+            const Parameters& par = parameterSets[parameterIndices[i*nLon + j]];
+            float snowSleetThreshold = Util::MV;
+            float sleetRainThreshold = Util::MV;
+            if(par.size() >= 2) {
+               snowSleetThreshold = par[0];
+               sleetRainThreshold = par[1];
+            }
             for(int e = 0; e < nEns; e++) {
                float currDryTemp  = (*temp)(i,j,e);
                float currTemp     = currDryTemp;
@@ -90,6 +91,11 @@ bool CalibratorPhase::calibrateCore(File& iFile, const ParameterFile* iParameter
    return true;
 }
 
+bool CalibratorPhase::usesVariable(Variable::Type iVariable) const {
+   return iVariable == Variable::T || iVariable == Variable::Precip || iVariable == Variable::Phase ||
+          iVariable == Variable::RH || iVariable == Variable::P;
+}
+
 float CalibratorPhase::getMinPrecip() const {
    return mMinPrecip;
 }
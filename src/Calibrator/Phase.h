@@ -9,6 +9,7 @@ class CalibratorPhase : public Calibrator {
       CalibratorPhase(const Options& iOptions);
       static std::string description();
       std::string name() const {return "phase";};
+      bool usesVariable(Variable::Type iVariable) const;
       //! Compute wetbulb temperature
       //! @param iTemperature Temperature in K
       //! @param iPressure Pressure in pa
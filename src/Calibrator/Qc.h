@@ -14,6 +14,7 @@ class CalibratorQc : public Calibrator {
       CalibratorQc(Variable::Type iVariable, const Options& iOptions);
       static std::string description();
       std::string name() const {return "qc";};
+      bool usesVariable(Variable::Type iVariable) const {return iVariable == mVariable;};
       bool requiresParameterFile() const { return false;};
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
@@ -9,6 +9,7 @@ class CalibratorQnh : public Calibrator {
       CalibratorQnh(const Options& iOptions);
       static std::string description();
       std::string name() const {return "qnh";};
+      bool usesVariable(Variable::Type iVariable) const {return iVariable == Variable::P || iVariable == Variable::QNH;};
       static float calcQnh(float iElev, float iPressure);
       bool requiresParameterFile() const { return false;};
    private:
@@ -41,32 +41,25 @@ bool CalibratorQq::calibrateCore(File& iFile, const ParameterFile* iParameterFil
    const int nLon = iFile.getNumLon();
    const int nEns = iFile.getNumEns();
    const int nTime = iFile.getNumTime();
-   const vec2 lats = iFile.getLats();
-   const vec2 lons = iFile.getLons();
-   const vec2 elevs = iFile.getElevs();
 
    for(int t = 0; t < nTime; t++) {
       const FieldPtr field = iFile.getField(mVariable, t);
 
-      // Retrieve the calibration parameters for this time
-      // Overwrite them later if they are location dependent
-      std::vector<float> obsVecGlobal, fcstVecGlobal;
-      if(!iParameterFile->isLocationDependent()) {
-         Parameters parameters = iParameterFile->getParameters(t);
-         separate(parameters, obsVecGlobal, fcstVecGlobal);
+      // Retrieve the calibration parameters for this time, and separate each set only once
+      std::vector<int> parameterIndices;
+      std::vector<Parameters> parameterSets;
+      iParameterFile->getParameters(t, iFile, parameterIndices, parameterSets);
+      std::vector<std::vector<float> > obsVecs(parameterSets.size());
+      std::vector<std::vector<float> > fcstVecs(parameterSets.size());
+      for(int k = 0; k < parameterSets.size(); k++) {
+         separate(parameterSets[k], obsVecs[k], fcstVecs[k]);
       }
       #pragma omp parallel for
       for(int i = 0; i < nLat; i++) {
          for(int j = 0; j < nLon; j++) {
-            std::vector<float> obsVec, fcstVec;
-            if(iParameterFile->isLocationDependent()) {
-               Parameters parameters = iParameterFile->getParameters(t, Location(lats[i][j], lons[i][j], elevs[i][j]));
-               separate(parameters, obsVec, fcstVec);
-            }
-            else {
-               obsVec = obsVecGlobal;
-               fcstVec = fcstVecGlobal;
-            }
+            int index = parameterIndices[i*nLon + j];
+            const std::vector<float>& obsVec = obsVecs[index];
+            const std::vector<float>& fcstVec = fcstVecs[index];
             int N = obsVec.size();
             if(obsVec.size() < 1) {
                Util::error("CalibratorQq cannot use parameters with size less than 2");
@@ -9,6 +9,7 @@ class CalibratorQq : public Calibrator {
       CalibratorQq(Variable::Type iVariable, const Options& iOptions);
       static std::string description();
       std::string name() const {return "qq";};
+      bool usesVariable(Variable::Type iVariable) const {return iVariable == mVariable;};
       Parameters train(const std::vector<ObsEns>& iData) const;
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
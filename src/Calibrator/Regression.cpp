@@ -17,9 +17,6 @@ bool CalibratorRegression::calibrateCore(File& iFile, const ParameterFile* iPara
    int nLon = iFile.getNumLon();
    int nEns = iFile.getNumEns();
    int nTime = iFile.getNumTime();
-   vec2 lats = iFile.getLats();
-   vec2 lons = iFile.getLons();
-   vec2 elevs = iFile.getElevs();
 
    if(iParameterFile->getNumParameters() == 0) {
       Util::error("Parameter file '" + iParameterFile->getFilename() + "' must have at least one dataacolumns");
@@ -27,16 +24,15 @@ bool CalibratorRegression::calibrateCore(File& iFile, const ParameterFile* iPara
 
    // Loop over offsets
    for(int t = 0; t < nTime; t++) {
-      Parameters parameters;
-      if(!iParameterFile->isLocationDependent())
-         parameters = iParameterFile->getParameters(t);
+      std::vector<int> parameterIndices;
+      std::vector<Parameters> parameterSets;
+      iParameterFile->getParameters(t, iFile, parameterIndices, parameterSets);
       const FieldPtr field = iFile.getField(mVariable, t);
 
       #pragma omp parallel for
       for(int i = 0; i < nLat; i++) {
          for(int j = 0; j < nLon; j++) {
-            if(iParameterFile->isLocationDependent())
-               parameters = iParameterFile->getParameters(t, Location(lats[i][j], lons[i][j], elevs[i][j]));
+            const Parameters& parameters = parameterSets[parameterIndices[i*nLon + j]];
             for(int e = 0; e < nEns; e++) {
                if(Util::isValid((*field)(i,j,e))) {
                   float total = 0;
@@ -10,6 +10,7 @@ class CalibratorRegression : public Calibrator {
       CalibratorRegression(Variable::Type iVariable, const Options& iOptions);
       static std::string description();
       std::string name() const {return "regression";};
+      bool usesVariable(Variable::Type iVariable) const {return iVariable == mVariable;};
       Parameters train(const std::vector<ObsEns>& iData) const;
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
@@ -10,6 +10,7 @@ class CalibratorSort : public Calibrator {
       CalibratorSort(Variable::Type iVariable, const Options& iOptions);
       static std::string description();
       std::string name() const {return "sort";};
+      bool usesVariable(Variable::Type iVariable) const {return iVariable == mVariable;};
       bool requiresParameterFile() const { return false;};
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
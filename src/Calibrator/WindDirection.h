@@ -14,6 +14,7 @@ class CalibratorWindDirection : public Calibrator {
       CalibratorWindDirection(Variable::Type iVariable, const Options& iOptions);
       static std::string description();
       std::string name() const {return "windDirection";};
+      bool usesVariable(Variable::Type iVariable) const {return iVariable == mVariable || iVariable == Variable::WD;};
       //! Get multiplication factor for given wind direction
       //! @param iWindDirection in degrees, meteorological wind direction (0 degrees is from North)
       static float getFactor(float iWindDirection, const Parameters& iPar);
@@ -1,6 +1,8 @@
 #include "Window.h"
 #include "../Util.h"
 #include "../File/File.h"
+#include <algorithm>
+#include <cmath>
 CalibratorWindow::CalibratorWindow(Variable::Type iVariable, const Options& iOptions) :
       Calibrator(iOptions),
       mRadius(3),
@@ -57,25 +59,85 @@ bool CalibratorWindow::calibrateCore(File& iFile, const ParameterFile* iParamete
    // Get all fields
    std::vector<FieldPtr> fields(nTime);
    std::vector<FieldPtr> fieldsOrig(nTime);
+   std::vector<const float*> input(nTime);
+   std::vector<float*> output(nTime);
    for(int t = 0; t < nTime; t++) {
       fieldsOrig[t]     = iFile.getField(mVariable, t);
       fields[t] = iFile.getEmptyField();
+      input[t] = fieldsOrig[t]->getData();
+      output[t] = fields[t]->getData();
    }
+   if(nTime == 0)
+      return true;
 
-   for(int t = 0; t < nTime; t++) {
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            for(int e = 0; e < nEns; e++) {
-               std::vector<float> window;
-               window.resize(2*mRadius+1, Util::MV);
-               int index = 0;
-               for(int tt = std::max(0,t-mRadius); tt <= std::min(nTime-1, t + mRadius); tt++) {
-                  float curr = (*fieldsOrig[tt])(i,j,e);
-                  window[index] = curr;
-                  index++;
+   #pragma omp parallel for
+   for(int i = 0; i < nLat; i++) {
+      // Work space, reused for all points in the row
+      std::vector<float> series(nTime);
+      std::vector<float> result(nTime);
+      std::vector<int> queue(nTime);
+      std::vector<float> window(2*mRadius+1);
+      for(int j = 0; j < nLon; j++) {
+         for(int e = 0; e < nEns; e++) {
+            int index = (i*nLon + j)*nEns + e;
+            for(int t = 0; t < nTime; t++) {
+               series[t] = input[t][index];
+            }
+
+            if(mStatType == Util::StatTypeQuantile && (mQuantile == 0 || mQuantile == 1)) {
+               Util::getWindowExtreme(&series[0], nTime, 1, mRadius, mQuantile == 1, &result[0], &queue[0]);
+            }
+            else if(mStatType == Util::StatTypeMean || mStatType == Util::StatTypeStd) {
+               // Update running sums as the window moves. Values are shifted by the first valid
+               // value for stability, as in Util::calculateStat.
+               double K = Util::MV;
+               for(int t = 0; t < nTime && !Util::isValid(K); t++) {
+                  if(Util::isValid(series[t]))
+                     K = series[t];
+               }
+               double total = 0;
+               double total2 = 0;
+               int count = 0;
+               for(int m = 0; m < nTime + mRadius; m++) {
+                  int add = m;
+                  int remove = m - 2*mRadius - 1;
+                  if(add < nTime && Util::isValid(series[add])) {
+                     total += series[add] - K;
+                     total2 += (series[add] - K)*(series[add] - K);
+                     count++;
+                  }
+                  if(remove >= 0 && Util::isValid(series[remove])) {
+                     total -= series[remove] - K;
+                     total2 -= (series[remove] - K)*(series[remove] - K);
+                     count--;
+                  }
+                  int t = m - mRadius;
+                  if(t < 0)
+                     continue;
+                  if(count == 0) {
+                     result[t] = Util::MV;
+                  }
+                  else if(mStatType == Util::StatTypeMean) {
+                     result[t] = total / count + K;
+                  }
+                  else {
+                     double mean = total / count;
+                     double var = total2 / count - mean*mean;
+                     result[t] = sqrt(std::max(var, 0.0));
+                  }
                }
-               (*fields[t])(i,j,e) = Util::calculateStat(window, mStatType, mQuantile);
+            }
+            else {
+               for(int t = 0; t < nTime; t++) {
+                  int start = std::max(0, t-mRadius);
+                  int end = std::min(nTime-1, t+mRadius);
+                  std::copy(&series[start], &series[end]+1, &window[0]);
+                  result[t] = Util::calculateStat(&window[0], end - start + 1, mStatType, mQuantile);
+               }
+            }
+
+            for(int t = 0; t < nTime; t++) {
+               output[t][index] = result[t];
             }
          }
       }
@@ -9,6 +9,7 @@ class CalibratorWindow : public Calibrator {
       CalibratorWindow(Variable::Type iVariable, const Options& iOptions);
       static std::string description();
       std::string name() const {return "window";};
+      bool usesVariable(Variable::Type iVariable) const {return iVariable == mVariable;};
       bool requiresParameterFile() const { return false;};
    private:
       bool calibrateCore(File& iFile, const ParameterFile* iParameterFile) const;
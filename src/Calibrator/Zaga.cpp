@@ -44,9 +44,6 @@ bool CalibratorZaga::calibrateCore(File& iFile, const ParameterFile* iParameterF
    int nLon = iFile.getNumLon();
    int nEns = iFile.getNumEns();
    int nTime = iFile.getNumTime();
-   vec2 lats = iFile.getLats();
-   vec2 lons = iFile.getLons();
-   vec2 elevs = iFile.getElevs();
 
    Variable::Type popVariable = Variable::Pop;
    int startTime = 0;
@@ -67,9 +64,9 @@ bool CalibratorZaga::calibrateCore(File& iFile, const ParameterFile* iParameterF
       int numInvalidRaw = 0;
       int numInvalidCal = 0;
 
-      Parameters parameters;
-      if(!iParameterFile->isLocationDependent())
-         parameters = iParameterFile->getParameters(t);
+      std::vector<int> parameterIndices;
+      std::vector<Parameters> parameterSets;
+      iParameterFile->getParameters(t, iFile, parameterIndices, parameterSets);
 
       // Load the POP output field, if needed
       FieldPtr pop;
@@ -92,8 +89,7 @@ bool CalibratorZaga::calibrateCore(File& iFile, const ParameterFile* iParameterF
       #pragma omp parallel for reduction(+:numInvalidRaw, numInvalidCal)
       for(int i = 0; i < nLat; i++) {
          for(int j = 0; j < nLon; j++) {
-            if(iParameterFile->isLocationDependent())
-               parameters = iParameterFile->getParameters(t, Location(lats[i][j], lons[i][j], elevs[i][j]));
+            const Parameters& parameters = parameterSets[parameterIndices[i*nLon + j]];
 
             // for Pop6h, the first few hours are undefined, since we cannot do a 6h accumulation
             if(mOutputPop && t < startTime) {
@@ -0,0 +1,178 @@
+#include "DiskCache.h"
+#include "Util.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+std::string DiskCache::mDirectory = "";
+double DiskCache::mMaxSize = 1e9;
+
+namespace {
+   // Files start with this identifier, followed by the number of arrays, the size of each array
+   // and then the values of all arrays, all stored as 32-bit integers.
+   const char magic[8] = {'G','R','I','D','P','P','C','1'};
+   const std::string extension = ".cache";
+}
+
+void DiskCache::setDirectory(std::string iDirectory, double iMaxSize) {
+   struct stat info;
+   if(stat(iDirectory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+      Util::error("Cache directory '" + iDirectory + "' does not exist");
+   }
+   if(!Util::isValid(iMaxSize) || iMaxSize < 0) {
+      Util::error("Maximum cache size must be >= 0");
+   }
+   mDirectory = iDirectory;
+   mMaxSize = iMaxSize;
+}
+
+std::string DiskCache::getDirectory() {
+   return mDirectory;
+}
+
+void DiskCache::disable() {
+   mDirectory = "";
+}
+
+bool DiskCache::isEnabled() {
+   return mDirectory != "";
+}
+
+std::string DiskCache::getFilename(std::string iKey) {
+   return mDirectory + "/" + iKey + extension;
+}
+
+bool DiskCache::read(std::string iKey, std::vector<std::vector<int> >& iArrays) {
+   if(!isEnabled())
+      return false;
+
+   std::string filename = getFilename(iKey);
+   int fd = open(filename.c_str(), O_RDONLY);
+   if(fd == -1)
+      return false;
+
+   struct stat info;
+   if(fstat(fd, &info) != 0 || info.st_size < sizeof(magic) + sizeof(int32_t)) {
+      close(fd);
+      return false;
+   }
+   size_t size = info.st_size;
+   void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if(map == MAP_FAILED)
+      return false;
+
+   // Check that the header is consistent with the size of the file, in case the file has been
+   // truncated or is not a cache file
+   const char* data = static_cast<const char*>(map);
+   bool isValid = memcmp(data, magic, sizeof(magic)) == 0;
+   const int32_t* values = reinterpret_cast<const int32_t*>(data + sizeof(magic));
+   size_t numValues = (size - sizeof(magic)) / sizeof(int32_t);
+   int32_t numArrays = values[0];
+   isValid = isValid && numArrays >= 0 && numArrays + 1 <= numValues;
+   size_t total = 1 + numArrays;
+   for(int a = 0; isValid && a < numArrays; a++) {
+      if(values[1 + a] < 0)
+         isValid = false;
+      else
+         total += values[1 + a];
+   }
+   isValid = isValid && total == numValues;
+
+   if(isValid) {
+      iArrays.resize(numArrays);
+      const int32_t* curr = values + 1 + numArrays;
+      for(int a = 0; a < numArrays; a++) {
+         iArrays[a].assign(curr, curr + values[1 + a]);
+         curr += values[1 + a];
+      }
+      // Mark the entry as recently used
+      utime(filename.c_str(), NULL);
+   }
+   else {
+      Util::warning("Ignoring corrupt cache file '" + filename + "'");
+   }
+   munmap(map, size);
+   return isValid;
+}
+
+bool DiskCache::write(std::string iKey, const std::vector<std::vector<int> >& iArrays) {
+   if(!isEnabled())
+      return false;
+
+   // Write to a temporary file first, so that other processes never see a partially written entry
+   std::string filename = getFilename(iKey);
+   std::stringstream ss;
+   ss << filename << "." << getpid() << ".tmp";
+   std::string tempFilename = ss.str();
+
+   FILE* fid = fopen(tempFilename.c_str(), "wb");
+   if(fid == NULL) {
+      Util::warning("Could not write cache file '" + tempFilename + "'");
+      return false;
+   }
+   int32_t numArrays = iArrays.size();
+   std::vector<int32_t> sizes(numArrays);
+   for(int a = 0; a < numArrays; a++) {
+      sizes[a] = iArrays[a].size();
+   }
+   bool success = fwrite(magic, sizeof(magic), 1, fid) == 1;
+   success = success && fwrite(&numArrays, sizeof(int32_t), 1, fid) == 1;
+   if(numArrays > 0)
+      success = success && fwrite(&sizes[0], sizeof(int32_t), numArrays, fid) == numArrays;
+   for(int a = 0; a < numArrays; a++) {
+      if(sizes[a] > 0) {
+         std::vector<int32_t> values(iArrays[a].begin(), iArrays[a].end());
+         success = success && fwrite(&values[0], sizeof(int32_t), sizes[a], fid) == sizes[a];
+      }
+   }
+   success = (fclose(fid) == 0) && success;
+
+   if(!success || rename(tempFilename.c_str(), filename.c_str()) != 0) {
+      Util::warning("Could not write cache file '" + filename + "'");
+      Util::remove(tempFilename);
+      return false;
+   }
+   removeOldFiles();
+   return true;
+}
+
+void DiskCache::removeOldFiles() {
+   DIR* dir = opendir(mDirectory.c_str());
+   if(dir == NULL)
+      return;
+
+   // Modification time and filename of each cache file
+   std::vector<std::pair<time_t, std::string> > files;
+   double total = 0;
+   struct dirent* entry;
+   while((entry = readdir(dir)) != NULL) {
+      std::string name = entry->d_name;
+      if(name.size() <= extension.size() || name.substr(name.size() - extension.size()) != extension)
+         continue;
+      std::string filename = mDirectory + "/" + name;
+      struct stat info;
+      if(stat(filename.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+         files.push_back(std::pair<time_t, std::string>(info.st_mtime, filename));
+         total += info.st_size;
+      }
+   }
+   closedir(dir);
+
+   std::sort(files.begin(), files.end());
+   for(int f = 0; f < files.size() && total > mMaxSize; f++) {
+      struct stat info;
+      if(stat(files[f].second.c_str(), &info) == 0 && Util::remove(files[f].second)) {
+         total -= info.st_size;
+         Util::status("Removed cache file '" + files[f].second + "'");
+      }
+   }
+}
@@ -0,0 +1,33 @@
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+#include <string>
+#include <vector>
+
+//! Persistent cache of integer arrays (e.g. neighbour maps) stored as files in a directory, so that
+//! results can be reused across runs. The cache is disabled until a directory is set. Each entry
+//! is identified by a key, which should be derived from a hash of all inputs used to compute it.
+//! When the total size of the directory exceeds the limit, the least recently used entries are
+//! removed.
+class DiskCache {
+   public:
+      //! Enable the cache and store entries in iDirectory, which must exist
+      //! @param iMaxSize Maximum total size of the cache files (in bytes)
+      static void setDirectory(std::string iDirectory, double iMaxSize=1e9);
+      static std::string getDirectory();
+      //! Disable the cache. Existing cache files are kept.
+      static void disable();
+      static bool isEnabled();
+
+      //! Read the entry with key iKey. Returns false if the entry does not exist or is corrupt.
+      static bool read(std::string iKey, std::vector<std::vector<int> >& iArrays);
+      //! Write the arrays to the entry with key iKey, overwriting it if it exists. Returns true if
+      //! successful.
+      static bool write(std::string iKey, const std::vector<std::vector<int> >& iArrays);
+   private:
+      static std::string getFilename(std::string iKey);
+      //! Remove the least recently used entries until the cache is within its size limit
+      static void removeOldFiles();
+      static std::string mDirectory;
+      static double mMaxSize;
+};
+#endif
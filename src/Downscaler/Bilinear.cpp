@@ -0,0 +1,28 @@
+#include "Bilinear.h"
+#include "../File/File.h"
+#include "../Util.h"
+
+DownscalerBilinear::DownscalerBilinear(Variable::Type iVariable, const Options& iOptions) :
+      Downscaler(iVariable, iOptions) {
+}
+
+void DownscalerBilinear::downscaleCore(const File& iInput, File& iOutput) const {
+   int nTime = iInput.getNumTime();
+
+   // The operator only depends on the grids, so compute it once and apply it to each timestep
+   std::vector<int> indices;
+   std::vector<float> weights;
+   getBilinearOperator(iInput, iOutput, indices, weights);
+
+   for(int t = 0; t < nTime; t++) {
+      const Field& ifield = *iInput.getField(mVariable, t);
+      Field& ofield = *iOutput.getField(mVariable, t);
+      applyOperator(indices, weights, 4, ifield, ofield);
+   }
+}
+
+std::string DownscalerBilinear::description() {
+   std::stringstream ss;
+   ss << Util::formatDescription("-d bilinear", "Bilinear interpolation between the four surrounding gridpoints. Uses the nearest neighbour for points that are not surrounded by valid gridpoints.") << std::endl;
+   return ss.str();
+}
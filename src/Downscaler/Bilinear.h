@@ -0,0 +1,18 @@
+#ifndef DOWNSCALER_BILINEAR_H
+#define DOWNSCALER_BILINEAR_H
+#include "Downscaler.h"
+#include "../Variable.h"
+#include "../Util.h"
+//! Bilinear interpolation between the four gridpoints surrounding the lookup point. Uses the
+//! nearest neighbour for points that are not inside a cell of the input grid (e.g. outside the
+//! domain or next to missing coordinates).
+class DownscalerBilinear : public Downscaler {
+   public:
+      DownscalerBilinear(Variable::Type iVariable, const Options& iOptions);
+      static std::string description();
+      std::string name() const {return "bilinear";};
+      int getHaloSize() const {return 1;};
+   private:
+      void downscaleCore(const File& iInput, File& iOutput) const;
+};
+#endif
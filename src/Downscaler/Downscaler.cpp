@@ -1,11 +1,16 @@
 #include <boost/scoped_ptr.hpp>
 #include <cmath>
+#include <algorithm>
 
 #include "Downscaler.h"
 #include "../File/File.h"
 #include "../KDTree.h"
+#include "../DiskCache.h"
+#include "../Field.h"
 
 std::map<Uuid, std::map<Uuid, std::pair<vec2Int, vec2Int> > > Downscaler::mNeighbourCache;
+std::map<Uuid, std::map<Uuid, std::pair<std::vector<int>, std::vector<float> > > > Downscaler::mOperatorCache;
+std::map<std::string, std::pair<std::vector<int>, std::vector<int> > > Downscaler::mListCache;
 
 Downscaler::Downscaler(Variable::Type iVariable, const Options& iOptions) : Scheme(iOptions),
       mVariable(iVariable) {
@@ -51,6 +56,10 @@ Downscaler* Downscaler::getScheme(std::string iName, Variable::Type iVariable, c
       DownscalerPressure* d = new DownscalerPressure(iVariable, iOptions);
       return d;
    }
+   else if(iName == "bilinear") {
+      DownscalerBilinear* d = new DownscalerBilinear(iVariable, iOptions);
+      return d;
+   }
    else {
       Util::error("Could not instantiate downscaler of type '" + iName + "'");
       return NULL;
@@ -96,7 +105,7 @@ void Downscaler::getNearestNeighbourBruteForce(const File& iFrom, const File& iT
       iJ[i].resize(nLon, Util::MV);
       for(int j = 0; j < nLon; j++) {
          if(Util::isValid(olats[i][j]) && Util::isValid(olons[i][j])) {
-            getNearestNeighbourBruteForce(iFrom, olons[i][j], olats[i][j], iI[i][j], iJ[i][j]);
+            getNearestNeighbourBruteForce(ilats, ilons, olons[i][j], olats[i][j], iI[i][j], iJ[i][j]);
          }
       }
    }
@@ -137,10 +146,149 @@ void Downscaler::getNearestNeighbour(const File& iFrom, const File& iTo, vec2Int
       }
    }
 
-   KDTree searchTree(iFrom.getLats(), iFrom.getLons());
-   searchTree.getNearestNeighbour(iTo, iI, iJ);
+   // Check if the neighbours have been computed in a previous run
+   std::string key;
+   if(DiskCache::isEnabled()) {
+      key = "nn_" + getGridKey(iFrom, false) + "_" + getGridKey(iTo, false);
+      std::vector<std::vector<int> > arrays;
+      if(DiskCache::read(key, arrays) && arrays.size() == 2 && unflatten(arrays[0], iTo, iI) && unflatten(arrays[1], iTo, iJ)) {
+         Util::status("Nearest neighbours read from cache");
+         addToCache(iFrom, iTo, iI, iJ);
+         return;
+      }
+   }
+
+   if(getNearestNeighbourRegular(iFrom, iTo, iI, iJ)) {
+      Util::status("Input grid is a regular lat/lon grid, computing nearest neighbours directly");
+   }
+   else if(getNearestNeighbourProjected(iFrom, iTo, iI, iJ)) {
+      Util::status("Input grid is projected, computing nearest neighbours directly");
+   }
+   else {
+      KDTree searchTree(iFrom.getLats(), iFrom.getLons());
+      searchTree.getNearestNeighbour(iTo, iI, iJ);
+   }
 
    addToCache(iFrom, iTo, iI, iJ);
+   if(DiskCache::isEnabled()) {
+      std::vector<std::vector<int> > arrays(2);
+      flatten(iI, arrays[0]);
+      flatten(iJ, arrays[1]);
+      DiskCache::write(key, arrays);
+   }
+}
+
+void Downscaler::getNearestNeighbour(const File& iFrom, const File& iTo, std::vector<int>& iIndices) {
+   vec2Int nearestI, nearestJ;
+   getNearestNeighbour(iFrom, iTo, nearestI, nearestJ);
+
+   int nLat = iTo.getNumLat();
+   int nLon = iTo.getNumLon();
+   int nLonFrom = iFrom.getNumLon();
+   iIndices.resize(nLat*nLon);
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         int I = nearestI[i][j];
+         int J = nearestJ[i][j];
+         if(Util::isValid(I) && Util::isValid(J))
+            iIndices[i*nLon + j] = I*nLonFrom + J;
+         else
+            iIndices[i*nLon + j] = Util::MV;
+      }
+   }
+}
+
+bool Downscaler::getBoundingBox(const File& iFrom, const File& iTo, int iHaloSize,
+      int& iStartI, int& iEndI, int& iStartJ, int& iEndJ) {
+   vec2Int nearestI, nearestJ;
+   getNearestNeighbour(iFrom, iTo, nearestI, nearestJ);
+
+   iStartI = iFrom.getNumLat();
+   iStartJ = iFrom.getNumLon();
+   iEndI = -1;
+   iEndJ = -1;
+   for(int i = 0; i < nearestI.size(); i++) {
+      for(int j = 0; j < nearestI[i].size(); j++) {
+         int I = nearestI[i][j];
+         int J = nearestJ[i][j];
+         if(Util::isValid(I) && Util::isValid(J)) {
+            iStartI = std::min(iStartI, I);
+            iEndI   = std::max(iEndI, I);
+            iStartJ = std::min(iStartJ, J);
+            iEndJ   = std::max(iEndJ, J);
+         }
+      }
+   }
+   if(iEndI < 0)
+      return false;
+
+   iStartI = std::max(0, iStartI - iHaloSize);
+   iStartJ = std::max(0, iStartJ - iHaloSize);
+   iEndI   = std::min(iFrom.getNumLat() - 1, iEndI + iHaloSize);
+   iEndJ   = std::min(iFrom.getNumLon() - 1, iEndJ + iHaloSize);
+   return true;
+}
+
+void Downscaler::gather(const std::vector<int>& iIndices, const Field& iInput, Field& iOutput) {
+   int nPoints = iOutput.getNumLat() * iOutput.getNumLon();
+   int nEns = iOutput.getNumEns();
+   if(iInput.getNumEns() != nEns)
+      Util::error("Cannot gather values, input and output have different numbers of ensemble members");
+   if(iIndices.size() != nPoints)
+      Util::error("Cannot gather values, the number of indices does not match the output field");
+   if(nPoints == 0 || nEns == 0)
+      return;
+
+   // Ensemble members are stored contiguously, so copy whole blocks
+   const float* input = iInput.getData();
+   float* output = iOutput.getData();
+   #pragma omp parallel for
+   for(int k = 0; k < nPoints; k++) {
+      int index = iIndices[k];
+      if(Util::isValid(index))
+         std::copy(input + index*nEns, input + (index+1)*nEns, output + k*nEns);
+      else
+         std::fill(output + k*nEns, output + (k+1)*nEns, Util::MV);
+   }
+}
+
+std::string Downscaler::getGridKey(const File& iFile, bool iUseElevs) {
+   uint64_t hash = iFile.getUniqueTag();
+   if(iUseElevs)
+      hash = Util::hash(iFile.getElevs(), hash);
+   return Util::hashToString(hash);
+}
+
+void Downscaler::flatten(const vec2Int& iValues, std::vector<int>& iFlat) {
+   iFlat.clear();
+   for(int i = 0; i < iValues.size(); i++) {
+      iFlat.insert(iFlat.end(), iValues[i].begin(), iValues[i].end());
+   }
+}
+
+bool Downscaler::unflatten(const std::vector<int>& iFlat, const File& iFile, vec2Int& iValues) {
+   int nLat = iFile.getNumLat();
+   int nLon = iFile.getNumLon();
+   if(iFlat.size() != nLat * nLon)
+      return false;
+   iValues.resize(nLat);
+   for(int i = 0; i < nLat; i++) {
+      iValues[i].assign(iFlat.begin() + i*nLon, iFlat.begin() + (i+1)*nLon);
+   }
+   return true;
+}
+
+bool Downscaler::getListFromCache(const std::string& iKey, std::vector<int>& iOffsets, std::vector<int>& iIndices) {
+   std::map<std::string, std::pair<std::vector<int>, std::vector<int> > >::const_iterator it = mListCache.find(iKey);
+   if(it == mListCache.end())
+      return false;
+   iOffsets = it->second.first;
+   iIndices = it->second.second;
+   return true;
+}
+
+void Downscaler::addListToCache(const std::string& iKey, const std::vector<int>& iOffsets, const std::vector<int>& iIndices) {
+   mListCache[iKey] = std::pair<std::vector<int>, std::vector<int> >(iOffsets, iIndices);
 }
 
 bool Downscaler::isCached(const File& iFrom, const File& iTo) {
@@ -168,18 +316,19 @@ bool Downscaler::getFromCache(const File& iFrom, const File& iTo, vec2Int& iI, v
 }
 
 void Downscaler::getNearestNeighbourBruteForce(const File& iFrom, float iLon, float iLat, int& iI, int &iJ) {
-   vec2 ilats = iFrom.getLats();
-   vec2 ilons = iFrom.getLons();
+   getNearestNeighbourBruteForce(iFrom.getLats(), iFrom.getLons(), iLon, iLat, iI, iJ);
+}
 
+void Downscaler::getNearestNeighbourBruteForce(const vec2& iLats, const vec2& iLons, float iLon, float iLat, int& iI, int &iJ) {
    iI = Util::MV;
    iJ = Util::MV;
 
    if(Util::isValid(iLat) && Util::isValid(iLon)) {
       float minDist = Util::MV;
-      for(int i = 0; i < ilats.size(); i++) {
-         for(int j = 0; j < ilats[0].size(); j++) {
-            if(Util::isValid(ilats[i][j]) && Util::isValid(ilons[i][j])) {
-               float currDist = Util::getDistance(ilats[i][j], ilons[i][j], iLat, iLon);
+      for(int i = 0; i < iLats.size(); i++) {
+         for(int j = 0; j < iLats[0].size(); j++) {
+            if(Util::isValid(iLats[i][j]) && Util::isValid(iLons[i][j])) {
+               float currDist = Util::getDistance(iLats[i][j], iLons[i][j], iLat, iLon);
                if(!Util::isValid(minDist) || currDist < minDist) {
                   iI = i;
                   iJ = j;
@@ -191,16 +340,445 @@ void Downscaler::getNearestNeighbourBruteForce(const File& iFrom, float iLon, fl
    }
 }
 
+void Downscaler::getNearestNeighbourWithin(const vec2& iLats, const vec2& iLons, float iLat, float iLon,
+      const int* iRows, int iNumRows, const int* iCols, int iNumCols, int& iI, int& iJ) {
+   iI = Util::MV;
+   iJ = Util::MV;
+   float minDist = Util::MV;
+   for(int r = 0; r < iNumRows; r++) {
+      int i = iRows[r];
+      for(int c = 0; c < iNumCols; c++) {
+         int j = iCols[c];
+         if(Util::isValid(iLats[i][j]) && Util::isValid(iLons[i][j])) {
+            float currDist = Util::getDistance(iLats[i][j], iLons[i][j], iLat, iLon);
+            if(!Util::isValid(minDist) || currDist < minDist) {
+               iI = i;
+               iJ = j;
+               minDist = currDist;
+            }
+         }
+      }
+   }
+}
+
+namespace {
+   // Wrap a longitude difference (in degrees) into [-180, 180)
+   double wrapLon(double iDiff) {
+      return iDiff - 360 * floor((iDiff + 180) / 360);
+   }
+   // Add iIndex to the sorted list iList (of length iSize) unless it is already there
+   void addIndex(int iIndex, int* iList, int& iSize) {
+      int k = iSize;
+      while(k > 0 && iList[k-1] > iIndex)
+         k--;
+      if(k > 0 && iList[k-1] == iIndex)
+         return;
+      for(int m = iSize; m > k; m--)
+         iList[m] = iList[m-1];
+      iList[k] = iIndex;
+      iSize++;
+   }
+}
+
+bool Downscaler::getNearestNeighbourRegular(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ) {
+   vec2 ilats = iFrom.getLats();
+   vec2 ilons = iFrom.getLons();
+   int nLatFrom = iFrom.getNumLat();
+   int nLonFrom = iFrom.getNumLon();
+   if(nLatFrom == 0 || nLonFrom == 0)
+      return false;
+
+   // Latitudes must only vary along the first dimension, and longitudes along the second
+   for(int i = 0; i < nLatFrom; i++) {
+      for(int j = 0; j < nLonFrom; j++) {
+         if(!Util::isValid(ilats[i][j]) || !Util::isValid(ilons[i][j]))
+            return false;
+         if(ilats[i][j] != ilats[i][0] || ilons[i][j] != ilons[0][j])
+            return false;
+      }
+   }
+   // The spacing must be constant. Since the coordinates are only stored with single precision,
+   // allow for small deviations. Neighbours are checked in a window around the computed index, so
+   // this does not affect the result.
+   double lat0 = ilats[0][0];
+   double lon0 = ilons[0][0];
+   double dlat = nLatFrom > 1 ? (ilats[nLatFrom-1][0] - lat0) / (nLatFrom - 1) : 0;
+   double dlon = 0;
+   for(int j = 1; j < nLonFrom; j++) {
+      dlon += wrapLon(ilons[0][j] - ilons[0][j-1]);
+   }
+   if(nLonFrom > 1)
+      dlon /= nLonFrom - 1;
+   if((nLatFrom > 1 && dlat == 0) || (nLonFrom > 1 && dlon == 0))
+      return false;
+   for(int i = 0; i < nLatFrom; i++) {
+      if(fabs(ilats[i][0] - lat0 - i*dlat) > 0.01 * fabs(dlat))
+         return false;
+   }
+   for(int j = 0; j < nLonFrom; j++) {
+      if(fabs(wrapLon(ilons[0][j] - lon0 - j*dlon)) > 0.01 * fabs(dlon))
+         return false;
+   }
+   if(fabs(dlon) * nLonFrom > 360 + 0.01 * fabs(dlon))
+      return false;
+   // Does the grid wrap around the globe?
+   bool isGlobal = nLonFrom > 1 && fabs(fabs(dlon) * nLonFrom - 360) < 0.01 * fabs(dlon);
+
+   vec2 olats = iTo.getLats();
+   vec2 olons = iTo.getLons();
+   int nLat = iTo.getNumLat();
+   int nLon = iTo.getNumLon();
+   iI.resize(nLat);
+   iJ.resize(nLat);
+
+   #pragma omp parallel for
+   for(int i = 0; i < nLat; i++) {
+      iI[i].clear();
+      iJ[i].clear();
+      iI[i].resize(nLon, Util::MV);
+      iJ[i].resize(nLon, Util::MV);
+      for(int j = 0; j < nLon; j++) {
+         float lat = olats[i][j];
+         float lon = olons[i][j];
+         if(!Util::isValid(lat) || !Util::isValid(lon))
+            continue;
+         if(fabs(lat) >= 90) {
+            // All points on a row are equally far from the pole, check all points
+            getNearestNeighbourBruteForce(ilats, ilons, lon, lat, iI[i][j], iJ[i][j]);
+            continue;
+         }
+
+         // Candidate columns around the fractional column index. For every row, the nearest
+         // point is in the column closest in longitude.
+         int cols[8];
+         int numCols = 0;
+         int nearestCol = 0;
+         if(nLonFrom > 1) {
+            double offset = lon - lon0;
+            if(dlon < 0)
+               offset = -offset;
+            offset = offset - 360 * floor(offset / 360);
+            double u = offset / fabs(dlon);
+            int start = floor(u);
+            if(isGlobal) {
+               for(int c = start - 1; c <= start + 2; c++)
+                  addIndex(((c % nLonFrom) + nLonFrom) % nLonFrom, cols, numCols);
+               nearestCol = ((int) floor(u + 0.5)) % nLonFrom;
+            }
+            else if(u <= nLonFrom - 1) {
+               for(int c = std::max(0, start - 1); c <= std::min(nLonFrom - 1, start + 2); c++)
+                  addIndex(c, cols, numCols);
+               nearestCol = floor(u + 0.5);
+            }
+            else {
+               // Outside the grid, so one of the edges is nearest
+               addIndex(0, cols, numCols);
+               addIndex(nLonFrom - 1, cols, numCols);
+               addIndex(nLonFrom - 2, cols, numCols);
+               nearestCol = fabs(wrapLon(lon - ilons[0][0])) < fabs(wrapLon(lon - ilons[0][nLonFrom-1])) ? 0 : nLonFrom - 1;
+            }
+         }
+         else {
+            addIndex(0, cols, numCols);
+         }
+
+         // Along a meridian offset by dLon, the distance is smallest at latitude phi, which is
+         // slightly poleward of the lookup latitude. The distance increases monotonically away
+         // from phi, so the nearest row is next to phi.
+         int rows[4];
+         int numRows = 0;
+         if(nLatFrom > 1) {
+            double dLon = Util::deg2rad(wrapLon(lon - ilons[0][nearestCol]));
+            double latr = Util::deg2rad(lat);
+            if(cos(dLon) <= 0) {
+               // Far away from the grid, check all points
+               getNearestNeighbourBruteForce(ilats, ilons, lon, lat, iI[i][j], iJ[i][j]);
+               continue;
+            }
+            double phi = Util::rad2deg(atan2(sin(latr), cos(dLon) * cos(latr)));
+            int start = floor((phi - lat0) / dlat);
+            for(int r = std::max(0, start - 1); r <= std::min(nLatFrom - 1, start + 2); r++)
+               addIndex(r, rows, numRows);
+            if(numRows == 0)
+               addIndex(start < 0 ? 0 : nLatFrom - 1, rows, numRows);
+         }
+         else {
+            addIndex(0, rows, numRows);
+         }
+         getNearestNeighbourWithin(ilats, ilons, lat, lon, rows, numRows, cols, numCols, iI[i][j], iJ[i][j]);
+      }
+   }
+   return true;
+}
+
+bool Downscaler::getNearestNeighbourProjected(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ) {
+   vec2 ilats = iFrom.getLats();
+   vec2 ilons = iFrom.getLons();
+   int nLatFrom = iFrom.getNumLat();
+   int nLonFrom = iFrom.getNumLon();
+   if(nLatFrom == 0 || nLonFrom == 0)
+      return false;
+
+   // Check that the projection is consistent with the lats/lons of the corners and center
+   int checkI[5] = {0, 0, nLatFrom-1, nLatFrom-1, nLatFrom/2};
+   int checkJ[5] = {0, nLonFrom-1, 0, nLonFrom-1, nLonFrom/2};
+   for(int k = 0; k < 5; k++) {
+      float fi, fj;
+      if(!iFrom.getProjectedIndices(ilats[checkI[k]][checkJ[k]], ilons[checkI[k]][checkJ[k]], fi, fj))
+         return false;
+      if(fabs(fi - checkI[k]) > 0.1 || fabs(fj - checkJ[k]) > 0.1) {
+         Util::warning("Projection does not match the latitudes/longitudes in '" + iFrom.getFilename() + "'");
+         return false;
+      }
+   }
+
+   vec2 olats = iTo.getLats();
+   vec2 olons = iTo.getLons();
+   int nLat = iTo.getNumLat();
+   int nLon = iTo.getNumLon();
+   iI.resize(nLat);
+   iJ.resize(nLat);
+
+   // Points outside the grid are looked up afterwards using a search tree
+   std::vector<std::vector<bool> > isOutside(nLat, std::vector<bool>(nLon, false));
+   int numOutside = 0;
+   #pragma omp parallel for reduction(+:numOutside)
+   for(int i = 0; i < nLat; i++) {
+      iI[i].clear();
+      iJ[i].clear();
+      iI[i].resize(nLon, Util::MV);
+      iJ[i].resize(nLon, Util::MV);
+      for(int j = 0; j < nLon; j++) {
+         float lat = olats[i][j];
+         float lon = olons[i][j];
+         if(!Util::isValid(lat) || !Util::isValid(lon))
+            continue;
+         float fi, fj;
+         bool isValid = iFrom.getProjectedIndices(lat, lon, fi, fj);
+         if(isValid && fi > -0.5 && fi < nLatFrom - 0.5 && fj > -0.5 && fj < nLonFrom - 0.5) {
+            // The projection is conformal, so the nearest neighbour is close to the nearest
+            // gridpoint in projected coordinates
+            int Ic = floor(fi + 0.5);
+            int Jc = floor(fj + 0.5);
+            int rows[3];
+            int cols[3];
+            int numRows = 0;
+            int numCols = 0;
+            for(int r = std::max(0, Ic - 1); r <= std::min(nLatFrom - 1, Ic + 1); r++)
+               addIndex(r, rows, numRows);
+            for(int c = std::max(0, Jc - 1); c <= std::min(nLonFrom - 1, Jc + 1); c++)
+               addIndex(c, cols, numCols);
+            getNearestNeighbourWithin(ilats, ilons, lat, lon, rows, numRows, cols, numCols, iI[i][j], iJ[i][j]);
+         }
+         if(!Util::isValid(iI[i][j])) {
+            isOutside[i][j] = true;
+            numOutside++;
+         }
+      }
+   }
+   if(numOutside > 0) {
+      KDTree searchTree(ilats, ilons);
+      for(int i = 0; i < nLat; i++) {
+         for(int j = 0; j < nLon; j++) {
+            if(isOutside[i][j])
+               searchTree.getNearestNeighbour(olats[i][j], olons[i][j], iI[i][j], iJ[i][j]);
+         }
+      }
+   }
+   return true;
+}
+
+void Downscaler::getBilinearOperator(const File& iFrom, const File& iTo, std::vector<int>& iIndices, std::vector<float>& iWeights) {
+   std::map<Uuid, std::map<Uuid, std::pair<std::vector<int>, std::vector<float> > > >::const_iterator it = mOperatorCache.find(iFrom.getUniqueTag());
+   if(it != mOperatorCache.end()) {
+      std::map<Uuid, std::pair<std::vector<int>, std::vector<float> > >::const_iterator it2 = it->second.find(iTo.getUniqueTag());
+      if(it2 != it->second.end()) {
+         iIndices = it2->second.first;
+         iWeights = it2->second.second;
+         return;
+      }
+   }
+
+   // The cell containing a point is one of the four cells surrounding its nearest neighbour
+   vec2Int nearestI, nearestJ;
+   getNearestNeighbour(iFrom, iTo, nearestI, nearestJ);
+
+   vec2 ilats = iFrom.getLats();
+   vec2 ilons = iFrom.getLons();
+   vec2 olats = iTo.getLats();
+   vec2 olons = iTo.getLons();
+   int nLat = iTo.getNumLat();
+   int nLon = iTo.getNumLon();
+   int nLatFrom = iFrom.getNumLat();
+   int nLonFrom = iFrom.getNumLon();
+   iIndices.clear();
+   iWeights.clear();
+   iIndices.resize(4*nLat*nLon, Util::MV);
+   iWeights.resize(4*nLat*nLon, 0);
+
+   #pragma omp parallel for
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         int I = nearestI[i][j];
+         int J = nearestJ[i][j];
+         if(!Util::isValid(I) || !Util::isValid(J))
+            continue;
+         int k = 4*(i*nLon + j);
+         // Use the nearest neighbour, unless the point is inside a cell
+         for(int n = 0; n < 4; n++) {
+            iIndices[k+n] = I*nLonFrom + J;
+         }
+         iWeights[k] = 1;
+         bool found = false;
+         for(int ii = I-1; ii <= I && !found; ii++) {
+            for(int jj = J-1; jj <= J && !found; jj++) {
+               if(ii < 0 || jj < 0 || ii+1 >= nLatFrom || jj+1 >= nLonFrom)
+                  continue;
+               float s, t;
+               if(getBilinearCoordinates(ilats, ilons, olats[i][j], olons[i][j], ii, jj, s, t)) {
+                  iIndices[k]   = ii*nLonFrom + jj;
+                  iIndices[k+1] = ii*nLonFrom + jj+1;
+                  iIndices[k+2] = (ii+1)*nLonFrom + jj+1;
+                  iIndices[k+3] = (ii+1)*nLonFrom + jj;
+                  iWeights[k]   = (1-s)*(1-t);
+                  iWeights[k+1] = s*(1-t);
+                  iWeights[k+2] = s*t;
+                  iWeights[k+3] = (1-s)*t;
+                  found = true;
+               }
+            }
+         }
+      }
+   }
+   mOperatorCache[iFrom.getUniqueTag()][iTo.getUniqueTag()] = std::pair<std::vector<int>, std::vector<float> >(iIndices, iWeights);
+}
+
+bool Downscaler::getBilinearCoordinates(const vec2& iLats, const vec2& iLons, float iLat, float iLon,
+      int iI, int iJ, float& iS, float& iT) {
+   // Corners in counter-clockwise order, starting at the lower corner
+   const int dI[4] = {0, 0, 1, 1};
+   const int dJ[4] = {0, 1, 1, 0};
+
+   // Use a local flat coordinate system centered on the point
+   double x[4], y[4];
+   double scale = cos(Util::deg2rad(iLat));
+   for(int n = 0; n < 4; n++) {
+      float lat = iLats[iI+dI[n]][iJ+dJ[n]];
+      float lon = iLons[iI+dI[n]][iJ+dJ[n]];
+      if(!Util::isValid(lat) || !Util::isValid(lon))
+         return false;
+      x[n] = wrapLon(lon - iLon) * scale;
+      y[n] = lat - iLat;
+   }
+
+   // Invert P = A + s*E + t*F + s*t*G, where P is the origin. This gives a quadratic equation
+   // k2*t^2 + k1*t + k0 = 0.
+   double ex = x[1] - x[0];
+   double ey = y[1] - y[0];
+   double fx = x[3] - x[0];
+   double fy = y[3] - y[0];
+   double gx = x[0] - x[1] + x[2] - x[3];
+   double gy = y[0] - y[1] + y[2] - y[3];
+   double hx = -x[0];
+   double hy = -y[0];
+   double k2 = gx*fy - gy*fx;
+   double k1 = ex*fy - ey*fx + hx*gy - hy*gx;
+   double k0 = hx*ey - hy*ex;
+   double disc = k1*k1 - 4*k0*k2;
+   if(disc < 0)
+      return false;
+   // Numerically stable roots, also when the cell is a parallelogram (k2 = 0)
+   double q = -0.5 * (k1 + (k1 < 0 ? -1 : 1) * sqrt(disc));
+   if(q == 0)
+      return false;
+   double roots[2] = {k0 / q, Util::MV};
+   int numRoots = 1;
+   if(k2 != 0) {
+      roots[1] = q / k2;
+      numRoots = 2;
+   }
+
+   const double tol = 1e-4;
+   for(int r = 0; r < numRoots; r++) {
+      double t = roots[r];
+      double dx = ex + gx*t;
+      double dy = ey + gy*t;
+      double s;
+      if(fabs(dx) > fabs(dy))
+         s = (hx - fx*t) / dx;
+      else if(dy != 0)
+         s = (hy - fy*t) / dy;
+      else
+         continue;
+      if(s >= -tol && s <= 1+tol && t >= -tol && t <= 1+tol) {
+         iS = std::max(0.0, std::min(1.0, s));
+         iT = std::max(0.0, std::min(1.0, t));
+         return true;
+      }
+   }
+   return false;
+}
+
+void Downscaler::applyOperator(const std::vector<int>& iIndices, const std::vector<float>& iWeights, int iNum,
+      const Field& iInput, Field& iOutput) {
+   int nPoints = iOutput.getNumLat() * iOutput.getNumLon();
+   int nEns = iOutput.getNumEns();
+   if(iInput.getNumEns() != nEns)
+      Util::error("Cannot apply operator, input and output have different numbers of ensemble members");
+   if(iIndices.size() != nPoints * iNum || iWeights.size() != nPoints * iNum)
+      Util::error("Cannot apply operator, its size does not match the output field");
+   if(nPoints == 0 || nEns == 0)
+      return;
+
+   const float* input = iInput.getData();
+   float* output = iOutput.getData();
+   #pragma omp parallel for
+   for(int k = 0; k < nPoints; k++) {
+      const int* indices = &iIndices[k*iNum];
+      const float* weights = &iWeights[k*iNum];
+      float* values = output + k*nEns;
+      if(!Util::isValid(indices[0])) {
+         for(int e = 0; e < nEns; e++)
+            values[e] = Util::MV;
+         continue;
+      }
+      for(int e = 0; e < nEns; e++)
+         values[e] = 0;
+      for(int n = 0; n < iNum; n++) {
+         if(weights[n] == 0)
+            continue;
+         const float* curr = input + indices[n]*nEns;
+         float weight = weights[n];
+         for(int e = 0; e < nEns; e++)
+            values[e] += weight * curr[e];
+      }
+      // Only a small fraction of values are missing, so check these afterwards
+      for(int n = 0; n < iNum; n++) {
+         if(weights[n] == 0)
+            continue;
+         const float* curr = input + indices[n]*nEns;
+         for(int e = 0; e < nEns; e++) {
+            if(!Util::isValid(curr[e]))
+               values[e] = Util::MV;
+         }
+      }
+   }
+}
+
 std::string Downscaler::getDescriptions() {
    std::stringstream ss;
    ss << DownscalerNearestNeighbour::description();
    ss << DownscalerGradient::description();
    ss << DownscalerSmart::description();
    ss << DownscalerPressure::description();
+   ss << DownscalerBilinear::description();
    ss << DownscalerBypass::description();
    return ss.str();
 }
 
 void Downscaler::clearCache() {
    mNeighbourCache.clear();
+   mOperatorCache.clear();
+   mListCache.clear();
+   DownscalerGradient::clearElevationCache();
 }
@@ -6,7 +6,9 @@
 #include "../Variable.h"
 #include "../Scheme.h"
 #include "../Uuid.h"
+#include "../Util.h"
 class File;
+class Field;
 typedef std::vector<std::vector<int> > vec2Int;
 
 //! Converts fields from one grid to another
@@ -18,12 +20,33 @@ class Downscaler : public Scheme {
       static Downscaler* getScheme(std::string iName, Variable::Type iVariable, const Options& iOptions);
       virtual std::string name() const = 0;
 
+      //! How many gridpoints away from the nearest neighbour (in each direction) can input values
+      //! be used for an output point? Util::MV if any point in the input grid can be used.
+      virtual int getHaloSize() const {return Util::MV;};
+
+      //! Find the smallest part of the grid in iFrom that contains the nearest neighbours of all
+      //! points in iTo, extended by iHaloSize points on each side (within the grid). Indices are
+      //! inclusive.
+      //! @return false if no point in iTo has a nearest neighbour
+      static bool getBoundingBox(const File& iFrom, const File& iTo, int iHaloSize,
+            int& iStartI, int& iEndI, int& iStartJ, int& iEndJ);
+
       //! Create a nearest-neighbour map. For each grid point in iTo, find the index into the grid
-      //! in iFrom of the nearest neighbour. Uses a 2-d BST for search speedup.
+      //! in iFrom of the nearest neighbour. Indices are computed directly when iFrom is a regular
+      //! lat/lon grid or has a known projection, otherwise a 2-d BST is used for search speedup.
       //! @param iI I-indices of nearest point. Set to Util::MV if no nearest neighbour.
       //! @param iJ J-indices of nearest point. Set to Util::MV if no nearest neighbour.
       static void getNearestNeighbour(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ);
 
+      //! Create a nearest-neighbour map as indices into the flattened grid of iFrom (I*nLon + J),
+      //! for each point in the flattened grid of iTo (i*nLon + j). Set to Util::MV if there is no
+      //! nearest neighbour.
+      static void getNearestNeighbour(const File& iFrom, const File& iTo, std::vector<int>& iIndices);
+
+      //! Set each gridpoint k in iOutput to the ensemble at the flattened index iIndices[k] in
+      //! iInput (missing if the index is missing)
+      static void gather(const std::vector<int>& iIndices, const Field& iInput, Field& iOutput);
+
       //! Reference realization of getNearestNeighbour. Uses a brute force method by checking every
       //! neighbour.
       static void getNearestNeighbourBruteForce(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ);
@@ -34,6 +57,19 @@ class Downscaler : public Scheme {
       //! @param iJ J-index of nearest point. Set to Util::MV if no nearest neighbour.
       static void getNearestNeighbourBruteForce(const File& iFrom, float iLon, float iLat, int& iI, int &iJ);
 
+      //! Create a sparse bilinear interpolation operator from iFrom to iTo, with 4 input points for
+      //! each output point. Output point k (i*nLon + j) is the sum over n = 0..3 of
+      //! iWeights[4*k+n] times the input at the flattened index iIndices[4*k+n] (I*nLon + J).
+      //! Points that do not lie inside a cell of 4 valid gridpoints use the nearest neighbour.
+      //! Indices are set to Util::MV when there is no nearest neighbour. The operator is cached.
+      static void getBilinearOperator(const File& iFrom, const File& iTo, std::vector<int>& iIndices, std::vector<float>& iWeights);
+
+      //! Apply a sparse interpolation operator with iNum input points per output point (as created
+      //! by getBilinearOperator) to all ensemble members of iInput. An output value is missing if
+      //! any input with a non-zero weight is missing.
+      static void applyOperator(const std::vector<int>& iIndices, const std::vector<float>& iWeights, int iNum,
+            const Field& iInput, Field& iOutput);
+
       static std::string getDescriptions();
 
       //! Clears nearest neighbour cache
@@ -41,6 +77,20 @@ class Downscaler : public Scheme {
    protected:
       virtual void downscaleCore(const File& iInput, File& iOutput) const = 0;
       Variable::Type mVariable;
+
+      //! Returns a key identifying the lats/lons (and optionally elevations) of the grid in iFile,
+      //! suitable for persistent caching with DiskCache
+      static std::string getGridKey(const File& iFile, bool iUseElevs);
+      //! Concatenate the rows of iValues into iFlat
+      static void flatten(const vec2Int& iValues, std::vector<int>& iFlat);
+      //! Split iFlat into rows of the grid in iFile. Returns false if the size does not match.
+      static bool unflatten(const std::vector<int>& iFlat, const File& iFile, vec2Int& iValues);
+
+      //! Cache of neighbour lists for each output point, stored as offsets into a flat list of
+      //! neighbour indices (the neighbours of point k are at iOffsets[k] to iOffsets[k+1]-1).
+      //! Entries are identified by a key, which must include all settings used to compute them.
+      static bool getListFromCache(const std::string& iKey, std::vector<int>& iOffsets, std::vector<int>& iIndices);
+      static void addListToCache(const std::string& iKey, const std::vector<int>& iOffsets, const std::vector<int>& iIndices);
    private:
       // Cache calls to nearest neighbour
       //! Is the nearest neighbours in @param iFrom for each point in @param iTo already computed?
@@ -48,10 +98,32 @@ class Downscaler : public Scheme {
       static void addToCache(const File& iFrom, const File& iTo, vec2Int iI, vec2Int iJ);
       static bool getFromCache(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ);
       static std::map<Uuid, std::map<Uuid, std::pair<vec2Int, vec2Int> > > mNeighbourCache;
+      static std::map<Uuid, std::map<Uuid, std::pair<std::vector<int>, std::vector<float> > > > mOperatorCache;
+      static std::map<std::string, std::pair<std::vector<int>, std::vector<int> > > mListCache;
+
+      //! Compute nearest neighbours when iFrom has evenly spaced latitudes (varying along the first
+      //! dimension only) and longitudes (varying along the second dimension only). Returns false
+      //! if the grid is not regular.
+      static bool getNearestNeighbourRegular(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ);
+      //! Compute nearest neighbours using the projection of iFrom. Returns false if the projection
+      //! is unknown or does not match the lats/lons of iFrom.
+      static bool getNearestNeighbourProjected(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ);
+      //! Find the nearest neighbour among the gridpoints in rows iRows and columns iCols (both sorted).
+      //! Points are checked in the same order as in a brute force search, so ties are resolved the
+      //! same way.
+      static void getNearestNeighbourWithin(const vec2& iLats, const vec2& iLons, float iLat, float iLon,
+            const int* iRows, int iNumRows, const int* iCols, int iNumCols, int& iI, int& iJ);
+      static void getNearestNeighbourBruteForce(const vec2& iLats, const vec2& iLons, float iLon, float iLat, int& iI, int &iJ);
+      //! Compute the bilinear coordinates (iS along the second dimension, iT along the first) of
+      //! the point iLat/iLon within the cell with lower corner [iI][iJ]. Returns false if the
+      //! point is not inside the cell or if the cell has missing corners.
+      static bool getBilinearCoordinates(const vec2& iLats, const vec2& iLons, float iLat, float iLon,
+            int iI, int iJ, float& iS, float& iT);
 };
 #include "NearestNeighbour.h"
 #include "Gradient.h"
 #include "Smart.h"
 #include "Bypass.h"
 #include "Pressure.h"
+#include "Bilinear.h"
 #endif
@@ -1,8 +1,11 @@
 #include "Gradient.h"
 #include "../File/File.h"
 #include "../Util.h"
+#include "../IntegralImage.h"
 #include <math.h>
 
+std::map<Uuid, std::map<int, DownscalerGradient::ElevationSums> > DownscalerGradient::mElevationCache;
+
 DownscalerGradient::DownscalerGradient(Variable::Type iVariable, const Options& iOptions) :
       Downscaler(iVariable, iOptions),
       mSearchRadius(3),
@@ -30,165 +33,324 @@ void DownscalerGradient::downscaleCore(const File& iInput, File& iOutput) const
    int nLon = iOutput.getNumLon();
    int nEns = iOutput.getNumEns();
    int nTime = iInput.getNumTime();
+   int nLatIn = iInput.getNumLat();
+   int nLonIn = iInput.getNumLon();
+   int nIn = nLatIn * nLonIn;
 
-   vec2 ilats  = iInput.getLats();
-   vec2 ilons  = iInput.getLons();
-   vec2 ielevs = iInput.getElevs();
-   vec2 olats  = iOutput.getLats();
-   vec2 olons  = iOutput.getLons();
    vec2 oelevs = iOutput.getElevs();
 
    float minAllowed = Variable::getMin(mVariable);
    float maxAllowed = Variable::getMax(mVariable);
 
    // Get nearest neighbour
-   vec2Int nearestI, nearestJ;
-   getNearestNeighbour(iInput, iOutput, nearestI, nearestJ);
+   std::vector<int> nearest;
+   getNearestNeighbour(iInput, iOutput, nearest);
+   std::vector<float> currElevs(nLat*nLon);
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         currElevs[i*nLon + j] = oelevs[i][j];
+      }
+   }
+
+   int averagingRadius = 0;
+   if(mAverageNeighbourhood)
+      averagingRadius = mSearchRadius;
+   bool computeGradient = !Util::isValid(mConstantGradient);
+
+   /* Sums over neighbourhoods are computed using integral images, so that the cost for each point
+      does not depend on the search radius. Sums that only depend on the elevation are computed once
+      for each input grid. Elevations and values are shifted by their means to reduce round-off
+      errors when subtracting large sums.
+   */
+   const ElevationSums& elevSums = getElevationSums(iInput);
+   const std::vector<float>& elevs = elevSums.elevs;
+   const std::vector<double>& elevShifted = elevSums.shifted;
+   const std::vector<double>& elevShifted2 = elevSums.shifted2;
+   const std::vector<float>& elevMin = elevSums.min;
+   const std::vector<float>& elevMax = elevSums.max;
+   double elevRef = elevSums.elevRef;
 
+   std::vector<float> values(nIn);
+   std::vector<float> regValues(nIn);
    for(int t = 0; t < nTime; t++) {
-      Field& ifield = *iInput.getField(mVariable, t);
+      const Field& ifield = *iInput.getField(mVariable, t);
       Field& ofield = *iOutput.getField(mVariable, t);
+      const float* input = ifield.getData();
+      float* output = ofield.getData();
 
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            int Icenter = nearestI[i][j];
-            int Jcenter = nearestJ[i][j];
-            assert(Icenter < ielevs.size());
-            assert(Jcenter < ielevs[Icenter].size());
-            for(int e = 0; e < nEns; e++) {
-               float currElev = oelevs[i][j];
-               float nearestElev = ielevs[Icenter][Jcenter];
-               if(!Util::isValid(currElev) || !Util::isValid(nearestElev)) {
-                  // Can't adjust if we don't have an elevation, use nearest neighbour
-                  ofield(i,j,e) = ifield(Icenter,Jcenter,e);
-               }
-               else {
-                  float gradient = mDefaultGradient;
-                  float totalValue = 0;
-                  float totalElev = 0;
-                  int counter = 0;
-                  int averagingRadius = 0;
-                  if(mAverageNeighbourhood)
-                     averagingRadius = mSearchRadius;
-                  for(int ii = std::max(0, Icenter-averagingRadius); ii <= std::min(iInput.getNumLat()-1, Icenter+averagingRadius); ii++) {
-                     for(int jj = std::max(0, Jcenter-averagingRadius); jj <= std::min(iInput.getNumLon()-1, Jcenter+averagingRadius); jj++) {
-                        float currValue = ifield(ii,jj,e);
-                        float currElev  = ielevs[ii][jj];
-                        if(Util::isValid(currValue) && Util::isValid(currElev)) {
-                           totalValue += currValue;
-                           totalElev  += currElev;
-                           counter++;
-                        }
-                     }
-                  }
-                  float baseValue = Util::MV;
-                  float baseElev  = Util::MV;
-                  if(counter > 0) {
-                     baseValue = totalValue / counter;
-                     baseElev  = totalElev  / counter;
-                  }
-                  float dElev = currElev - baseElev;
+      for(int e = 0; e < nEns; e++) {
+         for(int n = 0; n < nIn; n++) {
+            values[n] = input[n*nEns + e];
+         }
 
-                  if(Util::isValid(mConstantGradient)) {
-                     gradient = mConstantGradient;
+         // Neighbourhood sums used to compute the regression
+         IntegralImage count, sumX, sumXX, sumY, sumXY, numMissing;
+         const IntegralImage* countPtr = &elevSums.count;
+         const IntegralImage* sumXPtr = &elevSums.sum;
+         const IntegralImage* sumXXPtr = &elevSums.sum2;
+         double valueRef = 0;
+         bool hasMissing = false;
+         if(computeGradient) {
+            int numValid = 0;
+            for(int n = 0; n < nIn; n++) {
+               regValues[n] = values[n];
+               if(mLogTransform)
+                  regValues[n] = log(values[n]);
+               if(Util::isValid(elevs[n])) {
+                  if(Util::isValid(regValues[n])) {
+                     valueRef += regValues[n];
+                     numValid++;
                   }
                   else {
-                     /* Compute the model's gradient:
-                        The gradient is computed by using linear regression on forecast ~ elevation
-                        using all forecasts within a neighbourhood. To produce stable results, there
-                        is a requirement that the elevation within the neighbourhood has a large
-                        range (see mMinElevDiff).
-
-                        For bounded variables (e.g. wind speed), the gradient approach could cause
-                        forecasts to go outside its domain (e.g. negative winds). If this occurs,
-                        the nearest neighbour is used.
-                     */
-                     float meanXY  = 0; // elev*T
-                     float meanX   = 0; // elev
-                     float meanY   = 0; // T
-                     float meanXX  = 0; // elev*elev
-                     int   counter = 0;
-                     float min = Util::MV;
-                     float max = Util::MV;
-                     for(int ii = std::max(0, Icenter-mSearchRadius); ii <= std::min(iInput.getNumLat()-1, Icenter+mSearchRadius); ii++) {
-                        for(int jj = std::max(0, Jcenter-mSearchRadius); jj <= std::min(iInput.getNumLon()-1, Jcenter+mSearchRadius); jj++) {
-                           assert(ii < ielevs.size());
-                           assert(jj < ielevs[ii].size());
-                           float x = ielevs[ii][jj];
-                           float y = ifield(ii,jj,e);
-                           if(mLogTransform) {
-                              y = log(y);
-                           }
-                           if(Util::isValid(x) && Util::isValid(y)) {
-                              meanXY += x*y;
-                              meanX  += x;
-                              meanY  += y;
-                              meanXX += x*x;
-                              counter++;
-                              // Found a new min
-                              if(!Util::isValid(min) || x < min)
-                                 min = x;
-                              // Found a new max
-                              if(!Util::isValid(max) || x > max)
-                                 max = x;
-                           }
-                        }
-                     }
-                     // Compute elevation difference within neighbourhood
-                     float elevDiff = Util::MV;
-                     if(Util::isValid(min) && Util::isValid(max)) {
-                        assert(max >= min);
-                        elevDiff = max - min;
-                     }
+                     hasMissing = true;
+                  }
+               }
+            }
+            if(numValid > 0)
+               valueRef /= numValid;
 
-                     // Use model gradient if:
-                     // 1) sufficient elevation difference in neighbourhood
-                     // 2) regression parameters are stable enough
-                     if(counter > 0 && Util::isValid(elevDiff) && elevDiff >= mMinElevDiff && meanXX != meanX*meanX) {
-                        // Estimate lapse rate
-                        meanXY /= counter;
-                        meanX  /= counter;
-                        meanY  /= counter;
-                        meanXX /= counter;
-                        gradient = (meanXY - meanX*meanY)/(meanXX - meanX*meanX);
+            std::vector<double> y(nIn, 0), xy(nIn, 0);
+            for(int n = 0; n < nIn; n++) {
+               if(Util::isValid(elevs[n]) && Util::isValid(regValues[n])) {
+                  y[n] = regValues[n] - valueRef;
+                  xy[n] = elevShifted[n] * y[n];
+               }
+            }
+            sumY.build(y, nLatIn, nLonIn);
+            sumXY.build(xy, nLatIn, nLonIn);
+
+            // Elevations where the value is missing must not be included in the sums
+            if(hasMissing) {
+               std::vector<double> valid(nIn, 0), x(nIn, 0), xx(nIn, 0), missing(nIn, 0);
+               for(int n = 0; n < nIn; n++) {
+                  if(Util::isValid(elevs[n])) {
+                     if(Util::isValid(regValues[n])) {
+                        valid[n] = 1;
+                        x[n] = elevShifted[n];
+                        xx[n] = elevShifted2[n];
                      }
-                     else if(!mHasIssuedWarningUnstable) {
-                        std::stringstream ss;
-                        ss << "DownscalerGradient cannot compute gradient (unstable regression). Reverting to default gradient. Warning issued only once.";
-                        Util::warning(ss.str());
-                        mHasIssuedWarningUnstable = true;
+                     else {
+                        missing[n] = 1;
                      }
-                     // Safety check
-                     if(!Util::isValid(gradient))
-                        gradient = 0;
-                     // Check against minimum and maximum gradients
-                     if(Util::isValid(mMinGradient) && gradient < mMinGradient)
-                        gradient = mMinGradient;
-                     if(Util::isValid(mMaxGradient) && gradient > mMaxGradient)
-                        gradient = mMaxGradient;
-
                   }
-                  float value = Util::MV;
-                  if(mLogTransform) {
-                     value = baseValue * exp(gradient * dElev);
-                  }
-                  else {
-                     value = baseValue + dElev * gradient;
-                  }
-                  if((Util::isValid(minAllowed) && value < minAllowed) || (Util::isValid(maxAllowed) && value > maxAllowed)) {
-                     // Use nearest neighbour if the gradient put us outside the bounds of the variable
-                     ofield(i,j,e) = baseValue;
-                  }
-                  else {
-                     ofield(i,j,e)  = value;
+               }
+               count.build(valid, nLatIn, nLonIn);
+               sumX.build(x, nLatIn, nLonIn);
+               sumXX.build(xx, nLatIn, nLonIn);
+               numMissing.build(missing, nLatIn, nLonIn);
+               countPtr = &count;
+               sumXPtr = &sumX;
+               sumXXPtr = &sumXX;
+            }
+         }
+
+         // Neighbourhood sums used to compute the average value and elevation
+         IntegralImage avgCount, avgSumElev, avgSumValue;
+         double avgValueRef = 0;
+         if(averagingRadius > 0) {
+            int numValid = 0;
+            for(int n = 0; n < nIn; n++) {
+               if(Util::isValid(elevs[n]) && Util::isValid(values[n])) {
+                  avgValueRef += values[n];
+                  numValid++;
+               }
+            }
+            if(numValid > 0)
+               avgValueRef /= numValid;
+            std::vector<double> valid(nIn, 0), x(nIn, 0), y(nIn, 0);
+            for(int n = 0; n < nIn; n++) {
+               if(Util::isValid(elevs[n]) && Util::isValid(values[n])) {
+                  valid[n] = 1;
+                  x[n] = elevShifted[n];
+                  y[n] = values[n] - avgValueRef;
+               }
+            }
+            avgCount.build(valid, nLatIn, nLonIn);
+            avgSumElev.build(x, nLatIn, nLonIn);
+            avgSumValue.build(y, nLatIn, nLonIn);
+         }
+
+         #pragma omp parallel for
+         for(int k = 0; k < nLat*nLon; k++) {
+            int index = nearest[k];
+            if(!Util::isValid(index)) {
+               output[k*nEns + e] = Util::MV;
+               continue;
+            }
+            int Icenter = index / nLonIn;
+            int Jcenter = index % nLonIn;
+            float currElev = currElevs[k];
+            float nearestElev = elevs[index];
+            if(!Util::isValid(currElev) || !Util::isValid(nearestElev)) {
+               // Can't adjust if we don't have an elevation, use nearest neighbour
+               output[k*nEns + e] = values[index];
+               continue;
+            }
+
+            float gradient = mDefaultGradient;
+            float baseValue = Util::MV;
+            float baseElev  = Util::MV;
+            if(averagingRadius > 0) {
+               int startI = Icenter - averagingRadius;
+               int startJ = Jcenter - averagingRadius;
+               int endI = Icenter + averagingRadius;
+               int endJ = Jcenter + averagingRadius;
+               double counter = avgCount.getSum(startI, startJ, endI, endJ);
+               if(counter > 0) {
+                  baseValue = avgSumValue.getSum(startI, startJ, endI, endJ) / counter + avgValueRef;
+                  baseElev  = avgSumElev.getSum(startI, startJ, endI, endJ) / counter + elevRef;
+               }
+            }
+            else if(Util::isValid(values[index])) {
+               baseValue = values[index];
+               baseElev  = nearestElev;
+            }
+            float dElev = currElev - baseElev;
+
+            if(Util::isValid(mConstantGradient)) {
+               gradient = mConstantGradient;
+            }
+            else {
+               /* Compute the model's gradient:
+                  The gradient is computed by using linear regression on forecast ~ elevation
+                  using all forecasts within a neighbourhood. To produce stable results, there
+                  is a requirement that the elevation within the neighbourhood has a large
+                  range (see mMinElevDiff).
+
+                  For bounded variables (e.g. wind speed), the gradient approach could cause
+                  forecasts to go outside its domain (e.g. negative winds). If this occurs,
+                  the nearest neighbour is used.
+               */
+               int startI = Icenter - mSearchRadius;
+               int startJ = Jcenter - mSearchRadius;
+               int endI = Icenter + mSearchRadius;
+               int endJ = Jcenter + mSearchRadius;
+               double counter = countPtr->getSum(startI, startJ, endI, endJ);
+
+               // Compute elevation difference within neighbourhood
+               float min = elevMin[index];
+               float max = elevMax[index];
+               if(hasMissing && numMissing.getSum(startI, startJ, endI, endJ) > 0) {
+                  // Some elevations in the neighbourhood have missing values, so they cannot
+                  // be used
+                  min = Util::MV;
+                  max = Util::MV;
+                  for(int ii = std::max(0, startI); ii <= std::min(nLatIn-1, endI); ii++) {
+                     for(int jj = std::max(0, startJ); jj <= std::min(nLonIn-1, endJ); jj++) {
+                        float x = elevs[ii*nLonIn + jj];
+                        if(Util::isValid(x) && Util::isValid(regValues[ii*nLonIn + jj])) {
+                           if(!Util::isValid(min) || x < min)
+                              min = x;
+                           if(!Util::isValid(max) || x > max)
+                              max = x;
+                        }
+                     }
                   }
                }
+               float elevDiff = Util::MV;
+               if(Util::isValid(min) && Util::isValid(max)) {
+                  assert(max >= min);
+                  elevDiff = max - min;
+               }
+
+               // Use model gradient if:
+               // 1) sufficient elevation difference in neighbourhood
+               // 2) regression parameters are stable enough
+               double meanX = 0;
+               double varX = 0;
+               if(counter > 0) {
+                  meanX = sumXPtr->getSum(startI, startJ, endI, endJ) / counter;
+                  varX = sumXXPtr->getSum(startI, startJ, endI, endJ) / counter - meanX*meanX;
+               }
+               if(counter > 0 && Util::isValid(elevDiff) && elevDiff >= mMinElevDiff && elevDiff > 0 && varX > 0) {
+                  // Estimate lapse rate
+                  double meanY  = sumY.getSum(startI, startJ, endI, endJ) / counter;
+                  double meanXY = sumXY.getSum(startI, startJ, endI, endJ) / counter;
+                  gradient = (meanXY - meanX*meanY) / varX;
+               }
+               else if(!mHasIssuedWarningUnstable) {
+                  std::stringstream ss;
+                  ss << "DownscalerGradient cannot compute gradient (unstable regression). Reverting to default gradient. Warning issued only once.";
+                  Util::warning(ss.str());
+                  mHasIssuedWarningUnstable = true;
+               }
+               // Safety check
+               if(!Util::isValid(gradient))
+                  gradient = 0;
+               // Check against minimum and maximum gradients
+               if(Util::isValid(mMinGradient) && gradient < mMinGradient)
+                  gradient = mMinGradient;
+               if(Util::isValid(mMaxGradient) && gradient > mMaxGradient)
+                  gradient = mMaxGradient;
+
+            }
+            float value = Util::MV;
+            if(mLogTransform) {
+               value = baseValue * exp(gradient * dElev);
+            }
+            else {
+               value = baseValue + dElev * gradient;
+            }
+            if((Util::isValid(minAllowed) && value < minAllowed) || (Util::isValid(maxAllowed) && value > maxAllowed)) {
+               // Use nearest neighbour if the gradient put us outside the bounds of the variable
+               output[k*nEns + e] = baseValue;
+            }
+            else {
+               output[k*nEns + e] = value;
             }
          }
       }
    }
 }
+const DownscalerGradient::ElevationSums& DownscalerGradient::getElevationSums(const File& iFile) const {
+   int nLat = iFile.getNumLat();
+   int nLon = iFile.getNumLon();
+   int n = nLat * nLon;
+   vec2 ielevs = iFile.getElevs();
+   std::vector<float> elevs(n);
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         elevs[i*nLon + j] = ielevs[i][j];
+      }
+   }
+
+   // The unique tag only covers the lats/lons, so check that the elevations are the same
+   ElevationSums& sums = mElevationCache[iFile.getUniqueTag()][mSearchRadius];
+   if(sums.elevs == elevs)
+      return sums;
+
+   sums.elevs = elevs;
+   sums.elevRef = 0;
+   int numValid = 0;
+   for(int k = 0; k < n; k++) {
+      if(Util::isValid(elevs[k])) {
+         sums.elevRef += elevs[k];
+         numValid++;
+      }
+   }
+   if(numValid > 0)
+      sums.elevRef /= numValid;
+   std::vector<double> valid(n, 0);
+   sums.shifted.assign(n, 0);
+   sums.shifted2.assign(n, 0);
+   for(int k = 0; k < n; k++) {
+      if(Util::isValid(elevs[k])) {
+         valid[k] = 1;
+         sums.shifted[k] = elevs[k] - sums.elevRef;
+         sums.shifted2[k] = sums.shifted[k] * sums.shifted[k];
+      }
+   }
+   sums.count.build(valid, nLat, nLon);
+   sums.sum.build(sums.shifted, nLat, nLon);
+   sums.sum2.build(sums.shifted2, nLat, nLon);
+   Util::getWindowMinMax(elevs, nLat, nLon, mSearchRadius, sums.min, sums.max);
+   return sums;
+}
+
+void DownscalerGradient::clearElevationCache() {
+   mElevationCache.clear();
+}
+
 float DownscalerGradient::getConstantGradient() const {
    return mConstantGradient;
 }
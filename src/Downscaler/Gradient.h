@@ -3,6 +3,9 @@
 #include "Downscaler.h"
 #include "../Variable.h"
 #include "../Util.h"
+#include "../Uuid.h"
+#include "../IntegralImage.h"
+#include <map>
 typedef std::vector<std::vector<int> > vec2Int;
 //! Adjust the value of the nearest neighbour (nn), based on the gradient in a neighbourhood
 //! surrounding the nearest neighbour, and the elevation difference to the lookup point (p):
@@ -23,8 +26,33 @@ class DownscalerGradient : public Downscaler {
       float getDefaultGradient() const;
       static std::string description();
       std::string name() const {return "gradient";};
+      int getHaloSize() const {return mSearchRadius;};
+
+      //! Clears the cache of elevation sums (called by Downscaler::clearCache)
+      static void clearElevationCache();
    private:
       void downscaleCore(const File& iInput, File& iOutput) const;
+      //! Sums over the elevations of an input grid, which are the same for all times and members
+      struct ElevationSums {
+         ElevationSums() : elevRef(0) {};
+         //! Elevations on the flattened grid
+         std::vector<float> elevs;
+         //! Valid elevations minus their mean (elevRef), 0 if missing
+         std::vector<double> shifted;
+         std::vector<double> shifted2;
+         double elevRef;
+         //! Integral images of the number of valid elevations, shifted, and shifted2
+         IntegralImage count;
+         IntegralImage sum;
+         IntegralImage sum2;
+         //! Lowest and highest elevation within the search radius
+         std::vector<float> min;
+         std::vector<float> max;
+      };
+      //! Get the elevation sums of the grid in iFile, computing them if they are not cached
+      const ElevationSums& getElevationSums(const File& iFile) const;
+      // Elevation sums by unique tag of the input grid and search radius
+      static std::map<Uuid, std::map<int, ElevationSums> > mElevationCache;
       int   mSearchRadius;
       float mConstantGradient;
       float mMinElevDiff; // Minimum elevation difference within neighbourhood to use gradient
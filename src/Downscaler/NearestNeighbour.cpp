@@ -10,32 +10,16 @@ DownscalerNearestNeighbour::DownscalerNearestNeighbour(Variable::Type iVariable,
 }
 
 void DownscalerNearestNeighbour::downscaleCore(const File& iInput, File& iOutput) const {
-   int nLat = iOutput.getNumLat();
-   int nLon = iOutput.getNumLon();
-   int nEns = iOutput.getNumEns();
    int nTime = iInput.getNumTime();
 
    // Get nearest neighbour
-   vec2Int nearestI, nearestJ;
-   getNearestNeighbour(iInput, iOutput, nearestI, nearestJ);
+   std::vector<int> indices;
+   getNearestNeighbour(iInput, iOutput, indices);
 
    for(int t = 0; t < nTime; t++) {
-      Field& ifield = *iInput.getField(mVariable, t);
+      const Field& ifield = *iInput.getField(mVariable, t);
       Field& ofield = *iOutput.getField(mVariable, t);
-
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            int I = nearestI[i][j];
-            int J = nearestJ[i][j];
-            for(int e = 0; e < nEns; e++) {
-               if(Util::isValid(I) && Util::isValid(J))
-                  ofield(i,j,e) = ifield(I,J,e);
-               else
-                  ofield(i,j,e) = Util::MV;
-            }
-         }
-      }
+      gather(indices, ifield, ofield);
    }
 }
 
@@ -10,6 +10,7 @@ class DownscalerNearestNeighbour : public Downscaler {
       DownscalerNearestNeighbour(Variable::Type iVariable, const Options& iOptions);
       static std::string description();
       std::string name() const {return "nearestNeighbour";};
+      int getHaloSize() const {return 0;};
    private:
       void downscaleCore(const File& iInput, File& iOutput) const;
 };
@@ -13,42 +13,43 @@ void DownscalerPressure::downscaleCore(const File& iInput, File& iOutput) const
    int nLon = iOutput.getNumLon();
    int nEns = iOutput.getNumEns();
    int nTime = iInput.getNumTime();
+   int nLonIn = iInput.getNumLon();
 
-   vec2 ilats  = iInput.getLats();
-   vec2 ilons  = iInput.getLons();
    vec2 ielevs = iInput.getElevs();
-   vec2 olats  = iOutput.getLats();
-   vec2 olons  = iOutput.getLons();
    vec2 oelevs = iOutput.getElevs();
 
    // Get nearest neighbour
-   vec2Int nearestI, nearestJ;
-   getNearestNeighbour(iInput, iOutput, nearestI, nearestJ);
+   std::vector<int> indices;
+   getNearestNeighbour(iInput, iOutput, indices);
+
+   // Elevations do not change with time, so look them up once
+   std::vector<float> nearestElevs(nLat*nLon, Util::MV);
+   std::vector<float> currElevs(nLat*nLon, Util::MV);
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         int k = i*nLon + j;
+         currElevs[k] = oelevs[i][j];
+         if(Util::isValid(indices[k]))
+            nearestElevs[k] = ielevs[indices[k] / nLonIn][indices[k] % nLonIn];
+      }
+   }
 
    for(int t = 0; t < nTime; t++) {
-      Field& ifield = *iInput.getField(mVariable, t);
+      const Field& ifield = *iInput.getField(mVariable, t);
       Field& ofield = *iOutput.getField(mVariable, t);
+      gather(indices, ifield, ofield);
 
+      float* output = ofield.getData();
       #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            int Icenter = nearestI[i][j];
-            int Jcenter = nearestJ[i][j];
-            assert(Icenter < ielevs.size());
-            assert(Jcenter < ielevs[Icenter].size());
-            for(int e = 0; e < nEns; e++) {
-               float currElev = oelevs[i][j];
-               float nearestElev = ielevs[Icenter][Jcenter];
-               if(!Util::isValid(currElev) || !Util::isValid(nearestElev)) {
-                  // Can't adjust if we don't have an elevation, use nearest neighbour
-                  ofield(i,j,e) = ifield(Icenter,Jcenter,e);
-               }
-               else {
-                  float nearestPressure = ifield(Icenter,Jcenter,e);
-                  float currPressure = calcPressure(nearestElev, nearestPressure, currElev);
-                  ofield(i,j,e) = currPressure;
-               }
-            }
+      for(int k = 0; k < nLat*nLon; k++) {
+         float currElev = currElevs[k];
+         float nearestElev = nearestElevs[k];
+         // Can't adjust if we don't have an elevation, use nearest neighbour
+         if(!Util::isValid(currElev) || !Util::isValid(nearestElev))
+            continue;
+         for(int e = 0; e < nEns; e++) {
+            float nearestPressure = output[k*nEns + e];
+            output[k*nEns + e] = calcPressure(nearestElev, nearestPressure, currElev);
          }
       }
    }
@@ -13,6 +13,7 @@ class DownscalerPressure : public Downscaler {
       DownscalerPressure(Variable::Type iVariable, const Options& iOptions);
       static std::string description();
       std::string name() const {return "pressure";};
+      int getHaloSize() const {return 0;};
       static float calcPressure(float iElev0, float iPressure0, float iElev1);
    private:
       void downscaleCore(const File& iInput, File& iOutput) const;
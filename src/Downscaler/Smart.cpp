@@ -1,6 +1,8 @@
 #include "Smart.h"
 #include "../File/File.h"
 #include "../Util.h"
+#include "../DiskCache.h"
+#include <algorithm>
 #include <math.h>
 
 DownscalerSmart::DownscalerSmart(Variable::Type iVariable, const Options& iOptions) :
@@ -16,47 +18,32 @@ void DownscalerSmart::downscaleCore(const File& iInput, File& iOutput) const {
    int nEns = iOutput.getNumEns();
    int nTime = iInput.getNumTime();
 
-   vec2 ilats  = iInput.getLats();
-   vec2 ilons  = iInput.getLons();
-   vec2 ielevs = iInput.getElevs();
-   vec2 olats  = iOutput.getLats();
-   vec2 olons  = iOutput.getLons();
-   vec2 oelevs = iOutput.getElevs();
-
    // Get nearest neighbour
-   vec3Int nearestI, nearestJ;
-   getSmartNeighbours(iInput, iOutput, nearestI, nearestJ);
+   std::vector<int> offsets, indices;
+   getSmartNeighbours(iInput, iOutput, offsets, indices);
 
    for(int t = 0; t < nTime; t++) {
-      Field& ifield = *iInput.getField(mVariable, t);
+      const Field& ifield = *iInput.getField(mVariable, t);
       Field& ofield = *iOutput.getField(mVariable, t);
+      const float* input = ifield.getData();
+      float* output = ofield.getData();
 
       #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            for(int e = 0; e < nEns; e++) {
-               float total = 0;
-               int   count = 0;
-               int N = nearestI[i][j].size();
-               assert(nearestI[i][j].size() == nearestJ[i][j].size());
-               for(int n = 0; n < N; n++) {
-                  int ii = nearestI[i][j][n];
-                  int jj = nearestJ[i][j][n];
-
-                  if(Util::isValid(ii) && Util::isValid(jj)) {
-                     float value = ifield(ii,jj,e);
-                     if(Util::isValid(value)) {
-                        total += value;
-                        count++;
-                     }
-                  }
+      for(int k = 0; k < nLat*nLon; k++) {
+         for(int e = 0; e < nEns; e++) {
+            float total = 0;
+            int   count = 0;
+            for(int n = offsets[k]; n < offsets[k+1]; n++) {
+               float value = input[indices[n]*nEns + e];
+               if(Util::isValid(value)) {
+                  total += value;
+                  count++;
                }
-               if(count > 0)
-                  ofield(i,j,e) = total/count;
-               else
-                  ofield(i,j,e) = Util::MV;
-               // ofield[i][j][e] = nearestI[i][j][0];
             }
+            if(count > 0)
+               output[k*nEns + e] = total/count;
+            else
+               output[k*nEns + e] = Util::MV;
          }
       }
    }
@@ -78,91 +65,139 @@ void DownscalerSmart::setSearchRadius(int iNumPoints) {
    mSearchRadius = iNumPoints;
 }
 void DownscalerSmart::getSmartNeighbours(const File& iFrom, const File& iTo, vec3Int& iI, vec3Int& iJ) const {
-   vec2 ilats  = iFrom.getLats();
-   vec2 ilons  = iFrom.getLons();
+   std::vector<int> offsets, indices;
+   getSmartNeighbours(iFrom, iTo, offsets, indices);
+
+   int nLat = iTo.getNumLat();
+   int nLon = iTo.getNumLon();
+   int nLonFrom = iFrom.getNumLon();
+   iI.resize(nLat);
+   iJ.resize(nLat);
+   for(int i = 0; i < nLat; i++) {
+      iI[i].resize(nLon);
+      iJ[i].resize(nLon);
+      for(int j = 0; j < nLon; j++) {
+         int k = i*nLon + j;
+         iI[i][j].resize(offsets[k+1] - offsets[k]);
+         iJ[i][j].resize(offsets[k+1] - offsets[k]);
+         for(int n = offsets[k]; n < offsets[k+1]; n++) {
+            iI[i][j][n - offsets[k]] = indices[n] / nLonFrom;
+            iJ[i][j][n - offsets[k]] = indices[n] % nLonFrom;
+         }
+      }
+   }
+}
+
+void DownscalerSmart::getSmartNeighbours(const File& iFrom, const File& iTo, std::vector<int>& iOffsets, std::vector<int>& iIndices) const {
    vec2 ielevs = iFrom.getElevs();
-   vec2 olats  = iTo.getLats();
-   vec2 olons  = iTo.getLons();
    vec2 oelevs = iTo.getElevs();
    int nLon    = iTo.getNumLon();
    int nLat    = iTo.getNumLat();
-   int numSearch = getNumSearchPoints(mSearchRadius);
+   int nLatFrom = iFrom.getNumLat();
+   int nLonFrom = iFrom.getNumLon();
+
+   // The neighbours only depend on the grids and the settings, so they can be reused for other
+   // variables and in later runs (if a cache directory is set)
+   std::stringstream ss;
+   ss << "smart_" << getGridKey(iFrom, true) << "_" << getGridKey(iTo, true) << "_"
+      << mSearchRadius << "_" << mNumSmart << "_" << mMinElevDiff;
+   std::string key = ss.str();
+   if(getListFromCache(key, iOffsets, iIndices))
+      return;
+   if(DiskCache::isEnabled()) {
+      std::vector<std::vector<int> > arrays;
+      if(DiskCache::read(key, arrays) && arrays.size() == 2 && arrays[0].size() == nLat*nLon + 1 &&
+            arrays[0][nLat*nLon] == arrays[1].size()) {
+         iOffsets.swap(arrays[0]);
+         iIndices.swap(arrays[1]);
+         addListToCache(key, iOffsets, iIndices);
+         Util::status("Smart neighbours read from cache");
+         return;
+      }
+   }
 
    vec2Int Icenter, Jcenter;
    getNearestNeighbour(iFrom, iTo, Icenter, Jcenter);
 
-   iI.resize(nLat);
-   iJ.resize(nLat);
-   #pragma omp parallel for
+   // Determine the number of neighbours of each point first, so that the lists can be filled in
+   // parallel
+   iOffsets.clear();
+   iOffsets.resize(nLat*nLon + 1, 0);
+   std::vector<bool> useNearest(nLat*nLon, false);
    for(int i = 0; i < nLat; i++) {
-      iI[i].resize(nLon);
-      iJ[i].resize(nLon);
       for(int j = 0; j < nLon; j++) {
+         int k = i*nLon + j;
          int Ic = Icenter[i][j];
          int Jc = Jcenter[i][j];
-         float oelev = oelevs[i][j];
-         float nnElev = ielevs[Ic][Jc];
-         bool isWithinMinElev = Util::isValid(oelev) && Util::isValid(nnElev) && Util::isValid(mMinElevDiff) && 
-                                fabs(oelev - nnElev) <= mMinElevDiff;
-         if(!Util::isValid(oelev) || isWithinMinElev) {
-            // No elevation information available or within minimum elevation difference:
-            // Use nearest neighbour.
-            iI[i][j].push_back(Ic);
-            iJ[i][j].push_back(Jc);
-         }
-         else {
-            // Compute elevation differences on the stencil surrounding the current point
-            std::vector<std::pair<int, float> > elevDiff; // elevation difference of points in stencil
-                                                          // but placed in 1D array, to simplify sort
-            elevDiff.reserve(numSearch);
-            // Keep track of which I/J corresponds to indices in elevDiff
-            std::vector<int> Ilookup;
-            std::vector<int> Jlookup;
-            Ilookup.reserve(numSearch);
-            Jlookup.reserve(numSearch);
-
-            int index = 0;
-            for(int ii = std::max(0, Ic-mSearchRadius); ii <= std::min(iFrom.getNumLat()-1, Ic+mSearchRadius); ii++) {
-               for(int jj = std::max(0, Jc-mSearchRadius); jj <= std::min(iFrom.getNumLon()-1, Jc+mSearchRadius); jj++) {
-                  float ielev = ielevs[ii][jj];
-                  float diff = 1e10;
-                  if(Util::isValid(ielev) && Util::isValid(oelev))
-                     diff = abs(ielev - oelev);
-                  elevDiff.push_back(std::pair<int, float>(index, diff));
-                  Ilookup.push_back(ii);
-                  Jlookup.push_back(jj);
-                  index++;
-               }
+         int N = 0;
+         if(Util::isValid(Ic) && Util::isValid(Jc)) {
+            float oelev = oelevs[i][j];
+            float nnElev = ielevs[Ic][Jc];
+            bool isWithinMinElev = Util::isValid(oelev) && Util::isValid(nnElev) && Util::isValid(mMinElevDiff) &&
+                                   fabs(oelev - nnElev) <= mMinElevDiff;
+            if(!Util::isValid(oelev) || isWithinMinElev) {
+               // No elevation information available or within minimum elevation difference:
+               // Use nearest neighbour.
+               useNearest[k] = true;
+               N = 1;
             }
+            else {
+               int numI = std::min(nLatFrom-1, Ic+mSearchRadius) - std::max(0, Ic-mSearchRadius) + 1;
+               int numJ = std::min(nLonFrom-1, Jc+mSearchRadius) - std::max(0, Jc-mSearchRadius) + 1;
+               N = std::min(numI*numJ, mNumSmart);
+            }
+         }
+         iOffsets[k+1] = iOffsets[k] + N;
+      }
+   }
+   iIndices.clear();
+   iIndices.resize(iOffsets[nLat*nLon]);
 
-            std::sort(elevDiff.begin(), elevDiff.end(), Util::sort_pair_second<int,float>());
-
-            std::stringstream ss;
-            ss << "Smart neighbours for " << i << " " << j << " " << oelev;
-            Util::status(ss.str());
+   #pragma omp parallel for
+   for(int i = 0; i < nLat; i++) {
+      // Elevation difference and index of points in the stencil surrounding the current point
+      std::vector<std::pair<float, int> > elevDiff;
+      elevDiff.reserve(getNumSearchPoints(mSearchRadius));
+      for(int j = 0; j < nLon; j++) {
+         int k = i*nLon + j;
+         int N = iOffsets[k+1] - iOffsets[k];
+         if(N == 0)
+            continue;
+         int Ic = Icenter[i][j];
+         int Jc = Jcenter[i][j];
+         if(useNearest[k]) {
+            iIndices[iOffsets[k]] = Ic*nLonFrom + Jc;
+            continue;
+         }
 
-            // Use nearest neighbour if all fails
-            if(elevDiff.size() == 0) {
-               iI[i][j].push_back(Ic);
-               iJ[i][j].push_back(Jc);
-            }
-            else {
-               int N = std::min((int) elevDiff.size(), mNumSmart);
-               iI[i][j].resize(N, Util::MV);
-               iJ[i][j].resize(N, Util::MV);
-
-               for(int n = 0; n < N; n++) {
-                  int index = elevDiff[n].first;
-                  iI[i][j][n] = Ilookup[index];
-                  iJ[i][j][n] = Jlookup[index];
-                  std::stringstream ss;
-                  ss << "   " << iI[i][j][n] << " " << iJ[i][j][n] << " " << elevDiff[n].second;
-                  Util::status(ss.str());
-               }
+         float oelev = oelevs[i][j];
+         elevDiff.clear();
+         for(int ii = std::max(0, Ic-mSearchRadius); ii <= std::min(nLatFrom-1, Ic+mSearchRadius); ii++) {
+            for(int jj = std::max(0, Jc-mSearchRadius); jj <= std::min(nLonFrom-1, Jc+mSearchRadius); jj++) {
+               float ielev = ielevs[ii][jj];
+               float diff = 1e10;
+               if(Util::isValid(ielev))
+                  diff = fabs(ielev - oelev);
+               elevDiff.push_back(std::pair<float, int>(diff, ii*nLonFrom + jj));
             }
          }
+
+         // Only the best N points need to be ordered. Ties are resolved by the position in the
+         // grid.
+         std::partial_sort(elevDiff.begin(), elevDiff.begin() + N, elevDiff.end());
+         for(int n = 0; n < N; n++) {
+            iIndices[iOffsets[k] + n] = elevDiff[n].second;
+         }
       }
    }
+
+   addListToCache(key, iOffsets, iIndices);
+   if(DiskCache::isEnabled()) {
+      std::vector<std::vector<int> > arrays(2);
+      arrays[0] = iOffsets;
+      arrays[1] = iIndices;
+      DiskCache::write(key, arrays);
+   }
 }
 
 int DownscalerSmart::getNumSearchPoints() const {
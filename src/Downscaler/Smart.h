@@ -22,9 +22,14 @@ class DownscalerSmart : public Downscaler {
       float getMinElevDiff();
       static std::string description();
       std::string name() const {return "smart";};
+      int getHaloSize() const {return mSearchRadius;};
 
       //! Method may return fewer than num smart neighbours
       void getSmartNeighbours(const File& iFrom, const File& iTo, vec3Int& iI, vec3Int& iJ) const;
+      //! Compute smart neighbours in a flat layout. The neighbours of output point k (i*nLon + j)
+      //! are at iIndices[iOffsets[k]] to iIndices[iOffsets[k+1]-1], ordered by increasing elevation
+      //! difference, as indices into the flattened input grid (I*nLon + J). Results are cached.
+      void getSmartNeighbours(const File& iFrom, const File& iTo, std::vector<int>& iOffsets, std::vector<int>& iIndices) const;
       static int getNumSearchPoints(int iSearchRadius) ;
              int getNumSearchPoints() const;
    private:
@@ -12,7 +12,7 @@
 void writeUsage() {
    std::cout << "Post-processes gridded forecasts" << std::endl;
    std::cout << std::endl;
-   std::cout << "usage:  gridpp inputs [options] outputs [options] [-v var [options] [-d downscaler [options] [-p parameters [options]]] [-c calibrator [options] [-p parameters [options]]]*]+" << std::endl;
+   std::cout << "usage:  gridpp [options] inputs [options] outputs [options] [-v var [options] [-d downscaler [options] [-p parameters [options]]] [-c calibrator [options] [-p parameters [options]]]*]+" << std::endl;
    std::cout << "        gridpp [--version]" << std::endl;
    std::cout << "        gridpp [--help]" << std::endl;
    std::cout << std::endl;
@@ -47,8 +47,15 @@ void writeUsage() {
    std::cout << "Variables:" << std::endl;
    std::cout << Variable::getDescriptions();
    std::cout << std::endl;
+   std::cout << "Run options (and default values), given before the inputs:" << std::endl;
+   std::cout << Util::formatDescription("cacheDir=undef", "Store neighbour lookups in this (existing) directory, so that they can be reused in later runs on the same grids.") << std::endl;
+   std::cout << Util::formatDescription("cacheSize=1000", "Maximum size of the cache directory (in MB). The least recently used entries are removed first.") << std::endl;
+   std::cout << std::endl;
    std::cout << "Variable options (and default values):" << std::endl;
    std::cout << Util::formatDescription("write=1", "Set to 0 to prevent the variable to be written to output") << std::endl;
+   std::cout << Util::formatDescription("packing=float", "Store new NetCDF output variables as 'float', or as packed 'short' or 'byte' integers") << std::endl;
+   std::cout << Util::formatDescription("precision=undef", "Precision of packed values. If unspecified, the full range of the variable is used, which requires the variable to have a lower and upper limit.") << std::endl;
+   std::cout << Util::formatDescription("digits=undef", "Round NetCDF output values of this variable to this many significant digits. Overrides the 'digits' option of the output file.") << std::endl;
    std::cout << std::endl;
    std::cout << "Downscalers with options (and default values):" << std::endl;
    std::cout << Downscaler::getDescriptions();
@@ -90,50 +97,8 @@ int main(int argc, const char *argv[]) {
    }
    Setup setup(args);
    for(int f = 0; f < setup.inputFiles.size(); f++) {
-      std::cout << "Input type:  " << setup.inputFiles[f]->name() << std::endl;
-      std::cout << "Output type: " << setup.outputFiles[f]->name() << std::endl;
-      setup.outputFiles[f]->setTimes(setup.inputFiles[f]->getTimes());
-      setup.outputFiles[f]->setReferenceTime(setup.inputFiles[f]->getReferenceTime());
-
-      // Post-process file
-      std::vector<Variable::Type> writeVariables;
-      for(int v = 0; v < setup.variableConfigurations.size(); v++) {
-         double s = Util::clock();
-         VariableConfiguration varconf = setup.variableConfigurations[v];
-         Variable::Type variable = varconf.variable;
-
-         bool write = 1;
-         varconf.variableOptions.getValue("write", write);
-         if(write) {
-            writeVariables.push_back(variable);
-         }
-         setup.outputFiles[f]->initNewVariable(variable);
-
-         std::cout << "Processing " << Variable::getTypeName(variable) << std::endl;
-
-         // Downscale
-         std::cout << "   Downscaler " << varconf.downscaler->name() << std::endl;
-         varconf.downscaler->downscale(*setup.inputFiles[f], *setup.outputFiles[f]);
-         for(int c = 0; c < varconf.calibrators.size(); c++) {
-            // Calibrate
-            std::cout << "   Calibrator " << varconf.calibrators[c]->name() << std::endl;
-            varconf.calibrators[c]->calibrate(*setup.outputFiles[f], varconf.parameterFileCalibrators[c]);
-         }
-         double e = Util::clock();
-         std::cout << "   " << e-s << " seconds" << std::endl;
-         std::cout << "Current mem usage input: " << setup.inputFiles[f]->getCacheSize() / 1e6<< std::endl;
-         std::cout << "Current mem usage output: " << setup.outputFiles[f]->getCacheSize() / 1e6<< std::endl;
-         // setup.inputFile->clear();
-      }
-
-      // Write to output
-      double s = Util::clock();
-      setup.outputFiles[f]->write(writeVariables);
-      double e = Util::clock();
-      std::cout << "Writing file: " << e-s << " seconds" << std::endl;
-      std::cout << "Total time:   " << e-start << " seconds" << std::endl;
-      setup.inputFiles[f]->clear();
-      setup.outputFiles[f]->clear();
+      setup.process(f, true);
+      std::cout << "Total time:   " << Util::clock()-start << " seconds" << std::endl;
    }
    return 0;
 }
@@ -1,10 +1,13 @@
 #include <sstream>
+#include <algorithm>
 #include "Field.h"
 Field::Field(int nLat, int nLon, int nEns, float iFillValue) :
-      mNLat(nLat), mNLon(nLon), mNEns(nEns) {
+      mNLat(nLat), mNLon(nLon), mNEns(nEns), mData(NULL) {
    if(Util::isValid(nLat) && Util::isValid(nLon) && Util::isValid(nEns)
          && nLat >= 0 && nLon >= 0 && nEns >= 0) {
       mValues.resize(nLat*nLon*nEns, iFillValue);
+      if(mValues.size() > 0)
+         mData = &mValues[0];
    }
    else {
       std::stringstream ss;
@@ -13,11 +16,51 @@ Field::Field(int nLat, int nLon, int nEns, float iFillValue) :
    }
 }
 
+Field::Field(int nLat, int nLon, int nEns, float* iValues, boost::shared_ptr<void> iStorage) :
+      mNLat(nLat), mNLon(nLon), mNEns(nEns), mData(iValues), mStorage(iStorage) {
+   if(!Util::isValid(nLat) || !Util::isValid(nLon) || !Util::isValid(nEns)
+         || nLat < 0 || nLon < 0 || nEns < 0) {
+      std::stringstream ss;
+      ss << "Cannot create field of size [" << nLat << "," << nLon << "," << nEns << "]";
+      Util::error(ss.str());
+   }
+   if(nLat*nLon*nEns == 0)
+      mData = NULL;
+}
+
+Field::Field(const Field& iField) :
+      mNLat(iField.mNLat), mNLon(iField.mNLon), mNEns(iField.mNEns), mData(NULL) {
+   int size = mNLat*mNLon*mNEns;
+   if(size > 0) {
+      mValues.assign(iField.mData, iField.mData + size);
+      mData = &mValues[0];
+   }
+}
+
+Field& Field::operator=(const Field& iField) {
+   if(this != &iField) {
+      mNLat = iField.mNLat;
+      mNLon = iField.mNLon;
+      mNEns = iField.mNEns;
+      mStorage.reset();
+      mData = NULL;
+      int size = mNLat*mNLon*mNEns;
+      if(size > 0) {
+         mValues.assign(iField.mData, iField.mData + size);
+         mData = &mValues[0];
+      }
+      else {
+         mValues.clear();
+      }
+   }
+   return *this;
+}
+
 float& Field::operator()(unsigned int i, unsigned int j, unsigned int k) {
-   return mValues[getIndex(i,j,k)];
+   return mData[getIndex(i,j,k)];
 }
 float const& Field::operator()(unsigned int i, unsigned int j, unsigned int k) const {
-   return mValues[getIndex(i,j,k)];
+   return mData[getIndex(i,j,k)];
 }
 int Field::getIndex(unsigned int i, unsigned int j, unsigned int k) const {
    if(i >= mNLat || j >= mNLon || k >= mNEns)
@@ -26,7 +69,7 @@ int Field::getIndex(unsigned int i, unsigned int j, unsigned int k) const {
 }
 
 std::vector<float> Field::operator()(unsigned int i, unsigned int j) const {
-   std::vector<float> values(mValues.begin()+getIndex(i, j, 0), mValues.begin()+getIndex(i, j, mNEns-1)+1);
+   std::vector<float> values(mData+getIndex(i, j, 0), mData+getIndex(i, j, mNEns-1)+1);
    return values;
 }
 
@@ -40,9 +83,19 @@ int Field::getNumEns() const {
    return mNEns;
 }
 
+float* Field::getData() {
+   return mData;
+}
+const float* Field::getData() const {
+   return mData;
+}
+
 bool Field::operator==(const Field& iField) const {
-   return mValues == iField.mValues;
+   int size = mNLat*mNLon*mNEns;
+   if(size != iField.mNLat*iField.mNLon*iField.mNEns)
+      return false;
+   return std::equal(mData, mData + size, iField.mData);
 }
 bool Field::operator!=(const Field& iField) const {
-   return mValues != iField.mValues;
+   return !(*this == iField);
 }
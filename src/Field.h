@@ -17,6 +17,15 @@ class Field {
       //! @param iFillValue initialize all values in field with this
       Field(int nLat, int nLon, int nEns, float iFillValue=Util::MV);
 
+      //! Initialize a field that uses existing memory for its values, without copying them
+      //! @param iValues nLat*nLon*nEns values, ordered as in getData()
+      //! @param iStorage keeps the memory alive while the field exists
+      Field(int nLat, int nLon, int nEns, float* iValues, boost::shared_ptr<void> iStorage);
+
+      //! Copies always get their own memory
+      Field(const Field& iField);
+      Field& operator=(const Field& iField);
+
       //! Access to data
       //! @param i latitude index
       //! @param j longitude index
@@ -44,9 +53,18 @@ class Field {
       //! Number of ensemble members
       int getNumEns() const;
 
+      //! Direct access to the flat array of values, where the ensemble index changes fastest,
+      //! followed by the longitude index. Returns NULL if the field is empty.
+      float* getData();
+      const float* getData() const;
+
    private:
-      //! Data values stored in a flat array. Index for ensemble changes fastest.
+      //! Data values stored in a flat array. Index for ensemble changes fastest. Empty if the
+      //! field uses external memory.
       std::vector<float> mValues;
+      //! Points to the values, either in mValues or in the external memory
+      float* mData;
+      boost::shared_ptr<void> mStorage;
       int mNLat;
       int mNLon;
       int mNEns;
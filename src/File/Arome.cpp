@@ -3,13 +3,15 @@
 #include <netcdf.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <algorithm>
 #include "../Util.h"
 
 FileArome::FileArome(std::string iFilename, const Options& iOptions, bool iReadOnly) : FileNetcdf(iFilename, iOptions, iReadOnly),
       mXName(""),
       mYName(""),
       mLatName("latitude"),
-      mLonName("longitude") {
+      mLonName("longitude"),
+      mHasProjection(false) {
 
    iOptions.getValue("lat", mLatName);
    iOptions.getValue("lon", mLonName);
@@ -43,33 +45,35 @@ FileArome::FileArome(std::string iFilename, const Options& iOptions, bool iReadO
    mNLon  = getDimSize(mXName);
    mNEns  = 1;
 
-   mLats = getLatLonVariable(mLatName);
-   mLons = getLatLonVariable(mLonName);
+   vec2 elevs;
    if(hasVar("surface_geopotential")) {
-      FieldPtr elevField = getFieldCore("surface_geopotential", 0);
-      mElevs.resize(getNumLat());
+      std::vector<FieldPtr> elevFields;
+      readFields("surface_geopotential", 0, 1, elevFields);
+      FieldPtr elevField = elevFields[0];
+      elevs.resize(getNumLat());
       for(int i = 0; i < getNumLat(); i++) {
-         mElevs[i].resize(getNumLon());
+         elevs[i].resize(getNumLon());
          for(int j = 0; j < getNumLon(); j++) {
             float value = (*elevField)(i,j,0) / 9.81;
-            mElevs[i][j] = value;
+            elevs[i][j] = value;
          }
       }
       std::cout << "Deriving altitude from geopotential height in " << getFilename() << std::endl;
    }
    else if(hasVar("altitude")) {
-      mElevs = getLatLonVariable("altitude");
+      elevs = getLatLonVariable("altitude");
    }
    else {
-      mElevs.resize(getNumLat());
+      elevs.resize(getNumLat());
       for(int i = 0; i < getNumLat(); i++) {
-         mElevs[i].resize(getNumLon());
+         elevs[i].resize(getNumLon());
          for(int j = 0; j < getNumLon(); j++) {
-            mElevs[i][j] = Util::MV;
+            elevs[i][j] = Util::MV;
          }
       }
       Util::warning("No altitude field available in " + getFilename());
    }
+   setGrid(getLatLonVariable(mLatName), getLatLonVariable(mLonName), elevs);
 
    if(hasVar("land_area_fraction")) {
       mLandFractions = getLatLonVariable("land_area_fraction");
@@ -106,87 +110,115 @@ FileArome::FileArome(std::string iFilename, const Options& iOptions, bool iReadO
       setReferenceTime(referenceTime);
    }
 
+   readProjection();
+
    Util::status( "File '" + iFilename + " 'has dimensions " + getDimenionString());
 }
 
-FieldPtr FileArome::getFieldCore(Variable::Type iVariable, int iTime) const {
-   std::string variableName = getVariableName(iVariable);
-   return getFieldCore(variableName, iTime);
+void FileArome::readProjection() {
+   if(!hasVar("projection_lambert") || !hasVar(mXName) || !hasVar(mYName))
+      return;
+   if(getAttribute("projection_lambert", "grid_mapping_name") != "lambert_conformal_conic")
+      return;
+
+   int var = getVar("projection_lambert");
+   size_t numParallels = 0;
+   double parallels[2];
+   double lon0, lat0;
+   double radius = Util::radiusEarth;
+   if(nc_inq_attlen(mFile, var, "standard_parallel", &numParallels) != NC_NOERR || numParallels < 1 || numParallels > 2)
+      return;
+   if(nc_get_att_double(mFile, var, "standard_parallel", parallels) != NC_NOERR)
+      return;
+   if(nc_get_att_double(mFile, var, "longitude_of_central_meridian", &lon0) != NC_NOERR)
+      return;
+   if(nc_get_att_double(mFile, var, "latitude_of_projection_origin", &lat0) != NC_NOERR)
+      return;
+   nc_get_att_double(mFile, var, "earth_radius", &radius);
+   if(numParallels == 1)
+      parallels[1] = parallels[0];
+
+   // The projected coordinates must be evenly spaced
+   std::vector<double> x(getNumLon());
+   std::vector<double> y(getNumLat());
+   if(x.size() < 2 || y.size() < 2)
+      return;
+   int status = nc_get_var_double(mFile, getVar(mXName), &x[0]);
+   handleNetcdfError(status, "could not get data from variable " + mXName);
+   status = nc_get_var_double(mFile, getVar(mYName), &y[0]);
+   handleNetcdfError(status, "could not get data from variable " + mYName);
+   mDx = (x[x.size()-1] - x[0]) / (x.size() - 1);
+   mDy = (y[y.size()-1] - y[0]) / (y.size() - 1);
+   if(mDx == 0 || mDy == 0)
+      return;
+   for(int j = 0; j < x.size(); j++) {
+      if(fabs(x[j] - x[0] - j*mDx) > 0.01 * fabs(mDx))
+         return;
+   }
+   for(int i = 0; i < y.size(); i++) {
+      if(fabs(y[i] - y[0] - i*mDy) > 0.01 * fabs(mDy))
+         return;
+   }
+   mX0 = x[0];
+   mY0 = y[0];
+
+   // Constants for the spherical form of the projection (Snyder 1987, eq. 15-1 to 15-3)
+   double phi1 = Util::deg2rad(parallels[0]);
+   double phi2 = Util::deg2rad(parallels[1]);
+   if(fabs(phi1 - phi2) < 1e-10)
+      mProjN = sin(phi1);
+   else
+      mProjN = log(cos(phi1) / cos(phi2)) / log(tan(Util::pi/4 + phi2/2) / tan(Util::pi/4 + phi1/2));
+   if(mProjN == 0)
+      return;
+   mProjRF = radius * cos(phi1) * pow(tan(Util::pi/4 + phi1/2), mProjN) / mProjN;
+   mProjRho0 = mProjRF / pow(tan(Util::pi/4 + Util::deg2rad(lat0)/2), mProjN);
+   mProjLon0 = lon0;
+   mHasProjection = true;
+}
+
+bool FileArome::getProjectedIndices(float iLat, float iLon, float& iI, float& iJ) const {
+   if(!mHasProjection || !Util::isValid(iLat) || !Util::isValid(iLon) || fabs(iLat) >= 90)
+      return false;
+   double dlon = iLon - mProjLon0;
+   dlon = dlon - 360 * floor((dlon + 180) / 360);
+   double rho = mProjRF / pow(tan(Util::pi/4 + Util::deg2rad(iLat)/2), mProjN);
+   double theta = mProjN * Util::deg2rad(dlon);
+   double x = rho * sin(theta);
+   double y = mProjRho0 - rho * cos(theta);
+   // Relative to the part of the grid that is read
+   iI = (y - mY0) / mDy - mCropLat;
+   iJ = (x - mX0) / mDx - mCropLon;
+   return true;
 }
-FieldPtr FileArome::getFieldCore(std::string iVariable, int iTime) const {
-   startDataMode();
-   // Not cached, retrieve data
-   int var = getVar(iVariable);
-   int nLat  = mNLat;
-   int nLon  = mNLon;
-
-   int numDims = getNumDims(var);
-
-   size_t* count;
-   size_t* start;
-   long totalCount = nLat*nLon;
-   if(numDims == 4) {
+
+void FileArome::readFields(std::string iVariable, int iStartTime, int iNumTimes, std::vector<FieldPtr>& iFields) const {
+   const VariableInfo& info = getVariableInfo(iVariable);
+   size_t nLat = mNLat;
+   size_t nLon = mNLon;
+
+   std::vector<size_t> count;
+   if(info.dimSizes.size() == 4) {
       // Variable has a surface dimension
-      count = new size_t[4];
-      count[0] = 1;
-      count[1] = 1;
-      count[2] = nLat;
-      count[3] = nLon;
-      start = new size_t[4];
-      start[0] = iTime;
-      start[1] = 0;
-      start[2] = 0;
-      start[3] = 0;
-   }
-   else if(numDims == 3) {
-      count = new size_t[3];
-      count[0] = 1;
-      count[1] = nLat;
-      count[2] = nLon;
-      start = new size_t[3];
-      start[0] = iTime;
-      start[1] = 0;
-      start[2] = 0;
+      size_t count4[4] = {1, 1, nLat, nLon};
+      count.assign(count4, count4 + 4);
+   }
+   else if(info.dimSizes.size() == 3) {
+      size_t count3[3] = {1, nLat, nLon};
+      count.assign(count3, count3 + 3);
    }
    else {
       std::stringstream ss;
       ss << "Cannot read variable '" << iVariable << "' from '" << getFilename() << "'";
       Util::error(ss.str());
    }
-   float* values = new float[nLat*nLon];
-   nc_get_vara_float(mFile, var, start, count, values);
-   float MV = getMissingValue(var);
-
-   float offset = getOffset(var);
-   float scale = getScale(var);
-   int index = 0;
-   FieldPtr field = getEmptyField();
-   for(int lat = 0; lat < nLat; lat++) {
-      for(int lon = 0; lon < nLon; lon++) {
-         float value = values[index];
-         assert(index < totalCount);
-         if(value == MV) {
-            // Field has missing value indicator and the value is missing
-            // Save values using our own internal missing value indicator
-            value = Util::MV;
-         }
-         else {
-            value = scale*values[index] + offset;
-         }
-         (*field)(lat,lon,0) = value;
-         index++;
-      }
-   }
-   delete[] values;
-   delete[] count;
-   delete[] start;
-   return field;
+   readFieldValues(info, iStartTime, iNumTimes, count, iFields);
 }
 
 FileArome::~FileArome() {
 }
 
-void FileArome::writeCore(std::vector<Variable::Type> iVariables) {
+void FileArome::defineVariables(std::vector<Variable::Type> iVariables) {
    // General rule: Try to define all variables first, then write variables
    // to avoid swapping between define and data mode unnecessarily
    startDefineMode();
@@ -216,9 +248,7 @@ void FileArome::writeCore(std::vector<Variable::Type> iVariables) {
          int dLon     = getDim(mXName);
          int dLat     = getDim(mYName);
          int dims[3]  = {dTime, dLat, dLon};
-         int var = Util::MV;
-         int status = nc_def_var(mFile,variable.c_str(), NC_FLOAT, 3, dims, &var);
-         handleNetcdfError(status, "could not define variable");
+         defineVariable(varType, std::vector<int>(dims, dims+3));
       }
       int var = getVar(variable);
       float MV = getMissingValue(var); // The output file's missing value indicator
@@ -238,65 +268,24 @@ void FileArome::writeCore(std::vector<Variable::Type> iVariables) {
    writeTimes(); // 2-3 seconds
    if(isAltitudeValid)
       writeLatLonVariable("altitude");
-   for(int v = 0; v < iVariables.size(); v++) {
-      Variable::Type varType = iVariables[v];
-      std::string variable = getVariableName(varType);
-      assert(hasVariableCore(varType));
-      int var = getVar(variable);
-      float MV = getMissingValue(var); // The output file's missing value indicator
-      float* values = new float[mNTime*mNLat*mNLon];
-      for(int k = 0; k < mNTime*mNLat*mNLon; k++) {
-         values[k] = Util::MV;
-      }
-
-      // Arrange all data into the 'values' array
-      for(int t = 0; t < mNTime; t++) {
-         float offset = getOffset(var);
-         float scale = getScale(var);
-         FieldPtr field = getField(varType, t);
-         if(field != NULL) { // TODO: Can't be null if coming from reference
-            #pragma omp parallel for
-            for(int lat = 0; lat < mNLat; lat++) {
-               for(int lon = 0; lon < mNLon; lon++) {
-                  float value = (*field)(lat,lon,0);
-                  int index = t * mNLat * mNLon + lat * mNLon + lon;
-                  if(!Util::isValid(value)) {
-                     // Field has missing value indicator and the value is missing
-                     // Save values using the file's missing indicator value
-                     value = MV;
-                  }
-                  else {
-                     value = ((*field)(lat,lon,0) - offset)/scale;
-                  }
-                  values[index] = value;
-               }
-            }
-         }
-      }
+}
 
-      // Write to file
-      int numDims;
-      int status = nc_inq_varndims(mFile, var, &numDims);
-      handleNetcdfError(status, "could not determine number of dimensions for variable " + variable);
-      if(numDims == 4) {
-         size_t count[4] = {mNTime, 1, mNLat, mNLon};
-         size_t start[4] = {0, 0, 0, 0};
-         int status = nc_put_vara_float(mFile, var, start, count, values);
-         handleNetcdfError(status, "could not write variable " + variable);
-      }
-      else if(numDims == 3) {
-         size_t count[3] = {mNTime, mNLat, mNLon};
-         size_t start[3] = {0, 0, 0};
-         int status = nc_put_vara_float(mFile, var, start, count, values);
-         handleNetcdfError(status, "could not write variable " + variable);
-      }
-      else {
-         std::stringstream ss;
-         ss << "Cannot write variable '" << variable << "' to '" << getFilename() << "'";
-         Util::error(ss.str());
-      }
-      delete[] values;
+void FileArome::writeField(Variable::Type iVariable, int iTime, const Field& iField) {
+   std::string variable = getVariableName(iVariable);
+   const VariableInfo& info = getVariableInfo(variable);
+   int numDims = info.dimSizes.size();
+   std::vector<size_t> count(numDims, 1);
+   if(numDims == 3 || numDims == 4) {
+      count[numDims-2] = mNLat;
+      count[numDims-1] = mNLon;
+   }
+   else {
+      std::stringstream ss;
+      ss << "Cannot write variable '" << variable << "' to '" << getFilename() << "'";
+      Util::error(ss.str());
    }
+   // The field has the same layout as the file, since there is only one member
+   writeFieldValues(iVariable, info, iTime, count, iField.getData());
 }
 
 
@@ -538,5 +527,6 @@ std::string FileArome::description() {
    ss << Util::formatDescription("lon=longitude", "Name of the variable representing longitudes") << std::endl;
    ss << Util::formatDescription("x=undef", "Name of dimension in the x-direction. If unspecified, the name is auto-detected.") << std::endl;
    ss << Util::formatDescription("y=undef", "Name of dimension in the y-direction. If unspecified, the name is auto-detected.") << std::endl;
+   ss << FileNetcdf::description();
    return ss.str();
 }
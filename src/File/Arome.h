@@ -19,10 +19,12 @@ class FileArome : public FileNetcdf {
       static bool isValid(std::string iFilename);
       static std::string description();
       std::string name() const {return "arome";};
+      //! Available when the grid has a Lambert conformal conic projection
+      bool getProjectedIndices(float iLat, float iLon, float& iI, float& iJ) const;
    protected:
-      void writeCore(std::vector<Variable::Type> iVariables);
-      FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const;
-      FieldPtr getFieldCore(std::string iVariable, int iTime) const;
+      void defineVariables(std::vector<Variable::Type> iVariables);
+      void writeField(Variable::Type iVariable, int iTime, const Field& iField);
+      void readFields(std::string iVariable, int iStartTime, int iNumTimes, std::vector<FieldPtr>& iFields) const;
       // Must be one of "latitude", "longitude", or "altitude"
       vec2 getLatLonVariable(std::string iVariable) const;
       void writeLatLonVariable(std::string iVariable);
@@ -32,5 +34,19 @@ class FileArome : public FileNetcdf {
       std::string mYName;
       std::string mLatName;
       std::string mLonName;
+
+      //! Read the parameters of a Lambert conformal conic projection, if the file has one
+      void readProjection();
+      bool mHasProjection;
+      // Projection constants (spherical earth)
+      double mProjN;
+      double mProjRF;
+      double mProjRho0;
+      double mProjLon0;
+      // Projected coordinate of the first gridpoint and the grid spacing (in meters)
+      double mX0;
+      double mY0;
+      double mDx;
+      double mDy;
 };
 #endif
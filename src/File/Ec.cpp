@@ -19,23 +19,22 @@ FileEc::FileEc(std::string iFilename, const Options& iOptions, bool iReadOnly) :
    // Retrieve lat/lon/elev
    int vLat = getLatVar();
    int vLon = getLonVar();
-   mLats  = getGridValues(vLat);
-   mLons  = getGridValues(vLon);
-
+   vec2 elevs;
    if(hasVar("altitude")) {
       int vElev = getVar("altitude");
-      mElevs = getGridValues(vElev);
+      elevs = getGridValues(vElev);
    }
    else {
-      mElevs.resize(getNumLat());
+      elevs.resize(getNumLat());
       for(int i = 0; i < getNumLat(); i++) {
-         mElevs[i].resize(getNumLon());
+         elevs[i].resize(getNumLon());
          for(int j = 0; j < getNumLon(); j++) {
-            mElevs[i][j] = Util::MV;
+            elevs[i][j] = Util::MV;
          }
       }
       Util::warning("No altitude field available in " + getFilename());
    }
+   setGrid(getGridValues(vLat), getGridValues(vLon), elevs);
 
    // TODO: No land fraction info in EC files?
    mLandFractions.resize(getNumLat());
@@ -71,49 +70,17 @@ FileEc::FileEc(std::string iFilename, const Options& iOptions, bool iReadOnly) :
    Util::status( "File '" + iFilename + " 'has dimensions " + getDimenionString());
 }
 
-FieldPtr FileEc::getFieldCore(Variable::Type iVariable, int iTime) const {
-   startDataMode();
-   std::string variable = getVariableName(iVariable);
-   // Not cached, retrieve data
-   int var = getVar(variable);
-   int nTime = mNTime;
+void FileEc::readFields(std::string iVariable, int iStartTime, int iNumTimes, std::vector<FieldPtr>& iFields) const {
+   const VariableInfo& info = getVariableInfo(iVariable);
    int nEns  = mNEns;
    int nLat  = mNLat;
    int nLon  = mNLon;
 
    size_t count[5] = {1, 1, nEns, nLat, nLon};
-   size_t start[5] = {iTime, 0, 0, 0, 0};
-   size_t size = 1*1*nEns*nLat*nLon;
-   float* values = new float[size];
-   nc_get_vara_float(mFile, var, start, count, values);
-   float MV = getMissingValue(var);
-
-   float offset = getOffset(var);
-   float scale = getScale(var);
-   int index = 0;
-   FieldPtr field = getEmptyField();
-   for(int e = 0; e < nEns; e++) {
-      for(int lat = 0; lat < nLat; lat++) {
-         for(int lon = 0; lon < nLon; lon++) {
-            float value = values[index];
-            if(Util::isValid(MV) && value == MV) {
-               // Field has missing value indicator and the value is missing
-               // Save values using our own internal missing value indicator
-               value = Util::MV;
-            }
-            else {
-               value = scale*values[index] + offset;
-            }
-            (*field)(lat,lon,e) = value;
-            index++;
-         }
-      }
-   }
-   delete[] values;
-   return field;
+   readFieldValues(info, iStartTime, iNumTimes, std::vector<size_t>(count, count + 5), iFields);
 }
 
-void FileEc::writeCore(std::vector<Variable::Type> iVariables) {
+void FileEc::defineVariables(std::vector<Variable::Type> iVariables) {
    startDefineMode();
 
    // Define variables
@@ -133,9 +100,7 @@ void FileEc::writeCore(std::vector<Variable::Type> iVariables) {
          int dLon = getLonDim();
          int dLat = getLatDim();
          int dims[5] = {dTime, dSurface, dEns, dLat, dLon};
-         int var = Util::MV;
-         int status = nc_def_var(mFile, variable.c_str(), NC_FLOAT, 5, dims, &var);
-         handleNetcdfError(status, "could not define variable '" + variable + "'");
+         defineVariable(varType, std::vector<int>(dims, dims+5));
       }
       int var = getVar(variable);
       float MV = getMissingValue(var); // The output file's missing value indicator
@@ -152,55 +117,33 @@ void FileEc::writeCore(std::vector<Variable::Type> iVariables) {
    writeTimes();
    writeReferenceTime();
    writeAltitude();
-   for(int v = 0; v < iVariables.size(); v++) {
-      Variable::Type varType = iVariables[v];
-      std::string variable = getVariableName(varType);
-      assert(hasVariableCore(varType));
-      int var = getVar(variable);
-      float MV = getMissingValue(var); // The output file's missing value indicator
-      size_t size = 1*1*mNEns*mNLat*mNLon;
-      float* values = new float[size];
-      for(int t = 0; t < mNTime; t++) {
-         float offset = getOffset(var);
-         float scale = getScale(var);
-         FieldPtr field = getField(varType, t);
-         if(field != NULL) { // TODO: Can't be null if coming from reference
-            size_t start[5] = {t, 0, 0, 0, 0};
+}
 
-            int index = 0;
-            for(int e = 0; e < mNEns; e++) {
-               for(int lat = 0; lat < mNLat; lat++) {
-                  for(int lon = 0; lon < mNLon; lon++) {
-                     float value = (*field)(lat,lon,e);
-                     if(Util::isValid(MV) && !Util::isValid(value)) {
-                        // Field has missing value indicator and the value is missing
-                        // Save values using the file's missing indicator value
-                        value = MV;
-                     }
-                     else {
-                        value = ((*field)(lat,lon,e) - offset)/scale;
-                     }
-                     values[index] = value;
-                     index++;
-                  }
-               }
-            }
-            int numDims = getNumDims(var);
-            if(numDims == 5) {
-               size_t count[5] = {1,1,mNEns, mNLat, mNLon};
-               int status = nc_put_vara_float(mFile, var, start, count, values);
-               handleNetcdfError(status, "could not write variable " + variable);
-            }
-            else {
-               std::stringstream ss;
-               ss << "Cannot write " << variable << " to '" << getFilename() <<
-                             "' because it does not have 5 dimensions. It has " << numDims << " dimensions.";
-               Util::warning(ss.str());
-            }
+void FileEc::writeField(Variable::Type iVariable, int iTime, const Field& iField) {
+   std::string variable = getVariableName(iVariable);
+   const VariableInfo& info = getVariableInfo(variable);
+   int numDims = info.dimSizes.size();
+   if(numDims != 5) {
+      std::stringstream ss;
+      ss << "Cannot write " << variable << " to '" << getFilename() <<
+                    "' because it does not have 5 dimensions. It has " << numDims << " dimensions.";
+      Util::warning(ss.str());
+      return;
+   }
+
+   // The file has all points of one member after each other
+   std::vector<float> values(mNEns*mNLat*mNLon);
+   int index = 0;
+   for(int e = 0; e < mNEns; e++) {
+      for(int lat = 0; lat < mNLat; lat++) {
+         for(int lon = 0; lon < mNLon; lon++) {
+            values[index] = iField(lat,lon,e);
+            index++;
          }
       }
-      delete[] values;
    }
+   size_t count[5] = {1, 1, (size_t) mNEns, (size_t) mNLat, (size_t) mNLon};
+   writeFieldValues(iVariable, info, iTime, std::vector<size_t>(count, count+5), &values[0]);
 }
 
 
@@ -392,6 +335,7 @@ int FileEc::getLonVar() const {
 std::string FileEc::description() {
    std::stringstream ss;
    ss << Util::formatDescription("type=ec", "ECMWF ensemble file") << std::endl;
+   ss << FileNetcdf::description();
    return ss.str();
 }
 
@@ -24,8 +24,9 @@ class FileEc : public FileNetcdf {
       static std::string description();
       std::string name() const {return "ec";};
    protected:
-      void writeCore(std::vector<Variable::Type> iVariables);
-      FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const;
+      void defineVariables(std::vector<Variable::Type> iVariables);
+      void writeField(Variable::Type iVariable, int iTime, const Field& iField);
+      void readFields(std::string iVariable, int iStartTime, int iNumTimes, std::vector<FieldPtr>& iFields) const;
 
       std::vector<int> mTimes;
       vec2 getGridValues(int iVariable) const;
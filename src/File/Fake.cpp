@@ -22,27 +22,29 @@ FileFake::FileFake(const Options& iOptions) :
    if(!Util::isValid(mNTime) || mNTime <= 0) {
       Util::error("FileFake: Invalid number of times");
    }
-   mLats.resize(getNumLat());
+   vec2 lats, lons, elevs;
+   lats.resize(getNumLat());
    for(int i = 0; i < getNumLat(); i++) {
-      mLats[i].resize(getNumLon());
+      lats[i].resize(getNumLon());
       for(int j = 0; j < getNumLon(); j++) {
-         mLats[i][j] = 50 + 10.0 * i / getNumLat();
+         lats[i][j] = 50 + 10.0 * i / getNumLat();
       }
    }
-   mLons.resize(getNumLat());
+   lons.resize(getNumLat());
    for(int i = 0; i < getNumLat(); i++) {
-      mLons[i].resize(getNumLon());
+      lons[i].resize(getNumLon());
       for(int j = 0; j < getNumLon(); j++) {
-         mLons[i][j] = 0 + 10.0 * j / getNumLon();
+         lons[i][j] = 0 + 10.0 * j / getNumLon();
       }
    }
-   mElevs.resize(getNumLat());
+   elevs.resize(getNumLat());
    for(int i = 0; i < getNumLat(); i++) {
-      mElevs[i].resize(getNumLon());
+      elevs[i].resize(getNumLon());
       for(int j = 0; j < getNumLon(); j++) {
-         mElevs[i][j] = 0;
+         elevs[i][j] = 0;
       }
    }
+   setGrid(lats, lons, elevs);
    mLandFractions.resize(getNumLat());
    for(int i = 0; i < getNumLat(); i++) {
       mLandFractions[i].resize(getNumLon());
@@ -6,12 +6,25 @@
 #include <cmath>
 #include "../Util.h"
 #include "../Options.h"
-Uuid File::mNextTag = 0;
+#include <limits.h>
+#include <sys/stat.h>
+std::map<uint64_t, boost::weak_ptr<const vec2> > File::mSharedArrays;
 
 File::File(std::string iFilename, const Options& iOptions) :
       mFilename(iFilename),
-      mReferenceTime(Util::MV) {
-   createNewTag();
+      mLats(new vec2()),
+      mLons(new vec2()),
+      mElevs(new vec2()),
+      mTag(0),
+      mHasTag(false),
+      mReferenceTime(Util::MV),
+      mIsWriting(false) {
+   if(iOptions.getValue("fieldCache", mFieldCacheDirectory)) {
+      struct stat info;
+      if(stat(mFieldCacheDirectory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+         Util::error("Field cache directory '" + mFieldCacheDirectory + "' does not exist");
+      }
+   }
 }
 
 File* File::getScheme(std::string iFilename, const Options& iOptions, bool iReadOnly) {
@@ -21,7 +34,10 @@ File* File::getScheme(std::string iFilename, const Options& iOptions, bool iRead
    std::string type = "";
    if(!iOptions.getValue("type", type)) {
       // Autodetect type based on content
-      if(FileArome::isValid(iFilename)) {
+      if(FileRaw::isValid(iFilename)) {
+         type = "raw";
+      }
+      else if(FileArome::isValid(iFilename)) {
          type = "arome";
       }
       else if(FileEc::isValid(iFilename)) {
@@ -49,6 +65,9 @@ File* File::getScheme(std::string iFilename, const Options& iOptions, bool iRead
    else if(type == "point") {
       file = new FilePoint(iFilename, iOptions);
    }
+   else if(type == "raw") {
+      file = new FileRaw(iFilename, iOptions);
+   }
    else if(type == "text") {
       file = new FileText(iFilename, iOptions);
    }
@@ -82,7 +101,10 @@ FieldPtr File::getField(Variable::Type iVariable, int iTime) const {
    if(needsReading) {
       // Load non-derived variable from file
       if(hasVariableCore(iVariable)) {
-         mFields[iVariable][iTime] = getFieldCore(iVariable, iTime);
+         if(mFieldCacheDirectory != "")
+            mFields[iVariable][iTime] = getFieldFromCache(iVariable, iTime);
+         else
+            mFields[iVariable][iTime] = getFieldCore(iVariable, iTime);
       }
       // Try to derive the field
       else if(iVariable == Variable::Precip) {
@@ -260,6 +282,119 @@ void File::write(std::vector<Variable::Type> iVariables) {
    // mCache.clear();
 }
 
+FieldPtr File::getFieldFromCache(Variable::Type iVariable, int iTime) const {
+   std::map<Variable::Type, boost::shared_ptr<File> >::const_iterator it = mFieldCaches.find(iVariable);
+   if(it == mFieldCaches.end()) {
+      std::string filename = getFieldCacheFilename(iVariable);
+      boost::shared_ptr<File> cache;
+      if(FileRaw::isValid(filename)) {
+         cache.reset(new FileRaw(filename));
+         if(!cache->hasVariable(iVariable) || !hasSameDimensions(*cache)) {
+            Util::warning("Ignoring field cache '" + filename + "', since it does not match '" + getFilename() + "'");
+            cache.reset();
+         }
+      }
+      if(cache == NULL) {
+         // Decode all times once, so that later runs can use the cache
+         for(int t = 0; t < getNumTime(); t++) {
+            if(!isCached(iVariable, t))
+               addField(getFieldCore(iVariable, t), iVariable, t);
+         }
+         FileRaw::write(filename, *this, std::vector<Variable::Type>(1, iVariable));
+      }
+      it = mFieldCaches.insert(std::pair<Variable::Type, boost::shared_ptr<File> >(iVariable, cache)).first;
+   }
+   if(it->second == NULL) {
+      // The fields have been decoded in this run
+      if(isCached(iVariable, iTime))
+         return mFields[iVariable][iTime];
+      return getFieldCore(iVariable, iTime);
+   }
+   return it->second->getField(iVariable, iTime);
+}
+
+std::string File::getFieldCacheFilename(Variable::Type iVariable) const {
+   // Identify the file by its name, size and modification time
+   std::stringstream ss;
+   struct stat info;
+   char path[PATH_MAX];
+   if(realpath(getFilename().c_str(), path) != NULL)
+      ss << path;
+   else
+      ss << getFilename();
+   if(stat(getFilename().c_str(), &info) == 0)
+      ss << " " << info.st_size << " " << info.st_mtime;
+   ss << " " << name() << " " << Variable::getTypeName(iVariable);
+
+   // Include the grid, so that cropped files use other entries
+   uint64_t hash = Util::hash(ss.str(), getUniqueTag());
+   return mFieldCacheDirectory + "/" + Util::hashToString(hash) + ".raw";
+}
+
+bool File::crop(int iStartLat, int iEndLat, int iStartLon, int iEndLon) {
+   if(iStartLat < 0 || iStartLat > iEndLat || iEndLat >= getNumLat() ||
+         iStartLon < 0 || iStartLon > iEndLon || iEndLon >= getNumLon()) {
+      std::stringstream ss;
+      ss << "Cannot crop '" << getFilename() << "' to latitudes " << iStartLat << "-" << iEndLat
+         << " and longitudes " << iStartLon << "-" << iEndLon;
+      Util::error(ss.str());
+   }
+   if(mFields.size() > 0) {
+      Util::error("Cannot crop '" + getFilename() + "' after fields have been retrieved");
+   }
+   if(!cropCore(iStartLat, iStartLon))
+      return false;
+
+   mNLat = iEndLat - iStartLat + 1;
+   mNLon = iEndLon - iStartLon + 1;
+   vec2 lats(mNLat), lons(mNLat), elevs(mNLat), landFractions(mNLat);
+   for(int i = 0; i < mNLat; i++) {
+      lats[i].assign((*mLats)[iStartLat + i].begin() + iStartLon, (*mLats)[iStartLat + i].begin() + iEndLon + 1);
+      lons[i].assign((*mLons)[iStartLat + i].begin() + iStartLon, (*mLons)[iStartLat + i].begin() + iEndLon + 1);
+      elevs[i].assign((*mElevs)[iStartLat + i].begin() + iStartLon, (*mElevs)[iStartLat + i].begin() + iEndLon + 1);
+      if(iStartLat + i < mLandFractions.size() && iEndLon < mLandFractions[iStartLat + i].size())
+         landFractions[i].assign(mLandFractions[iStartLat + i].begin() + iStartLon, mLandFractions[iStartLat + i].begin() + iEndLon + 1);
+      else
+         landFractions[i].resize(mNLon, Util::MV);
+   }
+   setGrid(lats, lons, elevs);
+   mLandFractions = landFractions;
+   return true;
+}
+
+void File::setVariableOptions(Variable::Type iVariable, const Options& iOptions) {
+   mVariableOptions[iVariable] = iOptions;
+}
+
+Options File::getVariableOptions(Variable::Type iVariable) const {
+   std::map<Variable::Type, Options>::const_iterator it = mVariableOptions.find(iVariable);
+   if(it == mVariableOptions.end())
+      return Options();
+   return it->second;
+}
+
+bool File::startWrite(std::vector<Variable::Type> iVariables) {
+   std::vector<Variable::Type> newVariables;
+   for(int v = 0; v < iVariables.size(); v++) {
+      if(!hasVariableCore(iVariables[v]))
+         newVariables.push_back(iVariables[v]);
+   }
+   if(!startWriteCore(iVariables))
+      return false;
+   mIsWriting = true;
+   mUnwrittenVariables.insert(newVariables.begin(), newVariables.end());
+   return true;
+}
+
+void File::writeVariable(Variable::Type iVariable) {
+   if(!mIsWriting) {
+      Util::error("Cannot write variable '" + Variable::getTypeName(iVariable) + "' to '" + getFilename() + "' before startWrite is called");
+   }
+   writeVariableCore(iVariable);
+   mUnwrittenVariables.erase(iVariable);
+   mFields.erase(iVariable);
+}
+
 
 FieldPtr File::getEmptyField(float iFillValue) const {
    return getEmptyField(getNumLat(), getNumLon(), getNumEns(), iFillValue);
@@ -278,6 +413,13 @@ void File::addField(FieldPtr iField, Variable::Type iVariable, int iTime) const
    mFields[iVariable][iTime] = iField;
 }
 
+bool File::isCached(Variable::Type iVariable, int iTime) const {
+   std::map<Variable::Type, std::vector<FieldPtr> >::const_iterator it = mFields.find(iVariable);
+   if(it == mFields.end() || it->second.size() <= iTime)
+      return false;
+   return it->second[iTime] != NULL;
+}
+
 bool File::hasSameDimensions(const File& iOther) const {
    if(getNumLat() == iOther.getNumLat()
          && getNumLon() == iOther.getNumLon()
@@ -298,7 +440,8 @@ std::string File::getFilename() const {
 }
 
 void File::initNewVariable(Variable::Type iVariable) {
-   if(!hasVariable(iVariable)) {
+   // Variables defined by startWrite have no values in the file yet
+   if(!hasVariable(iVariable) || mUnwrittenVariables.count(iVariable) > 0) {
       for(int t = 0; t < getNumTime(); t++) {
          addField(getEmptyField(), iVariable, t);
       }
@@ -330,6 +473,7 @@ bool File::hasVariable(Variable::Type iVariable) const {
 }
 void File::clear() {
    mFields.clear();
+   mFieldCaches.clear();
 }
 
 long File::getCacheSize() const {
@@ -342,25 +486,52 @@ long File::getCacheSize() const {
 }
 
 Uuid File::getUniqueTag() const {
+   if(!mHasTag) {
+      mTag = Util::hash(*mLons, Util::hash(*mLats));
+      mHasTag = true;
+   }
    return mTag;
 }
+void File::setGrid(const vec2& iLats, const vec2& iLons, const vec2& iElevs) {
+   mLats = share(iLats);
+   mLons = share(iLons);
+   mElevs = share(iElevs);
+   mHasTag = false;
+}
+boost::shared_ptr<const vec2> File::share(const vec2& iValues) {
+   uint64_t hash = Util::hash(iValues);
+   std::map<uint64_t, boost::weak_ptr<const vec2> >::iterator it = mSharedArrays.find(hash);
+   if(it != mSharedArrays.end()) {
+      boost::shared_ptr<const vec2> values = it->second.lock();
+      if(values != NULL && *values == iValues)
+         return values;
+   }
+   // Remove arrays no longer used by any file
+   for(it = mSharedArrays.begin(); it != mSharedArrays.end(); ) {
+      if(it->second.expired())
+         mSharedArrays.erase(it++);
+      else
+         it++;
+   }
+   boost::shared_ptr<const vec2> values(new vec2(iValues));
+   mSharedArrays[hash] = values;
+   return values;
+}
 bool File::setLats(vec2 iLats) {
    if(iLats.size() != mNLat || iLats[0].size() != mNLon)
       return false;
-   if(mLats != iLats)
-      createNewTag();
-   mLats = iLats;
+   if(*mLats != iLats) {
+      mLats = share(iLats);
+      mHasTag = false;
+   }
    return true;
 }
 bool File::setLons(vec2 iLons) {
    if(iLons.size() != mNLat || iLons[0].size() != mNLon)
       return false;
-   if(mLons != iLons)
-      createNewTag();
-   mLons = iLons;
-   for(int i = 0; i < mLons.size(); i++) {
-      for(int j = 0; j < mLons[i].size(); j++) {
-         float lon = mLons[i][j];
+   for(int i = 0; i < iLons.size(); i++) {
+      for(int j = 0; j < iLons[i].size(); j++) {
+         float lon = iLons[i][j];
          if(Util::isValid(lon)) {
             // Ensure lon is between -180 and 180
             int sign = lon / fabs(lon);
@@ -371,18 +542,21 @@ bool File::setLons(vec2 iLons) {
                lon = lon - 360;
             else if(lon < -180)
                lon = lon + 360;
-            mLons[i][j] = lon;
-            assert(mLons[i][j] >= -180.0001 && mLons[i][j] <= 180.0001);
+            iLons[i][j] = lon;
+            assert(iLons[i][j] >= -180.0001 && iLons[i][j] <= 180.0001);
          }
       }
    }
-
+   if(*mLons != iLons) {
+      mLons = share(iLons);
+      mHasTag = false;
+   }
    return true;
 }
 bool File::setElevs(vec2 iElevs) {
    if(iElevs.size() != mNLat || iElevs[0].size() != mNLon)
       return false;
-   mElevs = iElevs;
+   mElevs = share(iElevs);
    return true;
 }
 bool File::setLandFractions(vec2 iLandFractions) {
@@ -392,13 +566,16 @@ bool File::setLandFractions(vec2 iLandFractions) {
    return true;
 }
 vec2 File::getLats() const {
-   return mLats;
+   return *mLats;
 }
 vec2 File::getLons() const {
-   return mLons;
+   return *mLons;
 }
 vec2 File::getElevs() const {
-   return mElevs;
+   return *mElevs;
+}
+bool File::getProjectedIndices(float iLat, float iLon, float& iI, float& iJ) const {
+   return false;
 }
 vec2 File::getLandFractions() const {
    return mLandFractions;
@@ -415,10 +592,6 @@ int File::getNumEns() const {
 int File::getNumTime() const {
    return mNTime;
 }
-void File::createNewTag() const {
-   mTag = mNextTag; //boost::uuids::random_generator()();
-   mNextTag++;
-}
 void File::setReferenceTime(double iTime) {
    mReferenceTime = iTime;
 }
@@ -445,5 +618,7 @@ std::string File::getDescriptions() {
    ss << FilePoint::description();
    ss << FileNorcomQnh::description();
    ss << FileText::description();
+   ss << FileRaw::description();
+   ss << Util::formatDescription("fieldCache=undef", "Store the decoded fields of an input file in this (existing) directory, so that later runs on the same file can use them without decoding. Can be used with all types.") << std::endl;
    return ss.str();
 }
@@ -2,12 +2,13 @@
 #define FILE_H
 #include <vector>
 #include <map>
+#include <set>
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 #include "../Variable.h"
 #include "../Uuid.h"
 #include "../Field.h"
-
-class Options;
+#include "../Options.h"
 
 // 3D array of data: [lat][lon][ensemble_member]
 typedef std::vector<std::vector<float> > vec2; // Lat, Lon
@@ -32,6 +33,23 @@ class File {
       // Write these variables to file
       void write(std::vector<Variable::Type> iVariables);
 
+      //! Restrict the file to the part of its grid with latitude indices iStartLat to iEndLat and
+      //! longitude indices iStartLon to iEndLon (inclusive), so that only this part is read. Must
+      //! be called before any fields are retrieved.
+      //! @return false if the file cannot be cropped
+      bool crop(int iStartLat, int iEndLat, int iStartLon, int iEndLon);
+
+      //! Set options that control how a variable is stored when it is written, such as packing
+      void setVariableOptions(Variable::Type iVariable, const Options& iOptions);
+
+      //! Prepare the file for writing these variables one at a time with writeVariable, so that
+      //! each variable can be written as soon as its fields are final.
+      //! @return false if the file does not support this, in which case write must be used
+      bool startWrite(std::vector<Variable::Type> iVariables);
+      //! Write all times of a variable passed to startWrite and remove its fields from the cache.
+      //! The fields are read back from the file if they are needed later.
+      void writeVariable(Variable::Type iVariable);
+
       // Dimension sizes
       int getNumLat() const;
       int getNumLon() const;
@@ -61,9 +79,9 @@ class File {
       //! @return Number of bytes
       long getCacheSize() const;
 
-      //! Returns a tag that uniquely identifies the latitude/longitude grid
-      //! If the grid changes, a new tag is issued. Two files with the same grid
-      //! will not have the same unique tag.
+      //! Returns a tag that identifies the latitude/longitude grid. The tag is a hash of the
+      //! latitudes and longitudes, so two files with the same grid have the same tag. If the grid
+      //! changes, a new tag is issued.
       Uuid getUniqueTag() const;
 
       //! Set the time that the file is issued
@@ -75,17 +93,35 @@ class File {
       void setTimes(std::vector<double> iTimes);
       std::vector<double> getTimes() const;
       static std::string getDescriptions();
+
+      //! Compute the fractional indices into the grid of the location iLat/iLon, for files that
+      //! know the projection of their grid. Indices are not limited to the extent of the grid.
+      //! @return false if the projection is not known
+      virtual bool getProjectedIndices(float iLat, float iLon, float& iI, float& iJ) const;
    protected:
       virtual FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const = 0;
       // File must save variables, but also altitudes, in case they got changed
       virtual void writeCore(std::vector<Variable::Type> iVariables) = 0;
       //! Can the subclass provide this variable?
       virtual bool hasVariableCore(Variable::Type iVariable) const = 0;
+      //! Subclasses that can read part of their grid override this. The indices are relative to the
+      //! current grid, which may already be cropped.
+      virtual bool cropCore(int iStartLat, int iStartLon) {return false;};
+      //! Subclasses that can write one variable at a time override these
+      virtual bool startWriteCore(std::vector<Variable::Type> iVariables) {return false;};
+      virtual void writeVariableCore(Variable::Type iVariable) {};
+
+      //! Options set by setVariableOptions. Empty if none are set.
+      Options getVariableOptions(Variable::Type iVariable) const;
+
+      //! Has the field for this variable and time already been retrieved or computed?
+      bool isCached(Variable::Type iVariable, int iTime) const;
+
+      //! Set the lat/lon/elev grids, without any checks or conversions. Subclasses must call this
+      //! in the constructor.
+      void setGrid(const vec2& iLats, const vec2& iLons, const vec2& iElevs);
 
       // Subclasses must fill these fields in the constructor:
-      vec2 mLats;
-      vec2 mLons;
-      vec2 mElevs;
       vec2 mLandFractions;
       int mNTime;
       int mNLat;
@@ -94,16 +130,38 @@ class File {
    private:
       std::string mFilename;
       mutable std::map<Variable::Type, std::vector<FieldPtr> > mFields;  // Variable, offset
+      //! Read the field from the field cache, decoding all times of the variable and storing them
+      //! in the cache if they are not there yet
+      FieldPtr getFieldFromCache(Variable::Type iVariable, int iTime) const;
+      //! Name of the cache file for the variable. Changes when the file is modified.
+      std::string getFieldCacheFilename(Variable::Type iVariable) const;
+      // Directory with decoded fields, "" if the field cache is disabled
+      std::string mFieldCacheDirectory;
+      // Opened cache files for each variable
+      mutable std::map<Variable::Type, boost::shared_ptr<File> > mFieldCaches;
+      // Files with identical lats, lons, or elevs share the same array
+      boost::shared_ptr<const vec2> mLats;
+      boost::shared_ptr<const vec2> mLons;
+      boost::shared_ptr<const vec2> mElevs;
+      // The tag is computed when first needed
       mutable Uuid mTag;
-      void createNewTag() const;
+      mutable bool mHasTag;
+      //! Returns an array with the values in iValues, reusing the array of another file if the
+      //! values are identical
+      static boost::shared_ptr<const vec2> share(const vec2& iValues);
+      static std::map<uint64_t, boost::weak_ptr<const vec2> > mSharedArrays;
       FieldPtr getEmptyField(int nLat, int nLon, int nEns, float iFillValue=Util::MV) const;
       double mReferenceTime;
       std::vector<double> mTimes;
-      static Uuid mNextTag;
+      std::map<Variable::Type, Options> mVariableOptions;
+      bool mIsWriting;
+      // Variables created by startWrite that have not been written yet
+      std::set<Variable::Type> mUnwrittenVariables;
 };
 #include "Netcdf.h"
 #include "Fake.h"
 #include "Point.h"
 #include "NorcomQnh.h"
 #include "Text.h"
+#include "Raw.h"
 #endif
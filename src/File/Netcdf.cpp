@@ -3,15 +3,41 @@
 #include <math.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <string.h>
+#include <float.h>
 #include "../Util.h"
+#include "../Options.h"
 
 FileNetcdf::FileNetcdf(std::string iFilename, const Options& iOptions, bool iReadOnly) :
       File(iFilename, iOptions),
-      mInDataMode(true) {
+      mInDataMode(true),
+      mCropLat(0),
+      mCropLon(0),
+      mIsCropped(false),
+      mDeflateLevel(0),
+      mShuffle(true),
+      mChunkLat(Util::MV),
+      mChunkLon(Util::MV),
+      mNumDigits(Util::MV) {
    int status = nc_open(getFilename().c_str(), iReadOnly ? NC_NOWRITE: NC_WRITE, &mFile);
    if(status != NC_NOERR) {
       Util::error("Could not open NetCDF file " + getFilename());
    }
+   iOptions.getValue("deflate", mDeflateLevel);
+   iOptions.getValue("shuffle", mShuffle);
+   iOptions.getValue("chunkLat", mChunkLat);
+   iOptions.getValue("chunkLon", mChunkLon);
+   iOptions.getValue("digits", mNumDigits);
+   if(mDeflateLevel < 0 || mDeflateLevel > 9) {
+      Util::error("'deflate' must be between 0 and 9");
+   }
+   if((Util::isValid(mChunkLat) && mChunkLat <= 0) || (Util::isValid(mChunkLon) && mChunkLon <= 0)) {
+      Util::error("'chunkLat' and 'chunkLon' must be positive");
+   }
+   if(Util::isValid(mNumDigits) && mNumDigits <= 0) {
+      Util::error("'digits' must be positive");
+   }
 }
 
 FileNetcdf::~FileNetcdf() {
@@ -43,6 +69,450 @@ float FileNetcdf::getOffset(int iVar) const {
    return offset;
 }
 
+const FileNetcdf::VariableInfo& FileNetcdf::getVariableInfo(std::string iVariable) const {
+   std::map<std::string, VariableInfo>::const_iterator it = mVariableInfo.find(iVariable);
+   if(it != mVariableInfo.end())
+      return it->second;
+
+   VariableInfo& info = mVariableInfo[iVariable];
+   info.id = getVar(iVariable);
+   int numDims = getNumDims(info.id);
+   std::vector<int> dims(numDims);
+   if(numDims > 0) {
+      int status = nc_inq_vardimid(mFile, info.id, &dims[0]);
+      handleNetcdfError(status, "could not get dimensions of '" + iVariable + "'");
+   }
+   info.dimSizes.resize(numDims);
+   for(int d = 0; d < numDims; d++) {
+      info.dimSizes[d] = getDimSize(dims[d]);
+   }
+   nc_inq_vartype(mFile, info.id, &info.type);
+   info.scale = getScale(info.id);
+   info.offset = getOffset(info.id);
+   info.missingValue = getMissingValue(info.id);
+   int attribute;
+   if(nc_inq_attid(mFile, info.id, "_FillValue", &attribute) != NC_NOERR) {
+      // Use the default fill value for packed types
+      if(info.type == NC_SHORT)
+         info.missingValue = NC_FILL_SHORT;
+      else if(info.type == NC_BYTE)
+         info.missingValue = NC_FILL_BYTE;
+   }
+   info.numChunkTimes = 1;
+
+   int storage;
+   std::vector<size_t> chunkSizes(numDims);
+   if(numDims > 0 && nc_inq_var_chunking(mFile, info.id, &storage, &chunkSizes[0]) == NC_NOERR && storage == NC_CHUNKED) {
+      info.numChunkTimes = std::max(1, (int) chunkSizes[0]);
+      // Make room in the cache for all chunks that cover one time, so that no chunk has to be
+      // decompressed twice when the times of a chunk are read
+      size_t chunkBytes = getTypeSize(info.type);
+      size_t numChunks = 1;
+      for(int d = 0; d < numDims; d++) {
+         chunkBytes *= chunkSizes[d];
+         if(d > 0)
+            numChunks *= (info.dimSizes[d] + chunkSizes[d] - 1) / chunkSizes[d];
+      }
+      size_t cacheSize, cacheElements;
+      float preemption;
+      if(nc_get_var_chunk_cache(mFile, info.id, &cacheSize, &cacheElements, &preemption) == NC_NOERR) {
+         if(cacheSize < numChunks * chunkBytes || cacheElements < numChunks) {
+            nc_set_var_chunk_cache(mFile, info.id, std::max(cacheSize, numChunks * chunkBytes),
+                  std::max(cacheElements, numChunks), preemption);
+         }
+      }
+   }
+   return info;
+}
+
+FieldPtr FileNetcdf::getFieldCore(Variable::Type iVariable, int iTime) const {
+   if(iTime < 0 || iTime >= mNTime) {
+      std::stringstream ss;
+      ss << "Cannot read time " << iTime << " from '" << getFilename() << "'";
+      Util::error(ss.str());
+   }
+   std::string variable = getVariableName(iVariable);
+   const VariableInfo& info = getVariableInfo(variable);
+   int startTime = iTime - iTime % info.numChunkTimes;
+   int numTimes = std::min(info.numChunkTimes, mNTime - startTime);
+
+   // Don't read times at the start and end of the chunk that are already cached
+   while(startTime < iTime && isCached(iVariable, startTime)) {
+      startTime++;
+      numTimes--;
+   }
+   while(startTime + numTimes - 1 > iTime && isCached(iVariable, startTime + numTimes - 1)) {
+      numTimes--;
+   }
+
+   std::vector<FieldPtr> fields;
+   readFields(variable, startTime, numTimes, fields);
+   for(int t = 0; t < numTimes; t++) {
+      // Cached fields may have been modified, so do not overwrite them
+      if(startTime + t != iTime && !isCached(iVariable, startTime + t))
+         addField(fields[t], iVariable, startTime + t);
+   }
+   return fields[iTime - startTime];
+}
+
+void FileNetcdf::readFieldValues(const VariableInfo& iInfo, int iStartTime, int iNumTimes, std::vector<size_t> iCount, std::vector<FieldPtr>& iFields) const {
+   startDataMode();
+   int numDims = iCount.size();
+   std::vector<size_t> start(numDims, 0);
+   start[0] = iStartTime;
+   iCount[0] = iNumTimes;
+   if(numDims >= 3) {
+      start[numDims-2] = mCropLat;
+      start[numDims-1] = mCropLon;
+   }
+   long numMembers = 1;
+   for(int d = 1; d < numDims - 2; d++) {
+      numMembers *= iCount[d];
+   }
+   long numPoints = numDims < 3 ? 0 : iCount[numDims-2] * iCount[numDims-1];
+   if(numMembers != mNEns || numPoints != (long) mNLat * mNLon) {
+      std::stringstream ss;
+      ss << "Cannot read fields from variable with " << numDims << " dimensions in '" << getFilename() << "'";
+      Util::error(ss.str());
+   }
+
+   iFields.resize(iNumTimes);
+   std::vector<float*> outputs(iNumTimes);
+   for(int t = 0; t < iNumTimes; t++) {
+      iFields[t] = getEmptyField();
+      outputs[t] = iFields[t]->getData();
+   }
+   if(iNumTimes == 0 || numPoints == 0 || numMembers == 0)
+      return;
+
+   // Packed variables are read in their own type, to avoid converting them to floats twice
+   int status;
+   long size = iNumTimes * numMembers * numPoints;
+   if(iInfo.type == NC_SHORT) {
+      std::vector<short> values(size);
+      status = nc_get_vara_short(mFile, iInfo.id, &start[0], &iCount[0], &values[0]);
+      handleNetcdfError(status, "could not read variable");
+      decodeFields(&values[0], iNumTimes, numMembers, numPoints, (short) iInfo.missingValue, iInfo.scale, iInfo.offset, outputs);
+   }
+   else if(iInfo.type == NC_BYTE) {
+      std::vector<signed char> values(size);
+      status = nc_get_vara_schar(mFile, iInfo.id, &start[0], &iCount[0], &values[0]);
+      handleNetcdfError(status, "could not read variable");
+      decodeFields(&values[0], iNumTimes, numMembers, numPoints, (signed char) iInfo.missingValue, iInfo.scale, iInfo.offset, outputs);
+   }
+   else {
+      std::vector<float> values(size);
+      status = nc_get_vara_float(mFile, iInfo.id, &start[0], &iCount[0], &values[0]);
+      handleNetcdfError(status, "could not read variable");
+      decodeFields(&values[0], iNumTimes, numMembers, numPoints, iInfo.missingValue, iInfo.scale, iInfo.offset, outputs);
+   }
+}
+
+template <class T> void FileNetcdf::decodeFields(const T* iValues, int iNumTimes, long iNumMembers, long iNumPoints,
+      T iMissingValue, float iScale, float iOffset, const std::vector<float*>& iOutputs) {
+   float MV = Util::MV;
+   // Points are processed in blocks that fit in the cache
+   long blockSize = 256;
+   long numBlocks = (iNumPoints + blockSize - 1) / blockSize;
+   for(int t = 0; t < iNumTimes; t++) {
+      const T* input = iValues + t * iNumMembers * iNumPoints;
+      float* output = iOutputs[t];
+      #pragma omp parallel for
+      for(long b = 0; b < numBlocks; b++) {
+         long startPoint = b * blockSize;
+         long endPoint = std::min(startPoint + blockSize, iNumPoints);
+         if(iNumMembers == 1) {
+            // Same layout in the file and in the field. Unpack all values first, without
+            // branches so that the loop can be vectorised, then set the missing values.
+            for(long p = startPoint; p < endPoint; p++) {
+               output[p] = iScale * input[p] + iOffset;
+            }
+            for(long p = startPoint; p < endPoint; p++) {
+               if(input[p] == iMissingValue)
+                  output[p] = MV;
+            }
+         }
+         else {
+            // The file has all points of one member after each other, but fields have all
+            // members of one point after each other. The block of the field stays in the cache
+            // while each member is written.
+            for(long e = 0; e < iNumMembers; e++) {
+               const T* memberInput = input + e * iNumPoints;
+               for(long p = startPoint; p < endPoint; p++) {
+                  T value = memberInput[p];
+                  output[p * iNumMembers + e] = value == iMissingValue ? MV : iScale * value + iOffset;
+               }
+            }
+         }
+      }
+   }
+}
+
+bool FileNetcdf::cropCore(int iStartLat, int iStartLon) {
+   mCropLat += iStartLat;
+   mCropLon += iStartLon;
+   mIsCropped = true;
+   return true;
+}
+
+void FileNetcdf::writeCore(std::vector<Variable::Type> iVariables) {
+   if(mIsCropped) {
+      Util::error("Cannot write to '" + getFilename() + "' since only part of its grid is read");
+   }
+   defineVariables(iVariables);
+   for(int v = 0; v < iVariables.size(); v++) {
+      writeVariableCore(iVariables[v]);
+   }
+}
+
+bool FileNetcdf::startWriteCore(std::vector<Variable::Type> iVariables) {
+   if(mIsCropped) {
+      Util::error("Cannot write to '" + getFilename() + "' since only part of its grid is read");
+   }
+   defineVariables(iVariables);
+   return true;
+}
+
+void FileNetcdf::writeVariableCore(Variable::Type iVariable) {
+   assert(hasVariableCore(iVariable));
+   startDataMode();
+   mClampedVariables.erase(iVariable);
+   for(int t = 0; t < mNTime; t++) {
+      FieldPtr field = getField(iVariable, t);
+      if(field != NULL) { // TODO: Can't be null if coming from reference
+         writeField(iVariable, t, *field);
+      }
+   }
+}
+
+int FileNetcdf::defineVariable(Variable::Type iVariable, const std::vector<int>& iDims) {
+   std::string variable = getVariableName(iVariable);
+   Options options = getVariableOptions(iVariable);
+   std::string packing = "float";
+   options.getValue("packing", packing);
+   int type = NC_FLOAT;
+   // Largest stored value. The smallest value of the type is kept for the fill value.
+   float limit = 0;
+   if(packing == "float") {
+      type = NC_FLOAT;
+   }
+   else if(packing == "short") {
+      type = NC_SHORT;
+      limit = 32766;
+   }
+   else if(packing == "byte") {
+      type = NC_BYTE;
+      limit = 126;
+   }
+   else {
+      Util::error("Cannot write '" + variable + "' with packing '" + packing + "'. Must be one of float, short, or byte.");
+   }
+
+   int var = Util::MV;
+   int status = nc_def_var(mFile, variable.c_str(), type, iDims.size(), &iDims[0], &var);
+   handleNetcdfError(status, "could not define variable '" + variable + "'");
+
+   if(type != NC_FLOAT) {
+      float min = Variable::getMin(iVariable);
+      float max = Variable::getMax(iVariable);
+      float precision = Util::MV;
+      options.getValue("precision", precision);
+      float scale;
+      float offset;
+      if(Util::isValid(precision)) {
+         if(precision <= 0) {
+            Util::error("'precision' must be positive");
+         }
+         // Center the stored range on the range of the variable, when it is known
+         scale = precision;
+         if(Util::isValid(min) && Util::isValid(max))
+            offset = (min + max) / 2;
+         else if(Util::isValid(min))
+            offset = min + limit * scale;
+         else if(Util::isValid(max))
+            offset = max - limit * scale;
+         else
+            offset = 0;
+      }
+      else {
+         if(!Util::isValid(min) || !Util::isValid(max)) {
+            Util::error("Cannot pack '" + variable + "' without 'precision', since the variable has no lower or upper limit");
+         }
+         scale = (max - min) / (2 * limit);
+         offset = (min + max) / 2;
+      }
+      status = nc_put_att_float(mFile, var, "scale_factor", NC_FLOAT, 1, &scale);
+      handleNetcdfError(status, "could not set scale_factor");
+      status = nc_put_att_float(mFile, var, "add_offset", NC_FLOAT, 1, &offset);
+      handleNetcdfError(status, "could not set add_offset");
+   }
+   defineStorage(var);
+   return var;
+}
+
+void FileNetcdf::writeFieldValues(Variable::Type iVariable, const VariableInfo& iInfo, int iTime, std::vector<size_t> iCount, const float* iValues) {
+   std::vector<size_t> start(iCount.size(), 0);
+   start[0] = iTime;
+   iCount[0] = 1;
+   long numValues = 1;
+   for(int d = 1; d < iCount.size(); d++) {
+      numValues *= iCount[d];
+   }
+
+   int status;
+   long numClamped = 0;
+   if(iInfo.type == NC_SHORT) {
+      std::vector<short> values(numValues);
+      numClamped = encodeValues(iValues, numValues, iInfo.scale, iInfo.offset, 32766, 0.5, (short) iInfo.missingValue, &values[0]);
+      status = nc_put_vara_short(mFile, iInfo.id, &start[0], &iCount[0], &values[0]);
+   }
+   else if(iInfo.type == NC_BYTE) {
+      std::vector<signed char> values(numValues);
+      numClamped = encodeValues(iValues, numValues, iInfo.scale, iInfo.offset, 126, 0.5, (signed char) iInfo.missingValue, &values[0]);
+      status = nc_put_vara_schar(mFile, iInfo.id, &start[0], &iCount[0], &values[0]);
+   }
+   else {
+      std::vector<float> values(numValues);
+      numClamped = encodeValues(iValues, numValues, iInfo.scale, iInfo.offset, FLT_MAX, 0, iInfo.missingValue, &values[0]);
+      roundValues(&values[0], numValues, iInfo.missingValue, getNumDigits(iVariable));
+      status = nc_put_vara_float(mFile, iInfo.id, &start[0], &iCount[0], &values[0]);
+   }
+   handleNetcdfError(status, "could not write values");
+
+   if(numClamped > 0 && mClampedVariables.find(iVariable) == mClampedVariables.end()) {
+      std::stringstream ss;
+      ss << numClamped << " values of '" << Variable::getTypeName(iVariable) << "' at time " << iTime
+         << " are outside the range that can be stored in '" << getFilename()
+         << "' and are set to the nearest value that can";
+      Util::warning(ss.str());
+      mClampedVariables.insert(iVariable);
+   }
+}
+
+template <class T> long FileNetcdf::encodeValues(const float* iValues, long iNumValues, float iScale, float iOffset,
+      float iLimit, float iRounding, T iMissingValue, T* oValues) {
+   float inverseScale = 1 / iScale;
+   long blockSize = 4096;
+   long numBlocks = (iNumValues + blockSize - 1) / blockSize;
+   long numClamped = 0;
+   #pragma omp parallel for reduction(+:numClamped)
+   for(long b = 0; b < numBlocks; b++) {
+      long start = b * blockSize;
+      long end = std::min(start + blockSize, iNumValues);
+      // The same arithmetic is done for every value, including missing ones, which are
+      // overwritten in a second pass over the block
+      for(long i = start; i < end; i++) {
+         float value = (iValues[i] - iOffset) * inverseScale;
+         value = std::min(std::max(value, -iLimit), iLimit);
+         oValues[i] = (T) (value + copysignf(iRounding, value));
+      }
+      for(long i = start; i < end; i++) {
+         if(!Util::isValid(iValues[i]))
+            oValues[i] = iMissingValue;
+         else if(fabs((iValues[i] - iOffset) * inverseScale) >= iLimit + iRounding)
+            numClamped++;
+      }
+   }
+   return numClamped;
+}
+
+void FileNetcdf::defineStorage(int iVar) const {
+   bool hasCompression = mDeflateLevel > 0;
+   bool hasChunking = Util::isValid(mChunkLat) || Util::isValid(mChunkLon);
+   int format;
+   int status = nc_inq_format(mFile, &format);
+   handleNetcdfError(status, "could not determine the format of the file");
+   if(format != NC_FORMAT_NETCDF4 && format != NC_FORMAT_NETCDF4_CLASSIC) {
+      if(hasCompression || hasChunking)
+         Util::warning("Cannot chunk or compress variables in '" + getFilename() + "', since it is not a NetCDF-4 file");
+      return;
+   }
+
+   int numDims = getNumDims(iVar);
+   if(numDims < 3)
+      return;
+   std::vector<int> dims(numDims);
+   status = nc_inq_vardimid(mFile, iVar, &dims[0]);
+   handleNetcdfError(status, "could not get dimensions of variable");
+
+   // One time in each chunk, so that each time is compressed as soon as it is written
+   std::vector<size_t> chunkSizes(numDims);
+   chunkSizes[0] = 1;
+   for(int d = 1; d < numDims; d++) {
+      chunkSizes[d] = getDimSize(dims[d]);
+   }
+   if(Util::isValid(mChunkLat))
+      chunkSizes[numDims-2] = std::min((size_t) mChunkLat, chunkSizes[numDims-2]);
+   if(Util::isValid(mChunkLon))
+      chunkSizes[numDims-1] = std::min((size_t) mChunkLon, chunkSizes[numDims-1]);
+   status = nc_def_var_chunking(mFile, iVar, NC_CHUNKED, &chunkSizes[0]);
+   handleNetcdfError(status, "could not set chunk sizes");
+
+   if(hasCompression) {
+      status = nc_def_var_deflate(mFile, iVar, mShuffle, 1, mDeflateLevel);
+      handleNetcdfError(status, "could not set compression");
+   }
+}
+
+int FileNetcdf::getNumDigits(Variable::Type iVariable) const {
+   int numDigits = mNumDigits;
+   getVariableOptions(iVariable).getValue("digits", numDigits);
+   if(Util::isValid(numDigits) && numDigits <= 0) {
+      Util::error("'digits' must be positive for variable '" + Variable::getTypeName(iVariable) + "'");
+   }
+   return numDigits;
+}
+
+void FileNetcdf::roundValues(float* iValues, long iNumValues, float iMissingValue, int iNumDigits) {
+   if(!Util::isValid(iNumDigits))
+      return;
+   // Number of bits in the mantissa needed to represent the digits
+   int keepBits = ceil(iNumDigits * log(10.0) / log(2.0));
+   if(keepBits >= 23)
+      return;
+   // Round to nearest by adding half of the last kept bit, then clear the remaining bits
+   uint32_t half = 1u << (22 - keepBits);
+   uint32_t mask = ~((1u << (23 - keepBits)) - 1);
+   #pragma omp parallel for
+   for(long i = 0; i < iNumValues; i++) {
+      float value = iValues[i];
+      if(value != iMissingValue && Util::isValid(value)) {
+         uint32_t bits;
+         memcpy(&bits, &value, sizeof(float));
+         bits = (bits + half) & mask;
+         memcpy(&iValues[i], &bits, sizeof(float));
+      }
+   }
+}
+
+std::string FileNetcdf::description() {
+   std::stringstream ss;
+   ss << Util::formatDescription("deflate=0", "Compression level (0-9) for new variables. 0 means no compression. Requires a NetCDF-4 output file. The NetCDF library compresses each chunk as it is written, so compression makes writing slower.") << std::endl;
+   ss << Util::formatDescription("shuffle=1", "Shuffle the bytes of the values before compressing them. Usually makes the file smaller.") << std::endl;
+   ss << Util::formatDescription("chunkLat=undef", "Number of latitudes in each chunk of new variables. Each chunk contains one time. If unspecified, chunks cover the whole grid.") << std::endl;
+   ss << Util::formatDescription("chunkLon=undef", "Number of longitudes in each chunk of new variables.") << std::endl;
+   ss << Util::formatDescription("digits=undef", "Round written values to this many significant digits, so that they compress better. Variables can override this with their own 'digits' option. If unspecified, values are not rounded.") << std::endl;
+   return ss.str();
+}
+
+int FileNetcdf::getTypeSize(int iType) {
+   switch(iType) {
+      case NC_BYTE:
+      case NC_CHAR:
+      case NC_UBYTE:
+         return 1;
+      case NC_SHORT:
+      case NC_USHORT:
+         return 2;
+      case NC_DOUBLE:
+      case NC_INT64:
+      case NC_UINT64:
+         return 8;
+      default:
+         return 4;
+   }
+}
+
 int FileNetcdf::getDim(std::string iDim) const {
    int dim;
    int status = nc_inq_dimid(mFile, iDim.c_str(), &dim);
@@ -117,8 +587,13 @@ void FileNetcdf::setMissingValue(int iVar, float iValue) const {
    // In HDF5 1.8.0 through HDF5 1.8.4" on
    // http://www.hdfgroup.org/HDF5/release/known_problems/index.html
    // Does this still apply when using the C-interface to NetCDF?
+   mVariableInfo.clear();
    if(iValue != NC_FILL_FLOAT) {
-      int status = nc_put_att(mFile, iVar, "_FillValue", NC_FLOAT, 1, &iValue);
+      // The fill value must have the same type as the variable
+      int type;
+      int status = nc_inq_vartype(mFile, iVar, &type);
+      handleNetcdfError(status, "could not get the type of a variable");
+      status = nc_put_att_float(mFile, iVar, "_FillValue", type, 1, &iValue);
       handleNetcdfError(status, "could not set missing value flag");
    }
 }
@@ -130,6 +605,7 @@ void FileNetcdf::setAttribute(std::string iVariable, std::string iName, std::str
 
 void FileNetcdf::setAttribute(int iVar, std::string iName, std::string iValue) {
    startDefineMode();
+   mVariableInfo.clear();
    int status = nc_put_att_text(mFile, iVar,iName.c_str(), iValue.size(), iValue.c_str());
    handleNetcdfError(status, "could not set attribute");
 }
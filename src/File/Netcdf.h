@@ -2,6 +2,7 @@
 #define FILE_NETCDF_H
 #include <vector>
 #include <map>
+#include <set>
 #include <boost/shared_ptr.hpp>
 #include "File.h"
 #include "../Variable.h"
@@ -32,7 +33,83 @@ class FileNetcdf : public File {
 
       //! Get global string attribute. Returns "" if non-existant.
       std::string getGlobalAttribute(std::string iName);
+
+      //! Options controlling how new variables are stored, shared by all NetCDF formats
+      static std::string description();
    protected:
+      //! Information needed to read a variable, looked up once for each variable
+      struct VariableInfo {
+         int id;
+         //! NetCDF type of the stored values
+         int type;
+         //! Size of each dimension of the variable
+         std::vector<size_t> dimSizes;
+         float scale;
+         float offset;
+         float missingValue;
+         //! Number of times in each chunk (1 if the variable is not chunked)
+         int numChunkTimes;
+      };
+      //! Look up the variable the first time it is used. The chunk cache of chunked variables is
+      //! made large enough to hold all chunks covering one time.
+      const VariableInfo& getVariableInfo(std::string iVariable) const;
+
+      //! Returns the field for time iTime. The other times in the same chunk are read in the same
+      //! call and added to the cache, since the whole chunk must be decompressed anyway.
+      FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const;
+      //! Read the fields for times iStartTime to iStartTime + iNumTimes - 1
+      virtual void readFields(std::string iVariable, int iStartTime, int iNumTimes, std::vector<FieldPtr>& iFields) const = 0;
+      //! Read iNumTimes fields starting at iStartTime from a variable with time as the first
+      //! dimension and latitude and longitude as the last two. Dimensions in between are combined
+      //! into the ensemble dimension. The other dimensions are read from index 0, with iCount[d]
+      //! values for dimension d (iCount[0] is ignored). Missing values are converted to Util::MV
+      //! and packed values are unpacked.
+      void readFieldValues(const VariableInfo& iInfo, int iStartTime, int iNumTimes, std::vector<size_t> iCount, std::vector<FieldPtr>& iFields) const;
+      //! Unpack values ordered by time, member, and point into the fields of each time
+      template <class T> static void decodeFields(const T* iValues, int iNumTimes, long iNumMembers, long iNumPoints,
+            T iMissingValue, float iScale, float iOffset, const std::vector<float*>& iOutputs);
+
+      //! Fields are read from the cropped part of the grid. Files that are cropped cannot be written.
+      bool cropCore(int iStartLat, int iStartLon);
+
+      //! Writes each variable one time at a time
+      void writeCore(std::vector<Variable::Type> iVariables);
+      bool startWriteCore(std::vector<Variable::Type> iVariables);
+      void writeVariableCore(Variable::Type iVariable);
+      //! Define the variables and their attributes, and write the times and the grid, so that the
+      //! fields can be written afterwards without going back to define mode
+      virtual void defineVariables(std::vector<Variable::Type> iVariables) = 0;
+      //! Write the field of a defined variable for time iTime
+      virtual void writeField(Variable::Type iVariable, int iTime, const Field& iField) = 0;
+
+      //! Create a new variable with dimensions iDims. The variable is stored as given by the
+      //! 'packing' and 'precision' options of the variable (see File::setVariableOptions).
+      //! @return Id of the new variable
+      int defineVariable(Variable::Type iVariable, const std::vector<int>& iDims);
+      //! Write the values of one time to a variable, with time as the first dimension. iValues are
+      //! ordered as in the file and use Util::MV for missing values. Values are packed to the
+      //! type of the variable using its scale and offset, and float values are rounded to the
+      //! digits set for iVariable. Values that cannot be stored are set to the nearest value that
+      //! can, with a warning.
+      void writeFieldValues(Variable::Type iVariable, const VariableInfo& iInfo, int iTime, std::vector<size_t> iCount, const float* iValues);
+      //! Convert values to the stored representation: (value - offset) / scale, limited to
+      //! +-iLimit and rounded by adding iRounding away from zero
+      //! @return Number of values that were changed by the limit
+      template <class T> static long encodeValues(const float* iValues, long iNumValues, float iScale, float iOffset,
+            float iLimit, float iRounding, T iMissingValue, T* oValues);
+
+      //! Set up chunking and compression for a newly defined variable. The first dimension must be
+      //! time and the last two latitude and longitude.
+      void defineStorage(int iVar) const;
+      //! Number of significant digits to keep when writing iVariable. Uses the 'digits' option of
+      //! the variable if set, otherwise the option of the file. Util::MV if values are not rounded.
+      int getNumDigits(Variable::Type iVariable) const;
+      //! Round the values to iNumDigits significant digits, so that they compress better. Values
+      //! equal to iMissingValue are left untouched. Does nothing if iNumDigits is Util::MV.
+      static void roundValues(float* iValues, long iNumValues, float iMissingValue, int iNumDigits);
+
+      //! Number of bytes in a value of type iType
+      static int getTypeSize(int iType);
       float getScale(int iVar) const;
       float getOffset(int iVar) const;
       int mFile;
@@ -70,7 +147,23 @@ class FileNetcdf : public File {
       void startDefineMode() const;
       void startDataMode() const;
       mutable bool mInDataMode;
+      // Index of the first latitude and longitude read from the file
+      int mCropLat;
+      int mCropLon;
+      bool mIsCropped;
       const static int mMaxAttributeLength = 100000000;
+   private:
+      // Output options (see description())
+      int mDeflateLevel;
+      bool mShuffle;
+      int mChunkLat;
+      int mChunkLon;
+      int mNumDigits;
+      // Cleared when attributes change
+      mutable std::map<std::string, VariableInfo> mVariableInfo;
+      // Variables with values outside the storable range in the current write, so that the
+      // warning is only given once for each variable
+      std::set<Variable::Type> mClampedVariables;
 };
 #include "Ec.h"
 #include "Arome.h"
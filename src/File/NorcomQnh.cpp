@@ -8,31 +8,29 @@
 
 FileNorcomQnh::FileNorcomQnh(std::string iFilename, const Options& iOptions) :
       File(iFilename, iOptions) {
-   mLats.resize(1);
-   mLons.resize(1);
-   mElevs.resize(1);
+   vec2 lats(1), lons(1), elevs(1);
    mLandFractions.resize(1);
-   if(!iOptions.getValues("lats", mLats[0])) {
+   if(!iOptions.getValues("lats", lats[0])) {
       Util::error("Missing 'lats' option for '" + iFilename + "'");
    }
-   if(!iOptions.getValues("lons", mLons[0])) {
+   if(!iOptions.getValues("lons", lons[0])) {
       Util::error("Missing 'lons' option for '" + iFilename + "'");
    }
-   if(!iOptions.getValues("elevs", mElevs[0])) {
+   if(!iOptions.getValues("elevs", elevs[0])) {
       Util::error("Missing 'elevs' option for '" + iFilename + "'");
    }
-   mLandFractions[0].resize(mElevs[0].size(), Util::MV);
+   mLandFractions[0].resize(elevs[0].size(), Util::MV);
    if(!iOptions.getValues("names", mNames)) {
       Util::error("Missing 'names' option for '" + iFilename + "'");
    }
    if(!iOptions.getValue("numTimes", mNTime)) {
       Util::error("Missing 'numTimes' option for '" + iFilename + "'");
    }
-   if(mLats[0].size() != mLons[0].size() || mLats[0].size() != mElevs[0].size() || mLats[0].size() != mNames.size()) {
+   if(lats[0].size() != lons[0].size() || lats[0].size() != elevs[0].size() || lats[0].size() != mNames.size()) {
       Util::error("FileNorcomQnh: 'lats', 'lons', 'elevs', 'names' must be the same size");
    }
-   for(int i = 0; i < mLats[0].size(); i++) {
-      float lat = mLats[0][i];
+   for(int i = 0; i < lats[0].size(); i++) {
+      float lat = lats[0][i];
       if(lat < -90 || lat > 90) {
          std::stringstream ss;
          ss << "Invalid latitude: " << lat;
@@ -40,7 +38,8 @@ FileNorcomQnh::FileNorcomQnh(std::string iFilename, const Options& iOptions) :
       }
    }
    mNLat = 1;
-   mNLon = mLats[0].size();
+   mNLon = lats[0].size();
+   setGrid(lats, lons, elevs);
    mNEns = 1;
 
    std::vector<double> times;
@@ -100,7 +99,7 @@ void FileNorcomQnh::writeCore(std::vector<Variable::Type> iVariables) {
 
    ofs.precision(0);
    // Write one line for each station
-   for(int j = 0; j < mLats[0].size(); j++) {
+   for(int j = 0; j < getNumLon(); j++) {
       std::string locationName = mNames[j];
       ofs << "EST MIN QNH ";
       ofs << std::setfill(' ') << std::setw(maxNameSize) << std::left << locationName << ": ";
@@ -4,62 +4,92 @@
 #include <stdlib.h>
 #include <fstream>
 #include "../Util.h"
+#include "../TextReader.h"
 
 FilePoint::FilePoint(std::string iFilename, const Options& iOptions) :
       File(iFilename, iOptions) {
-   float lat,lon,elev;
-   if(!iOptions.getValue("lat", lat)) {
+   std::vector<float> lats, lons, elevs;
+   if(!iOptions.getValues("lat", lats)) {
       Util::error("Missing 'lat' option for '" + iFilename + "'");
    }
-   if(!iOptions.getValue("lon", lon)) {
+   if(!iOptions.getValues("lon", lons)) {
       Util::error("Missing 'lon' option for '" + iFilename + "'");
    }
-   if(!iOptions.getValue("elev", elev)) {
+   if(!iOptions.getValues("elev", elevs)) {
       Util::error("Missing 'elev' option for '" + iFilename + "'");
    }
-   if(lat < -90 || lat > 90) {
-      std::stringstream ss;
-      ss << "Invalid latitude: " << lat;
-      Util::error(ss.str());
+   if(lats.size() == 0 || lats.size() != lons.size() || lats.size() != elevs.size()) {
+      Util::error("Options 'lat', 'lon', and 'elev' must have the same number of values for '" + iFilename + "'");
+   }
+   for(int i = 0; i < lats.size(); i++) {
+      if(lats[i] < -90 || lats[i] > 90) {
+         std::stringstream ss;
+         ss << "Invalid latitude: " << lats[i];
+         Util::error(ss.str());
+      }
    }
-   std::vector<float> lat0(1, lat);
-   std::vector<float> lon0(1, lon);
-   std::vector<float> elev0(1, elev);
-   std::vector<float> landFraction0(1, Util::MV);
-   mLats.push_back(lat0);
-   mLons.push_back(lon0);
-   mElevs.push_back(elev0);
-   mLandFractions.push_back(landFraction0);
-   mNLat = 1;
+   // Each station is one row in the grid
+   mNLat = lats.size();
    mNLon = 1;
-   mNEns = 1;
+   vec2 gridLats(mNLat), gridLons(mNLat), gridElevs(mNLat);
+   for(int i = 0; i < mNLat; i++) {
+      gridLats[i].push_back(lats[i]);
+      gridLons[i].push_back(lons[i]);
+      gridElevs[i].push_back(elevs[i]);
+   }
+   setGrid(gridLats, gridLons, gridElevs);
+   mLandFractions = vec2(mNLat, std::vector<float>(1, Util::MV));
    std::vector<double> times;
    mNTime = Util::MV;
    mNEns = Util::MV;
 
-   // Determine time and ensemble dimension if possible
-   std::ifstream ifs(getFilename().c_str());
-   if(ifs.good()) {
-      while(ifs.good()) {
-         char line[10000];
-         ifs.getline(line, 10000, '\n');
-         if(ifs.good() && line[0] != '#') {
-            std::stringstream ss(line);
-            double time;
-            ss >> time;
-            times.push_back(time);
-            double value;
-            mNEns = 0;
-            while(ss >> value) {
-               mNEns++;
+   // Read the whole file once. Determine time and ensemble dimension if possible.
+   std::vector<double> values;
+   std::vector<int> offsets;
+   std::vector<int> rows;
+   TextReader reader(getFilename());
+   if(reader.isValid()) {
+      int invalidLine = reader.readAll(values, offsets);
+      if(Util::isValid(invalidLine)) {
+         std::stringstream ss;
+         ss << "Could not read line " << invalidLine + 1 << " in file '" << iFilename << "'";
+         Util::error(ss.str());
+      }
+      int numRowValues = Util::MV;
+      for(int l = 0; l < reader.getNumLines(); l++) {
+         int numValues = offsets[l+1] - offsets[l];
+         if(numValues > 0) {
+            if(Util::isValid(numRowValues) && numValues - 1 != numRowValues) {
+               std::stringstream ss;
+               ss << "Line " << l + 1 << " in file '" << iFilename << "' has " << numValues - 1
+                  << " values (expecting " << numRowValues << " as on the previous lines)";
+               Util::error(ss.str());
             }
+            numRowValues = numValues - 1;
+            times.push_back(values[offsets[l]]);
+            rows.push_back(l);
+         }
+      }
+      if(Util::isValid(numRowValues)) {
+         if(numRowValues % mNLat != 0) {
+            std::stringstream ss;
+            ss << "The rows in file '" << iFilename << "' have " << numRowValues
+               << " values, which is not a multiple of the " << mNLat << " locations";
+            Util::error(ss.str());
          }
-         mNTime = times.size();
+         mNEns = numRowValues / mNLat;
       }
+      mNTime = times.size();
    }
 
    // Otherwise get the time or ensemble dimension from options
+   int numFileEns = mNEns;
    iOptions.getValue("ens", mNEns);
+   if(Util::isValid(numFileEns) && mNEns != numFileEns) {
+      std::stringstream ss;
+      ss << "File '" << iFilename << "' has " << numFileEns << " members for each location, but 'ens' is " << mNEns;
+      Util::error(ss.str());
+   }
    if(iOptions.getValue("time", mNTime)) {
       times.clear();
       // Empty file, probably used as output only
@@ -75,48 +105,30 @@ FilePoint::FilePoint(std::string iFilename, const Options& iOptions) :
       Util::error("Missing 'ens' option for empty file '" + iFilename + "'");
    }
    setTimes(times);
+
+   // Row t in the file holds time t
+   mLocalFields.resize(mNTime);
+   for(int t = 0; t < mNTime && t < rows.size(); t++) {
+      int l = rows[t];
+      FieldPtr field = getEmptyField();
+      const double* rowValues = &values[offsets[l] + 1];
+      for(int i = 0; i < mNLat; i++) {
+         for(int e = 0; e < mNEns; e++) {
+            (*field)(i,0,e) = rowValues[i*mNEns + e];
+         }
+      }
+      mLocalFields[t] = field;
+   }
 }
 
 FilePoint::~FilePoint() {
 }
 
 FieldPtr FilePoint::getFieldCore(Variable::Type iVariable, int iTime) const {
-   std::ifstream ifs(getFilename().c_str());
-   FieldPtr field = getEmptyField();
-
-   int row = 0;
-   while(ifs.good()) {
-      char line[10000];
-      ifs.getline(line, 10000, '\n');
-      if(ifs.good() && line[0] != '#') {
-         std::stringstream ss(line);
-         double time;
-         ss >> time;
-
-         if(time == iTime) {
-            double value;
-            int e = 0;
-            while(ss >> value) {
-               if(e >= mNEns) {
-                  std::stringstream ss;
-                  ss << "Row " << row << " in file '" << getFilename() << "' has too many members (expecting " << mNEns << ")" << std::endl;
-                  Util::error(ss.str());
-               }
-               (*field)(0,0,e) = value;
-               e++;
-            }
-            if(e != mNEns) {
-               std::stringstream ss;
-               ss << "Row " << row << " in file '" << getFilename() << "' has too many members (expecting " << mNEns << ")" << std::endl;
-               Util::error(ss.str());
-            }
-         }
-      }
-      row++;
-   }
-
-   ifs.close();
-   return field;
+   if(mLocalFields[iTime] == NULL)
+      return getEmptyField();
+   // Each variable gets its own copy, since fields can be changed after they are retrieved
+   return FieldPtr(new Field(*mLocalFields[iTime]));
 }
 
 void FilePoint::writeCore(std::vector<Variable::Type> iVariables) {
@@ -132,8 +144,10 @@ void FilePoint::writeCore(std::vector<Variable::Type> iVariables) {
       if(field != NULL) {
          ofs << (long) getTimes()[i];
          ofs.precision(2);
-         for(int e = 0; e < getNumEns(); e++) {
-            ofs << std::fixed << " " << (*field)(0,0,e);
+         for(int i = 0; i < getNumLat(); i++) {
+            for(int e = 0; e < getNumEns(); e++) {
+               ofs << std::fixed << " " << (*field)(i,0,e);
+            }
          }
          ofs << std::endl;
       }
@@ -143,11 +157,11 @@ void FilePoint::writeCore(std::vector<Variable::Type> iVariables) {
 
 std::string FilePoint::description() {
    std::stringstream ss;
-   ss << Util::formatDescription("type=point", "Point file for one location. Each row contains columns where the first column is the UNIX time and the second and onward columns are an ensemble of forecast values (each member has one column).") << std::endl;
-   ss << Util::formatDescription("   lat=required", "Latitude (in degrees, north is positive)") << std::endl;
-   ss << Util::formatDescription("   lon=required", "Longitude (in degrees, east is positive)") << std::endl;
-   ss << Util::formatDescription("   elev=required", "Elevation (in meters)") << std::endl;
+   ss << Util::formatDescription("type=point", "Point file for one or more locations. Each row is one time and contains columns where the first column is the UNIX time and the second and onward columns are an ensemble of forecast values (each member has one column). With multiple locations, the members of the first location come first, then the members of the second location, and so on.") << std::endl;
+   ss << Util::formatDescription("   lat=required", "Latitude (in degrees, north is positive). Use a comma-separated list for multiple locations.") << std::endl;
+   ss << Util::formatDescription("   lon=required", "Longitude (in degrees, east is positive). One value for each location.") << std::endl;
+   ss << Util::formatDescription("   elev=required", "Elevation (in meters). One value for each location.") << std::endl;
    ss << Util::formatDescription("   time=undef", "Number of times. Required if the file does not exist.") << std::endl;
-   ss << Util::formatDescription("   ens=1", "Number of ensemble members.") << std::endl;
+   ss << Util::formatDescription("   ens=1", "Number of ensemble members for each location.") << std::endl;
    return ss.str();
 }
@@ -6,8 +6,9 @@
 #include "../Variable.h"
 #include "../Options.h"
 
-//! Represents a point-based text file. First column is the time (in seconds since 1970)
-//! and the second column is the forecast value.
+//! Represents a point-based text file for one or more locations. Each row is one time. The first
+//! column is the time (in seconds since 1970) followed by the ensemble members of each location.
+//! The file is read once when it is opened.
 class FilePoint : public File {
    public:
       FilePoint(std::string iFilename, const Options& iOptions);
@@ -18,5 +19,8 @@ class FilePoint : public File {
       FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const;
       void writeCore(std::vector<Variable::Type> iVariables);
       bool hasVariableCore(Variable::Type iVariable) const {return true;};
+   private:
+      // Field for each time, NULL if the file does not have the time
+      std::vector<FieldPtr> mLocalFields;
 };
 #endif
@@ -0,0 +1,261 @@
+#include "Raw.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../Util.h"
+
+namespace {
+   const char magic[8] = {'G','R','I','D','P','P','F','1'};
+   // Written as a 32-bit integer, so that files from machines with a different byte order are
+   // not accepted
+   const int32_t endianMarker = 1;
+   const size_t headerSize = sizeof(magic) + 6 * sizeof(int32_t);
+   const size_t indexEntrySize = 2 * sizeof(int32_t) + sizeof(int64_t);
+   // Fields start on multiples of this (in bytes), so that they are aligned for vector loads
+   const size_t alignment = 64;
+
+   size_t align(size_t iSize) {
+      return (iSize + alignment - 1) / alignment * alignment;
+   }
+
+   //! Unmaps the file when the last field using it is gone
+   class Unmapper {
+      public:
+         Unmapper(size_t iSize) : mSize(iSize) {};
+         void operator()(void* iMap) const {
+            munmap(iMap, mSize);
+         };
+      private:
+         size_t mSize;
+   };
+
+   bool writePadding(FILE* iFid, size_t iSize) {
+      if(iSize == 0)
+         return true;
+      std::vector<char> zeros(iSize, 0);
+      return fwrite(&zeros[0], 1, iSize, iFid) == iSize;
+   }
+
+   bool writeGrid(FILE* iFid, const vec2& iValues, int iNumLat, int iNumLon) {
+      std::vector<float> values(iNumLat*iNumLon, Util::MV);
+      for(int i = 0; i < iNumLat && i < iValues.size(); i++) {
+         for(int j = 0; j < iNumLon && j < iValues[i].size(); j++) {
+            values[i*iNumLon + j] = iValues[i][j];
+         }
+      }
+      if(values.size() == 0)
+         return true;
+      return fwrite(&values[0], sizeof(float), values.size(), iFid) == values.size();
+   }
+
+   vec2 readGrid(const char* iData, int iNumLat, int iNumLon) {
+      vec2 values(iNumLat);
+      for(int i = 0; i < iNumLat; i++) {
+         values[i].resize(iNumLon);
+         if(iNumLon > 0)
+            memcpy(&values[i][0], iData + i*iNumLon*sizeof(float), iNumLon*sizeof(float));
+      }
+      return values;
+   }
+}
+
+FileRaw::FileRaw(std::string iFilename, const Options& iOptions) :
+      File(iFilename, iOptions),
+      mFieldStride(0) {
+   load();
+}
+
+FileRaw::~FileRaw() {
+}
+
+void FileRaw::load() {
+   int fd = open(getFilename().c_str(), O_RDONLY);
+   if(fd == -1) {
+      Util::error("Could not open raw file '" + getFilename() + "'");
+   }
+   struct stat info;
+   if(fstat(fd, &info) != 0 || info.st_size < headerSize) {
+      close(fd);
+      Util::error("'" + getFilename() + "' is not a valid raw file");
+   }
+   size_t size = info.st_size;
+   // Private mapping, so that fields can be changed without changing the file
+   void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if(map == MAP_FAILED) {
+      Util::error("Could not map raw file '" + getFilename() + "'");
+   }
+   mMap.reset(map, Unmapper(size));
+   const char* data = static_cast<const char*>(map);
+
+   int32_t header[6];
+   memcpy(header, data + sizeof(magic), sizeof(header));
+   if(memcmp(data, magic, sizeof(magic)) != 0 || header[0] != endianMarker) {
+      Util::error("'" + getFilename() + "' is not a valid raw file");
+   }
+   mNTime = header[1];
+   mNLat  = header[2];
+   mNLon  = header[3];
+   mNEns  = header[4];
+   int numVariables = header[5];
+   if(mNTime < 0 || mNLat < 0 || mNLon < 0 || mNEns < 0 || numVariables < 0) {
+      Util::error("Raw file '" + getFilename() + "' has invalid dimensions");
+   }
+
+   size_t numPoints = mNLat*mNLon;
+   size_t gridStart = headerSize + (1 + mNTime) * sizeof(double);
+   size_t indexStart = gridStart + 4 * numPoints * sizeof(float);
+   size_t dataStart = align(indexStart + numVariables * indexEntrySize);
+   mFieldStride = align(numPoints * mNEns * sizeof(float));
+   if(dataStart + numVariables * mNTime * mFieldStride > size) {
+      Util::error("Raw file '" + getFilename() + "' is truncated");
+   }
+
+   double referenceTime;
+   memcpy(&referenceTime, data + headerSize, sizeof(double));
+   setReferenceTime(referenceTime);
+   std::vector<double> times(mNTime);
+   if(mNTime > 0)
+      memcpy(&times[0], data + headerSize + sizeof(double), mNTime * sizeof(double));
+   setTimes(times);
+
+   vec2 lats  = readGrid(data + gridStart, mNLat, mNLon);
+   vec2 lons  = readGrid(data + gridStart + numPoints * sizeof(float), mNLat, mNLon);
+   vec2 elevs = readGrid(data + gridStart + 2 * numPoints * sizeof(float), mNLat, mNLon);
+   mLandFractions = readGrid(data + gridStart + 3 * numPoints * sizeof(float), mNLat, mNLon);
+   setGrid(lats, lons, elevs);
+
+   mOffsets.clear();
+   for(int v = 0; v < numVariables; v++) {
+      const char* entry = data + indexStart + v * indexEntrySize;
+      int32_t variable;
+      int64_t offset;
+      memcpy(&variable, entry, sizeof(int32_t));
+      memcpy(&offset, entry + 2 * sizeof(int32_t), sizeof(int64_t));
+      if(offset < dataStart || offset % alignment != 0 || offset + mNTime * mFieldStride > size) {
+         Util::error("Raw file '" + getFilename() + "' has an invalid index");
+      }
+      mOffsets[(Variable::Type) variable] = offset;
+   }
+}
+
+bool FileRaw::isValid(std::string iFilename) {
+   FILE* fid = fopen(iFilename.c_str(), "rb");
+   if(fid == NULL)
+      return false;
+   char start[sizeof(magic) + sizeof(int32_t)];
+   bool isValid = fread(start, sizeof(start), 1, fid) == 1;
+   fclose(fid);
+   int32_t marker;
+   memcpy(&marker, start + sizeof(magic), sizeof(int32_t));
+   return isValid && memcmp(start, magic, sizeof(magic)) == 0 && marker == endianMarker;
+}
+
+bool FileRaw::write(std::string iFilename, const File& iFile, std::vector<Variable::Type> iVariables) {
+   std::vector<Variable::Type> variables;
+   for(int v = 0; v < iVariables.size(); v++) {
+      if(std::find(variables.begin(), variables.end(), iVariables[v]) == variables.end())
+         variables.push_back(iVariables[v]);
+   }
+   int nTime = iFile.getNumTime();
+   int nLat = iFile.getNumLat();
+   int nLon = iFile.getNumLon();
+   int nEns = iFile.getNumEns();
+   int numVariables = variables.size();
+   size_t numValues = nLat*nLon*nEns;
+   size_t indexStart = headerSize + (1 + nTime) * sizeof(double) + 4 * nLat*nLon * sizeof(float);
+   size_t dataStart = align(indexStart + numVariables * indexEntrySize);
+   size_t fieldStride = align(numValues * sizeof(float));
+
+   // Write to a temporary file first, so that other processes never see a partially written file
+   std::stringstream ss;
+   ss << iFilename << "." << getpid() << ".tmp";
+   std::string tempFilename = ss.str();
+   FILE* fid = fopen(tempFilename.c_str(), "wb");
+   if(fid == NULL) {
+      Util::warning("Could not write raw file '" + tempFilename + "'");
+      return false;
+   }
+
+   int32_t header[6] = {endianMarker, nTime, nLat, nLon, nEns, numVariables};
+   bool success = fwrite(magic, sizeof(magic), 1, fid) == 1;
+   success = success && fwrite(header, sizeof(header), 1, fid) == 1;
+   std::vector<double> times = iFile.getTimes();
+   times.resize(nTime, Util::MV);
+   times.insert(times.begin(), iFile.getReferenceTime());
+   success = success && fwrite(&times[0], sizeof(double), times.size(), fid) == times.size();
+   success = success && writeGrid(fid, iFile.getLats(), nLat, nLon);
+   success = success && writeGrid(fid, iFile.getLons(), nLat, nLon);
+   success = success && writeGrid(fid, iFile.getElevs(), nLat, nLon);
+   success = success && writeGrid(fid, iFile.getLandFractions(), nLat, nLon);
+   for(int v = 0; v < numVariables; v++) {
+      int32_t entry[2] = {variables[v], 0};
+      int64_t offset = dataStart + v * nTime * fieldStride;
+      success = success && fwrite(entry, sizeof(entry), 1, fid) == 1;
+      success = success && fwrite(&offset, sizeof(offset), 1, fid) == 1;
+   }
+   success = success && writePadding(fid, dataStart - indexStart - numVariables * indexEntrySize);
+
+   for(int v = 0; success && v < numVariables; v++) {
+      for(int t = 0; success && t < nTime; t++) {
+         FieldPtr field = iFile.getField(variables[v], t);
+         if(field == NULL || numValues == 0) {
+            std::vector<float> missing(numValues, Util::MV);
+            success = numValues == 0 || fwrite(&missing[0], sizeof(float), numValues, fid) == numValues;
+         }
+         else {
+            success = fwrite(field->getData(), sizeof(float), numValues, fid) == numValues;
+         }
+         success = success && writePadding(fid, fieldStride - numValues * sizeof(float));
+      }
+   }
+   success = (fclose(fid) == 0) && success;
+
+   if(!success || rename(tempFilename.c_str(), iFilename.c_str()) != 0) {
+      Util::warning("Could not write raw file '" + iFilename + "'");
+      Util::remove(tempFilename);
+      return false;
+   }
+   return true;
+}
+
+FieldPtr FileRaw::getFieldCore(Variable::Type iVariable, int iTime) const {
+   std::map<Variable::Type, size_t>::const_iterator it = mOffsets.find(iVariable);
+   if(it == mOffsets.end() || iTime < 0 || iTime >= mNTime) {
+      std::stringstream ss;
+      ss << "Cannot read variable '" << Variable::getTypeName(iVariable) << "' for time " << iTime
+         << " from '" << getFilename() << "'";
+      Util::error(ss.str());
+   }
+   char* data = static_cast<char*>(mMap.get()) + it->second + iTime * mFieldStride;
+   return FieldPtr(new Field(mNLat, mNLon, mNEns, reinterpret_cast<float*>(data), mMap));
+}
+
+void FileRaw::writeCore(std::vector<Variable::Type> iVariables) {
+   std::vector<Variable::Type> variables = iVariables;
+   std::map<Variable::Type, size_t>::const_iterator it;
+   for(it = mOffsets.begin(); it != mOffsets.end(); it++) {
+      variables.push_back(it->first);
+   }
+   if(!write(getFilename(), *this, variables)) {
+      Util::error("Could not write '" + getFilename() + "'");
+   }
+   // Fields that are already retrieved keep the previous mapping
+   load();
+}
+
+bool FileRaw::hasVariableCore(Variable::Type iVariable) const {
+   return mOffsets.find(iVariable) != mOffsets.end();
+}
+
+std::string FileRaw::description() {
+   std::stringstream ss;
+   ss << Util::formatDescription("type=raw", "Decoded fields stored as raw floats, as written by the 'fieldCache' option. The file is memory mapped, so fields are available without decoding them.") << std::endl;
+   return ss.str();
+}
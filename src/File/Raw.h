@@ -0,0 +1,50 @@
+#ifndef FILE_RAW_H
+#define FILE_RAW_H
+#include <vector>
+#include <map>
+#include <boost/shared_ptr.hpp>
+#include "File.h"
+#include "../Variable.h"
+#include "../Options.h"
+
+//! Represents a file with decoded fields stored as raw 32-bit floats, so that the fields of a file
+//! only need to be decoded once and can be reused across runs. The file is memory mapped and the
+//! fields point directly into the mapped file, without copying. Changes to the fields are not
+//! written back to the file.
+//!
+//! Layout (host byte order; the endian marker rejects files from a machine with the other byte order):
+//!    Header: identifier, endian marker, number of times, lats, lons, members, and variables
+//!    Reference time and times (doubles)
+//!    Latitudes, longitudes, elevations, and land fractions (floats)
+//!    Index: variable type and offset (in bytes) of its first field, for each variable
+//!    Fields: all times of each variable, each field starting on a 64 byte boundary
+class FileRaw : public File {
+   public:
+      FileRaw(std::string iFilename, const Options& iOptions=Options());
+      ~FileRaw();
+      static std::string description();
+      std::string name() const {return "raw";};
+      //! Does the file start with the identifier of this format?
+      static bool isValid(std::string iFilename);
+
+      //! Write the grid, times, and the fields of the variables in iFile to iFilename. Other
+      //! processes never see a partially written file.
+      //! @return true if successful
+      static bool write(std::string iFilename, const File& iFile, std::vector<Variable::Type> iVariables);
+      using File::write;
+   protected:
+      FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const;
+      //! Rewrites the file with the existing variables and iVariables
+      void writeCore(std::vector<Variable::Type> iVariables);
+      bool hasVariableCore(Variable::Type iVariable) const;
+   private:
+      //! Map the file and read the header, grid, and index
+      void load();
+      // The mapped file, unmapped when the file and all its fields are gone
+      boost::shared_ptr<void> mMap;
+      // Offset of the first field of each variable
+      std::map<Variable::Type, size_t> mOffsets;
+      // Number of bytes between the starts of two consecutive fields
+      size_t mFieldStride;
+};
+#endif
@@ -5,89 +5,72 @@
 #include <fstream>
 #include "../Util.h"
 #include "../Location.h"
+#include "../TextReader.h"
 
 FileText::FileText(std::string iFilename, const Options& iOptions) :
       File(iFilename, iOptions) {
 
-   std::ifstream ifs(getFilename().c_str(), std::ifstream::in);
-   if(!ifs.good()) {
+   TextReader reader(getFilename());
+   if(!reader.isValid()) {
       return;
    }
+   std::vector<double> allValues;
+   std::vector<int> offsets;
+   int invalidLine = reader.readAll(allValues, offsets);
+   if(Util::isValid(invalidLine)) {
+      std::stringstream ss;
+      ss << "Could not read line " << invalidLine + 1 << " in file '" << iFilename << "'";
+      Util::error(ss.str());
+   }
+
    std::set<int> timesSet;
    std::set<Location> locationsSet;
    std::map<int, std::map<Location, std::vector<float> > > values;
    mNEns = Util::MV;
-   while(ifs.good()) {
-      char line[10000];
-      ifs.getline(line, 10000, '\n');
-      if(ifs.good() && line[0] != '#') {
-         std::stringstream ss(line);
-         // Loop over each value
-         std::vector<float> currValues;
-         int time;
-         bool status = ss >> time;
-         if(!status) {
-            Util::error("Could not read time from file '" + iFilename + "'");
-         }
-         timesSet.insert(time);
-
-         Location location(Util::MV, Util::MV, Util::MV);
-         float lat;
-         status = ss >> lat;
-         if(!status) {
-            Util::error("Could not read lat from file '" + iFilename + "'");
-         }
-
-         float lon;
-         status = ss >> lon;
-         if(!status) {
-            Util::error("Could not read lon from file '" + iFilename + "'");
-         }
-
-         float elev;
-         status = ss >> elev;
-         if(!status) {
-            Util::error("Could not read elev from file '" + iFilename + "'");
-         }
-         location = Location(lat, lon, elev);
+   for(int l = 0; l < reader.getNumLines(); l++) {
+      int numValues = offsets[l+1] - offsets[l];
+      if(numValues == 0)
+         continue;
+      if(numValues < 4) {
+         std::stringstream ss;
+         ss << "Could not read time, lat, lon and elev on line " << l + 1 << " in file '" << iFilename << "'";
+         Util::error(ss.str());
+      }
+      const double* lineValues = &allValues[offsets[l]];
+      int time = lineValues[0];
+      timesSet.insert(time);
+      Location location(lineValues[1], lineValues[2], lineValues[3]);
 
-         while(ss.good()) {
-            float value;
-            bool status  = ss >> value;
-            if(!status) {
-               Util::error("Could not read value from file '" + iFilename + "'");
-            }
-            currValues.push_back(value);
-         }
-         if(mNEns == Util::MV)
-            mNEns = currValues.size();
-         else if(currValues.size() != mNEns) {
-            std::stringstream ss;
-            ss << "File '" + getFilename() + "' is corrupt, because it does not have the same"
-               << " number of columns on each line" << std::endl;
-            Util::error(ss.str());
-         }
-         values[time][location] = currValues;
-         locationsSet.insert(location);
+      std::vector<float> currValues(lineValues + 4, lineValues + numValues);
+      if(mNEns == Util::MV)
+         mNEns = currValues.size();
+      else if(currValues.size() != mNEns) {
+         std::stringstream ss;
+         ss << "File '" + getFilename() + "' is corrupt, because it does not have the same"
+            << " number of columns on each line" << std::endl;
+         Util::error(ss.str());
       }
+      values[time][location] = currValues;
+      locationsSet.insert(location);
    }
-   ifs.close();
 
    std::vector<double> times(timesSet.begin(), timesSet.end());
    std::vector<Location> locations(locationsSet.begin(), locationsSet.end());
    std::sort(times.begin(), times.end());
 
-   mLats.resize(locations.size());
-   mLons.resize(locations.size());
-   mElevs.resize(locations.size());
+   vec2 lats, lons, elevs;
+   lats.resize(locations.size());
+   lons.resize(locations.size());
+   elevs.resize(locations.size());
    for(int i = 0; i < locations.size(); i++) {
-      mLats[i].resize(1);
-      mLons[i].resize(1);
-      mElevs[i].resize(1);
-      mLats[i][0] = locations[i].lat();
-      mLons[i][0] = locations[i].lon();
-      mElevs[i][0] = locations[i].elev();
+      lats[i].resize(1);
+      lons[i].resize(1);
+      elevs[i].resize(1);
+      lats[i][0] = locations[i].lat();
+      lons[i][0] = locations[i].lon();
+      elevs[i][0] = locations[i].elev();
    }
+   setGrid(lats, lons, elevs);
 
    setTimes(times);
    mNTime = times.size();
@@ -0,0 +1,58 @@
+#include "IntegralImage.h"
+#include "Util.h"
+#include <algorithm>
+
+IntegralImage::IntegralImage() : mNLat(0), mNLon(0) {
+}
+
+IntegralImage::IntegralImage(const std::vector<double>& iValues, int iNumLat, int iNumLon) : mNLat(0), mNLon(0) {
+   build(iValues, iNumLat, iNumLon);
+}
+
+void IntegralImage::build(const std::vector<double>& iValues, int iNumLat, int iNumLon) {
+   if(iNumLat < 0 || iNumLon < 0 || iValues.size() != iNumLat * iNumLon)
+      Util::error("Cannot create integral image, values do not match the size of the grid");
+
+   mNLat = iNumLat;
+   mNLon = iNumLon;
+   int stride = mNLon + 1;
+   mSums.clear();
+   mSums.resize((mNLat + 1) * stride, 0);
+
+   // Accumulate along each row, then down each column
+   #pragma omp parallel for
+   for(int i = 0; i < mNLat; i++) {
+      double* row = &mSums[(i+1) * stride];
+      const double* values = mNLon > 0 ? &iValues[i * mNLon] : NULL;
+      for(int j = 0; j < mNLon; j++) {
+         row[j+1] = row[j] + values[j];
+      }
+   }
+   for(int i = 1; i < mNLat; i++) {
+      double* prev = &mSums[i * stride];
+      double* row = &mSums[(i+1) * stride];
+      for(int j = 1; j <= mNLon; j++) {
+         row[j] += prev[j];
+      }
+   }
+}
+
+double IntegralImage::getSum(int iStartI, int iStartJ, int iEndI, int iEndJ) const {
+   int startI = std::max(iStartI, 0);
+   int startJ = std::max(iStartJ, 0);
+   int endI = std::min(iEndI, mNLat - 1);
+   int endJ = std::min(iEndJ, mNLon - 1);
+   if(startI > endI || startJ > endJ)
+      return 0;
+   int stride = mNLon + 1;
+   return mSums[(endI+1)*stride + endJ+1] - mSums[startI*stride + endJ+1]
+        - mSums[(endI+1)*stride + startJ] + mSums[startI*stride + startJ];
+}
+
+int IntegralImage::getNumLat() const {
+   return mNLat;
+}
+
+int IntegralImage::getNumLon() const {
+   return mNLon;
+}
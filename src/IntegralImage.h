@@ -0,0 +1,26 @@
+#ifndef INTEGRAL_IMAGE_H
+#define INTEGRAL_IMAGE_H
+#include <vector>
+
+//! Summed-area table of a 2D grid, allowing the sum of the values within any rectangular box
+//! to be computed in constant time. Sums are accumulated in double precision.
+class IntegralImage {
+   public:
+      IntegralImage();
+      //! @param iValues Values on a iNumLat*iNumLon grid, with the longitude index varying fastest
+      IntegralImage(const std::vector<double>& iValues, int iNumLat, int iNumLon);
+      void build(const std::vector<double>& iValues, int iNumLat, int iNumLon);
+
+      //! Sum of values in rows iStartI to iEndI and columns iStartJ to iEndJ (all inclusive). The
+      //! box is clipped to the grid. Returns 0 if the box does not overlap the grid.
+      double getSum(int iStartI, int iStartJ, int iEndI, int iEndJ) const;
+
+      int getNumLat() const;
+      int getNumLon() const;
+   private:
+      //! Sum of all values in rows < i and columns < j is stored at i*(nLon+1) + j
+      std::vector<double> mSums;
+      int mNLat;
+      int mNLon;
+};
+#endif
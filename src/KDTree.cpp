@@ -1,29 +1,16 @@
 #include "KDTree.h"
-KDTree::KDTree() : mRoot(NULL) {
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+KDTree::KDTree() : mNLon(0) {
 }
 
-KDTree::KDTree(const vec2& iLats, const vec2& iLons) {
+KDTree::KDTree(const vec2& iLats, const vec2& iLons) : mNLon(0) {
    build(iLats, iLons);
 }
 
-KDTree& KDTree::operator=(KDTree other) {
-   std::swap(mLats, other.mLats);
-   std::swap(mLons, other.mLons);
-
-   mRoot.swap(other.mRoot);
-
-   return *this;
-}
-
-KDTree::KDTree(const KDTree& other) {
-   mLats = other.mLats;
-   mLons = other.mLons;
-   mRoot.reset(new KDTree::TreeNode(*other.mRoot));
-}
-
 void KDTree::build(const vec2& iLats, const vec2& iLons) {
-   mLats = iLats;
-   mLons = iLons;
    if(iLats.size() != iLons.size())
       Util::error("Cannot initialize KDTree, lats and lons not the same size");
 
@@ -35,144 +22,131 @@ void KDTree::build(const vec2& iLats, const vec2& iLons) {
    if(nLon == 0)
       Util::error("Cannot initialize KDTree, no valid locations");
 
-   indexdVec lons(nLon*nLat);
-
-   indexdVec::iterator currLon = lons.begin();
-   size_t to = -1;
-   for(size_t i = 0; i < iLats.size(); ++i) {
-     for(size_t j = 0; j < iLats[0].size(); ++j) {
-        if(Util::isValid(iLons[i][j]) && Util::isValid(iLats[i][j])) {
-           *(currLon++) = Indexed(iLons[i][j], iLats[i][j], i, j);
-           ++to;
-        }
-     }
+   mNLon = nLon;
+   mPoints.clear();
+   mPoints.reserve(nLat*nLon);
+   for(size_t i = 0; i < nLat; ++i) {
+      for(size_t j = 0; j < nLon; ++j) {
+         if(Util::isValid(iLons[i][j]) && Util::isValid(iLats[i][j])) {
+            Point point;
+            toCartesian(iLats[i][j], iLons[i][j], point.x);
+            point.index = i*nLon + j;
+            mPoints.push_back(point);
+         }
+      }
    }
 
-   if(to == -1) {
+   if(mPoints.size() == 0) {
       Util::error("Cannot initialize KDTree, no valid locations");
    }
-   if(to >= 0) subTree(lons, 0, to, true, NULL, mRoot);
-}
-
-bool compareLons (const KDTree::Indexed& l, const KDTree::Indexed& r){ return (l.lon < r.lon); }
-bool compareLats (const KDTree::Indexed& l, const KDTree::Indexed& r){ return (l.lat < r.lat); }
-
-void KDTree::subTree(indexdVec& iLonLat,
-                     const size_t from,
-                     const size_t to,
-                     const bool xsection,
-                     const TreeNode* parent,
-                     unode& root) {
-
-   root.reset(new KDTree::TreeNode());
-
-   root->parent = parent;
-   root->xsection = xsection;
-
-   size_t len = to - from + 1;
-
-   if(len == 1) {
-      root->lon = iLonLat[from].lon;
-      root->lat = iLonLat[from].lat;
-      root->ipos = iLonLat[from].index1;
-      root->jpos = iLonLat[from].index2;
-      return;
-   }
 
-   size_t med = from + len/2;
-   if(xsection) {
-      std::sort(iLonLat.begin() + from, iLonLat.begin() + to + 1, compareLons);
-      while(med < to && iLonLat[med].lon == iLonLat[med+1].lon) {
-         assert(iLonLat.size() > med+1);
-         ++med;
+   int N = mPoints.size();
+   mAxes.clear();
+   mAxes.resize(N, 0);
+
+   // Build the tree one level at a time, so that the nodes on each level can be partitioned in
+   // parallel. Each node splits along the coordinate with the largest spread, since the points
+   // of a limited-area grid only span a thin patch of the sphere.
+   std::vector<std::pair<int,int> > ranges(1, std::pair<int,int>(0, N));
+   while(ranges.size() > 0) {
+      int nRanges = ranges.size();
+      std::vector<std::pair<int,int> > children(2*nRanges, std::pair<int,int>(0, 0));
+      #pragma omp parallel for
+      for(int r = 0; r < nRanges; r++) {
+         int from = ranges[r].first;
+         int to = ranges[r].second;
+         float min[3] = {mPoints[from].x[0], mPoints[from].x[1], mPoints[from].x[2]};
+         float max[3] = {min[0], min[1], min[2]};
+         for(int p = from+1; p < to; p++) {
+            for(int d = 0; d < 3; d++) {
+               min[d] = std::min(min[d], mPoints[p].x[d]);
+               max[d] = std::max(max[d], mPoints[p].x[d]);
+            }
+         }
+         int axis = 0;
+         for(int d = 1; d < 3; d++) {
+            if(max[d] - min[d] > max[axis] - min[axis])
+               axis = d;
+         }
+         int med = from + (to - from)/2;
+         std::nth_element(mPoints.begin() + from, mPoints.begin() + med, mPoints.begin() + to, CompareAxis(axis));
+         mAxes[med] = axis;
+         children[2*r] = std::pair<int,int>(from, med);
+         children[2*r+1] = std::pair<int,int>(med+1, to);
       }
-   }
-   else {
-      std::sort(iLonLat.begin() + from, iLonLat.begin() + to + 1, compareLats);
-      while(med < to && iLonLat[med].lat == iLonLat[med+1].lat) {
-         assert(iLonLat.size() > med+1);
-         ++med;
+      // Ranges with a single point are leaves and need no partitioning
+      ranges.clear();
+      for(int r = 0; r < children.size(); r++) {
+         if(children[r].second - children[r].first > 1)
+            ranges.push_back(children[r]);
       }
    }
-
-   root->lon = iLonLat[med].lon;
-   root->lat = iLonLat[med].lat;
-   root->ipos = iLonLat[med].index1;
-   root->jpos = iLonLat[med].index2;
-
-   if(med > from) subTree(iLonLat, from, med - 1, !xsection, root.get(), root->left);
-   if(med < to) subTree(iLonLat, med + 1, to, !xsection, root.get(), root->right);
-
 }
 
-const KDTree::TreeNode* KDTree::firstGuess(const unode& root, const float lon, const float lat) {
-   if(root->xsection){
-      if(lon <= root->lon) {
-         if(root->left) return firstGuess(root->left, lon, lat);
-      } else {
-         if(root->right) return firstGuess(root->right, lon, lat);
-      }
-   } else {
-      if(lat <= root->lat) {
-         if(root->left) return firstGuess(root->left, lon, lat);
-      } else {
-         if(root->right) return firstGuess(root->right, lon, lat);
-      }
-   }
-   return root.get();
+void KDTree::toCartesian(float iLat, float iLon, float iX[3]) {
+   double lat = Util::deg2rad(iLat);
+   double lon = Util::deg2rad(iLon);
+   iX[0] = cos(lat) * cos(lon);
+   iX[1] = cos(lat) * sin(lon);
+   iX[2] = sin(lat);
 }
 
-const KDTree::TreeNode* KDTree::nearestNeighbour(const unode& root, const float lon, const float lat) {
-
-   const TreeNode * nearLeaf = firstGuess(root, lon, lat);
-
-   float currBest = Util::getDistance(lat, lon, nearLeaf->lat, nearLeaf->lon);
-
-   const TreeNode * currentLeaf = nearLeaf;
-   const TreeNode * nearestLeaf = nearLeaf;
-
-   while (currentLeaf) {
-      float dist = Util::getDistance(lat, lon, currentLeaf->lat, currentLeaf->lon);
-
-      if(dist < currBest) {
-         currBest = dist;
-         nearestLeaf = currentLeaf;
+int KDTree::nearestNeighbour(const float iX[3]) const {
+   // Ranges still to be searched, with a lower bound on the squared distance to any point in them
+   struct Range {
+      int from;
+      int to;
+      float bound;
+   };
+   // Each level pushes at most two ranges, so this covers trees far deeper than 2^31 points
+   Range stack[128];
+   int size = 0;
+   stack[size].from = 0;
+   stack[size].to = mPoints.size();
+   stack[size].bound = 0;
+   size++;
+
+   int nearest = 0;
+   float best = Util::MV;
+   while(size > 0) {
+      size--;
+      const Range& range = stack[size];
+      if(range.from >= range.to || (Util::isValid(best) && range.bound > best))
+         continue;
+      int from = range.from;
+      int to = range.to;
+      int med = from + (to - from)/2;
+      const Point& point = mPoints[med];
+      float dx = iX[0] - point.x[0];
+      float dy = iX[1] - point.x[1];
+      float dz = iX[2] - point.x[2];
+      float dist = dx*dx + dy*dy + dz*dz;
+      // Resolve ties in favour of the first point in the grid, as in a brute force search
+      if(!Util::isValid(best) || dist < best || (dist == best && point.index < mPoints[nearest].index)) {
+         best = dist;
+         nearest = med;
       }
-
-      bool cross;
-      if(currentLeaf->xsection) {
-         cross = Util::getDistance(lat, lon, lat, currentLeaf->lon) < currBest;
-      } else {
-         cross = Util::getDistance(lat, lon, currentLeaf->lat, lon) < currBest;
+      float diff = iX[mAxes[med]] - point.x[mAxes[med]];
+      // Search the far side last, and only if the splitting plane is closer than the best match
+      Range& far = stack[size];
+      Range& near = stack[size+1];
+      if(diff <= 0) {
+         far.from = med + 1;
+         far.to = to;
+         near.from = from;
+         near.to = med;
       }
-
-      if(cross) {
-         if(currentLeaf->left.get() == nearLeaf) {
-            nearLeaf = NULL;
-            if(currentLeaf->right) nearLeaf = nearestNeighbour( currentLeaf->right, lon, lat);
-         } else {
-            nearLeaf = NULL;
-            if(currentLeaf->left) nearLeaf = nearestNeighbour(currentLeaf->left, lon, lat);
-         }
-
-         if(nearLeaf) {
-            float dist = Util::getDistance(lat, lon, nearLeaf->lat, nearLeaf->lon);
-            if(dist < currBest) {
-               currBest = dist;
-               nearestLeaf = nearLeaf;
-            }
-         }
-      }
-
-      nearLeaf = currentLeaf;
-      if(currentLeaf == root.get()) {
-         currentLeaf = NULL;
-      } else {
-         currentLeaf = currentLeaf->parent;
+      else {
+         far.from = from;
+         far.to = med;
+         near.from = med + 1;
+         near.to = to;
       }
+      far.bound = diff*diff;
+      near.bound = 0;
+      size += 2;
    }
-
-   return nearestLeaf;
+   return nearest;
 }
 
 void KDTree::getNearestNeighbour(const File& iTo, vec2Int& iI, vec2Int& iJ) const {
@@ -185,36 +159,243 @@ void KDTree::getNearestNeighbour(const File& iTo, vec2Int& iI, vec2Int& iJ) cons
    iI.resize(nLat);
    iJ.resize(nLat);
 
-   if(!mRoot) {
-      for(size_t i = 0; i < nLat; ++i) {
-         iI[i].resize(nLon, Util::MV);
-         iJ[i].resize(nLon, Util::MV);
-      }
-      return;
-   }
-
-   const TreeNode * nearest;
-
    for(size_t i = 0; i < nLat; ++i) {
+      iI[i].clear();
+      iJ[i].clear();
       iI[i].resize(nLon, Util::MV);
       iJ[i].resize(nLon, Util::MV);
    }
-   #pragma omp parallel for private(nearest)
+   if(mPoints.size() == 0)
+      return;
+
+   #pragma omp parallel for
    for(size_t i = 0; i < nLat; ++i) {
       for(size_t j = 0; j < nLon; ++j) {
          if(Util::isValid(olats[i][j]) && Util::isValid(olons[i][j])) {
             // Find the nearest neighbour from input grid (ii, jj)
-            nearest = nearestNeighbour(mRoot, olons[i][j], olats[i][j]);
-            iI[i][j] = nearest->ipos;
-            iJ[i][j] = nearest->jpos;
+            float x[3];
+            toCartesian(olats[i][j], olons[i][j], x);
+            int index = mPoints[nearestNeighbour(x)].index;
+            iI[i][j] = index / mNLon;
+            iJ[i][j] = index % mNLon;
          }
       }
    }
 }
 
 void KDTree::getNearestNeighbour(float iLat, float iLon, int& iI, int& iJ) const {
-   const TreeNode * nearest = nearestNeighbour(mRoot, iLon, iLat);
-   iI = nearest->ipos;
-   iJ = nearest->jpos;
-   return;
+   if(mPoints.size() == 0) {
+      iI = Util::MV;
+      iJ = Util::MV;
+      return;
+   }
+   float x[3];
+   toCartesian(iLat, iLon, x);
+   int index = mPoints[nearestNeighbour(x)].index;
+   iI = index / mNLon;
+   iJ = index % mNLon;
+}
+
+void KDTree::getNeighbours(const float iX[3], int iNum, float iMaxDist, std::vector<std::pair<float,int> >& iNeighbours) const {
+   iNeighbours.clear();
+   struct Range {
+      int from;
+      int to;
+      float bound;
+   };
+   Range stack[128];
+   int size = 0;
+   stack[size].from = 0;
+   stack[size].to = mPoints.size();
+   stack[size].bound = 0;
+   size++;
+
+   // When the number of neighbours is limited, keep them in a max-heap so that the worst match
+   // is at the front
+   bool isLimited = iNum > 0;
+   while(size > 0) {
+      size--;
+      const Range& range = stack[size];
+      float worst = iMaxDist;
+      if(isLimited && iNeighbours.size() == iNum)
+         worst = std::min(worst, iNeighbours.front().first);
+      if(range.from >= range.to || range.bound > worst)
+         continue;
+      int from = range.from;
+      int to = range.to;
+      int med = from + (to - from)/2;
+      const Point& point = mPoints[med];
+      float dx = iX[0] - point.x[0];
+      float dy = iX[1] - point.x[1];
+      float dz = iX[2] - point.x[2];
+      float dist = dx*dx + dy*dy + dz*dz;
+      if(dist <= iMaxDist) {
+         std::pair<float,int> candidate(dist, point.index);
+         if(!isLimited) {
+            iNeighbours.push_back(candidate);
+         }
+         else if(iNeighbours.size() < iNum) {
+            iNeighbours.push_back(candidate);
+            std::push_heap(iNeighbours.begin(), iNeighbours.end());
+         }
+         else if(candidate < iNeighbours.front()) {
+            std::pop_heap(iNeighbours.begin(), iNeighbours.end());
+            iNeighbours.back() = candidate;
+            std::push_heap(iNeighbours.begin(), iNeighbours.end());
+         }
+      }
+      float diff = iX[mAxes[med]] - point.x[mAxes[med]];
+      Range& far = stack[size];
+      Range& near = stack[size+1];
+      if(diff <= 0) {
+         far.from = med + 1;
+         far.to = to;
+         near.from = from;
+         near.to = med;
+      }
+      else {
+         far.from = from;
+         far.to = med;
+         near.from = med + 1;
+         near.to = to;
+      }
+      far.bound = diff*diff;
+      near.bound = 0;
+      size += 2;
+   }
+   std::sort(iNeighbours.begin(), iNeighbours.end());
+}
+
+float KDTree::toMeters(float iChord2) {
+   double halfChord = sqrt(iChord2) / 2;
+   return 2 * Util::radiusEarth * asin(std::min(halfChord, 1.0));
+}
+
+void KDTree::getNearestNeighbours(const std::vector<float>& iLats, const std::vector<float>& iLons, int iNum,
+      std::vector<int>& iIndices, std::vector<float>& iDistances) const {
+   if(iLats.size() != iLons.size())
+      Util::error("KDTree: lats and lons not the same size");
+   if(iNum < 1)
+      Util::error("KDTree: the number of neighbours must be >= 1");
+
+   int N = iLats.size();
+   iIndices.clear();
+   iDistances.clear();
+   iIndices.resize(N*iNum, Util::MV);
+   iDistances.resize(N*iNum, Util::MV);
+   if(mPoints.size() == 0)
+      return;
+
+   #pragma omp parallel for
+   for(int k = 0; k < N; k++) {
+      if(Util::isValid(iLats[k]) && Util::isValid(iLons[k])) {
+         float x[3];
+         toCartesian(iLats[k], iLons[k], x);
+         // The squared chord distance between two points on the unit sphere is at most 4
+         std::vector<std::pair<float,int> > neighbours;
+         getNeighbours(x, iNum, 4, neighbours);
+         for(int n = 0; n < neighbours.size(); n++) {
+            iIndices[k*iNum + n] = neighbours[n].second;
+            iDistances[k*iNum + n] = toMeters(neighbours[n].first);
+         }
+      }
+   }
+}
+
+void KDTree::getNeighboursWithin(const std::vector<float>& iLats, const std::vector<float>& iLons, float iRadius,
+      std::vector<int>& iOffsets, std::vector<int>& iIndices, std::vector<float>& iDistances) const {
+   getNeighboursWithinCore(iLats, iLons, iRadius, iOffsets, iIndices, &iDistances);
+}
+
+void KDTree::getNeighboursWithin(const std::vector<float>& iLats, const std::vector<float>& iLons, float iRadius,
+      std::vector<int>& iOffsets, std::vector<int>& iIndices) const {
+   getNeighboursWithinCore(iLats, iLons, iRadius, iOffsets, iIndices, NULL);
+}
+
+void KDTree::getNeighboursWithinCore(const std::vector<float>& iLats, const std::vector<float>& iLons, float iRadius,
+      std::vector<int>& iOffsets, std::vector<int>& iIndices, std::vector<float>* iDistances) const {
+   if(iLats.size() != iLons.size())
+      Util::error("KDTree: lats and lons not the same size");
+   if(!Util::isValid(iRadius) || iRadius < 0)
+      Util::error("KDTree: radius must be >= 0");
+
+   int N = iLats.size();
+   iOffsets.clear();
+   iIndices.clear();
+   if(iDistances != NULL)
+      iDistances->clear();
+   iOffsets.resize(N+1, 0);
+   if(mPoints.size() == 0)
+      return;
+
+   // Convert the radius into a squared chord distance on the unit sphere
+   double angle = std::min((double) iRadius / Util::radiusEarth, (double) Util::pi);
+   float maxDist = 4 * pow(sin(angle / 2), 2);
+
+   std::vector<std::vector<std::pair<float,int> > > neighbours(N);
+   #pragma omp parallel for
+   for(int k = 0; k < N; k++) {
+      if(Util::isValid(iLats[k]) && Util::isValid(iLons[k])) {
+         float x[3];
+         toCartesian(iLats[k], iLons[k], x);
+         getNeighbours(x, 0, maxDist, neighbours[k]);
+      }
+   }
+
+   for(int k = 0; k < N; k++) {
+      iOffsets[k+1] = iOffsets[k] + neighbours[k].size();
+   }
+   iIndices.resize(iOffsets[N]);
+   if(iDistances != NULL)
+      iDistances->resize(iOffsets[N]);
+   #pragma omp parallel for
+   for(int k = 0; k < N; k++) {
+      for(int n = 0; n < neighbours[k].size(); n++) {
+         iIndices[iOffsets[k] + n] = neighbours[k][n].second;
+         if(iDistances != NULL)
+            (*iDistances)[iOffsets[k] + n] = toMeters(neighbours[k][n].first);
+      }
+   }
+}
+
+void KDTree::serialize(std::vector<char>& iData) const {
+   // Number of longitudes and points, followed by the points and the split axes
+   int32_t header[2] = {mNLon, (int32_t) mPoints.size()};
+   size_t N = mPoints.size();
+   iData.resize(sizeof(header) + N*sizeof(Point) + N);
+   char* curr = &iData[0];
+   memcpy(curr, header, sizeof(header));
+   curr += sizeof(header);
+   if(N > 0) {
+      memcpy(curr, &mPoints[0], N*sizeof(Point));
+      curr += N*sizeof(Point);
+      memcpy(curr, &mAxes[0], N);
+   }
+}
+
+bool KDTree::deserialize(const char* iData, size_t iSize) {
+   int32_t header[2];
+   if(iSize < sizeof(header))
+      return false;
+   memcpy(header, iData, sizeof(header));
+   if(header[0] < 0 || header[1] < 0)
+      return false;
+   size_t N = header[1];
+   if(iSize != sizeof(header) + N*sizeof(Point) + N)
+      return false;
+
+   std::vector<Point> points(N);
+   std::vector<unsigned char> axes(N);
+   if(N > 0) {
+      memcpy(&points[0], iData + sizeof(header), N*sizeof(Point));
+      memcpy(&axes[0], iData + sizeof(header) + N*sizeof(Point), N);
+   }
+   for(int i = 0; i < N; i++) {
+      if(axes[i] > 2 || points[i].index < 0)
+         return false;
+   }
+   mNLon = header[0];
+   mPoints.swap(points);
+   mAxes.swap(axes);
+   return true;
 }
@@ -1,92 +1,82 @@
 #ifndef KDTREE_H
 #define KDTREE_H
-#include <boost/scoped_ptr.hpp>
 #include <vector>
 #include "Util.h"
 #include "File/File.h"
 typedef std::vector<std::vector<int> > vec2Int;
 
+//! Spatial index for nearest neighbour lookups in a lat/lon grid. Points are stored as 3D
+//! unit vectors in a flat array, arranged as an implicit balanced tree: the node of the
+//! range [from, to) is at the middle of the range, with its left subtree in the lower half and
+//! its right subtree in the upper half. Distances are compared using squared chord lengths,
+//! which are monotonic with great-circle distances.
 class KDTree {
    public:
       KDTree();
-      void build(const vec2& iLats, const vec2& iLons);
       KDTree(const vec2& iLats, const vec2& iLons);
-      KDTree& operator=(KDTree other);
-      KDTree(const KDTree& other);
+      void build(const vec2& iLats, const vec2& iLons);
 
       void getNearestNeighbour(const File& iTo, vec2Int& iI, vec2Int& iJ) const;
       // I,J: The indices into the lat/lon grid with the nearest neighbour
       void getNearestNeighbour(float iLat, float iLon, int& iI, int& iJ) const;
 
-   private:
-      struct TreeNode {
-         bool xsection;
-         float lon;
-         float lat;
-         size_t ipos;
-         size_t jpos;
-
-         boost::scoped_ptr<TreeNode> left;
-         boost::scoped_ptr<TreeNode> right;
-
-         const TreeNode* parent;
-
-         TreeNode(): xsection(false), left(NULL), right(NULL), parent(NULL) {}
-         TreeNode(const TreeNode &other):
-            xsection(other.xsection),
-            lon(other.lon),
-            lat(other.lat),
-            ipos(other.ipos),
-            jpos(other.jpos),
-            left(NULL),
-            right(NULL),
-            parent(NULL) {
-
-            if(other.left) {
-               left.reset(new TreeNode(*other.left));
-               left->parent = this;
-            }
+      //! Find the iNum nearest neighbours of each of the points iLats/iLons. Results for point k
+      //! are stored at positions k*iNum to (k+1)*iNum-1, ordered by increasing distance. Slots are
+      //! set to Util::MV when fewer than iNum neighbours exist.
+      //! @param iIndices Indices into the flattened lat/lon grid (i*nLon + j)
+      //! @param iDistances Great-circle distances (in meters)
+      void getNearestNeighbours(const std::vector<float>& iLats, const std::vector<float>& iLons, int iNum,
+            std::vector<int>& iIndices, std::vector<float>& iDistances) const;
+
+      //! Find all neighbours within iRadius (in meters) of each of the points iLats/iLons. Results
+      //! for point k are stored at positions iOffsets[k] to iOffsets[k+1]-1, ordered by increasing
+      //! distance.
+      //! @param iIndices Indices into the flattened lat/lon grid (i*nLon + j)
+      //! @param iDistances Great-circle distances (in meters)
+      void getNeighboursWithin(const std::vector<float>& iLats, const std::vector<float>& iLons, float iRadius,
+            std::vector<int>& iOffsets, std::vector<int>& iIndices, std::vector<float>& iDistances) const;
+      //! Same as above, but without computing the distances
+      void getNeighboursWithin(const std::vector<float>& iLats, const std::vector<float>& iLons, float iRadius,
+            std::vector<int>& iOffsets, std::vector<int>& iIndices) const;
+
+      //! Store the tree in a flat array of bytes, so that it can be restored without being rebuilt
+      void serialize(std::vector<char>& iData) const;
+      //! Restore a tree from data created by serialize. Returns false if the data is not a valid tree.
+      bool deserialize(const char* iData, size_t iSize);
 
-            if(other.right) {
-               right.reset(new TreeNode(*other.right));
-               right->parent = this;
-            }
-         }
+   private:
+      struct Point {
+         float x[3];
+         // Index into the flattened lat/lon grid (i*nLon + j)
+         int index;
       };
-
-      struct Indexed {
-         float lon;
-         float lat;
-         size_t index1;
-         size_t index2;
-
-         Indexed() {}
-         Indexed(const float lon_,
-                 const float lat_,
-                 const size_t index1_,
-                 const size_t index2_):
-            lon(lon_), lat(lat_), index1(index1_), index2(index2_) {}
+      //! Orders points by one of the three coordinates
+      class CompareAxis {
+         public:
+            CompareAxis(int iAxis) : mAxis(iAxis) {};
+            bool operator()(const Point& iLeft, const Point& iRight) const {
+               return iLeft.x[mAxis] < iRight.x[mAxis];
+            };
+         private:
+            int mAxis;
       };
 
-      typedef boost::scoped_ptr<TreeNode> unode;
-      unode mRoot;
-      vec2 mLats;
-      vec2 mLons;
-
-      friend bool compareLons (const KDTree::Indexed& l, const KDTree::Indexed& r);
-      friend bool compareLats (const KDTree::Indexed& l, const KDTree::Indexed& r);
-      typedef std::vector<Indexed> indexdVec;
-
-
-      static const TreeNode* nearestNeighbour(const unode& root, const float lon, const float lat);
-      static const TreeNode* firstGuess(const unode& root, const float lon, const float lat);
-      static void subTree(indexdVec& iLonLat,
-                          const size_t from,
-                          const size_t to,
-                          const bool xsection,
-                          const TreeNode* parent,
-                          unode& root);
-
+      //! Convert lat/lon (in degrees) into a point on the unit sphere
+      static void toCartesian(float iLat, float iLon, float iX[3]);
+      //! Returns the position in mPoints of the point nearest to iX
+      int nearestNeighbour(const float iX[3]) const;
+      //! Find up to iNum (all if iNum is 0) points with a squared chord distance to iX of at most
+      //! iMaxDist. iNeighbours is filled with (squared chord distance, grid index) sorted by distance.
+      void getNeighbours(const float iX[3], int iNum, float iMaxDist, std::vector<std::pair<float,int> >& iNeighbours) const;
+      static float toMeters(float iChord2);
+      //! Implements getNeighboursWithin. Distances are only computed if iDistances is not NULL.
+      void getNeighboursWithinCore(const std::vector<float>& iLats, const std::vector<float>& iLons, float iRadius,
+            std::vector<int>& iOffsets, std::vector<int>& iIndices, std::vector<float>* iDistances) const;
+
+      std::vector<Point> mPoints;
+      // Coordinate (0, 1, 2) that node is split along
+      std::vector<unsigned char> mAxes;
+      int mNLon;
 };
 
 #endif
@@ -0,0 +1,175 @@
+#include "Binary.h"
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../Util.h"
+
+namespace {
+   const char magic[8] = {'G','R','I','D','P','P','P','1'};
+   struct Header {
+      char magic[8];
+      int32_t numLocations;
+      int32_t numTimes;
+      int32_t numParameters;
+      int32_t isTimeDependent;
+      // Number of bytes in the serialized tree
+      int64_t treeSize;
+   };
+}
+
+ParameterFileBinary::ParameterFileBinary(const Options& iOptions, bool iIsNew) : ParameterFile(iOptions, iIsNew) {
+   if(iIsNew || !Util::exists(getFilename()))
+      return;
+   if(!read()) {
+      Util::error("Parameter file '" + getFilename() + "' is not a valid binary parameter file");
+   }
+}
+
+bool ParameterFileBinary::read() {
+   int fd = open(getFilename().c_str(), O_RDONLY);
+   if(fd == -1)
+      return false;
+
+   struct stat info;
+   if(fstat(fd, &info) != 0 || info.st_size < sizeof(Header)) {
+      close(fd);
+      return false;
+   }
+   size_t size = info.st_size;
+   void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if(map == MAP_FAILED)
+      return false;
+
+   // Check that the sections described in the header add up to the size of the file
+   const char* data = static_cast<const char*>(map);
+   Header header;
+   memcpy(&header, data, sizeof(Header));
+   size_t N = header.numLocations;
+   size_t T = header.numTimes;
+   size_t S = header.numParameters;
+   bool isValid = memcmp(header.magic, magic, sizeof(magic)) == 0 && header.numLocations >= 0
+      && header.numTimes >= 0 && header.numParameters >= 0 && header.treeSize >= 0;
+   size_t locationsSize = 3*N*sizeof(float);
+   size_t valuesSize = N*T*S*sizeof(float);
+   size_t isSetSize = N*T;
+   isValid = isValid && size == sizeof(Header) + locationsSize + valuesSize + isSetSize + header.treeSize;
+
+   if(isValid) {
+      const float* locationValues = reinterpret_cast<const float*>(data + sizeof(Header));
+      const float* values = reinterpret_cast<const float*>(data + sizeof(Header) + locationsSize);
+      const unsigned char* isSet = reinterpret_cast<const unsigned char*>(data + sizeof(Header) + locationsSize + valuesSize);
+      const char* tree = data + sizeof(Header) + locationsSize + valuesSize + isSetSize;
+
+      std::vector<Location> locations(N, Location(0,0,0));
+      for(int i = 0; i < N; i++) {
+         locations[i] = Location(locationValues[3*i], locationValues[3*i+1], locationValues[3*i+2]);
+      }
+      setParameterArrays(locations, T, S, values, isSet);
+      setIsTimeDependent(header.isTimeDependent);
+      setMaxTime(std::max((int) T - 1, 0));
+
+      if(N > 0) {
+         KDTree searchTree;
+         if(searchTree.deserialize(tree, header.treeSize))
+            setTree(searchTree);
+         else
+            recomputeTree();
+      }
+
+      std::stringstream ss;
+      ss << "Reading " << getFilename() << ". Found " << N << " locations and " << T << " times.";
+      Util::status(ss.str());
+   }
+   munmap(map, size);
+   return isValid;
+}
+
+void ParameterFileBinary::write() const {
+   // Store locations in the order of getLocations, so that they can be indexed quickly when read
+   std::vector<Location> locations = getLocations();
+   std::vector<int> times = ParameterFile::getTimes();
+   int N = locations.size();
+   int T = times.size();
+   if(N == 0 || T == 0) {
+      Util::error("Cannot write parameter file '" + getFilename() + "'. No data to write.");
+   }
+   int S = getNumParameters();
+
+   std::vector<float> locationValues(3*N);
+   std::vector<float> values((size_t) N*T*S, Util::MV);
+   std::vector<unsigned char> isSet((size_t) N*T, 0);
+   for(int i = 0; i < N; i++) {
+      locationValues[3*i] = locations[i].lat();
+      locationValues[3*i+1] = locations[i].lon();
+      locationValues[3*i+2] = locations[i].elev();
+      int index = getLocationIndex(locations[i]);
+      for(int t = 0; t < T; t++) {
+         const float* par = getValues(index, times[t]);
+         if(par != NULL) {
+            std::copy(par, par + S, values.begin() + ((size_t) i*T + t)*S);
+            isSet[(size_t) i*T + t] = 1;
+         }
+      }
+   }
+
+   // Build the tree with the locations in the order they are written
+   vec2 lats(N, std::vector<float>(1, 0));
+   vec2 lons(N, std::vector<float>(1, 0));
+   for(int i = 0; i < N; i++) {
+      lats[i][0] = locations[i].lat();
+      lons[i][0] = locations[i].lon();
+   }
+   KDTree searchTree(lats, lons);
+   std::vector<char> tree;
+   searchTree.serialize(tree);
+
+   Header header;
+   memcpy(header.magic, magic, sizeof(magic));
+   header.numLocations = N;
+   header.numTimes = T;
+   header.numParameters = S;
+   header.isTimeDependent = isTimeDependent();
+   header.treeSize = tree.size();
+
+   FILE* fid = fopen(getFilename().c_str(), "wb");
+   if(fid == NULL) {
+      Util::error("Cannot write parameters to " + getFilename());
+   }
+   bool success = fwrite(&header, sizeof(Header), 1, fid) == 1;
+   success = success && fwrite(&locationValues[0], sizeof(float), locationValues.size(), fid) == locationValues.size();
+   if(values.size() > 0)
+      success = success && fwrite(&values[0], sizeof(float), values.size(), fid) == values.size();
+   success = success && fwrite(&isSet[0], 1, isSet.size(), fid) == isSet.size();
+   success = success && fwrite(&tree[0], 1, tree.size(), fid) == tree.size();
+   success = (fclose(fid) == 0) && success;
+   if(!success) {
+      Util::error("Could not write parameters to " + getFilename());
+   }
+}
+
+bool ParameterFileBinary::isValid(std::string iFilename) {
+   FILE* fid = fopen(iFilename.c_str(), "rb");
+   if(fid == NULL)
+      return false;
+   char header[sizeof(magic)];
+   bool status = fread(header, sizeof(magic), 1, fid) == 1 && memcmp(header, magic, sizeof(magic)) == 0;
+   fclose(fid);
+   return status;
+}
+
+bool ParameterFileBinary::isReadable() const {
+   return ParameterFileBinary::isValid(getFilename());
+}
+
+std::string ParameterFileBinary::description() {
+   std::stringstream ss;
+   ss << Util::formatDescription("-p binary", "Parameters stored in a binary file, which is fast to read since no parsing is needed. The file contains the parameters for all locations and times, together with a search tree for the locations. Files can be created by gridpp_train and gridpp_kf, and can only be read on machines with the same byte order.") << std::endl;
+   ss << Util::formatDescription("   file=required", "Filename of file.") << std::endl;
+   return ss.str();
+}
@@ -0,0 +1,30 @@
+#ifndef PARAMETER_FILE_BINARY_H
+#define PARAMETER_FILE_BINARY_H
+#include <iostream>
+#include "ParameterFile.h"
+#include "../Parameters.h"
+#include "../Location.h"
+
+//! Parameters stored in a binary file, which is memory-mapped when read so that no parsing is
+//! needed. The file has a fixed header, followed by the locations, the parameters as a
+//! [location][time][parameter] array, flags for which sets are available, and the nearest
+//! neighbour tree of the locations. Values are stored in the byte order of the machine that wrote
+//! the file.
+class ParameterFileBinary : public ParameterFile {
+   public:
+      ParameterFileBinary(const Options& iOptions, bool iIsNew=false);
+
+      bool isFixedSize() const {return true;};
+
+      static bool isValid(std::string iFilename);
+      bool isReadable() const;
+
+      static std::string description();
+      std::string name() const {return "binary";};
+
+      void write() const;
+   private:
+      //! Read parameters from the file. Returns false if the file is not a valid parameter file.
+      bool read();
+};
+#endif
@@ -4,6 +4,7 @@
 #include "../Util.h"
 #include "../NetcdfUtil.h"
 #include <assert.h>
+#include <algorithm>
 #include <set>
 #include <fstream>
 #include <math.h>
@@ -80,26 +81,29 @@ ParameterFileNetcdf::ParameterFileNetcdf(const Options& iOptions, bool iIsNew) :
    handleNetcdfError(status, "could not get times");
 
    int var = getVar(mFile, mVarName);
-   int totalNumParameters = nLat*nLon*nTime*nCoeff;
    float* values = getNcFloats(mFile, var);
 
    // Initialize parameters to empty and then fill in later
    std::vector<Location> locations;
    for(int i = 0; i < nLat; i++) {
       for(int j = 0; j < nLon; j++) {
-         int locIndex = i * nLon + j;
          Location location(lats[i][j], lons[i][j], elevs[i][j]);
          locations.push_back(location);
       }
    }
    initializeEmpty(locations, nTime, nCoeff);
+   // Position of each gridpoint in the parameter array
+   std::vector<int> locationIndices(nLat*nLon);
+   for(int k = 0; k < nLat*nLon; k++) {
+      locationIndices[k] = getLocationIndex(locations[k]);
+   }
 
    /*
-   Read parameters from file and arrange them in mParameters. This is a bit tricky because we do not
+   Read parameters from file and arrange them in the parameter array. This is a bit tricky because we do not
    force a certain ordering of dimensions in the coefficients variable. In addition, the variable
    may or may not have a time dimension. The algorithm is to figure out what order the various
    dimensions are and then loop over the retrieved parameters placing them into the right position
-   in mParameters.
+   in the parameter array.
    */
 
    // Which index in list of dimension is each dimension?
@@ -142,32 +146,53 @@ ParameterFileNetcdf::ParameterFileNetcdf(const Options& iOptions, bool iIsNew) :
    if(!Util::isValid(coeffDimIndex))
       Util::error("Coefficients in " + getFilename() + " is missing coefficient dimension");
 
-   // Loop over the parameters placing them into the right position
-   int index = 0;
-   Parameters par;
-   while(index < totalNumParameters) {
-      float currParameter = values[index];
-      // Translate the linear index into a vector index
-      std::vector<int> indices = getIndices(index, sizes);
-      assert(indices.size() == ndims);
-
-      // Determine the location, time, and parameter corresponding to 'index'
-      int i = indices[latDimIndex];
-      int j = indices[lonDimIndex];
-      int coeffIndex = indices[coeffDimIndex];
-      int timeIndex = 0;
-      if(Util::isValid(timeDimIndex))
-         timeIndex = indices[timeDimIndex];
-
-      Location location(lats[i][j], lons[i][j], elevs[i][j]);
-
-      // TODO: Only insert when parameters are valid
-      // Assign parameter
-      mParameters[location][timeIndex][coeffIndex] = currParameter;
-      if(timeIndex > 0)
-         setIsTimeDependent(true);
-      setMaxTime(std::max(getMaxTime(), timeIndex));
-      index++;
+   // Number of values between consecutive indices of each dimension, with the last dimension
+   // changing fastest
+   std::vector<long> strides(ndims, 1);
+   for(int d = ndims-2; d >= 0; d--) {
+      strides[d] = strides[d+1] * sizes[d+1];
+   }
+   long latStride = strides[latDimIndex];
+   long lonStride = strides[lonDimIndex];
+   long coeffStride = strides[coeffDimIndex];
+   long timeStride = 0;
+   int nTimeVar = 1;
+   if(Util::isValid(timeDimIndex)) {
+      timeStride = strides[timeDimIndex];
+      nTimeVar = sizes[timeDimIndex];
+   }
+   if(nTimeVar > 1)
+      setIsTimeDependent(true);
+   setMaxTime(std::max(getMaxTime(), nTimeVar-1));
+
+   // When several gridpoints have the same location, the last one is used
+   std::vector<int> lastGridpoint(nLat*nLon, Util::MV);
+   for(int k = 0; k < nLat*nLon; k++) {
+      lastGridpoint[locationIndices[k]] = k;
+   }
+
+   // Copy the coefficients of each location and time, which are contiguous when the coefficient
+   // dimension is last
+   #pragma omp parallel for
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         int locationIndex = locationIndices[i*nLon + j];
+         if(lastGridpoint[locationIndex] != i*nLon + j)
+            continue;
+         for(int t = 0; t < nTimeVar; t++) {
+            // TODO: Only insert when parameters are valid
+            const float* source = values + i*latStride + j*lonStride + t*timeStride;
+            float* target = getValueBuffer(locationIndex, t);
+            if(coeffStride == 1) {
+               std::copy(source, source + nCoeff, target);
+            }
+            else {
+               for(int c = 0; c < nCoeff; c++) {
+                  target[c] = source[c*coeffStride];
+               }
+            }
+         }
+      }
    }
 
    delete[] values;
@@ -352,25 +377,19 @@ void ParameterFileNetcdf::write() const {
 
    // Write parameters
    float* values = new float[nTime*nCoeff*nLat];
-   for(int t = 0; t < times.size(); t++) {
-      int time = times[t];
-      for(int i = 0; i < locations.size(); i++) {
-         Parameters par = getParameters(times[t], locations[i], false);
-         if(par.size() == nCoeff) {
-            for(int k = 0; k < nCoeff; k++) {
-               int index = t * nLat * nCoeff + i * nCoeff + k;
-               values[index] = par[k];
-            }
-         }
-         else if(par.size() == 0) {
-            for(int k = 0; k < nCoeff; k++) {
-               int index = t * nLat * nCoeff + i * nCoeff + k;
-               values[index] = Util::MV;
-            }
-         }
-         else {
-            Util::error("Wrong parameter size");
-         }
+   std::vector<int> locationIndices(nLat);
+   for(int i = 0; i < nLat; i++) {
+      locationIndices[i] = getLocationIndex(locations[i]);
+   }
+   #pragma omp parallel for
+   for(int t = 0; t < nTime; t++) {
+      for(int i = 0; i < nLat; i++) {
+         float* target = values + t * nLat * nCoeff + i * nCoeff;
+         const float* par = getValues(locationIndices[i], times[t]);
+         if(par != NULL)
+            std::copy(par, par + nCoeff, target);
+         else
+            std::fill(target, target + nCoeff, Util::MV);
       }
    }
    double e2 = Util::clock();
@@ -442,21 +461,6 @@ int ParameterFileNetcdf::getCoefficientDim(int iFile) const {
    return dCoeff;
 }
 
-std::vector<int> ParameterFileNetcdf::getIndices(int i, const std::vector<int>& iCount) const {
-   // The last index changes fastest, the first slowest
-   int numDims = iCount.size();
-   std::vector<int> indices;
-   indices.resize(numDims);
-   int sizeSoFar = 1;
-   for(int k = numDims-1; k >= 0; k--) {
-      int index = floor(i / sizeSoFar);
-      index     = index % iCount[k];
-      indices[k] = index;
-      sizeSoFar *= iCount[k];
-   }
-   return indices;
-}
-
 float* ParameterFileNetcdf::getNcFloats(int iFile, int iVar) {
    int size = NetcdfUtil::getTotalSize(iFile, iVar);
    float* values = new float[size];
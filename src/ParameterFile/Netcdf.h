@@ -41,10 +41,6 @@ class ParameterFileNetcdf : public ParameterFile {
       std::string mDimName;
       std::string mVarName;
       void handleNetcdfError(int status, std::string message="") const;
-      //! Convert linear index 'i' to vector 'iInidices'. 'iCount' specifies the size of the data
-      //! Using row-major ordering (last index varies fastest)
-      std::vector<int> getIndices(int i, const std::vector<int>& iCount) const;
-
       // Read variable from file, convert missing values
       // User must release memory
       float* getNcFloats(int iFile, int iVar);
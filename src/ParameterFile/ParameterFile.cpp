@@ -3,7 +3,7 @@
 #include <sstream>
 #include "../Util.h"
 #include <assert.h>
-#include <set>
+#include <algorithm>
 #include <fstream>
 
 ParameterFile::ParameterFile(const Options& iOptions, bool iIsNew) :
@@ -11,22 +11,26 @@ ParameterFile::ParameterFile(const Options& iOptions, bool iIsNew) :
       mFilename(""),
       mIsTimeDependent(false),
       mMaxTime(0),
+      mTimeStride(0),
+      mNumTimes(0),
+      mSetSize(0),
+      mNumTreeLocations(0),
       mIsNew(iIsNew) {
    iOptions.getValue("file", mFilename);
 }
 
 void ParameterFile::recomputeTree() const {
    vec2 lats, lons;
-   LocationParameters::const_iterator it = mParameters.begin();
-   for(it = mParameters.begin(); it != mParameters.end(); it++) {
-      const Location loc = it->first;
-      std::vector<float> lat(1, loc.lat());
-      std::vector<float> lon(1, loc.lon());
+   for(int i = 0; i < mLocations.size(); i++) {
+      std::vector<float> lat(1, mLocations[i].lat());
+      std::vector<float> lon(1, mLocations[i].lon());
       lats.push_back(lat);
       lons.push_back(lon);
-      mLocations.push_back(loc);
    }
    mNearestNeighbourTree.build(lats, lons);
+   mNumTreeLocations = mLocations.size();
+   mGridLocations.clear();
+   mTimeTrees.clear();
 }
 
 ParameterFile* ParameterFile::getScheme(std::string iName, const Options& iOptions, bool iIsNew) {
@@ -40,13 +44,16 @@ ParameterFile* ParameterFile::getScheme(std::string iName, const Options& iOptio
    else if(iName == "netcdf") {
       p = new ParameterFileNetcdf(iOptions, iIsNew);
    }
+   else if(iName == "binary") {
+      p = new ParameterFileBinary(iOptions, iIsNew);
+   }
    else {
       Util::error("Parameter file type '" + iName + "' not recognized");
    }
    return p;
 }
 
-Parameters ParameterFile::getParameters(int iTime) const {
+int ParameterFile::getTimeIndex(int iTime) const {
    if(iTime < 0) {
       std::stringstream ss;
       ss << "Could not load parameters for time " << iTime;
@@ -62,151 +69,335 @@ Parameters ParameterFile::getParameters(int iTime) const {
       ss << "Could not load parameters for time " << time << " (max " << mMaxTime << ")";
       Util::error(ss.str());
    }
+   return time;
+}
+
+Parameters ParameterFile::getParameters(int iTime) const {
+   int time = getTimeIndex(iTime);
 
    if(isLocationDependent()) {
       Util::error("Cannot retrieve location-independent parameters for a location-dependent file");
    }
-   // Find the right location to use
-   LocationParameters::const_iterator it;
-   if(mParameters.size() == 1) {
-      // One set of parameters for all locations
-       it = mParameters.begin();
-   }
-
-   // Find the right time to use
-   const std::vector<Parameters>& timeParameters = it->second;
-   if(timeParameters.size() > time)
-      return timeParameters[time];
-   else {
+   if(mLocations.size() == 0)
       return Parameters();
-   }
+
+   // One set of parameters for all locations
+   return getParametersAt(0, time);
 }
 Parameters ParameterFile::getParameters(int iTime, const Location& iLocation, bool iAllowNearestNeighbour) const {
-   if(iTime < 0) {
-      std::stringstream ss;
-      ss << "Could not load parameters for time " << iTime;
-      Util::error(ss.str());
-   }
+   int time = getTimeIndex(iTime);
 
-   int time = iTime;
-   if(!isTimeDependent())
-      time = 0;
+   if(mLocations.size() == 0)
+      return Parameters();
+   // Find the right location to use
+   int index = Util::MV;
+   if(iAllowNearestNeighbour)
+      index = getNearestLocationIndex(time, iLocation);
+   else
+      index = getLocationIndex(iLocation);
+   if(!Util::isValid(index))
+      return Parameters();
 
-   if(time > mMaxTime) {
-      std::stringstream ss;
-      ss << "Could not load parameters for time " << time << " (max " << mMaxTime << ")";
-      Util::error(ss.str());
+   return getParametersAt(index, time);
+}
+
+void ParameterFile::getParameters(int iTime, const File& iFile, std::vector<int>& iIndices, std::vector<Parameters>& iParameters) const {
+   int time = getTimeIndex(iTime);
+   int nLat = iFile.getNumLat();
+   int nLon = iFile.getNumLon();
+
+   // The first set is empty and used for gridpoints without parameters
+   iIndices.clear();
+   iIndices.resize(nLat*nLon, 0);
+   iParameters.clear();
+   iParameters.push_back(Parameters());
+   if(mLocations.size() == 0)
+      return;
+   if(mLocations.size() == 1) {
+      // One set of parameters for all locations
+      if(hasParameters(0, time)) {
+         iParameters.push_back(getParametersAt(0, time));
+         std::fill(iIndices.begin(), iIndices.end(), 1);
+      }
+      return;
    }
 
-   if(mParameters.size() == 0)
-      return Parameters();
-   // Find the right location to use
-   Location loc = iLocation;
-   if(iAllowNearestNeighbour) {
-      bool found = getNearestLocation(time, iLocation, loc);
-      if(!found)
-         return Parameters();
+   // Use the nearest parameter location when it has parameters for this time. Each location is
+   // only looked up once.
+   if(mNumTreeLocations != mLocations.size())
+      recomputeTree();
+   const std::vector<int>& locations = getGridLocations(iFile);
+   std::vector<int> slots(mLocations.size(), -1);
+   std::vector<int> remaining;
+   for(int k = 0; k < nLat*nLon; k++) {
+      int p = locations[k];
+      if(slots[p] == -1) {
+         if(hasParameters(p, time)) {
+            slots[p] = iParameters.size();
+            iParameters.push_back(getParametersAt(p, time));
+         }
+         else {
+            slots[p] = 0;
+         }
+      }
+      if(slots[p] > 0)
+         iIndices[k] = slots[p];
+      else
+         remaining.push_back(k);
    }
 
-   // Find the right time to use
-   LocationParameters::const_iterator it = mParameters.find(loc);
-   if(it == mParameters.end())
-      return Parameters();
+   // Otherwise search outwards from the gridpoint
+   if(remaining.size() > 0) {
+      vec2 lats = iFile.getLats();
+      vec2 lons = iFile.getLons();
+      vec2 elevs = iFile.getElevs();
+      for(int r = 0; r < remaining.size(); r++) {
+         int k = remaining[r];
+         int i = k / nLon;
+         int j = k % nLon;
+         int p = getNearestLocationIndex(time, Location(lats[i][j], lons[i][j], elevs[i][j]));
+         if(!Util::isValid(p))
+            continue;
+         if(slots[p] <= 0) {
+            slots[p] = iParameters.size();
+            iParameters.push_back(getParametersAt(p, time));
+         }
+         iIndices[k] = slots[p];
+      }
+   }
+}
 
-   const std::vector<Parameters>& timeParameters = it->second;
-   if(timeParameters.size() > time)
-      return timeParameters[time];
-   else {
-      return Parameters();
+const std::vector<int>& ParameterFile::getGridLocations(const File& iFile) const {
+   Uuid tag = iFile.getUniqueTag();
+   std::map<Uuid, std::vector<int> >::const_iterator it = mGridLocations.find(tag);
+   if(it != mGridLocations.end())
+      return it->second;
+
+   // Use the location itself when the gridpoint is in the set, otherwise the nearest neighbour
+   int nLat = iFile.getNumLat();
+   int nLon = iFile.getNumLon();
+   vec2 lats = iFile.getLats();
+   vec2 lons = iFile.getLons();
+   std::vector<int>& locations = mGridLocations[tag];
+   locations.resize(nLat*nLon);
+   #pragma omp parallel for
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         int index = getLocationIndex(Location(lats[i][j], lons[i][j]));
+         if(!Util::isValid(index)) {
+            int J;
+            mNearestNeighbourTree.getNearestNeighbour(lats[i][j], lons[i][j], index, J);
+         }
+         locations[i*nLon + j] = index;
+      }
    }
+   return locations;
 }
 
 bool ParameterFile::getNearestLocation(int iTime, const Location& iLocation, Location& iNearestLocation) const {
-   if(mParameters.size() == 1) {
+   int index = getNearestLocationIndex(iTime, iLocation);
+   if(!Util::isValid(index))
+      return false;
+   iNearestLocation = mLocations[index];
+   return true;
+}
+
+int ParameterFile::getNearestLocationIndex(int iTime, const Location& iLocation) const {
+   if(mLocations.size() == 1) {
       // One set of parameters for all locations
-      LocationParameters::const_iterator it = mParameters.begin();
-      iNearestLocation = it->first;
+      return 0;
    }
-   else {
-      // Try to see if we have an exact location
-      LocationParameters::const_iterator it2 = mParameters.find(iLocation);
-      if(it2 == mParameters.end()) {
-         // If not, use the nearest neighbour
-         int I, J;
-         mNearestNeighbourTree.getNearestNeighbour(iLocation.lat(), iLocation.lon(), I, J);
-         const Location& loc = mLocations[I];
-         it2 = mParameters.find(loc);
-      }
-      bool hasAtThisTime = it2->second.size() > iTime && it2->second[iTime].size() != 0;
-      if(hasAtThisTime) {
-         iNearestLocation = it2->first;
-         return true;
-      }
-      else {
-         LocationParameters::const_iterator it = mParameters.find(iLocation);
-         if(it == mParameters.end() || it->second.size() <= iTime || it->second[iTime].size() == 0) {
-            LocationParameters::const_iterator it;
-            float minDist = Util::MV;
-            for(it = mParameters.begin(); it != mParameters.end(); it++) {
-               const Location& currLoc = it->first;
-               float dist = iLocation.getDistance(currLoc);
-               if(!Util::isValid(minDist) || (Util::isValid(dist) && dist < minDist)) {
-                  // Check that this location actually has parameters available for this time
-                  bool hasAtThisTime = it->second.size() > iTime && it->second[iTime].size() != 0;
-                  if(hasAtThisTime) {
-                     minDist = dist;
-                     iNearestLocation = it->first;
-                  }
-               }
-            }
-            if(!Util::isValid(minDist)) {
-               return false;
-            }
-            else {
+   // Try to see if we have an exact location. If not, use the nearest neighbour
+   int index = getLocationIndex(iLocation);
+   if(!Util::isValid(index)) {
+      int J;
+      mNearestNeighbourTree.getNearestNeighbour(iLocation.lat(), iLocation.lon(), index, J);
+      if(!Util::isValid(index))
+         return Util::MV;
+   }
+   if(hasParameters(index, iTime))
+      return index;
+
+   // Otherwise use the nearest of the locations with parameters for this time
+   const TimeTree& timeTree = getTimeTree(iTime);
+   if(timeTree.locations.size() == 0)
+      return Util::MV;
+   int I, J;
+   timeTree.tree.getNearestNeighbour(iLocation.lat(), iLocation.lon(), I, J);
+   return timeTree.locations[I];
+}
+
+const ParameterFile::TimeTree& ParameterFile::getTimeTree(int iTime) const {
+   // Nodes in a std::map do not move, so the reference stays valid after leaving the critical
+   // section
+   const TimeTree* timeTree;
+   #pragma omp critical(ParameterFileTimeTree)
+   {
+      std::map<int, TimeTree>::iterator it = mTimeTrees.find(iTime);
+      if(it == mTimeTrees.end()) {
+         TimeTree& newTree = mTimeTrees[iTime];
+         vec2 lats, lons;
+         for(int i = 0; i < mLocations.size(); i++) {
+            if(hasParameters(i, iTime)) {
+               lats.push_back(std::vector<float>(1, mLocations[i].lat()));
+               lons.push_back(std::vector<float>(1, mLocations[i].lon()));
+               newTree.locations.push_back(i);
             }
          }
-         else {
-            iNearestLocation = it->first;
-         }
+         if(newTree.locations.size() > 0)
+            newTree.tree.build(lats, lons);
+         timeTree = &newTree;
+      }
+      else {
+         timeTree = &it->second;
       }
    }
-   return true;
+   return *timeTree;
 }
 
 void ParameterFile::setParameters(Parameters iParameters, int iTime, const Location& iLocation) {
    mMaxTime = std::max(mMaxTime, iTime);
-   LocationParameters::const_iterator it = mParameters.find(iLocation);
-   if(mParameters[iLocation].size() <= iTime) {
-      mParameters[iLocation].resize(mMaxTime+1);
-   }
-   mParameters[iLocation][iTime] = iParameters;
    mIsTimeDependent = mIsTimeDependent || iTime > 0;
+   int index = getLocationIndex(iLocation);
+   if(!Util::isValid(index))
+      index = addLocation(iLocation);
+   reserveTimes(iTime+1);
+   mNumTimes = std::max(mNumTimes, iTime+1);
+   mTimeTrees.clear();
+
+   if(iParameters.size() == 0) {
+      mIsSet[index*mTimeStride + iTime] = 0;
+      return;
+   }
+   if(mSetSize == 0) {
+      mSetSize = iParameters.size();
+      mValues.resize(mLocations.size()*mTimeStride*mSetSize, Util::MV);
+   }
+   else if(iParameters.size() != mSetSize) {
+      std::stringstream ss;
+      ss << "Cannot add a set of " << iParameters.size() << " parameters to a parameter file with "
+         << mSetSize << " parameters in each set";
+      Util::error(ss.str());
+   }
+   float* values = getValueBuffer(index, iTime);
+   for(int i = 0; i < mSetSize; i++) {
+      values[i] = iParameters[i];
+   }
+   mIsSet[index*mTimeStride + iTime] = 1;
 }
 void ParameterFile::setParameters(Parameters iParameters, int iTime) {
    setParameters(iParameters, iTime, Location(0,0,0));
 }
 
+int ParameterFile::getLocationIndex(const Location& iLocation) const {
+   std::map<Location, int, Location::CmpIgnoreElevation>::const_iterator it = mLocationIndices.find(iLocation);
+   if(it == mLocationIndices.end())
+      return Util::MV;
+   return it->second;
+}
+
+const float* ParameterFile::getValues(int iLocationIndex, int iTime) const {
+   if(!hasParameters(iLocationIndex, iTime))
+      return NULL;
+   return &mValues[(iLocationIndex*mTimeStride + iTime)*mSetSize];
+}
+
+float* ParameterFile::getValueBuffer(int iLocationIndex, int iTime) {
+   return &mValues[(iLocationIndex*mTimeStride + iTime)*mSetSize];
+}
+
+void ParameterFile::setParameterArrays(const std::vector<Location>& iLocations, int iNumTimes, int iSetSize, const float* iValues, const unsigned char* iIsSet) {
+   int N = iLocations.size();
+   mLocations = iLocations;
+   mLocationIndices.clear();
+   for(int i = 0; i < N; i++) {
+      // Inserting in sorted order is fast when the position is hinted
+      std::map<Location, int, Location::CmpIgnoreElevation>::iterator it = mLocationIndices.insert(mLocationIndices.end(), std::pair<Location,int>(iLocations[i], i));
+      if(it->second != i)
+         Util::error("Cannot set parameters with duplicate locations");
+   }
+   mTimeStride = iNumTimes;
+   mNumTimes = iNumTimes;
+   mSetSize = iSetSize;
+   mValues.assign(iValues, iValues + (size_t) N*iNumTimes*iSetSize);
+   mIsSet.assign(iIsSet, iIsSet + (size_t) N*iNumTimes);
+   mNumTreeLocations = 0;
+   mGridLocations.clear();
+   mTimeTrees.clear();
+}
+
+void ParameterFile::setTree(const KDTree& iTree) {
+   mNearestNeighbourTree = iTree;
+   mNumTreeLocations = mLocations.size();
+   mGridLocations.clear();
+   mTimeTrees.clear();
+}
+
+bool ParameterFile::hasParameters(int iLocationIndex, int iTime) const {
+   return iTime < mTimeStride && mIsSet[iLocationIndex*mTimeStride + iTime];
+}
+
+Parameters ParameterFile::getParametersAt(int iLocationIndex, int iTime) const {
+   const float* values = getValues(iLocationIndex, iTime);
+   if(values == NULL)
+      return Parameters();
+   return Parameters(std::vector<float>(values, values + mSetSize));
+}
+
+int ParameterFile::addLocation(const Location& iLocation) {
+   int index = mLocations.size();
+   mLocations.push_back(iLocation);
+   mLocationIndices[iLocation] = index;
+   mValues.resize(mLocations.size()*mTimeStride*mSetSize, Util::MV);
+   mIsSet.resize(mLocations.size()*mTimeStride, 0);
+   return index;
+}
+
+void ParameterFile::reserveTimes(int iNumTimes) {
+   if(iNumTimes <= mTimeStride)
+      return;
+
+   // Grow geometrically so that adding one time at a time does not copy the array each time
+   int stride = std::max(iNumTimes, 2*mTimeStride);
+   int N = mLocations.size();
+   std::vector<float> values(N*stride*mSetSize, Util::MV);
+   std::vector<unsigned char> isSet(N*stride, 0);
+   for(int i = 0; i < N; i++) {
+      std::copy(mValues.begin() + i*mTimeStride*mSetSize, mValues.begin() + (i+1)*mTimeStride*mSetSize, values.begin() + i*stride*mSetSize);
+      std::copy(mIsSet.begin() + i*mTimeStride, mIsSet.begin() + (i+1)*mTimeStride, isSet.begin() + i*stride);
+   }
+   mValues.swap(values);
+   mIsSet.swap(isSet);
+   mTimeStride = stride;
+}
+
 std::string ParameterFile::getFilename() const {
    return mFilename;
 }
 
 std::vector<Location> ParameterFile::getLocations() const {
-   return mLocations;
+   // Ordered by latitude and longitude
+   std::vector<Location> locations;
+   locations.reserve(mLocations.size());
+   std::map<Location, int, Location::CmpIgnoreElevation>::const_iterator it;
+   for(it = mLocationIndices.begin(); it != mLocationIndices.end(); it++) {
+      locations.push_back(mLocations[it->second]);
+   }
+   return locations;
 }
 
 std::vector<int> ParameterFile::getTimes() const {
-   std::set<int> times;
-   LocationParameters::const_iterator it;
-   for(it = mParameters.begin(); it != mParameters.end(); it++) {
-      for(int i = 0; i < it->second.size(); i++) {
-         times.insert(i);
+   std::vector<int> times;
+   if(mLocations.size() > 0) {
+      for(int i = 0; i < mNumTimes; i++) {
+         times.push_back(i);
       }
    }
-   return std::vector<int>(times.begin(), times.end());
+   return times;
 }
 
 bool ParameterFile::isLocationDependent() const {
-   return mParameters.size() > 1;
+   return mLocations.size() > 1;
 }
 // TODO
 bool ParameterFile::isTimeDependent() const {
@@ -214,31 +405,17 @@ bool ParameterFile::isTimeDependent() const {
 }
 
 int ParameterFile::getNumParameters() const {
-   int size = Util::MV;
-
-   LocationParameters::const_iterator itLoc;
-   for(itLoc = mParameters.begin(); itLoc != mParameters.end(); itLoc++) {
-      const std::vector<Parameters>& parvec = itLoc->second;
-      for(int i = 0; i < parvec.size(); i++) {
-         int currSize = parvec[i].size();
-         if(currSize != 0) {
-            if(Util::isValid(size) && currSize != size)
-               return Util::MV;
-            size = currSize;
-         }
-         else
-            return 0;
-      }
-   }
-   return size;
+   if(mLocations.size() == 0)
+      return Util::MV;
+   return mSetSize;
 }
 
 std::string ParameterFile::getDescription(bool iSpatialOnly) {
    std::stringstream ss;
    if(iSpatialOnly)
-      ss << "What file type is the parameters in? One of 'text' and 'metnoKalman'.";
+      ss << "What file type is the parameters in? Must have parameters for each location. One of 'text' (with spatial=1), 'metnoKalman', 'netcdf', and 'binary'.";
    else
-      ss << "What file type is the parameters in? One of 'text' and 'metnoKalman'.";
+      ss << "What file type is the parameters in? One of 'text', 'metnoKalman', 'netcdf', and 'binary'.";
    return ss.str();
 }
 
@@ -251,26 +428,35 @@ std::string ParameterFile::getDescriptions() {
    ss << ParameterFileText::description() << std::endl;
    ss << ParameterFileMetnoKalman::description() << std::endl;
    ss << ParameterFileNetcdf::description() << std::endl;
+   ss << ParameterFileBinary::description() << std::endl;
    return ss.str();
 }
 
 long ParameterFile::getCacheSize() const {
-   std::map<Location, std::vector<Parameters>, Location::CmpIgnoreElevation >::const_iterator it;
-   long total = 0;
-   for(it = mParameters.begin(); it != mParameters.end(); it++) {
-      for(int i = 0; i < it->second.size(); i++) {
-         total++;
-      }
-   }
-   return total;
+   return mValues.size()*sizeof(float) + mIsSet.size()*sizeof(unsigned char);
 }
 
 void ParameterFile::initializeEmpty(const std::vector<Location>& iLocations, int iNumTimes, int iNumParameters) {
-   std::vector<float> params(iNumParameters, Util::MV);
-   Parameters parameters(params);
-   std::vector<Parameters> pars(iNumTimes, params);
+   if(mSetSize == 0) {
+      mSetSize = iNumParameters;
+      mValues.resize(mLocations.size()*mTimeStride*mSetSize, Util::MV);
+   }
+   else if(iNumParameters != mSetSize) {
+      Util::error("Cannot initialize parameters with a different number of parameters in each set");
+   }
+   reserveTimes(iNumTimes);
+   mNumTimes = std::max(mNumTimes, iNumTimes);
+   mTimeTrees.clear();
+   mLocations.reserve(mLocations.size() + iLocations.size());
    for(int i = 0; i < iLocations.size(); i++) {
-      mParameters[iLocations[i]] = pars;
+      int index = getLocationIndex(iLocations[i]);
+      if(!Util::isValid(index))
+         index = addLocation(iLocations[i]);
+      for(int t = 0; t < iNumTimes; t++) {
+         float* values = getValueBuffer(index, t);
+         std::fill(values, values + mSetSize, Util::MV);
+         mIsSet[index*mTimeStride + t] = 1;
+      }
    }
 }
 
@@ -22,6 +22,12 @@ class ParameterFile : public Scheme {
       Parameters getParameters(int iTime, const Location& iLocation, bool iAllowNearestNeighbour=true) const;
       //! Only use this if isLocationDependent() is false otherwise an error occurs
       Parameters getParameters(int iTime) const;
+      //! Get the parameters valid at time iTime for all gridpoints in iFile. This gives the same
+      //! result as calling getParameters(iTime, Location) for each gridpoint, but each distinct set of
+      //! parameters is only stored once: the parameters for gridpoint (i,j) are
+      //! iParameters[iIndices[i*nLon + j]]. Gridpoints without parameters point to an empty set.
+      //! The nearest parameter location of each gridpoint is computed once per grid and cached.
+      void getParameters(int iTime, const File& iFile, std::vector<int>& iIndices, std::vector<Parameters>& iParameters) const;
 
       static ParameterFile* getScheme(std::string iName, const Options& iOptions, bool iIsNew=false);
       //! Finds the nearest parameter location with valid data at time iTime. Returns true if a
@@ -46,43 +52,99 @@ class ParameterFile : public Scheme {
       virtual std::vector<int> getTimes() const;
       virtual bool isReadable() const = 0;
 
-      // Returns Util::MV if the number are not consistent
+      //! Returns the number of parameters in each set (0 if none have been set). Returns Util::MV
+      //! if there are no locations.
       int getNumParameters() const;
 
+      //! Returns the position of iLocation in the parameter array, or Util::MV if the location has no
+      //! parameters. Positions are assigned in the order locations are added.
+      int getLocationIndex(const Location& iLocation) const;
+      //! Get the getNumParameters() contiguous values for the location at position iLocationIndex
+      //! and time iTime. Returns NULL if the location does not have parameters for this time.
+      const float* getValues(int iLocationIndex, int iTime) const;
+
       std::string getFilename() const;
       virtual std::string name() const = 0;
+      //! Describes the parameter file types
+      //! @param iSpatialOnly Describe the file types for calibrators that need parameters for each location
       static std::string getDescription(bool iSpatialOnly=false);
       virtual void write() const {};
 
       static std::string getDescriptions();
 
-      // Return the number of bytes in cache
+      //! Return the number of bytes used to store the parameters
       long getCacheSize() const;
    protected:
-
-      // Store all location-dependent parameters here
-      typedef std::map<Location, std::vector<Parameters>, Location::CmpIgnoreElevation > LocationParameters;
-      LocationParameters mParameters; // Location, Offset, Parameters
       std::string mFilename;
       void setFilename(std::string iFilename);
       bool mIsNew; // Should this file be created?
+      //! Add parameters for iNumTimes times for each location, with all values set to missing
       void initializeEmpty(const std::vector<Location>& iLocations, int iNumTimes, int iNumParameters);
+      //! Writable version of getValues, for filling in parameters after initializeEmpty
+      float* getValueBuffer(int iLocationIndex, int iTime);
+      //! Replace all parameters. Locations must be unique and are added fastest when ordered as in
+      //! getLocations(). iValues has dimensions [location][time][parameter] and iIsSet
+      //! [location][time], which is nonzero where a location has parameters for a time.
+      void setParameterArrays(const std::vector<Location>& iLocations, int iNumTimes, int iSetSize, const float* iValues, const unsigned char* iIsSet);
+      //! Use iTree as the nearest neighbour tree for the current locations instead of recomputing it
+      void setTree(const KDTree& iTree);
       void setIsTimeDependent(bool iFlag);
       void setMaxTime(int iMaxTime);
       int getMaxTime() const;
    private:
+      //! Check that parameters can be retrieved for iTime and return the time index to use
+      int getTimeIndex(int iTime) const;
+      //! Returns the position of the location nearest to iLocation that has parameters for time
+      //! index iTime, or Util::MV if there is no such location
+      int getNearestLocationIndex(int iTime, const Location& iLocation) const;
+      //! Returns the position in the parameter array of the nearest location for each gridpoint
+      const std::vector<int>& getGridLocations(const File& iFile) const;
+      //! Nearest neighbour tree with only the locations that have parameters for one time
+      struct TimeTree {
+         KDTree tree;
+         // Position in the parameter array of each location in the tree
+         std::vector<int> locations;
+      };
+      //! Returns the tree for time index iTime, creating it if needed. Safe to call in parallel.
+      const TimeTree& getTimeTree(int iTime) const;
+      bool hasParameters(int iLocationIndex, int iTime) const;
+      Parameters getParametersAt(int iLocationIndex, int iTime) const;
+      //! Add a new location without parameters and return its position
+      int addLocation(const Location& iLocation);
+      //! Make room for at least iNumTimes times for each location
+      void reserveTimes(int iNumTimes);
       bool mIsTimeDependent;
       int mMaxTime;
 
+      // All parameters are stored in one array with dimensions [location][time][parameter], with
+      // room for mTimeStride times per location. mIsSet ([location][time]) records which sets
+      // are available.
+      std::vector<float> mValues;
+      std::vector<unsigned char> mIsSet;
+      int mTimeStride;
+      // Number of times with parameters for any location
+      int mNumTimes;
+      // Number of values in each set of parameters (0 until the first set is added)
+      int mSetSize;
+      // Location at each position in the parameter array, and the position of each location
+      std::vector<Location> mLocations;
+      std::map<Location, int, Location::CmpIgnoreElevation> mLocationIndices;
+
       // Storing nearest neighbour information. Create a tree with the locations so that lookup for
-      // a location is fast. However, every time a new location is added to mParameters, the tree
-      // must be recomputed.
+      // a location is fast. However, every time a new location is added, the tree must be
+      // recomputed.
       mutable KDTree mNearestNeighbourTree;
-      // Locations in the tree
-      mutable std::vector<Location> mLocations;
+      // Number of locations in the tree
+      mutable int mNumTreeLocations;
+      // Trees used when the nearest location has no parameters for a time, for each time. Must be
+      // cleared when locations or available parameters change.
+      mutable std::map<int, TimeTree> mTimeTrees;
+      // Position in the parameter array for each gridpoint, for each grid (by its unique tag)
+      mutable std::map<Uuid, std::vector<int> > mGridLocations;
 };
 #include "MetnoKalman.h"
 #include "Text.h"
 #include "Simple.h"
 #include "Netcdf.h"
+#include "Binary.h"
 #endif
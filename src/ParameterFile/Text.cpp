@@ -2,6 +2,7 @@
 #include <fstream>
 #include <sstream>
 #include "../Util.h"
+#include "../TextReader.h"
 #include <assert.h>
 #include <set>
 #include <fstream>
@@ -12,71 +13,56 @@ ParameterFileText::ParameterFileText(const Options& iOptions, bool iIsNew) : Par
    iOptions.getValue("spatial", mIsSpatial);
    if(iIsNew)
       return;
-   std::ifstream ifs(getFilename().c_str(), std::ifstream::in);
-   if(!ifs.good()) {
+   TextReader reader(getFilename());
+   if(!reader.isValid()) {
       return;
    }
+   std::vector<double> allValues;
+   std::vector<int> offsets;
+   int invalidLine = reader.readAll(allValues, offsets);
+   if(Util::isValid(invalidLine)) {
+      std::stringstream ss;
+      ss << "Could not read line " << invalidLine + 1 << " in file '" << mFilename << "'";
+      Util::error(ss.str());
+   }
+
+   // Number of columns before the parameters
+   int numHeader = mIsSpatial ? 4 : 1;
    int numParameters = Util::MV;
    int counter = 0;
    std::set<int> times;
-   while(ifs.good()) {
-      char line[10000];
-      ifs.getline(line, 10000, '\n');
-      if(ifs.good() && line[0] != '#') {
-         std::stringstream ss(line);
-         // Loop over each value
-         std::vector<float> values;
-         int time;
-         bool status = ss >> time;
-         if(!status) {
-            Util::error("Could not read time from file '" + mFilename + "'");
-         }
-         times.insert(time);
-
-         Location location(0,0,0);
-         if(mIsSpatial) {
-            float lat;
-            status = ss >> lat;
-            if(!status) {
-               Util::error("Could not read lat from file '" + mFilename + "'");
-            }
-
-            float lon;
-            status = ss >> lon;
-            if(!status) {
-               Util::error("Could not read lon from file '" + mFilename + "'");
-            }
+   for(int l = 0; l < reader.getNumLines(); l++) {
+      int numValues = offsets[l+1] - offsets[l];
+      if(numValues == 0)
+         continue;
+      if(numValues < numHeader) {
+         std::stringstream ss;
+         ss << "Could not read " << (mIsSpatial ? "time, lat, lon and elev" : "time") << " on line "
+            << l + 1 << " in file '" << mFilename << "'";
+         Util::error(ss.str());
+      }
+      const double* lineValues = &allValues[offsets[l]];
+      int time = lineValues[0];
+      times.insert(time);
 
-            float elev;
-            status = ss >> elev;
-            if(!status) {
-               Util::error("Could not read elev from file '" + mFilename + "'");
-            }
-            location = Location(lat, lon, elev);
-         }
+      Location location(0,0,0);
+      if(mIsSpatial) {
+         location = Location(lineValues[1], lineValues[2], lineValues[3]);
+      }
 
-         while(ss.good()) {
-            float value;
-            bool status  = ss >> value;
-            if(!status) {
-               Util::error("Could not read value from file '" + mFilename + "'");
-            }
-            values.push_back(value);
-         }
-         if(numParameters == Util::MV)
-            numParameters = values.size();
-         else if(values.size() != numParameters) {
-            std::stringstream ss;
-            ss << "Parameter file '" + getFilename() + "' is corrupt, because it does not have the same"
-               << " number of columns on each line" << std::endl;
-            Util::error(ss.str());
-         }
-         Parameters parameters(values);
-         setParameters(parameters, time, location);
-         counter++;
+      std::vector<float> values(lineValues + numHeader, lineValues + numValues);
+      if(numParameters == Util::MV)
+         numParameters = values.size();
+      else if(values.size() != numParameters) {
+         std::stringstream ss;
+         ss << "Parameter file '" + getFilename() + "' is corrupt, because it does not have the same"
+            << " number of columns on each line" << std::endl;
+         Util::error(ss.str());
       }
+      Parameters parameters(values);
+      setParameters(parameters, time, location);
+      counter++;
    }
-   ifs.close();
    mTimes = std::vector<int>(times.begin(), times.end());
    std::sort(mTimes.begin(), mTimes.end());
 
@@ -121,26 +107,29 @@ void ParameterFileText::write(const std::string& iFilename) const {
       Util::error("Cannot write parameters to " + filename);
    }
 
-   std::map<Location, std::vector<Parameters> >::const_iterator it;
-   // Loop over times
+   std::vector<Location> locations = getLocations();
+   // Use all times with parameters, not just those read from the file
+   std::vector<int> times = ParameterFile::getTimes();
    if(mIsSpatial)
       ofs << "# time lat lon elev parameters" << std::endl;
    else
       ofs << "# time parameters" << std::endl;
-   for(it = mParameters.begin(); it != mParameters.end(); it++) {
-      // Loop over locations
-      const Location& location = it->first;
-      for(int i = 0; i < it->second.size(); i++) {
-         int time = i;
-         const Parameters& parameters = it->second[i];
-         if(parameters.size() != 0) {
+   // Loop over locations
+   for(int l = 0; l < locations.size(); l++) {
+      const Location& location = locations[l];
+      int index = getLocationIndex(location);
+      // Loop over times
+      for(int t = 0; t < times.size(); t++) {
+         int time = times[t];
+         const float* values = getValues(index, time);
+         if(values != NULL) {
             ofs << time;
             if(mIsSpatial) {
                ofs << " " << location.lat() << " " << location.lon() << " " << location.elev();
             }
             // Loop over parameter values
-            for(int i = 0; i < parameters.size(); i++) {
-               ofs << " " << parameters[i];
+            for(int i = 0; i < getNumParameters(); i++) {
+               ofs << " " << values[i];
             }
             ofs << std::endl;
          }
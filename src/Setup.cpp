@@ -1,7 +1,27 @@
 #include "Setup.h"
+#include <algorithm>
+#include <iostream>
 #include "File/File.h"
 #include "Calibrator/Calibrator.h"
 #include "Downscaler/Downscaler.h"
+#include "DiskCache.h"
+
+namespace {
+   //! Variables that a file can derive from iVariable when they are not in the file (see File::getField)
+   std::vector<Variable::Type> getDerivedVariables(Variable::Type iVariable) {
+      std::vector<Variable::Type> variables;
+      if(iVariable == Variable::Precip)
+         variables.push_back(Variable::PrecipAcc);
+      else if(iVariable == Variable::PrecipAcc)
+         variables.push_back(Variable::Precip);
+      else if(iVariable == Variable::U || iVariable == Variable::V ||
+            iVariable == Variable::Xwind || iVariable == Variable::Ywind) {
+         variables.push_back(Variable::W);
+         variables.push_back(Variable::WD);
+      }
+      return variables;
+   }
+}
 
 Setup::Setup(const std::vector<std::string>& argv) {
 
@@ -13,7 +33,12 @@ Setup::Setup(const std::vector<std::string>& argv) {
    while(index < argv.size()) {
       std::string arg = argv[index];
       if(inputFilename == "") {
-         inputFilename = arg;
+         if(Util::hasChar(arg, '=')) {
+            runOptions.addOptions(arg);
+         }
+         else {
+            inputFilename = arg;
+         }
       }
       else if(outputFilename == "") {
          if(Util::hasChar(arg, '=')) {
@@ -33,6 +58,14 @@ Setup::Setup(const std::vector<std::string>& argv) {
       }
       index++;
    }
+   // Neighbour lookups are shared by all downscalers, so they use the same cache
+   std::string cacheDir;
+   if(runOptions.getValue("cacheDir", cacheDir)) {
+      float cacheSize = 1000;
+      runOptions.getValue("cacheSize", cacheSize);
+      DiskCache::setDirectory(cacheDir, cacheSize * 1e6);
+   }
+
    std::vector<std::string> inputFilenames = Util::glob(inputFilename);
    std::vector<std::string> outputFilenames = Util::glob(outputFilename);
    if(inputFilenames.size() != outputFilenames.size()) {
@@ -485,6 +518,121 @@ Setup::~Setup() {
       }
    }
 }
+void Setup::process(int iIndex, bool iVerbose) const {
+   File* inputFile = inputFiles[iIndex];
+   File* outputFile = outputFiles[iIndex];
+   if(iVerbose) {
+      std::cout << "Input type:  " << inputFile->name() << std::endl;
+      std::cout << "Output type: " << outputFile->name() << std::endl;
+   }
+   outputFile->setTimes(inputFile->getTimes());
+   outputFile->setReferenceTime(inputFile->getReferenceTime());
+
+   std::vector<Variable::Type> writeVariables;
+   std::vector<bool> writeFlags(variableConfigurations.size(), true);
+   for(int v = 0; v < variableConfigurations.size(); v++) {
+      bool write = 1;
+      variableConfigurations[v].variableOptions.getValue("write", write);
+      if(write) {
+         writeVariables.push_back(variableConfigurations[v].variable);
+         outputFile->setVariableOptions(variableConfigurations[v].variable, variableConfigurations[v].variableOptions);
+      }
+      writeFlags[v] = write;
+   }
+   // Only read the part of the input grid that the downscalers use. Files that are also written
+   // to or used for other outputs need their full grid.
+   int haloSize = 0;
+   for(int v = 0; v < variableConfigurations.size() && Util::isValid(haloSize); v++) {
+      int curr = variableConfigurations[v].downscaler->getHaloSize();
+      haloSize = Util::isValid(curr) ? std::max(haloSize, curr) : Util::MV;
+   }
+   bool isShared = std::count(inputFiles.begin(), inputFiles.end(), inputFile) > 1 ||
+      std::find(outputFiles.begin(), outputFiles.end(), inputFile) != outputFiles.end();
+   int startLat, endLat, startLon, endLon;
+   if(Util::isValid(haloSize) && !isShared &&
+         Downscaler::getBoundingBox(*inputFile, *outputFile, haloSize, startLat, endLat, startLon, endLon) &&
+         (endLat - startLat + 1 < inputFile->getNumLat() || endLon - startLon + 1 < inputFile->getNumLon()) &&
+         inputFile->crop(startLat, endLat, startLon, endLon)) {
+      if(iVerbose) {
+         std::cout << "Reading input latitudes " << startLat << "-" << endLat << " and longitudes "
+                   << startLon << "-" << endLon << std::endl;
+      }
+   }
+
+   // Write each variable as soon as it is processed, if the output file supports it. Variables
+   // used by later configurations are kept in memory until the end, since reading them back from
+   // the file can lose precision (rounding, packing) and later changes would not be written.
+   bool isStreaming = outputFile->startWrite(writeVariables);
+   std::vector<Variable::Type> deferredVariables;
+
+   // Post-process file
+   for(int v = 0; v < variableConfigurations.size(); v++) {
+      double s = Util::clock();
+      const VariableConfiguration& varconf = variableConfigurations[v];
+      Variable::Type variable = varconf.variable;
+
+      outputFile->initNewVariable(variable);
+
+      if(iVerbose) {
+         std::cout << "Processing " << Variable::getTypeName(variable) << std::endl;
+         std::cout << "   Downscaler " << varconf.downscaler->name() << std::endl;
+      }
+
+      // Downscale
+      varconf.downscaler->downscale(*inputFile, *outputFile);
+      for(int c = 0; c < varconf.calibrators.size(); c++) {
+         // Calibrate
+         if(iVerbose)
+            std::cout << "   Calibrator " << varconf.calibrators[c]->name() << std::endl;
+         varconf.calibrators[c]->calibrate(*outputFile, varconf.parameterFileCalibrators[c]);
+      }
+      if(isStreaming && writeFlags[v]) {
+         if(isUsedLater(v))
+            deferredVariables.push_back(variable);
+         else
+            outputFile->writeVariable(variable);
+      }
+      double e = Util::clock();
+      if(iVerbose) {
+         std::cout << "   " << e-s << " seconds" << std::endl;
+         std::cout << "Current mem usage input: " << inputFile->getCacheSize() / 1e6<< std::endl;
+         std::cout << "Current mem usage output: " << outputFile->getCacheSize() / 1e6<< std::endl;
+      }
+   }
+
+   // Write to output
+   double s = Util::clock();
+   if(!isStreaming) {
+      outputFile->write(writeVariables);
+   }
+   else {
+      for(int v = 0; v < deferredVariables.size(); v++)
+         outputFile->writeVariable(deferredVariables[v]);
+   }
+   double e = Util::clock();
+   if(iVerbose)
+      std::cout << "Writing file: " << e-s << " seconds" << std::endl;
+   inputFile->clear();
+   outputFile->clear();
+}
+
+bool Setup::isUsedLater(int iIndex) const {
+   std::vector<Variable::Type> variables = getDerivedVariables(variableConfigurations[iIndex].variable);
+   variables.push_back(variableConfigurations[iIndex].variable);
+   for(int v = iIndex + 1; v < variableConfigurations.size(); v++) {
+      const VariableConfiguration& varconf = variableConfigurations[v];
+      for(int i = 0; i < variables.size(); i++) {
+         if(varconf.variable == variables[i])
+            return true;
+         for(int c = 0; c < varconf.calibrators.size(); c++) {
+            if(varconf.calibrators[c]->usesVariable(variables[i]))
+               return true;
+         }
+      }
+   }
+   return false;
+}
+
 std::string Setup::defaultDownscaler() {
    return "nearestNeighbour";
 }
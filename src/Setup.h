@@ -31,12 +31,24 @@ class Setup {
    public:
       std::vector<File*> inputFiles;
       std::vector<File*> outputFiles;
+      //! Options for the whole run, given before the inputs
+      Options runOptions;
       Options inputOptions;
       Options outputOptions;
       std::vector<VariableConfiguration> variableConfigurations;
       Setup(const std::vector<std::string>& argv);
       ~Setup();
       static std::string defaultDownscaler();
+
+      //! Post-process input file iIndex and place the results in output file iIndex. Variables are
+      //! written as soon as they are processed if the output file supports it, unless a later
+      //! variable configuration uses them.
+      //! @param iVerbose Write progress and timing information to std::cout
+      void process(int iIndex, bool iVerbose=false) const;
+
+      //! Does a variable configuration after iIndex read or change the variable of configuration
+      //! iIndex (or a variable derived from it)?
+      bool isUsedLater(int iIndex) const;
    private:
       // In some cases, it is not possible to open the same file first as readonly and then writeable
       // (for NetCDF). Therefore, use the same filehandle for both if the files are the same. Remember
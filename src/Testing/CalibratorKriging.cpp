@@ -94,6 +94,66 @@ namespace {
       EXPECT_FLOAT_EQ(278.80118, (*after1)(5,5,0)); // 0.9992003 * -5.4
       EXPECT_FLOAT_EQ(287.86127, (*after1)(0,0,0)); // 0.9760893 * 4
    }
+   // The stations near each gridpoint are found with a tree when the radius is small. Check that
+   // this gives the same result as computing the weights using all stations.
+   TEST_F(TestCalibratorKriging, radiusBruteForce) {
+      FileFake from(Options("nLat=20 nLon=20 nEns=1 nTime=1"));
+      FileFake raw(Options("nLat=20 nLon=20 nEns=1 nTime=1"));
+      ParameterFile* parFile = ParameterFile::getScheme("text", Options("file=testing/files/tempKriging.txt spatial=1"), true);
+      std::vector<Location> obsLocations;
+      for(int k = 0; k < 15; k++) {
+         // Scatter the stations, with some being close enough to influence each other
+         Location loc(50.3 + 0.61 * k, 0.2 + 0.37 * (k % 7), 0);
+         obsLocations.push_back(loc);
+         parFile->setParameters(Parameters(k % 4 - 1.5f), 0, loc);
+      }
+      parFile->recomputeTree();
+      CalibratorKriging cal = CalibratorKriging(Variable::T, Options("radius=90000 efoldDist=100000"));
+      cal.calibrate(from, parFile);
+      FieldPtr after = from.getField(Variable::T, 0);
+      FieldPtr before = raw.getField(Variable::T, 0);
+
+      // Brute force: Use the covariance to every station
+      std::vector<Location> locations = parFile->getLocations();
+      int N = locations.size();
+      ASSERT_EQ(15, N);
+      vec2 matrix(N, std::vector<float>(N, 1));
+      for(int ii = 0; ii < N; ii++) {
+         for(int jj = 0; jj < N; jj++) {
+            if(ii != jj)
+               matrix[ii][jj] = cal.calcCovar(locations[ii], locations[jj]) * 0.414 / 0.5;
+         }
+      }
+      vec2 inverse = Util::inverse(matrix);
+      vec2 lats = from.getLats();
+      vec2 lons = from.getLons();
+      vec2 elevs = from.getElevs();
+      int numChanged = 0;
+      for(int i = 0; i < from.getNumLat(); i++) {
+         for(int j = 0; j < from.getNumLon(); j++) {
+            Location gridPoint(lats[i][j], lons[i][j], elevs[i][j]);
+            std::vector<float> S(N);
+            for(int ii = 0; ii < N; ii++) {
+               S[ii] = cal.calcCovar(locations[ii], gridPoint);
+            }
+            float bias = 0;
+            for(int ii = 0; ii < N; ii++) {
+               float weight = 0;
+               for(int jj = 0; jj < N; jj++) {
+                  weight += inverse[ii][jj] * S[jj];
+               }
+               bias += weight * parFile->getParameters(0, locations[ii], false)[0];
+            }
+            EXPECT_NEAR((*before)(i,j,0) + bias, (*after)(i,j,0), 1e-4);
+            if((*before)(i,j,0) != (*after)(i,j,0))
+               numChanged++;
+         }
+      }
+      // Check that the radius limits the influence of the stations
+      EXPECT_GT(numChanged, 0);
+      EXPECT_LT(numChanged, from.getNumLat() * from.getNumLon());
+      delete parFile;
+   }
    /*
    TEST_F(TestCalibratorKriging, radius) {
       {
@@ -129,6 +129,55 @@ namespace {
       EXPECT_FLOAT_EQ(310,   (*after)(5,9,0));
       EXPECT_FLOAT_EQ(316.1, (*after)(0,9,0));
    }
+   // Compare against computing the statistic directly on each neighbourhood
+   TEST_F(TestCalibratorNeighbourhood, bruteForce) {
+      const char* stats[] = {"mean", "std", "min", "max", "median", "quantile quantile=0.1", "quantile quantile=0.73"};
+      Util::StatType statTypes[] = {Util::StatTypeMean, Util::StatTypeStd, Util::StatTypeQuantile, Util::StatTypeQuantile,
+                                    Util::StatTypeQuantile, Util::StatTypeQuantile, Util::StatTypeQuantile};
+      float quantiles[] = {Util::MV, Util::MV, 0, 1, 0.5, 0.1, 0.73};
+      const int radii[] = {0, 1, 3, 12};
+      int nLat = 17;
+      int nLon = 23;
+      int nEns = 2;
+      for(int s = 0; s < 7; s++) {
+         for(int r = 0; r < 4; r++) {
+            FileFake file(Options("nLat=17 nLon=23 nEns=2 nTime=1"));
+            Field& field = *file.getField(Variable::Precip, 0);
+            for(int i = 0; i < nLat; i++) {
+               for(int j = 0; j < nLon; j++) {
+                  for(int e = 0; e < nEns; e++) {
+                     // Include areas with constant values and repeated values
+                     field(i,j,e) = i < 5 ? 0 : ((i*7 + j*13 + e*3) % 11) * 0.7;
+                     if((i*3 + j + e) % 17 == 0)
+                        field(i,j,e) = Util::MV;
+                  }
+               }
+            }
+            Field raw = field;
+            std::stringstream ss;
+            ss << "radius=" << radii[r] << " stat=" << stats[s];
+            CalibratorNeighbourhood cal(Variable::Precip, Options(ss.str()));
+            cal.calibrate(file);
+            for(int i = 0; i < nLat; i++) {
+               for(int j = 0; j < nLon; j++) {
+                  for(int e = 0; e < nEns; e++) {
+                     std::vector<float> neighbourhood;
+                     for(int ii = std::max(0, i-radii[r]); ii <= std::min(nLat-1, i+radii[r]); ii++) {
+                        for(int jj = std::max(0, j-radii[r]); jj <= std::min(nLon-1, j+radii[r]); jj++) {
+                           neighbourhood.push_back(raw(ii,jj,e));
+                        }
+                     }
+                     float expected = Util::calculateStat(neighbourhood, statTypes[s], quantiles[s]);
+                     if(statTypes[s] == Util::StatTypeQuantile)
+                        EXPECT_FLOAT_EQ(expected, field(i,j,e)) << ss.str() << " " << i << " " << j << " " << e;
+                     else
+                        EXPECT_NEAR(expected, field(i,j,e), 1e-4) << ss.str() << " " << i << " " << j << " " << e;
+                  }
+               }
+            }
+         }
+      }
+   }
    TEST_F(TestCalibratorNeighbourhood, invalid) {
       ::testing::FLAGS_gtest_death_test_style = "threadsafe";
       Util::setShowError(false);
@@ -3,6 +3,8 @@
 #include "../ParameterFile/ParameterFile.h"
 #include "../Calibrator/Window.h"
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <sstream>
 
 namespace {
    class TestCalibratorWindow : public ::testing::Test {
@@ -123,6 +125,60 @@ namespace {
          EXPECT_FLOAT_EQ(20.666666, (*from.getField(Variable::T, t))(0,0,0));
       }
    }
+   // Check that the running window gives the same answer as computing each window from scratch
+   TEST_F(TestCalibratorWindow, bruteForce) {
+      const char* stats[] = {"mean", "std", "min", "max", "median", "quantile quantile=0.1", "quantile quantile=0.73"};
+      Util::StatType statTypes[] = {Util::StatTypeMean, Util::StatTypeStd, Util::StatTypeQuantile, Util::StatTypeQuantile,
+                                    Util::StatTypeQuantile, Util::StatTypeQuantile, Util::StatTypeQuantile};
+      float quantiles[] = {Util::MV, Util::MV, 0, 1, 0.5, 0.1, 0.73};
+      const int radii[] = {0, 1, 3, 30};
+      int nLat = 3;
+      int nLon = 4;
+      int nEns = 2;
+      int nTime = 19;
+      for(int s = 0; s < 7; s++) {
+         for(int r = 0; r < 4; r++) {
+            FileFake file(Options("nLat=3 nLon=4 nEns=2 nTime=19"));
+            std::vector<Field> raw;
+            for(int t = 0; t < nTime; t++) {
+               Field& field = *file.getField(Variable::T, t);
+               for(int i = 0; i < nLat; i++) {
+                  for(int j = 0; j < nLon; j++) {
+                     for(int e = 0; e < nEns; e++) {
+                        // Include constant periods, repeated values and missing values
+                        field(i,j,e) = t < 4 ? 280 : 270 + ((t*7 + i*5 + j*13 + e*3) % 11) * 0.7;
+                        if((t*3 + i + j + e) % 13 == 0 || (i == 2 && j == 3 && t > 5 && t < 15))
+                           field(i,j,e) = Util::MV;
+                     }
+                  }
+               }
+               raw.push_back(field);
+            }
+            std::stringstream ss;
+            ss << "radius=" << radii[r] << " stat=" << stats[s];
+            CalibratorWindow cal(Variable::T, Options(ss.str()));
+            cal.calibrate(file);
+            for(int t = 0; t < nTime; t++) {
+               const Field& field = *file.getField(Variable::T, t);
+               for(int i = 0; i < nLat; i++) {
+                  for(int j = 0; j < nLon; j++) {
+                     for(int e = 0; e < nEns; e++) {
+                        std::vector<float> window;
+                        for(int tt = std::max(0, t-radii[r]); tt <= std::min(nTime-1, t+radii[r]); tt++) {
+                           window.push_back(raw[tt](i,j,e));
+                        }
+                        float expected = Util::calculateStat(window, statTypes[s], quantiles[s]);
+                        if(statTypes[s] == Util::StatTypeQuantile)
+                           EXPECT_FLOAT_EQ(expected, field(i,j,e)) << ss.str() << " " << t << " " << i << " " << j << " " << e;
+                        else
+                           EXPECT_NEAR(expected, field(i,j,e), 1e-3) << ss.str() << " " << t << " " << i << " " << j << " " << e;
+                     }
+                  }
+               }
+            }
+         }
+      }
+   }
    TEST_F(TestCalibratorWindow, invalid) {
       ::testing::FLAGS_gtest_death_test_style = "threadsafe";
       Util::setShowError(false);
@@ -0,0 +1,88 @@
+#include "../DiskCache.h"
+#include "../Util.h"
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+   class DiskCacheTest : public ::testing::Test {
+      protected:
+         DiskCacheTest() : mDirectory("testing/files/cache") {
+            mkdir(mDirectory.c_str(), 0755);
+         };
+         ~DiskCacheTest() {
+            DiskCache::disable();
+            Util::remove(mDirectory + "/key1.cache");
+            Util::remove(mDirectory + "/key2.cache");
+            Util::remove(mDirectory + "/corrupt.cache");
+            rmdir(mDirectory.c_str());
+         };
+         std::vector<std::vector<int> > getArrays() {
+            std::vector<std::vector<int> > arrays(3);
+            arrays[0].push_back(3);
+            arrays[0].push_back(Util::MV);
+            arrays[0].push_back(-2);
+            arrays[2].resize(1000, 7);
+            return arrays;
+         };
+         std::string mDirectory;
+   };
+   TEST_F(DiskCacheTest, disabled) {
+      EXPECT_FALSE(DiskCache::isEnabled());
+      std::vector<std::vector<int> > arrays = getArrays();
+      EXPECT_FALSE(DiskCache::write("key1", arrays));
+      EXPECT_FALSE(DiskCache::read("key1", arrays));
+   }
+   TEST_F(DiskCacheTest, readWrite) {
+      DiskCache::setDirectory(mDirectory);
+      EXPECT_TRUE(DiskCache::isEnabled());
+      EXPECT_EQ(mDirectory, DiskCache::getDirectory());
+      std::vector<std::vector<int> > arrays = getArrays();
+      std::vector<std::vector<int> > values;
+      EXPECT_FALSE(DiskCache::read("key1", values));
+      EXPECT_TRUE(DiskCache::write("key1", arrays));
+      EXPECT_TRUE(DiskCache::read("key1", values));
+      EXPECT_EQ(arrays, values);
+      EXPECT_FALSE(DiskCache::read("key2", values));
+
+      // Entries are kept when the cache is reenabled
+      DiskCache::disable();
+      EXPECT_FALSE(DiskCache::read("key1", values));
+      DiskCache::setDirectory(mDirectory);
+      EXPECT_TRUE(DiskCache::read("key1", values));
+      EXPECT_EQ(arrays, values);
+   }
+   TEST_F(DiskCacheTest, corrupt) {
+      DiskCache::setDirectory(mDirectory);
+      std::ofstream ofs((mDirectory + "/corrupt.cache").c_str());
+      ofs << "GRIDPPC1 this is not a cache file";
+      ofs.close();
+      Util::setShowWarning(false);
+      std::vector<std::vector<int> > values;
+      EXPECT_FALSE(DiskCache::read("corrupt", values));
+   }
+   TEST_F(DiskCacheTest, maxSize) {
+      // Room for one entry only
+      DiskCache::setDirectory(mDirectory, 5000);
+      Util::setShowStatus(false);
+      std::vector<std::vector<int> > arrays = getArrays();
+      std::vector<std::vector<int> > values;
+      EXPECT_TRUE(DiskCache::write("key1", arrays));
+      sleep(1);
+      EXPECT_TRUE(DiskCache::write("key2", arrays));
+      EXPECT_FALSE(DiskCache::read("key1", values));
+      EXPECT_TRUE(DiskCache::read("key2", values));
+      EXPECT_EQ(arrays, values);
+   }
+   TEST_F(DiskCacheTest, invalidDirectory) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      EXPECT_DEATH(DiskCache::setDirectory("testing/filesDoesNotExist/"), ".*");
+      EXPECT_DEATH(DiskCache::setDirectory(mDirectory, -1), ".*");
+   }
+}
+int main(int argc, char **argv) {
+     ::testing::InitGoogleTest(&argc, argv);
+       return RUN_ALL_TESTS();
+}
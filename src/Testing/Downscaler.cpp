@@ -1,6 +1,11 @@
 #include "../Util.h"
 #include "../File/File.h"
 #include "../Downscaler/Downscaler.h"
+#include "../DiskCache.h"
+#include "../File/Arome.h"
+#include <cmath>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <gtest/gtest.h>
 #include <boost/assign/list_of.hpp>
 
@@ -46,6 +51,7 @@ namespace {
       Downscaler* d2 = Downscaler::getScheme("gradient", Variable::T, Options("searchRadius=5 constantGradient=0.04 minElevDiff=213.2"));
       Downscaler* d3 = Downscaler::getScheme("pressure", Variable::T, Options(""));
       Downscaler* d4 = Downscaler::getScheme("bypass", Variable::T, Options(""));
+      Downscaler* d5 = Downscaler::getScheme("bilinear", Variable::T, Options(""));
       EXPECT_EQ(3, ((DownscalerSmart*) d1)->getSearchRadius());
       EXPECT_EQ(2, ((DownscalerSmart*) d1)->getNumSmart());
       EXPECT_EQ(400, ((DownscalerSmart*) d1)->getMinElevDiff());
@@ -57,6 +63,7 @@ namespace {
       EXPECT_EQ("gradient", d2->name());
       EXPECT_EQ("pressure", d3->name());
       EXPECT_EQ("bypass", d4->name());
+      EXPECT_EQ("bilinear", d5->name());
    }
    TEST_F(TestDownscaler, invalidDownscalers) {
       ::testing::FLAGS_gtest_death_test_style = "threadsafe";
@@ -89,6 +96,67 @@ namespace {
       EXPECT_EQ(1, I[1][1]);
       EXPECT_EQ(1, J[1][1]);
    }
+   TEST_F(TestDownscaler, gather) {
+      FileFake from(Options("nLat=3 nLon=2 nEns=2 nTime=1"));
+      FileFake to(Options("nLat=2 nLon=2 nEns=2 nTime=1"));
+      setLatLon(from, (const float[]) {50,55,60}, (const float[]){0,10});
+      setLatLon(to,   (const float[]) {40, 54.99},   (const float[]){-1,9.99});
+
+      std::vector<int> indices;
+      Downscaler::getNearestNeighbour(from, to, indices);
+      ASSERT_EQ(4, indices.size());
+      EXPECT_EQ(0, indices[0]);
+      EXPECT_EQ(1, indices[1]);
+      EXPECT_EQ(2, indices[2]);
+      EXPECT_EQ(3, indices[3]);
+
+      Field& fromT = *from.getField(Variable::T, 0);
+      Field& toT = *to.getField(Variable::T, 0);
+      for(int i = 0; i < 3; i++) {
+         for(int j = 0; j < 2; j++) {
+            fromT(i,j,0) = 10*i + j;
+            fromT(i,j,1) = -10*i - j;
+         }
+      }
+      indices[1] = 5;
+      indices[3] = Util::MV;
+      Downscaler::gather(indices, fromT, toT);
+      EXPECT_FLOAT_EQ(0, toT(0,0,0));
+      EXPECT_FLOAT_EQ(0, toT(0,0,1));
+      EXPECT_FLOAT_EQ(21, toT(0,1,0));
+      EXPECT_FLOAT_EQ(-21, toT(0,1,1));
+      EXPECT_FLOAT_EQ(10, toT(1,0,0));
+      EXPECT_FLOAT_EQ(-10, toT(1,0,1));
+      EXPECT_FLOAT_EQ(Util::MV, toT(1,1,0));
+      EXPECT_FLOAT_EQ(Util::MV, toT(1,1,1));
+   }
+   TEST_F(TestDownscaler, diskCache) {
+      std::string directory = "testing/files/cache";
+      mkdir(directory.c_str(), 0755);
+      FileFake from(Options("nLat=3 nLon=2 nEns=1 nTime=1"));
+      FileFake to(Options("nLat=2 nLon=2 nEns=1 nTime=1"));
+      setLatLon(from, (const float[]) {50,55,60}, (const float[]){0,10});
+      setLatLon(to,   (const float[]) {40, 54.99},   (const float[]){-1,9.99});
+
+      DiskCache::setDirectory(directory, 1e6);
+      EXPECT_TRUE(DiskCache::isEnabled());
+      vec2Int I, J, Ic, Jc;
+      Downscaler::clearCache();
+      Downscaler::getNearestNeighbour(from, to, I, J);
+      // Neighbours are read from disk when the in-memory cache is empty
+      Downscaler::clearCache();
+      Downscaler::getNearestNeighbour(from, to, Ic, Jc);
+      EXPECT_EQ(I, Ic);
+      EXPECT_EQ(J, Jc);
+      std::string filename = directory + "/nn_" + Util::hashToString(Util::hash(from.getLons(), Util::hash(from.getLats())))
+         + "_" + Util::hashToString(Util::hash(to.getLons(), Util::hash(to.getLats()))) + ".cache";
+      EXPECT_TRUE(Util::exists(filename));
+
+      Util::remove(filename);
+      rmdir(directory.c_str());
+      DiskCache::disable();
+      Downscaler::clearCache();
+   }
    TEST_F(TestDownscaler, missingLatLon) {
       FileFake from(Options("nLat=3 nLon=2 nEns=1 nTime=1"));
       FileFake to(Options("nLat=2 nLon=2 nEns=1 nTime=1"));
@@ -251,6 +319,118 @@ namespace {
       EXPECT_EQ(1, I[0][0]);
       EXPECT_EQ(1, J[0][0]);
    }
+   TEST_F(TestDownscaler, sameGrid) {
+      // Files with identical grids share the cached neighbours
+      FileFake from1(Options("nLat=3 nLon=2 nEns=1 nTime=1"));
+      FileFake from2(Options("nLat=3 nLon=2 nEns=2 nTime=2"));
+      FileFake to(Options("nLat=2 nLon=2 nEns=1 nTime=1"));
+      setLatLon(from1, (const float[]) {60,50,55}, (const float[]){5,4});
+      setLatLon(from2, (const float[]) {60,50,55}, (const float[]){5,4});
+      setLatLon(to,   (const float[]) {56,49},    (const float[]){3,4.6});
+      EXPECT_EQ(from1.getUniqueTag(), from2.getUniqueTag());
+
+      vec2Int I1, J1, I2, J2;
+      Downscaler::getNearestNeighbour(from1, to, I1, J1);
+      Downscaler::getNearestNeighbour(from2, to, I2, J2);
+      EXPECT_EQ(I1, I2);
+      EXPECT_EQ(J1, J2);
+   }
+   // Check that nearest neighbours on regular lat/lon grids match a brute force search
+   TEST_F(TestDownscaler, regularGrid) {
+      // Regional grid with decreasing latitudes, global grid, and grid crossing the date line
+      float lat0[3] = {70, -85, 50};
+      float lon0[3] = {-10, 0, 170};
+      float dlat[3] = {-1.5, 5, 0.5};
+      float dlon[3] = {2, 10, 2.5};
+      int nLon[3] = {12, 36, 9};
+      for(int g = 0; g < 3; g++) {
+         std::stringstream ss;
+         ss << "nLat=12 nLon=" << nLon[g] << " nEns=1 nTime=1";
+         FileFake from(Options(ss.str()));
+         std::vector<float> lats(12), lons(nLon[g]);
+         for(int i = 0; i < 12; i++)
+            lats[i] = lat0[g] + i * dlat[g];
+         for(int j = 0; j < nLon[g]; j++)
+            lons[j] = lon0[g] + j * dlon[g];
+         setLatLon(from, &lats[0], &lons[0]);
+
+         // Lookup points inside and outside the grid
+         FileFake to(Options("nLat=19 nLon=37 nEns=1 nTime=1"));
+         std::vector<float> olats(19), olons(37);
+         for(int i = 0; i < 19; i++)
+            olats[i] = -89.9 + i * 9.99;
+         for(int j = 0; j < 37; j++)
+            olons[j] = -179.9 + j * 9.99;
+         setLatLon(to, &olats[0], &olons[0]);
+
+         vec2Int I, J, If, Jf;
+         Downscaler::getNearestNeighbour(from, to, I, J);
+         Downscaler::clearCache();
+         Downscaler::getNearestNeighbourBruteForce(from, to, If, Jf);
+         EXPECT_EQ(If, I);
+         EXPECT_EQ(Jf, J);
+      }
+   }
+   // Check that nearest neighbours on a Lambert grid match a brute force search
+   TEST_F(TestDownscaler, projectedGrid) {
+      FileArome from("testing/files/10x10.nc");
+      // Set the lats/lons according to the projection in the file
+      double n = sin(Util::deg2rad(63));
+      double F = cos(Util::deg2rad(63)) * pow(tan(Util::pi/4 + Util::deg2rad(63)/2), n) / n;
+      double rho0 = 6371000 * F / pow(tan(Util::pi/4 + Util::deg2rad(63)/2), n);
+      vec2 lats(10, std::vector<float>(10)), lons(10, std::vector<float>(10));
+      for(int i = 0; i < 10; i++) {
+         for(int j = 0; j < 10; j++) {
+            double x = -487442.188 + 2500 * j;
+            double y = -269321.812 + 2500 * i;
+            double rho = sqrt(x*x + (rho0 - y)*(rho0 - y));
+            double theta = atan2(x, rho0 - y);
+            lats[i][j] = Util::rad2deg(2 * atan(pow(6371000 * F / rho, 1 / n)) - Util::pi/2);
+            lons[i][j] = 15 + Util::rad2deg(theta / n);
+         }
+      }
+      from.setLats(lats);
+      from.setLons(lons);
+
+      FileFake to(Options("nLat=15 nLon=15 nEns=1 nTime=1"));
+      std::vector<float> olats(15), olons(15);
+      for(int i = 0; i < 15; i++)
+         olats[i] = lats[0][0] - 0.05 + 0.0213 * i;
+      for(int j = 0; j < 15; j++)
+         olons[j] = lons[0][0] - 0.1 + 0.0317 * j;
+      setLatLon(to, &olats[0], &olons[0]);
+
+      vec2Int I, J, If, Jf;
+      Downscaler::getNearestNeighbour(from, to, I, J);
+      Downscaler::clearCache();
+      Downscaler::getNearestNeighbourBruteForce(from, to, If, Jf);
+      EXPECT_EQ(If, I);
+      EXPECT_EQ(Jf, J);
+   }
+   TEST_F(TestDownscaler, boundingBox) {
+      FileArome from("testing/files/10x10.nc");
+      FileArome to("testing/files/10x10.nc");
+      to.crop(2, 5, 3, 7);
+      int startI, endI, startJ, endJ;
+      ASSERT_TRUE(Downscaler::getBoundingBox(from, to, 0, startI, endI, startJ, endJ));
+      EXPECT_EQ(2, startI);
+      EXPECT_EQ(5, endI);
+      EXPECT_EQ(3, startJ);
+      EXPECT_EQ(7, endJ);
+      // The halo is limited by the edges of the grid
+      ASSERT_TRUE(Downscaler::getBoundingBox(from, to, 3, startI, endI, startJ, endJ));
+      EXPECT_EQ(0, startI);
+      EXPECT_EQ(8, endI);
+      EXPECT_EQ(0, startJ);
+      EXPECT_EQ(9, endJ);
+
+      EXPECT_EQ(0, DownscalerNearestNeighbour(Variable::T, Options()).getHaloSize());
+      EXPECT_EQ(1, DownscalerBilinear(Variable::T, Options()).getHaloSize());
+      DownscalerSmart smart(Variable::T, Options());
+      smart.setSearchRadius(2);
+      EXPECT_EQ(2, smart.getHaloSize());
+      EXPECT_EQ(Util::MV, DownscalerBypass(Variable::T, Options()).getHaloSize());
+   }
    TEST_F(TestDownscaler, copyConstructor) {
       FileFake from(Options("nLat=3 nLon=2 nEns=1 nTime=1"));
       FileFake to = from;
@@ -0,0 +1,148 @@
+#include "../Util.h"
+#include "../File/File.h"
+#include "../Downscaler/Downscaler.h"
+#include <cmath>
+#include <gtest/gtest.h>
+
+namespace {
+   class TestDownscalerBilinear : public ::testing::Test {
+      public:
+         // Set up a grid where lats and lons vary linearly along both dimensions
+         void setGrid(FileFake& iFile, float iLat0, float iLon0, float iDLatI, float iDLatJ, float iDLonI, float iDLonJ) {
+            int nLat = iFile.getNumLat();
+            int nLon = iFile.getNumLon();
+            vec2 lats(nLat, std::vector<float>(nLon)), lons(nLat, std::vector<float>(nLon));
+            for(int i = 0; i < nLat; i++) {
+               for(int j = 0; j < nLon; j++) {
+                  lats[i][j] = iLat0 + iDLatI*i + iDLatJ*j;
+                  lons[i][j] = iLon0 + iDLonI*i + iDLonJ*j;
+               }
+            }
+            iFile.setLats(lats);
+            iFile.setLons(lons);
+         };
+         // Set the temperature to a linear function of lat/lon
+         void setLinearField(FileFake& iFile, int iTime) {
+            Field& field = *iFile.getField(Variable::T, iTime);
+            vec2 lats = iFile.getLats();
+            vec2 lons = iFile.getLons();
+            for(int i = 0; i < iFile.getNumLat(); i++) {
+               for(int j = 0; j < iFile.getNumLon(); j++) {
+                  for(int e = 0; e < iFile.getNumEns(); e++) {
+                     field(i,j,e) = getLinear(lats[i][j], lons[i][j], e + iTime);
+                  }
+               }
+            }
+         };
+         float getLinear(float iLat, float iLon, int iOffset) {
+            return 270 + 2*(iLat - 60) - 3*(iLon - 10)*cos(Util::deg2rad(iLat)) + iOffset;
+         }
+      protected:
+         virtual void SetUp() {
+            Downscaler::clearCache();
+         }
+   };
+
+   TEST_F(TestDownscalerBilinear, description) {
+      DownscalerBilinear::description();
+   }
+   // A linear field is reproduced exactly on a regular grid
+   TEST_F(TestDownscalerBilinear, regular) {
+      DownscalerBilinear d(Variable::T, Options());
+      FileFake from(Options("nLat=5 nLon=6 nEns=2 nTime=2"));
+      FileFake to(Options("nLat=3 nLon=4 nEns=2 nTime=2"));
+      setGrid(from, 59.8, 9.7, 0.1, 0, 0, 0.1);
+      setGrid(to, 59.93, 9.82, 0.13, 0, 0, 0.11);
+      for(int t = 0; t < 2; t++)
+         setLinearField(from, t);
+      d.downscale(from, to);
+      vec2 lats = to.getLats();
+      vec2 lons = to.getLons();
+      for(int t = 0; t < 2; t++) {
+         const Field& toT = *to.getField(Variable::T, t);
+         for(int i = 0; i < 3; i++) {
+            for(int j = 0; j < 4; j++) {
+               for(int e = 0; e < 2; e++) {
+                  // The flat coordinate system is only approximate, so allow for a small error
+                  EXPECT_NEAR(getLinear(lats[i][j], lons[i][j], e + t), toT(i,j,e), 0.01);
+               }
+            }
+         }
+      }
+   }
+   // Cells are parallelograms in a skewed grid
+   TEST_F(TestDownscalerBilinear, skewed) {
+      FileFake from(Options("nLat=6 nLon=6 nEns=1 nTime=1"));
+      FileFake to(Options("nLat=4 nLon=4 nEns=1 nTime=1"));
+      setGrid(from, 59.8, 9.7, 0.1, 0.03, 0.04, 0.1);
+      setGrid(to, 60.05, 10.05, 0.05, 0, 0, 0.05);
+      std::vector<int> indices;
+      std::vector<float> weights;
+      Downscaler::getBilinearOperator(from, to, indices, weights);
+      ASSERT_EQ(4*16, indices.size());
+      ASSERT_EQ(4*16, weights.size());
+
+      vec2 ilats = from.getLats();
+      vec2 ilons = from.getLons();
+      vec2 olats = to.getLats();
+      vec2 olons = to.getLons();
+      for(int k = 0; k < 16; k++) {
+         float total = 0;
+         float lat = 0;
+         float lon = 0;
+         for(int n = 0; n < 4; n++) {
+            int index = indices[4*k+n];
+            ASSERT_TRUE(index >= 0 && index < 36);
+            EXPECT_TRUE(weights[4*k+n] >= 0 && weights[4*k+n] <= 1);
+            total += weights[4*k+n];
+            lat += weights[4*k+n] * ilats[index / 6][index % 6];
+            lon += weights[4*k+n] * ilons[index / 6][index % 6];
+         }
+         // The weights interpolate the coordinates back to the lookup point
+         EXPECT_FLOAT_EQ(1, total);
+         EXPECT_NEAR(olats[k / 4][k % 4], lat, 1e-4);
+         EXPECT_NEAR(olons[k / 4][k % 4], lon, 1e-4);
+      }
+   }
+   // Points outside the grid, and next to missing values, use the nearest neighbour
+   TEST_F(TestDownscalerBilinear, outside) {
+      DownscalerBilinear d(Variable::T, Options());
+      FileFake from(Options("nLat=3 nLon=3 nEns=1 nTime=1"));
+      FileFake to(Options("nLat=1 nLon=3 nEns=1 nTime=1"));
+      setGrid(from, 60, 10, 1, 0, 0, 1);
+      setGrid(to, 60.5, 8.5, 0, 0, 0, 1.5);
+      Field& fromT = *from.getField(Variable::T, 0);
+      for(int i = 0; i < 3; i++) {
+         for(int j = 0; j < 3; j++) {
+            fromT(i,j,0) = 10*i + j;
+         }
+      }
+      fromT(0,0,0) = Util::MV;
+      d.downscale(from, to);
+      const Field& toT = *to.getField(Variable::T, 0);
+      // West of the grid
+      vec2Int I, J;
+      Downscaler::getNearestNeighbour(from, to, I, J);
+      EXPECT_FLOAT_EQ(fromT(I[0][0],J[0][0],0), toT(0,0,0));
+      // Inside the grid, next to a missing value
+      EXPECT_FLOAT_EQ(Util::MV, toT(0,1,0));
+      // Inside the grid
+      EXPECT_NEAR(6.5, toT(0,2,0), 0.01);
+   }
+   TEST_F(TestDownscalerBilinear, cache) {
+      FileFake from(Options("nLat=5 nLon=6 nEns=1 nTime=1"));
+      FileFake to(Options("nLat=3 nLon=4 nEns=1 nTime=1"));
+      setGrid(from, 59.8, 9.7, 0.1, 0, 0, 0.1);
+      setGrid(to, 59.93, 9.82, 0.13, 0, 0, 0.11);
+      std::vector<int> indices1, indices2;
+      std::vector<float> weights1, weights2;
+      Downscaler::getBilinearOperator(from, to, indices1, weights1);
+      Downscaler::getBilinearOperator(from, to, indices2, weights2);
+      EXPECT_EQ(indices1, indices2);
+      EXPECT_EQ(weights1, weights2);
+   }
+}
+int main(int argc, char **argv) {
+     ::testing::InitGoogleTest(&argc, argv);
+       return RUN_ALL_TESTS();
+}
@@ -1,6 +1,10 @@
 #include "../Util.h"
 #include "../File/File.h"
 #include "../Downscaler/Downscaler.h"
+#include "../DiskCache.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
 #include <gtest/gtest.h>
 #include <boost/assign/list_of.hpp>
 
@@ -67,6 +71,83 @@ namespace {
       EXPECT_EQ(1, I[0][0][1]);
       EXPECT_EQ(0, J[0][0][1]);
    }
+   TEST_F(TestDownscalerSmart, diskCache) {
+      std::string directory = "testing/files/cache";
+      mkdir(directory.c_str(), 0755);
+      FileFake from(Options("nLat=3 nLon=2 nEns=1 nTime=1"));
+      FileFake to(Options("nLat=1 nLon=2 nEns=1 nTime=1"));
+      setLatLonElev(from, (const float[]) {50,55,60}, (const float[]){0,10}, (const float[]){3, 15, 6, 30, 20, 11});
+      float elev[] = {10, Util::MV};
+      setLatLonElev(to,   (const float[]) {54},   (const float[]){9,1}, elev);
+
+      vec3Int I, J, Ic, Jc;
+      DiskCache::setDirectory(directory);
+      DownscalerSmart d(Variable::Precip, Options());
+      d.setSearchRadius(10);
+      d.setNumSmart(2);
+      d.getSmartNeighbours(from, to, I, J);
+      Downscaler::clearCache();
+      d.getSmartNeighbours(from, to, Ic, Jc);
+      EXPECT_EQ(I, Ic);
+      EXPECT_EQ(J, Jc);
+      ASSERT_EQ(2, Ic[0][0].size());
+      ASSERT_EQ(1, Ic[0][1].size());
+
+      // Changing the settings should not use the cached neighbours
+      d.setNumSmart(3);
+      d.getSmartNeighbours(from, to, Ic, Jc);
+      EXPECT_EQ(3, Ic[0][0].size());
+
+      DIR* dir = opendir(directory.c_str());
+      struct dirent* entry;
+      while((entry = readdir(dir)) != NULL) {
+         std::string name = entry->d_name;
+         if(name != "." && name != "..")
+            Util::remove(directory + "/" + name);
+      }
+      closedir(dir);
+      rmdir(directory.c_str());
+      DiskCache::disable();
+      Downscaler::clearCache();
+   }
+   // The flat neighbour lists match the nested ones, and are reused by other variables
+   TEST_F(TestDownscalerSmart, flat) {
+      FileFake from(Options("nLat=3 nLon=2 nEns=1 nTime=1"));
+      FileFake to(Options("nLat=1 nLon=2 nEns=1 nTime=1"));
+      setLatLonElev(from, (const float[]) {50,55,60}, (const float[]){0,10}, (const float[]){3, 15, 6, 30, 20, 11});
+      float elev[] = {10, Util::MV};
+      setLatLonElev(to,   (const float[]) {54},   (const float[]){9,1}, elev);
+
+      DownscalerSmart d(Variable::T, Options());
+      d.setSearchRadius(10);
+      d.setNumSmart(3);
+      std::vector<int> offsets, indices;
+      d.getSmartNeighbours(from, to, offsets, indices);
+      ASSERT_EQ(3, offsets.size());
+      EXPECT_EQ(0, offsets[0]);
+      EXPECT_EQ(3, offsets[1]);
+      EXPECT_EQ(4, offsets[2]);
+      ASSERT_EQ(4, indices.size());
+      // Elevation differences of 1, 4, 5
+      EXPECT_EQ(5, indices[0]);
+      EXPECT_EQ(2, indices[1]);
+      EXPECT_EQ(1, indices[2]);
+
+      vec3Int I, J;
+      d.getSmartNeighbours(from, to, I, J);
+      for(int n = 0; n < 3; n++) {
+         EXPECT_EQ(indices[n], I[0][0][n]*2 + J[0][0][n]);
+      }
+      EXPECT_EQ(indices[3], I[0][1][0]*2 + J[0][1][0]);
+
+      DownscalerSmart d2(Variable::Precip, Options());
+      d2.setSearchRadius(10);
+      d2.setNumSmart(3);
+      std::vector<int> offsets2, indices2;
+      d2.getSmartNeighbours(from, to, offsets2, indices2);
+      EXPECT_EQ(offsets, offsets2);
+      EXPECT_EQ(indices, indices2);
+   }
    TEST_F(TestDownscalerSmart, 10x10) {
       DownscalerSmart d(Variable::T, Options());
       d.setSearchRadius(3);
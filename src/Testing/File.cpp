@@ -30,6 +30,34 @@ namespace {
       FieldPtr p2 = f2.getField(Variable::T, 0);
       EXPECT_NE(*p1, *p2);
    }
+   TEST_F(FileTest, uniqueTag) {
+      // Files with the same grid have the same tag
+      FileArome f1("testing/files/10x10.nc");
+      FileArome f2("testing/files/10x10.nc");
+      FileFake f3(Options("nLat=10 nLon=10 nEns=1 nTime=1"));
+      FileFake f4(Options("nLat=10 nLon=10 nEns=2 nTime=3"));
+      EXPECT_EQ(f1.getUniqueTag(), f2.getUniqueTag());
+      EXPECT_EQ(f3.getUniqueTag(), f4.getUniqueTag());
+      EXPECT_NE(f1.getUniqueTag(), f3.getUniqueTag());
+
+      // Changing the elevations does not change the tag
+      Uuid tag = f3.getUniqueTag();
+      vec2 elevs = f3.getElevs();
+      elevs[0][0] = 100;
+      f3.setElevs(elevs);
+      EXPECT_EQ(tag, f3.getUniqueTag());
+      EXPECT_EQ(100, f3.getElevs()[0][0]);
+      EXPECT_EQ(0, f4.getElevs()[0][0]);
+
+      // Changing the latitudes does
+      vec2 lats = f3.getLats();
+      lats[0][0] = 0;
+      f3.setLats(lats);
+      EXPECT_NE(tag, f3.getUniqueTag());
+      EXPECT_EQ(tag, f4.getUniqueTag());
+      EXPECT_EQ(0, f3.getLats()[0][0]);
+      EXPECT_EQ(50, f4.getLats()[0][0]);
+   }
    TEST_F(FileTest, hasVariable) {
       FileArome from("testing/files/10x10.nc");
       EXPECT_TRUE(from.hasVariable(Variable::PrecipAcc)); // Derivable
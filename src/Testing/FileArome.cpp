@@ -2,10 +2,17 @@
 #include "../Util.h"
 #include "../Downscaler/Downscaler.h"
 #include <gtest/gtest.h>
+#include <netcdf.h>
 
 namespace {
    class FileAromeTest : public ::testing::Test {
    };
+   // Gives access to which fields are cached
+   class FileAromeCached : public FileArome {
+      public:
+         FileAromeCached(std::string iFilename) : FileArome(iFilename) {};
+         using File::isCached;
+   };
 
    TEST_F(FileAromeTest, 10x10) {
       {
@@ -46,6 +53,341 @@ namespace {
       FieldPtr p2 = f2.getField(Variable::T, 0);
       EXPECT_NE(*p1, *p2);
    }
+   TEST_F(FileAromeTest, writeVariable) {
+      Field expected(10, 10, 1);
+      {
+         FileArome from("testing/files/10x10.nc");
+         FileArome to("testing/files/10x10_copy.nc");
+         std::vector<Variable::Type> variables(1, Variable::T);
+         ASSERT_TRUE(to.startWrite(variables));
+         DownscalerSmart d(Variable::T, Options());
+         d.downscale(from, to);
+         expected = *to.getField(Variable::T, 1);
+
+         // The fields are removed from the cache once written
+         to.writeVariable(Variable::T);
+         EXPECT_EQ(0, to.getCacheSize());
+         EXPECT_EQ(expected, *to.getField(Variable::T, 1));
+      }
+      FileArome f("testing/files/10x10_copy.nc");
+      EXPECT_EQ(expected, *f.getField(Variable::T, 1));
+   }
+   TEST_F(FileAromeTest, digits) {
+      {
+         FileArome to("testing/files/10x10_copy.nc", Options("digits=2"));
+         FieldPtr field = to.getField(Variable::T, 0);
+         (*field)(0,0,0) = 273.15;
+         (*field)(0,1,0) = Util::MV;
+         (*field)(0,2,0) = -1.2345;
+         to.write(std::vector<Variable::Type>(1, Variable::T));
+      }
+      FileArome f("testing/files/10x10_copy.nc");
+      FieldPtr field = f.getField(Variable::T, 0);
+      // 2 digits need 7 bits in the mantissa, giving a relative error of at most 2^-8
+      EXPECT_NE(273.15f, (*field)(0,0,0));
+      EXPECT_NEAR(273.15, (*field)(0,0,0), 273.15 / 256);
+      EXPECT_FLOAT_EQ(Util::MV, (*field)(0,1,0));
+      EXPECT_NEAR(-1.2345, (*field)(0,2,0), 1.2345 / 256);
+   }
+   TEST_F(FileAromeTest, variableDigits) {
+      {
+         // The digits of the variable override the digits of the file
+         FileArome to("testing/files/10x10_copy.nc", Options("digits=7"));
+         to.setVariableOptions(Variable::T, Options("digits=2"));
+         FieldPtr field = to.getField(Variable::T, 0);
+         (*field)(0,0,0) = 273.15;
+         to.write(std::vector<Variable::Type>(1, Variable::T));
+      }
+      {
+         FileArome f("testing/files/10x10_copy.nc");
+         EXPECT_NE(273.15f, (*f.getField(Variable::T, 0))(0,0,0));
+         EXPECT_NEAR(273.15, (*f.getField(Variable::T, 0))(0,0,0), 273.15 / 256);
+      }
+      {
+         FileArome to("testing/files/10x10_copy.nc", Options("digits=2"));
+         to.setVariableOptions(Variable::T, Options("digits=7"));
+         FieldPtr field = to.getField(Variable::T, 0);
+         (*field)(0,0,0) = 273.15;
+         to.write(std::vector<Variable::Type>(1, Variable::T));
+      }
+      FileArome f("testing/files/10x10_copy.nc");
+      EXPECT_FLOAT_EQ(273.15, (*f.getField(Variable::T, 0))(0,0,0));
+   }
+   TEST_F(FileAromeTest, packing) {
+      std::string filename = "testing/files/10x10_packed.nc";
+      ASSERT_TRUE(Util::copy("testing/files/10x10.nc", filename));
+      {
+         FileArome file(filename);
+         ASSERT_FALSE(file.hasVariable(Variable::Pop));
+         ASSERT_FALSE(file.hasVariable(Variable::PrecipRate));
+         file.setVariableOptions(Variable::Pop, Options("packing=byte"));
+         file.setVariableOptions(Variable::PrecipRate, Options("packing=short precision=0.01"));
+         file.initNewVariable(Variable::Pop);
+         file.initNewVariable(Variable::PrecipRate);
+         FieldPtr pop = file.getField(Variable::Pop, 0);
+         (*pop)(0,0,0) = 0;
+         (*pop)(0,1,0) = 0.3;
+         (*pop)(0,2,0) = 1;
+         FieldPtr precip = file.getField(Variable::PrecipRate, 0);
+         (*precip)(0,0,0) = 0;
+         (*precip)(0,1,0) = 12.346;
+         (*precip)(0,2,0) = 1000; // Larger than the packed range
+         std::vector<Variable::Type> variables;
+         variables.push_back(Variable::Pop);
+         variables.push_back(Variable::PrecipRate);
+         file.write(variables);
+      }
+      FileArome file(filename);
+      FieldPtr pop = file.getField(Variable::Pop, 0);
+      EXPECT_NEAR(0, (*pop)(0,0,0), 1e-5);
+      EXPECT_NEAR(0.3, (*pop)(0,1,0), 0.5 / 252);
+      EXPECT_NEAR(1, (*pop)(0,2,0), 1e-5);
+      EXPECT_FLOAT_EQ(Util::MV, (*pop)(0,3,0));
+      FieldPtr precip = file.getField(Variable::PrecipRate, 0);
+      EXPECT_NEAR(0, (*precip)(0,0,0), 1e-3);
+      EXPECT_NEAR(12.35, (*precip)(0,1,0), 1e-3);
+      EXPECT_NEAR(655.32, (*precip)(0,2,0), 1e-2);
+      EXPECT_FLOAT_EQ(Util::MV, (*precip)(0,3,0));
+      Util::remove(filename);
+   }
+   // Values that cannot be packed are set to the nearest value that can, with one warning for
+   // each variable
+   TEST_F(FileAromeTest, packingOutOfRange) {
+      std::string filename = "testing/files/10x10_packed.nc";
+      ASSERT_TRUE(Util::copy("testing/files/10x10.nc", filename));
+      std::string output;
+      {
+         FileArome file(filename);
+         file.setVariableOptions(Variable::Pop, Options("packing=byte"));
+         file.setVariableOptions(Variable::PrecipRate, Options("packing=short precision=0.01"));
+         file.initNewVariable(Variable::Pop);
+         file.initNewVariable(Variable::PrecipRate);
+         (*file.getField(Variable::Pop, 0))(0,0,0) = 1.5;
+         (*file.getField(Variable::Pop, 0))(0,1,0) = 0.5;
+         (*file.getField(Variable::PrecipRate, 0))(0,0,0) = 1000;
+         (*file.getField(Variable::PrecipRate, 0))(0,1,0) = -5;
+         (*file.getField(Variable::PrecipRate, 1))(0,0,0) = 2000;
+         std::vector<Variable::Type> variables;
+         variables.push_back(Variable::Pop);
+         variables.push_back(Variable::PrecipRate);
+         Util::setShowWarning(true);
+         ::testing::internal::CaptureStdout();
+         file.write(variables);
+         output = ::testing::internal::GetCapturedStdout();
+         Util::setShowWarning(false);
+      }
+      EXPECT_NE(std::string::npos, output.find("'Pop'"));
+      EXPECT_NE(std::string::npos, output.find("2 values of 'PrecipRate' at time 0"));
+      EXPECT_EQ(std::string::npos, output.find("at time 1"));
+
+      FileArome file(filename);
+      EXPECT_NEAR(1, (*file.getField(Variable::Pop, 0))(0,0,0), 1e-5);
+      EXPECT_NEAR(0.5, (*file.getField(Variable::Pop, 0))(0,1,0), 0.5 / 252);
+      // The stored range of PrecipRate is 0 to 655.32
+      EXPECT_NEAR(655.32, (*file.getField(Variable::PrecipRate, 0))(0,0,0), 1e-2);
+      EXPECT_NEAR(0, (*file.getField(Variable::PrecipRate, 0))(0,1,0), 1e-2);
+      EXPECT_NEAR(655.32, (*file.getField(Variable::PrecipRate, 1))(0,0,0), 1e-2);
+      Util::remove(filename);
+   }
+   // New variables in a NetCDF-4 file are chunked and compressed as requested
+   TEST_F(FileAromeTest, compressedStorage) {
+      std::string filename = "testing/files/10x10_nc4_copy.nc";
+      ASSERT_TRUE(Util::copy("testing/files/10x10_nc4.nc", filename));
+      std::vector<FieldPtr> written;
+      {
+         FileArome file(filename, Options("deflate=4 shuffle=1 chunkLat=4 chunkLon=20"));
+         file.initNewVariable(Variable::Pop);
+         for(int t = 0; t < file.getNumTime(); t++) {
+            FieldPtr field = file.getField(Variable::Pop, t);
+            for(int i = 0; i < file.getNumLat(); i++) {
+               for(int j = 0; j < file.getNumLon(); j++) {
+                  (*field)(i,j,0) = 0.1 * t + 0.01 * i + 0.001 * j;
+               }
+            }
+            written.push_back(FieldPtr(new Field(*field)));
+         }
+         file.write(std::vector<Variable::Type>(1, Variable::Pop));
+      }
+
+      int ncid;
+      ASSERT_EQ(NC_NOERR, nc_open(filename.c_str(), NC_NOWRITE, &ncid));
+      int var;
+      ASSERT_EQ(NC_NOERR, nc_inq_varid(ncid, "precipitation_amount_prob_low", &var));
+      int ndims;
+      ASSERT_EQ(NC_NOERR, nc_inq_varndims(ncid, var, &ndims));
+      ASSERT_EQ(3, ndims);
+      int storage;
+      size_t chunkSizes[3];
+      ASSERT_EQ(NC_NOERR, nc_inq_var_chunking(ncid, var, &storage, chunkSizes));
+      EXPECT_EQ(NC_CHUNKED, storage);
+      EXPECT_EQ(1, chunkSizes[0]);
+      EXPECT_EQ(4, chunkSizes[1]);
+      // Chunks are no larger than the grid
+      EXPECT_EQ(10, chunkSizes[2]);
+      int shuffle, deflate, level;
+      ASSERT_EQ(NC_NOERR, nc_inq_var_deflate(ncid, var, &shuffle, &deflate, &level));
+      EXPECT_EQ(1, shuffle);
+      EXPECT_EQ(1, deflate);
+      EXPECT_EQ(4, level);
+      nc_close(ncid);
+
+      FileArome file(filename);
+      ASSERT_EQ(written.size(), file.getNumTime());
+      for(int t = 0; t < file.getNumTime(); t++) {
+         EXPECT_EQ(*written[t], *file.getField(Variable::Pop, t));
+      }
+      Util::remove(filename);
+   }
+   TEST_F(FileAromeTest, invalidStorageOptions) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      EXPECT_DEATH(FileArome("testing/files/10x10.nc", Options("deflate=10")), ".*");
+      EXPECT_DEATH(FileArome("testing/files/10x10.nc", Options("deflate=-1")), ".*");
+      EXPECT_DEATH(FileArome("testing/files/10x10.nc", Options("chunkLat=0")), ".*");
+      EXPECT_DEATH(FileArome("testing/files/10x10.nc", Options("digits=0")), ".*");
+
+      // Packing requires a limited range or a precision
+      std::string filename = "testing/files/10x10_packed.nc";
+      ASSERT_TRUE(Util::copy("testing/files/10x10.nc", filename));
+      FileArome file(filename);
+      file.setVariableOptions(Variable::PrecipRate, Options("packing=short"));
+      EXPECT_DEATH(file.write(std::vector<Variable::Type>(1, Variable::PrecipRate)), ".*");
+      file.setVariableOptions(Variable::PrecipRate, Options("packing=int"));
+      EXPECT_DEATH(file.write(std::vector<Variable::Type>(1, Variable::PrecipRate)), ".*");
+      file.setVariableOptions(Variable::PrecipRate, Options("digits=0"));
+      EXPECT_DEATH(file.write(std::vector<Variable::Type>(1, Variable::PrecipRate)), ".*");
+      Util::remove(filename);
+   }
+   TEST_F(FileAromeTest, projectedIndices) {
+      FileArome file("testing/files/10x10.nc");
+      float I, J;
+      // The origin of the Lambert projection (63N, 15E) is at x=0, y=0
+      ASSERT_TRUE(file.getProjectedIndices(63, 15, I, J));
+      EXPECT_NEAR(269321.812 / 2500, I, 1e-3);
+      EXPECT_NEAR(487442.188 / 2500, J, 1e-3);
+      // Moving north along the central meridian increases y
+      file.getProjectedIndices(63.1, 15, I, J);
+      EXPECT_NEAR(269321.812 / 2500 + Util::getDistance(63, 15, 63.1, 15) / 2500, I, 0.1);
+      EXPECT_NEAR(487442.188 / 2500, J, 1e-3);
+      // Points west of the central meridian have negative x
+      file.getProjectedIndices(63, 14, I, J);
+      EXPECT_LT(J, 487442.188 / 2500);
+      EXPECT_FALSE(file.getProjectedIndices(Util::MV, 14, I, J));
+   }
+   TEST_F(FileAromeTest, crop) {
+      FileArome full("testing/files/10x10.nc");
+      FileArome file("testing/files/10x10.nc");
+      ASSERT_TRUE(file.crop(2, 5, 3, 7));
+      ASSERT_EQ(4, file.getNumLat());
+      ASSERT_EQ(5, file.getNumLon());
+      EXPECT_NE(full.getUniqueTag(), file.getUniqueTag());
+      // Cropping again is relative to the cropped grid
+      ASSERT_TRUE(file.crop(1, 3, 0, 3));
+      ASSERT_EQ(3, file.getNumLat());
+      ASSERT_EQ(4, file.getNumLon());
+      for(int t = 0; t < file.getNumTime(); t++) {
+         FieldPtr fullField = full.getField(Variable::T, t);
+         FieldPtr field = file.getField(Variable::T, t);
+         ASSERT_EQ(3, field->getNumLat());
+         ASSERT_EQ(4, field->getNumLon());
+         for(int i = 0; i < 3; i++) {
+            for(int j = 0; j < 4; j++) {
+               EXPECT_FLOAT_EQ(full.getLats()[i+3][j+3], file.getLats()[i][j]);
+               EXPECT_FLOAT_EQ(full.getElevs()[i+3][j+3], file.getElevs()[i][j]);
+               EXPECT_FLOAT_EQ((*fullField)(i+3,j+3,0), (*field)(i,j,0));
+            }
+         }
+      }
+      // Projected indices are relative to the cropped grid
+      float I, J, Ifull, Jfull;
+      ASSERT_TRUE(full.getProjectedIndices(63, 15, Ifull, Jfull));
+      ASSERT_TRUE(file.getProjectedIndices(63, 15, I, J));
+      EXPECT_NEAR(Ifull - 3, I, 1e-3);
+      EXPECT_NEAR(Jfull - 3, J, 1e-3);
+   }
+   TEST_F(FileAromeTest, invalidCrop) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      FileArome file("testing/files/10x10.nc");
+      EXPECT_DEATH(file.crop(-1, 5, 3, 7), ".*");
+      EXPECT_DEATH(file.crop(2, 10, 3, 7), ".*");
+      EXPECT_DEATH(file.crop(5, 2, 3, 7), ".*");
+      ASSERT_TRUE(file.crop(2, 5, 3, 7));
+      // Cropped files cannot be written
+      EXPECT_DEATH(file.write(std::vector<Variable::Type>(1, Variable::T)), ".*");
+      EXPECT_DEATH(file.startWrite(std::vector<Variable::Type>(1, Variable::T)), ".*");
+      // Fields already retrieved have the old grid
+      file.getField(Variable::T, 0);
+      EXPECT_DEATH(file.crop(0, 1, 0, 1), ".*");
+   }
+   // Reading other times must not overwrite fields that are already retrieved
+   TEST_F(FileAromeTest, cachedFields) {
+      FileArome file("testing/files/10x10.nc");
+      FieldPtr field0 = file.getField(Variable::T, 0);
+      float original = (*field0)(2,3,0);
+      (*field0)(2,3,0) = original + 5;
+      for(int t = file.getNumTime() - 1; t >= 0; t--) {
+         FieldPtr field = file.getField(Variable::T, t);
+         ASSERT_EQ(file.getNumLat(), field->getNumLat());
+         ASSERT_EQ(file.getNumLon(), field->getNumLon());
+      }
+      EXPECT_FLOAT_EQ(original + 5, (*file.getField(Variable::T, 0))(2,3,0));
+      FileArome file2("testing/files/10x10.nc");
+      EXPECT_FLOAT_EQ(original, (*file2.getField(Variable::T, 0))(2,3,0));
+   }
+   // 10x10_chunked.nc has 5 times of T, stored with 3 times in each chunk
+   TEST_F(FileAromeTest, chunkedRead) {
+      {
+         // Reading one time also caches the other times in its chunk
+         FileAromeCached file("testing/files/10x10_chunked.nc");
+         ASSERT_EQ(5, file.getNumTime());
+         file.getField(Variable::T, 1);
+         EXPECT_TRUE(file.isCached(Variable::T, 0));
+         EXPECT_TRUE(file.isCached(Variable::T, 2));
+         EXPECT_FALSE(file.isCached(Variable::T, 3));
+         file.getField(Variable::T, 4);
+         EXPECT_TRUE(file.isCached(Variable::T, 3));
+      }
+      {
+         // Times already in the cache are not overwritten, whether they are at the end or in
+         // the middle of the chunk
+         FileAromeCached file1("testing/files/10x10_chunked.nc");
+         FieldPtr middle = file1.getEmptyField(100);
+         file1.addField(middle, Variable::T, 1);
+         file1.getField(Variable::T, 0);
+         EXPECT_TRUE(file1.isCached(Variable::T, 2));
+         EXPECT_EQ(middle, file1.getField(Variable::T, 1));
+         EXPECT_FLOAT_EQ(100, (*file1.getField(Variable::T, 1))(2,3,0));
+
+         FileAromeCached file2("testing/files/10x10_chunked.nc");
+         FieldPtr last = file2.getEmptyField(102);
+         file2.addField(last, Variable::T, 2);
+         file2.getField(Variable::T, 0);
+         EXPECT_TRUE(file2.isCached(Variable::T, 1));
+         EXPECT_EQ(last, file2.getField(Variable::T, 2));
+         EXPECT_FLOAT_EQ(102, (*file2.getField(Variable::T, 2))(2,3,0));
+      }
+      {
+         // Values are the same as when each time is read separately, in any order. The file
+         // contains 270 + time + 0.1 * lat + 0.01 * lon.
+         FileArome forward("testing/files/10x10_chunked.nc");
+         FileArome backward("testing/files/10x10_chunked.nc");
+         for(int t = forward.getNumTime() - 1; t >= 0; t--) {
+            backward.getField(Variable::T, t);
+         }
+         for(int t = 0; t < forward.getNumTime(); t++) {
+            FileArome single("testing/files/10x10_chunked.nc");
+            FieldPtr field = single.getField(Variable::T, t);
+            EXPECT_EQ(*field, *forward.getField(Variable::T, t));
+            EXPECT_EQ(*field, *backward.getField(Variable::T, t));
+            for(int i = 0; i < single.getNumLat(); i++) {
+               for(int j = 0; j < single.getNumLon(); j++) {
+                  EXPECT_NEAR(270 + t + 0.1 * i + 0.01 * j, (*field)(i,j,0), 1e-4);
+               }
+            }
+         }
+      }
+   }
    TEST_F(FileAromeTest, variables) {
       FileArome file("testing/files/10x10.nc");
       std::vector<Variable::Type> variables = Variable::getAllVariables();
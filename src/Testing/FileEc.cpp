@@ -2,6 +2,7 @@
 #include "../Util.h"
 #include "../Downscaler/Downscaler.h"
 #include <gtest/gtest.h>
+#include <netcdf.h>
 
 namespace {
    class FileEcTest : public ::testing::Test {
@@ -76,6 +77,59 @@ namespace {
       EXPECT_FLOAT_EQ(33, (*temp)(0,2,1));
    }
 
+   // Values packed as shorts are unpacked and members are placed correctly
+   TEST_F(FileEcTest, packed) {
+      std::string filename = "testing/files/ecPacked.nc";
+      int nTime = 2, nEns = 3, nLat = 20, nLon = 30;
+      {
+         int file, dTime, dSurface, dEns, dLat, dLon, vLat, vLon, vTemp;
+         ASSERT_EQ(NC_NOERR, nc_create(filename.c_str(), NC_CLOBBER, &file));
+         nc_def_dim(file, "time", nTime, &dTime);
+         nc_def_dim(file, "surface", 1, &dSurface);
+         nc_def_dim(file, "ensemble_member", nEns, &dEns);
+         nc_def_dim(file, "lat", nLat, &dLat);
+         nc_def_dim(file, "lon", nLon, &dLon);
+         nc_def_var(file, "lat", NC_FLOAT, 1, &dLat, &vLat);
+         nc_def_var(file, "lon", NC_FLOAT, 1, &dLon, &vLon);
+         int dims[5] = {dTime, dSurface, dEns, dLat, dLon};
+         nc_def_var(file, "air_temperature_2m", NC_SHORT, 5, dims, &vTemp);
+         float scale = 0.5;
+         float offset = 200;
+         short fill = -1;
+         nc_put_att_float(file, vTemp, "scale_factor", NC_FLOAT, 1, &scale);
+         nc_put_att_float(file, vTemp, "add_offset", NC_FLOAT, 1, &offset);
+         nc_put_att_short(file, vTemp, "_FillValue", NC_SHORT, 1, &fill);
+         nc_enddef(file);
+         std::vector<float> lats(nLat), lons(nLon);
+         for(int i = 0; i < nLat; i++)
+            lats[i] = 50 + i;
+         for(int j = 0; j < nLon; j++)
+            lons[j] = j;
+         nc_put_var_float(file, vLat, &lats[0]);
+         nc_put_var_float(file, vLon, &lons[0]);
+         std::vector<short> values(nTime*nEns*nLat*nLon);
+         for(int i = 0; i < values.size(); i++)
+            values[i] = i % 1000;
+         values[1] = fill;
+         nc_put_var_short(file, vTemp, &values[0]);
+         nc_close(file);
+      }
+      FileEc file(filename);
+      ASSERT_EQ(nEns, file.getNumEns());
+      for(int t = 0; t < nTime; t++) {
+         FieldPtr field = file.getField(Variable::T, t);
+         for(int e = 0; e < nEns; e++) {
+            for(int i = 0; i < nLat; i++) {
+               for(int j = 0; j < nLon; j++) {
+                  int index = ((t*nEns + e)*nLat + i)*nLon + j;
+                  float expected = index == 1 ? Util::MV : 200 + 0.5 * (index % 1000);
+                  EXPECT_FLOAT_EQ(expected, (*field)(i,j,e));
+               }
+            }
+         }
+      }
+      Util::remove(filename);
+   }
    TEST_F(FileEcTest, validFiles) {
       // Valid lat/lon ec file
       FileEc file1("testing/files/validEc1.nc");
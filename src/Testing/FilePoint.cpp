@@ -14,6 +14,14 @@ namespace {
       FieldPtr field1 = file.getField(Variable::T, 1);
       EXPECT_FLOAT_EQ(288, (*field1)(0,0,0));
    }
+   // Changing the field of one variable must not change the others
+   TEST_F(FilePointTest, independentVariables) {
+      FilePoint file("testing/files/validPoint1.txt", Options("lat=1 lon=2 elev=3"));
+      FieldPtr temperature = file.getField(Variable::T, 0);
+      (*temperature)(0,0,0) = 300;
+      EXPECT_FLOAT_EQ(290, (*file.getField(Variable::Precip, 0))(0,0,0));
+      EXPECT_FLOAT_EQ(300, (*file.getField(Variable::T, 0))(0,0,0));
+   }
    TEST_F(FilePointTest, asOutput) {
       {
          FileArome from("testing/files/10x10.nc");
@@ -40,6 +48,40 @@ namespace {
       EXPECT_FLOAT_EQ(288, (*field1)(0,0,0));
       EXPECT_FLOAT_EQ(300, (*field1)(0,0,1));
    }
+   TEST_F(FilePointTest, multipleLocations) {
+      // validPoint2 has two values on each row, read as two locations with one member each
+      FilePoint file("testing/files/validPoint2.txt", Options("lat=1,4 lon=2,5 elev=3,6"));
+      ASSERT_EQ(2, file.getNumLat());
+      ASSERT_EQ(1, file.getNumLon());
+      ASSERT_EQ(1, file.getNumEns());
+      EXPECT_FLOAT_EQ(4, file.getLats()[1][0]);
+      EXPECT_FLOAT_EQ(5, file.getLons()[1][0]);
+      EXPECT_FLOAT_EQ(6, file.getElevs()[1][0]);
+      FieldPtr field1 = file.getField(Variable::T, 1);
+      EXPECT_FLOAT_EQ(288, (*field1)(0,0,0));
+      EXPECT_FLOAT_EQ(300, (*field1)(1,0,0));
+
+      // Write and read back
+      {
+         FilePoint to("testing/files/filePointMultiple.txt", Options("lat=1,4,7 lon=2,5,8 elev=3,6,9 time=2 ens=2"));
+         for(int t = 0; t < 2; t++) {
+            FieldPtr field = to.getField(Variable::T, t);
+            for(int i = 0; i < 3; i++) {
+               for(int e = 0; e < 2; e++) {
+                  (*field)(i,0,e) = 100*t + 10*i + e;
+               }
+            }
+         }
+         to.write(std::vector<Variable::Type>(1, Variable::T));
+      }
+      FilePoint from("testing/files/filePointMultiple.txt", Options("lat=1,4,7 lon=2,5,8 elev=3,6,9"));
+      ASSERT_EQ(2, from.getNumTime());
+      ASSERT_EQ(2, from.getNumEns());
+      FieldPtr field = from.getField(Variable::T, 1);
+      EXPECT_FLOAT_EQ(121, (*field)(2,0,1));
+      EXPECT_FLOAT_EQ(110, (*field)(1,0,0));
+      Util::remove("testing/files/filePointMultiple.txt");
+   }
    TEST_F(FilePointTest, validFiles) {
       FilePoint file1("testing/files/validPoint1.txt", Options("lat=1 lon=2 elev=3 time=67"));
       FilePoint file2("testing/files/validPoint2.txt", Options("lat=1 lon=2 elev=3 time=67"));
@@ -59,6 +101,14 @@ namespace {
       // Invalid lat
       EXPECT_DEATH(FilePoint("testing/files/validPoint1.txt", Options("lat=91 lon=2 elev=3 time=67")), ".*");
       EXPECT_DEATH(FilePoint("testing/files/validPoint1.txt", Options("lat=-91 lon=2 elev=3 time=67")), ".*");
+      // Different number of locations
+      EXPECT_DEATH(FilePoint("testing/files/validPoint1.txt", Options("lat=1,2 lon=2 elev=3 time=67")), ".*");
+      // Rows do not match the number of members
+      EXPECT_DEATH(FilePoint("testing/files/validPoint2.txt", Options("lat=1 lon=2 elev=3 ens=3")), ".*");
+      // Rows that do not have a value for each location
+      EXPECT_DEATH(FilePoint("testing/files/validPoint2.txt", Options("lat=1,2,3 lon=2,3,4 elev=3,4,5")), ".*");
+      // Rows of different lengths
+      EXPECT_DEATH(FilePoint("testing/files/invalidPoint1.txt", Options("lat=1 lon=2 elev=3")), ".*");
       // Missing time for non-existant file
       EXPECT_DEATH(FilePoint("testing/files/hd92h3d98h38.txt", Options("lat=1 lon=2 elev=3")), ".*");
    }
@@ -0,0 +1,153 @@
+#include "../File/Raw.h"
+#include "../File/Arome.h"
+#include "../Util.h"
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+   class FileRawTest : public ::testing::Test {
+      protected:
+         FileRawTest() : mFilename("testing/files/10x10.raw"), mDirectory("testing/files/fieldCache") {
+            mkdir(mDirectory.c_str(), 0755);
+         };
+         ~FileRawTest() {
+            Util::remove(mFilename);
+            std::vector<std::string> files = getCacheFiles();
+            for(int i = 0; i < files.size(); i++) {
+               Util::remove(mDirectory + "/" + files[i]);
+            }
+            rmdir(mDirectory.c_str());
+         };
+         std::vector<std::string> getCacheFiles() const {
+            std::vector<std::string> files;
+            DIR* dir = opendir(mDirectory.c_str());
+            if(dir == NULL)
+               return files;
+            struct dirent* entry;
+            while((entry = readdir(dir)) != NULL) {
+               std::string name = entry->d_name;
+               if(name != "." && name != "..")
+                  files.push_back(name);
+            }
+            closedir(dir);
+            return files;
+         };
+         std::string mFilename;
+         std::string mDirectory;
+   };
+
+   TEST_F(FileRawTest, writeAndRead) {
+      FileArome from("testing/files/10x10.nc");
+      std::vector<Variable::Type> variables;
+      variables.push_back(Variable::T);
+      variables.push_back(Variable::Precip);
+      ASSERT_TRUE(FileRaw::write(mFilename, from, variables));
+      EXPECT_TRUE(FileRaw::isValid(mFilename));
+      EXPECT_FALSE(FileRaw::isValid("testing/files/10x10.nc"));
+
+      FileRaw file(mFilename);
+      EXPECT_TRUE(file.hasSameDimensions(from));
+      EXPECT_EQ(from.getTimes(), file.getTimes());
+      EXPECT_DOUBLE_EQ(from.getReferenceTime(), file.getReferenceTime());
+      EXPECT_EQ(from.getLats(), file.getLats());
+      EXPECT_EQ(from.getLons(), file.getLons());
+      EXPECT_EQ(from.getElevs(), file.getElevs());
+      EXPECT_EQ(from.getUniqueTag(), file.getUniqueTag());
+      EXPECT_TRUE(file.hasVariable(Variable::T));
+      EXPECT_FALSE(file.hasVariable(Variable::Cloud));
+      for(int t = 0; t < from.getNumTime(); t++) {
+         EXPECT_EQ(*from.getField(Variable::T, t), *file.getField(Variable::T, t));
+         EXPECT_EQ(*from.getField(Variable::Precip, t), *file.getField(Variable::Precip, t));
+      }
+      // Fields point into the mapped file and are aligned
+      const float* data = file.getField(Variable::T, 1)->getData();
+      EXPECT_EQ(0, ((size_t) data) % 64);
+   }
+   TEST_F(FileRawTest, changesNotWritten) {
+      FileArome from("testing/files/10x10.nc");
+      ASSERT_TRUE(FileRaw::write(mFilename, from, std::vector<Variable::Type>(1, Variable::T)));
+      float original;
+      {
+         FileRaw file(mFilename);
+         FieldPtr field = file.getField(Variable::T, 0);
+         original = (*field)(1,1,0);
+         (*field)(1,1,0) = 12;
+         // Copies have their own memory
+         Field copy = *field;
+         copy(1,1,0) = 13;
+         EXPECT_FLOAT_EQ(12, (*field)(1,1,0));
+      }
+      FileRaw file(mFilename);
+      EXPECT_FLOAT_EQ(original, (*file.getField(Variable::T, 0))(1,1,0));
+   }
+   TEST_F(FileRawTest, writeCore) {
+      FileArome from("testing/files/10x10.nc");
+      ASSERT_TRUE(FileRaw::write(mFilename, from, std::vector<Variable::Type>(1, Variable::T)));
+      {
+         FileRaw file(mFilename);
+         FieldPtr field = file.getField(Variable::T, 0);
+         (*field)(1,1,0) = 12;
+         file.initNewVariable(Variable::Cloud);
+         file.addField(file.getEmptyField(3), Variable::Cloud, 1);
+         file.write(std::vector<Variable::Type>(1, Variable::Cloud));
+         // The variables in the file are kept
+         EXPECT_TRUE(file.hasVariable(Variable::T));
+         EXPECT_TRUE(file.hasVariable(Variable::Cloud));
+      }
+      FileRaw file(mFilename);
+      EXPECT_FLOAT_EQ(12, (*file.getField(Variable::T, 0))(1,1,0));
+      EXPECT_FLOAT_EQ(3, (*file.getField(Variable::Cloud, 1))(2,3,0));
+      EXPECT_FLOAT_EQ(Util::MV, (*file.getField(Variable::Cloud, 0))(2,3,0));
+   }
+   TEST_F(FileRawTest, fieldCache) {
+      FileArome reference("testing/files/10x10.nc");
+      Options options("fieldCache=" + mDirectory);
+      {
+         // The first run decodes the fields and stores them in the cache
+         FileArome file("testing/files/10x10.nc", options);
+         EXPECT_EQ(*reference.getField(Variable::T, 1), *file.getField(Variable::T, 1));
+         ASSERT_EQ(1, getCacheFiles().size());
+      }
+      {
+         // Later runs read the cache
+         FileArome file("testing/files/10x10.nc", options);
+         FieldPtr field = file.getField(Variable::T, 1);
+         EXPECT_EQ(*reference.getField(Variable::T, 1), *field);
+         EXPECT_EQ(0, ((size_t) field->getData()) % 64);
+         // Derived variables use the cache for the variables they are derived from
+         EXPECT_EQ(*reference.getField(Variable::Precip, 1), *file.getField(Variable::Precip, 1));
+         EXPECT_EQ(2, getCacheFiles().size());
+         file.clear();
+         EXPECT_EQ(*reference.getField(Variable::T, 1), *file.getField(Variable::T, 1));
+      }
+   }
+   TEST_F(FileRawTest, getScheme) {
+      FileArome from("testing/files/10x10.nc");
+      ASSERT_TRUE(FileRaw::write(mFilename, from, std::vector<Variable::Type>(1, Variable::T)));
+      File* file = File::getScheme(mFilename, Options());
+      ASSERT_TRUE(file != NULL);
+      EXPECT_EQ("raw", file->name());
+      delete file;
+   }
+   TEST_F(FileRawTest, invalid) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      EXPECT_DEATH(FileRaw("testing/files/10x10.nc"), ".*");
+      EXPECT_DEATH(FileRaw("testing/files/weoihwoiedoiwe.raw"), ".*");
+      EXPECT_DEATH(FileArome("testing/files/10x10.nc", Options("fieldCache=testing/files/weoihwoiedoiwe")), ".*");
+      FileRaw* file = NULL;
+      {
+         FileArome from("testing/files/10x10.nc");
+         ASSERT_TRUE(FileRaw::write(mFilename, from, std::vector<Variable::Type>(1, Variable::T)));
+         file = new FileRaw(mFilename);
+      }
+      EXPECT_DEATH(file->getField(Variable::T, 100), ".*");
+      delete file;
+   }
+}
+int main(int argc, char **argv) {
+     ::testing::InitGoogleTest(&argc, argv);
+       return RUN_ALL_TESTS();
+}
@@ -0,0 +1,51 @@
+#include "../IntegralImage.h"
+#include "../Util.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+
+namespace {
+   class IntegralImageTest : public ::testing::Test {
+      protected:
+   };
+   // Compare against a direct sum over each box
+   TEST_F(IntegralImageTest, sums) {
+      int nLat = 5;
+      int nLon = 7;
+      std::vector<double> values(nLat*nLon);
+      for(int n = 0; n < nLat*nLon; n++)
+         values[n] = 0.5 * ((n * 13) % 11) - 2;
+      IntegralImage image(values, nLat, nLon);
+      EXPECT_EQ(nLat, image.getNumLat());
+      EXPECT_EQ(nLon, image.getNumLon());
+      for(int startI = -2; startI < nLat + 2; startI++) {
+         for(int startJ = -2; startJ < nLon + 2; startJ++) {
+            for(int endI = startI; endI < nLat + 2; endI++) {
+               for(int endJ = startJ; endJ < nLon + 2; endJ++) {
+                  double expected = 0;
+                  for(int i = std::max(startI, 0); i <= std::min(endI, nLat-1); i++) {
+                     for(int j = std::max(startJ, 0); j <= std::min(endJ, nLon-1); j++) {
+                        expected += values[i*nLon + j];
+                     }
+                  }
+                  EXPECT_DOUBLE_EQ(expected, image.getSum(startI, startJ, endI, endJ));
+               }
+            }
+         }
+      }
+   }
+   TEST_F(IntegralImageTest, empty) {
+      IntegralImage image;
+      EXPECT_EQ(0, image.getSum(0, 0, 3, 3));
+      IntegralImage empty(std::vector<double>(), 0, 4);
+      EXPECT_EQ(0, empty.getSum(0, 0, 3, 3));
+   }
+   TEST_F(IntegralImageTest, invalidSize) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      EXPECT_DEATH(IntegralImage(std::vector<double>(5, 1), 2, 3), ".*");
+   }
+}
+int main(int argc, char **argv) {
+     ::testing::InitGoogleTest(&argc, argv);
+       return RUN_ALL_TESTS();
+}
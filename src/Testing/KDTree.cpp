@@ -120,6 +120,153 @@ namespace {
       EXPECT_EQ(0, I);
       EXPECT_EQ(1, J);
    }
+   // Check that the tree gives the same answer as a brute force search on an irregular grid
+   TEST_F(KDTreeTest, bruteForce) {
+      int nLat = 23;
+      int nLon = 17;
+      vec2 lats, lons;
+      lats.resize(nLat);
+      lons.resize(nLat);
+      for(int i = 0; i < nLat; i++) {
+         lats[i].resize(nLon);
+         lons[i].resize(nLon);
+         for(int j = 0; j < nLon; j++) {
+            lats[i][j] = 55 + 0.13*i + 0.05*sin(j*1.3);
+            lons[i][j] = 5 + 0.21*j + 0.07*cos(i*0.7);
+         }
+      }
+      lats[3][4] = Util::MV;
+      KDTree tree(lats, lons);
+      for(float lat = 54; lat < 59; lat += 0.17) {
+         for(float lon = 4; lon < 10; lon += 0.23) {
+            int I, J;
+            tree.getNearestNeighbour(lat, lon, I, J);
+            int bestI = Util::MV;
+            int bestJ = Util::MV;
+            float minDist = Util::MV;
+            for(int i = 0; i < nLat; i++) {
+               for(int j = 0; j < nLon; j++) {
+                  if(!Util::isValid(lats[i][j]))
+                     continue;
+                  float dist = Util::getDistance(lat, lon, lats[i][j], lons[i][j]);
+                  if(!Util::isValid(minDist) || dist < minDist) {
+                     minDist = dist;
+                     bestI = i;
+                     bestJ = j;
+                  }
+               }
+            }
+            EXPECT_EQ(bestI, I);
+            EXPECT_EQ(bestJ, J);
+         }
+      }
+   }
+   // Two rows of lat/lon locations, with a missing point:
+   // [0,0] [0,1] [0,2]
+   // [1,0]  MV   [1,2]
+   TEST_F(KDTreeTest, nearestNeighbours) {
+      vec2 lats(2, std::vector<float>(3, 0)), lons(2, std::vector<float>(3, 0));
+      for(int i = 0; i < 2; i++) {
+         for(int j = 0; j < 3; j++) {
+            lats[i][j] = i;
+            lons[i][j] = j;
+         }
+      }
+      lats[1][1] = Util::MV;
+      KDTree tree(lats, lons);
+      std::vector<float> qlats(2), qlons(2);
+      qlats[0] = 0.4; qlons[0] = 0.9;
+      qlats[1] = Util::MV; qlons[1] = 1;
+      std::vector<int> indices;
+      std::vector<float> distances;
+      tree.getNearestNeighbours(qlats, qlons, 3, indices, distances);
+      ASSERT_EQ(6, indices.size());
+      ASSERT_EQ(6, distances.size());
+      // The missing point is not included, so [0,1] is nearest followed by [0,0] and [1,0]
+      EXPECT_EQ(1, indices[0]);
+      EXPECT_EQ(0, indices[1]);
+      EXPECT_EQ(3, indices[2]);
+      EXPECT_NEAR(Util::getDistance(0.4, 0.9, 0, 1), distances[0], 1);
+      EXPECT_NEAR(Util::getDistance(0.4, 0.9, 0, 0), distances[1], 1);
+      EXPECT_NEAR(Util::getDistance(0.4, 0.9, 1, 0), distances[2], 1);
+      for(int k = 3; k < 6; k++) {
+         EXPECT_EQ(Util::MV, indices[k]);
+         EXPECT_EQ(Util::MV, distances[k]);
+      }
+
+      // Ask for more neighbours than there are points
+      tree.getNearestNeighbours(qlats, qlons, 10, indices, distances);
+      ASSERT_EQ(20, indices.size());
+      EXPECT_EQ(2, indices[3]);
+      EXPECT_EQ(5, indices[4]);
+      EXPECT_EQ(Util::MV, indices[5]);
+   }
+   TEST_F(KDTreeTest, neighboursWithin) {
+      vec2 lats(2, std::vector<float>(3, 0)), lons(2, std::vector<float>(3, 0));
+      for(int i = 0; i < 2; i++) {
+         for(int j = 0; j < 3; j++) {
+            lats[i][j] = 60 + 0.1*i;
+            lons[i][j] = 10 + 0.1*j;
+         }
+      }
+      KDTree tree(lats, lons);
+      std::vector<float> qlats(3), qlons(3);
+      qlats[0] = 60; qlons[0] = 10;
+      qlats[1] = 70; qlons[1] = 10;
+      qlats[2] = 60.1; qlons[2] = 10.2;
+      std::vector<int> offsets, indices;
+      std::vector<float> distances;
+      // 0.1 degrees latitude is 11.1 km and 0.1 degrees longitude is 5.6 km
+      tree.getNeighboursWithin(qlats, qlons, 10000, offsets, indices, distances);
+      ASSERT_EQ(4, offsets.size());
+      EXPECT_EQ(0, offsets[0]);
+      EXPECT_EQ(2, offsets[1]);
+      EXPECT_EQ(2, offsets[2]);
+      EXPECT_EQ(4, offsets[3]);
+      ASSERT_EQ(4, indices.size());
+      EXPECT_EQ(0, indices[0]);
+      EXPECT_EQ(1, indices[1]);
+      EXPECT_NEAR(0, distances[0], 1);
+      EXPECT_NEAR(Util::getDistance(60, 10, 60, 10.1), distances[1], 1);
+      EXPECT_EQ(5, indices[2]);
+      EXPECT_EQ(4, indices[3]);
+
+      // The same neighbours are found when distances are not requested
+      std::vector<int> offsets2, indices2;
+      tree.getNeighboursWithin(qlats, qlons, 10000, offsets2, indices2);
+      EXPECT_EQ(offsets, offsets2);
+      EXPECT_EQ(indices, indices2);
+
+      // All points are within a large radius
+      tree.getNeighboursWithin(qlats, qlons, 1e7, offsets, indices, distances);
+      EXPECT_EQ(18, offsets[3]);
+   }
+   TEST_F(KDTreeTest, serialize) {
+      vec2 lats(3, std::vector<float>(4, 0)), lons(3, std::vector<float>(4, 0));
+      for(int i = 0; i < 3; i++) {
+         for(int j = 0; j < 4; j++) {
+            lats[i][j] = 60 + 0.3*i + 0.01*j;
+            lons[i][j] = 10 + 0.2*j;
+         }
+      }
+      KDTree tree(lats, lons);
+      std::vector<char> data;
+      tree.serialize(data);
+      KDTree restored;
+      ASSERT_TRUE(restored.deserialize(&data[0], data.size()));
+      for(float lat = 59; lat < 62; lat += 0.13) {
+         for(float lon = 9; lon < 11.5; lon += 0.11) {
+            int I0, J0, I1, J1;
+            tree.getNearestNeighbour(lat, lon, I0, J0);
+            restored.getNearestNeighbour(lat, lon, I1, J1);
+            EXPECT_EQ(I0, I1);
+            EXPECT_EQ(J0, J1);
+         }
+      }
+      // Truncated data
+      EXPECT_FALSE(restored.deserialize(&data[0], data.size()-1));
+      EXPECT_FALSE(restored.deserialize(&data[0], 3));
+   }
    TEST_F(KDTreeTest, assignmentOperator) {
       vec2 lats, lons;
       std::vector<float> lat(1,3), lon(1,2);
@@ -1,5 +1,6 @@
 #include "../Util.h"
 #include "../File/File.h"
+#include "../File/Fake.h"
 #include "../ParameterFile/ParameterFile.h"
 #include <gtest/gtest.h>
 #include <boost/assign/list_of.hpp>
@@ -60,6 +61,50 @@ namespace {
       ASSERT_EQ(1, par.size());
       EXPECT_FLOAT_EQ(-5.4, par[0]);
    }
+   // Only a few locations have parameters for most times
+   TEST_F(ParameterFileTest, nearestNeighbourSparse) {
+      ParameterFile* p = ParameterFile::getScheme("text", Options("file=testing/files/temp1231.txt spatial=1"));
+      std::vector<Location> locations;
+      for(int i = 0; i < 20; i++) {
+         for(int j = 0; j < 20; j++) {
+            Location loc(50 + 0.1*i, 10 + 0.13*j, 0);
+            locations.push_back(loc);
+            for(int t = 0; t < 4; t++) {
+               if(t == 0 || (i*20 + j) % (7*t) == 0)
+                  p->setParameters(createParameters(i, j, t), t, loc);
+            }
+         }
+      }
+      p->recomputeTree();
+      for(int iteration = 0; iteration < 2; iteration++) {
+         for(int t = 0; t < 4; t++) {
+            for(int k = 0; k < 30; k++) {
+               Location query(49.9 + 0.073*k, 9.8 + 0.097*k, 0);
+               // Brute force search
+               int nearest = Util::MV;
+               float minDist = Util::MV;
+               for(int i = 0; i < locations.size(); i++) {
+                  if(p->getParameters(t, locations[i], false).size() == 0)
+                     continue;
+                  float dist = Util::getDistance(query.lat(), query.lon(), locations[i].lat(), locations[i].lon());
+                  if(!Util::isValid(nearest) || dist < minDist) {
+                     nearest = i;
+                     minDist = dist;
+                  }
+               }
+               ASSERT_TRUE(Util::isValid(nearest));
+               Location loc(Util::MV, Util::MV);
+               EXPECT_TRUE(p->getNearestLocation(t, query, loc));
+               float dist = Util::getDistance(query.lat(), query.lon(), loc.lat(), loc.lon());
+               EXPECT_NEAR(minDist, dist, 1);
+            }
+         }
+         // Remove parameters, the nearest location must be updated
+         for(int i = 0; i < locations.size(); i += 2) {
+            p->setParameters(Parameters(), 0, locations[i]);
+         }
+      }
+   }
    TEST_F(ParameterFileTest, setParameters) {
       ::testing::FLAGS_gtest_death_test_style = "threadsafe";
       Util::setShowError(false);
@@ -93,6 +138,91 @@ namespace {
       // No location provided
       EXPECT_DEATH(p->getParameters(3), ".*");
    }
+   // Check that parameters for a whole grid are the same as for each gridpoint
+   TEST_F(ParameterFileTest, grid) {
+      ParameterFile* p = ParameterFile::getScheme("text", Options("file=testing/files/temp1231.txt spatial=1"));
+      // Locations on a coarse grid, with some missing times. One location is on the grid.
+      for(int k = 0; k < 12; k++) {
+         Location loc(50 + 0.8*k, 9 - 0.7*k, 0);
+         for(int t = 0; t < 3; t++) {
+            if((k + t) % 4 != 0)
+               p->setParameters(createParameters(k, t, k*t), t, loc);
+         }
+      }
+      p->setParameters(createParameters(-1, -2, -3), 1, Location(53, 4, 0));
+      p->recomputeTree();
+
+      FileFake file(Options("nLat=10 nLon=10 nEns=1 nTime=1"));
+      vec2 lats = file.getLats();
+      vec2 lons = file.getLons();
+      for(int t = 0; t < 3; t++) {
+         std::vector<int> indices;
+         std::vector<Parameters> parameters;
+         p->getParameters(t, file, indices, parameters);
+         ASSERT_EQ(100, indices.size());
+         for(int i = 0; i < 10; i++) {
+            for(int j = 0; j < 10; j++) {
+               Parameters expected = p->getParameters(t, Location(lats[i][j], lons[i][j], 0));
+               const Parameters& actual = parameters[indices[i*10 + j]];
+               ASSERT_EQ(expected.size(), actual.size());
+               for(int k = 0; k < expected.size(); k++) {
+                  EXPECT_FLOAT_EQ(expected[k], actual[k]);
+               }
+            }
+         }
+      }
+      // Location-independent parameters are used for all gridpoints
+      ParameterFile* p2 = ParameterFile::getScheme("text", Options("file=testing/files/parameters.txt"));
+      std::vector<int> indices;
+      std::vector<Parameters> parameters;
+      p2->getParameters(0, file, indices, parameters);
+      ASSERT_EQ(100, indices.size());
+      Parameters expected = p2->getParameters(0);
+      for(int k = 0; k < 100; k++) {
+         ASSERT_EQ(expected.size(), parameters[indices[k]].size());
+         EXPECT_FLOAT_EQ(expected[0], parameters[indices[k]][0]);
+      }
+   }
+   // Parameters are stored in one array and can be accessed by location index
+   TEST_F(ParameterFileTest, values) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      ParameterFile* p = ParameterFile::getScheme("text", Options("file=testing/files/temp1231.txt spatial=1"));
+      EXPECT_FALSE(Util::isValid(p->getNumParameters()));
+      // Add times one at a time, so that the array must grow
+      for(int t = 0; t < 20; t++) {
+         for(int k = 0; k < 5; k++) {
+            if(k != 2 || t % 3 == 0)
+               p->setParameters(createParameters(k, t, 1), t, Location(k, 0, 0));
+         }
+      }
+      EXPECT_EQ(3, p->getNumParameters());
+      for(int k = 0; k < 5; k++) {
+         int index = p->getLocationIndex(Location(k, 0, 0));
+         ASSERT_TRUE(Util::isValid(index));
+         for(int t = 0; t < 20; t++) {
+            const float* values = p->getValues(index, t);
+            if(k != 2 || t % 3 == 0) {
+               ASSERT_TRUE(values != NULL);
+               EXPECT_FLOAT_EQ(k, values[0]);
+               EXPECT_FLOAT_EQ(t, values[1]);
+               EXPECT_FLOAT_EQ(1, values[2]);
+            }
+            else {
+               EXPECT_TRUE(values == NULL);
+            }
+         }
+      }
+      EXPECT_FALSE(Util::isValid(p->getLocationIndex(Location(7, 0, 0))));
+
+      // Removing a set
+      p->setParameters(Parameters(), 4, Location(1, 0, 0));
+      EXPECT_TRUE(p->getValues(p->getLocationIndex(Location(1, 0, 0)), 4) == NULL);
+      EXPECT_EQ(0, p->getParameters(4, Location(1, 0, 0), false).size());
+
+      // All sets must have the same size
+      EXPECT_DEATH(p->setParameters(Parameters(3), 0, Location(1, 0, 0)), ".*");
+   }
    // Time-independent
    TEST_F(ParameterFileTest, timeIndependent) {
       ::testing::FLAGS_gtest_death_test_style = "threadsafe";
@@ -173,6 +303,7 @@ namespace {
    } 
    TEST_F(ParameterFileTest, descriptions) {
       ParameterFile::getDescriptions();
+      EXPECT_NE(ParameterFile::getDescription(false), ParameterFile::getDescription(true));
    }
    TEST_F(ParameterFileTest, factoryInvalid) {
       ::testing::FLAGS_gtest_death_test_style = "threadsafe";
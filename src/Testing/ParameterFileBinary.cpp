@@ -0,0 +1,117 @@
+#include "../ParameterFile/ParameterFile.h"
+#include "../Util.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+namespace {
+   class ParameterFileBinaryTest : public ::testing::Test {
+      public:
+         Parameters createParameters(float i1, float i2, float i3) {
+            std::vector<float> values;
+            values.push_back(i1);
+            values.push_back(i2);
+            values.push_back(i3);
+            return Parameters(values);
+         };
+      protected:
+   };
+   // Parameters should be the same after writing and reading the file
+   TEST_F(ParameterFileBinaryTest, write) {
+      {
+         ParameterFileBinary file(Options("file=testing/files/test192838.bin"), true);
+         file.setParameters(createParameters(1,2,3), 0, Location(3,2,5));
+         file.setParameters(createParameters(4,5,6), 1, Location(3,2,5));
+         file.setParameters(createParameters(7,8,9), 1, Location(1,9,2));
+         file.write();
+      }
+      EXPECT_TRUE(ParameterFileBinary::isValid("testing/files/test192838.bin"));
+      ParameterFileBinary file(Options("file=testing/files/test192838.bin"));
+      EXPECT_TRUE(file.isReadable());
+      EXPECT_TRUE(file.isTimeDependent());
+      EXPECT_EQ(3, file.getNumParameters());
+      std::vector<Location> locations = file.getLocations();
+      ASSERT_EQ(2, locations.size());
+      EXPECT_FLOAT_EQ(1, locations[0].lat());
+      EXPECT_FLOAT_EQ(2, locations[0].elev());
+
+      Parameters par = file.getParameters(0, Location(3,2,5));
+      ASSERT_EQ(3, par.size());
+      EXPECT_FLOAT_EQ(1, par[0]);
+      EXPECT_FLOAT_EQ(3, par[2]);
+      // No parameters at time 0, so the nearest location with parameters is used
+      par = file.getParameters(0, Location(1,9,2));
+      ASSERT_EQ(3, par.size());
+      EXPECT_FLOAT_EQ(1, par[0]);
+      par = file.getParameters(0, Location(1,9,2), false);
+      EXPECT_EQ(0, par.size());
+      par = file.getParameters(1, Location(1.1,8.9,0));
+      ASSERT_EQ(3, par.size());
+      EXPECT_FLOAT_EQ(7, par[0]);
+      EXPECT_FLOAT_EQ(9, par[2]);
+      Util::remove("testing/files/test192838.bin");
+   }
+   // The stored search tree gives the same nearest neighbours as the original file
+   TEST_F(ParameterFileBinaryTest, nearestNeighbour) {
+      ParameterFile* text = ParameterFile::getScheme("text", Options("file=testing/files/parametersKriging.txt spatial=1"));
+      ParameterFileBinary binary(Options("file=testing/files/test192839.bin"), true);
+      std::vector<Location> locations = text->getLocations();
+      std::vector<int> times = text->getTimes();
+      for(int i = 0; i < locations.size(); i++) {
+         for(int t = 0; t < times.size(); t++) {
+            Parameters par = text->getParameters(times[t], locations[i], false);
+            if(par.size() > 0)
+               binary.setParameters(par, times[t], locations[i]);
+         }
+      }
+      binary.write();
+
+      ParameterFile* p = ParameterFile::getScheme("binary", Options("file=testing/files/test192839.bin"));
+      EXPECT_EQ("binary", p->name());
+      EXPECT_TRUE(p->isLocationDependent());
+      for(float lat = -2; lat < 11; lat += 0.7) {
+         for(float lon = -2; lon < 11; lon += 0.9) {
+            for(int t = 0; t < times.size(); t++) {
+               Parameters expected = text->getParameters(times[t], Location(lat, lon, 0));
+               Parameters actual = p->getParameters(times[t], Location(lat, lon, 0));
+               EXPECT_EQ(expected.getValues(), actual.getValues());
+            }
+         }
+      }
+      delete text;
+      delete p;
+      Util::remove("testing/files/test192839.bin");
+   }
+   TEST_F(ParameterFileBinaryTest, invalidFiles) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      EXPECT_FALSE(ParameterFileBinary::isValid("testing/files/parametersf98wey8y8y89rwe.bin"));
+      ParameterFileBinary p(Options("file=testing/files/parametersf98wey8y8y89rwe.bin"));
+      EXPECT_FALSE(p.isReadable());
+      EXPECT_FALSE(ParameterFileBinary::isValid("testing/files/parameters.txt"));
+      EXPECT_DEATH(ParameterFileBinary(Options("file=testing/files/parameters.txt")), ".*");
+
+      // Truncated file
+      {
+         ParameterFileBinary file(Options("file=testing/files/test192840.bin"), true);
+         file.setParameters(createParameters(1,2,3), 0, Location(3,2,5));
+         file.write();
+      }
+      FILE* fid = fopen("testing/files/test192840.bin", "r+b");
+      ASSERT_TRUE(fid != NULL);
+      fseek(fid, 0, SEEK_END);
+      long size = ftell(fid);
+      fclose(fid);
+      ASSERT_EQ(0, truncate("testing/files/test192840.bin", size - 1));
+      EXPECT_DEATH(ParameterFileBinary(Options("file=testing/files/test192840.bin")), ".*");
+      Util::remove("testing/files/test192840.bin");
+   }
+   TEST_F(ParameterFileBinaryTest, description) {
+      ParameterFileBinary::description();
+   }
+}
+int main(int argc, char **argv) {
+     ::testing::InitGoogleTest(&argc, argv);
+       return RUN_ALL_TESTS();
+}
@@ -59,6 +59,20 @@ namespace {
          }
       }
    }
+   // The order of the dimensions should not matter for any location or time
+   TEST_F(ParameterFileNetcdfTest, xy_orderAll) {
+      ParameterFileNetcdf file_yx(Options("file=testing/files/10x10_param.nc"));
+      ParameterFileNetcdf file_xy(Options("file=testing/files/10x10_param_xy.nc"));
+      std::vector<Location> locations = file_yx.getLocations();
+      std::vector<int> times = file_yx.getTimes();
+      for(int i = 0; i < locations.size(); i++) {
+         for(int t = 0; t < times.size(); t++) {
+            Parameters par_yx = file_yx.getParameters(times[t], locations[i], false);
+            Parameters par_xy = file_xy.getParameters(times[t], locations[i], false);
+            EXPECT_EQ(par_yx.getValues(), par_xy.getValues());
+         }
+      }
+   }
    // Should be possible to write to file
    TEST_F(ParameterFileNetcdfTest, write) {
       // Write parameters (make sure it goes out of scope)
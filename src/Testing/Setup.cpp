@@ -2,6 +2,10 @@
 #include "../Setup.h"
 #include "../Downscaler/Smart.h"
 #include "../Calibrator/Calibrator.h"
+#include "../File/Arome.h"
+#include "../DiskCache.h"
+#include <sys/stat.h>
+#include <unistd.h>
 typedef Setup MetSetup;
 
 namespace {
@@ -204,6 +208,71 @@ namespace {
       EXPECT_FALSE(setup0.outputOptions.getValue("write", i));
       EXPECT_EQ(2, i);
    }
+   // The cache directory is set once for the run, not by each downscaler
+   TEST(SetupTest, runOptions) {
+      std::string directory = "testing/files/cache";
+      mkdir(directory.c_str(), 0755);
+      {
+         MetSetup setup(Util::split("cacheDir=" + directory + " cacheSize=10 testing/files/10x10.nc option1=1 testing/files/10x10.nc -v T"));
+         int i;
+         EXPECT_TRUE(setup.runOptions.getValue("cacheSize", i));
+         EXPECT_EQ(10, i);
+         EXPECT_FALSE(setup.inputOptions.getValue("cacheSize", i));
+         EXPECT_TRUE(setup.inputOptions.getValue("option1", i));
+         EXPECT_EQ("testing/files/10x10.nc", setup.inputFiles[0]->getFilename());
+         EXPECT_TRUE(DiskCache::isEnabled());
+         EXPECT_EQ(directory, DiskCache::getDirectory());
+      }
+      DiskCache::disable();
+      rmdir(directory.c_str());
+
+      // Downscaler options do not change the cache
+      MetSetup setup(Util::split("testing/files/10x10.nc testing/files/10x10.nc -v T -d nearestNeighbour cacheDir=" + directory));
+      EXPECT_FALSE(DiskCache::isEnabled());
+   }
+   TEST(SetupTest, isUsedLater) {
+      // Zaga is not known to leave other variables alone
+      MetSetup setup0(Util::split("testing/files/10x10.nc testing/files/10x10.nc -v T -v Cloud -v Precip -c zaga -p text file=testing/files/parameters.txt"));
+      EXPECT_TRUE(setup0.isUsedLater(0));
+      EXPECT_TRUE(setup0.isUsedLater(1));
+      EXPECT_FALSE(setup0.isUsedLater(2));
+
+      MetSetup setup1(Util::split("testing/files/10x10.nc testing/files/10x10.nc -v T -v Cloud -c cloud"));
+      EXPECT_FALSE(setup1.isUsedLater(0));
+
+      // Phase reads Precip, which can be derived from PrecipAcc
+      MetSetup setup2(Util::split("testing/files/10x10.nc testing/files/10x10.nc -v PrecipAcc -v Phase -c phase"));
+      EXPECT_TRUE(setup2.isUsedLater(0));
+
+      MetSetup setup3(Util::split("testing/files/10x10.nc testing/files/10x10.nc -v T -v Cloud -c accumulate outputVariable=T"));
+      EXPECT_TRUE(setup3.isUsedLater(0));
+   }
+   // A calibrator of a later variable changes a variable that is already processed. The change
+   // must be written to the output file.
+   TEST(SetupTest, processDependentVariable) {
+      std::string filename = "testing/files/10x10_process.nc";
+      ASSERT_TRUE(Util::copy("testing/files/10x10.nc", filename));
+      {
+         // Accumulating T replaces Cloud
+         MetSetup setup(Util::split("testing/files/10x10.nc " + filename + " -v Cloud -v T -c accumulate outputVariable=Cloud"));
+         EXPECT_TRUE(setup.isUsedLater(0));
+         EXPECT_FALSE(setup.isUsedLater(1));
+         setup.process(0);
+      }
+      FileArome input("testing/files/10x10.nc");
+      FileArome output(filename);
+      ASSERT_EQ(2, output.getNumTime());
+      const Field& temperature = *input.getField(Variable::T, 1);
+      const Field& cloud0 = *output.getField(Variable::Cloud, 0);
+      const Field& cloud1 = *output.getField(Variable::Cloud, 1);
+      for(int i = 0; i < output.getNumLat(); i++) {
+         for(int j = 0; j < output.getNumLon(); j++) {
+            EXPECT_FLOAT_EQ(0, cloud0(i,j,0));
+            EXPECT_FLOAT_EQ(temperature(i,j,0), cloud1(i,j,0));
+         }
+      }
+      Util::remove(filename);
+   }
 }
 int main(int argc, char **argv) {
      ::testing::InitGoogleTest(&argc, argv);
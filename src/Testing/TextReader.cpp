@@ -0,0 +1,132 @@
+#include "../TextReader.h"
+#include "../Util.h"
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+
+namespace {
+   class TextReaderTest : public ::testing::Test {
+      protected:
+         TextReaderTest() : mFilename("testing/files/textReader.txt") {
+         };
+         ~TextReaderTest() {
+            Util::remove(mFilename);
+         };
+         void writeFile(std::string iContents) {
+            std::ofstream ofs(mFilename.c_str());
+            ofs << iContents;
+         };
+         std::string mFilename;
+   };
+   TEST_F(TextReaderTest, missing) {
+      TextReader reader("testing/files/doesNotExist.txt");
+      EXPECT_FALSE(reader.isValid());
+      EXPECT_EQ(0, reader.getNumLines());
+   }
+   TEST_F(TextReaderTest, empty) {
+      writeFile("");
+      TextReader reader(mFilename);
+      EXPECT_TRUE(reader.isValid());
+      EXPECT_EQ(0, reader.getNumLines());
+      std::vector<double> values;
+      std::vector<int> offsets;
+      EXPECT_FALSE(Util::isValid(reader.readAll(values, offsets)));
+      EXPECT_EQ(0, values.size());
+   }
+   TEST_F(TextReaderTest, lines) {
+      // Comments, empty lines, windows line endings, and no newline at the end
+      writeFile("# 1 2 3\n1 2.5 -3e2\n\n   \t\r\n  4\t5  \r\n6");
+      TextReader reader(mFilename);
+      ASSERT_EQ(6, reader.getNumLines());
+      EXPECT_TRUE(reader.isEmpty(0));
+      EXPECT_FALSE(reader.isEmpty(1));
+      EXPECT_TRUE(reader.isEmpty(2));
+      EXPECT_TRUE(reader.isEmpty(3));
+      EXPECT_FALSE(reader.isEmpty(4));
+      EXPECT_FALSE(reader.isEmpty(5));
+
+      std::vector<double> values;
+      EXPECT_TRUE(reader.readLine(0, values));
+      EXPECT_EQ(0, values.size());
+      EXPECT_TRUE(reader.readLine(1, values));
+      ASSERT_EQ(3, values.size());
+      EXPECT_DOUBLE_EQ(1, values[0]);
+      EXPECT_DOUBLE_EQ(2.5, values[1]);
+      EXPECT_DOUBLE_EQ(-300, values[2]);
+
+      std::vector<int> offsets;
+      EXPECT_FALSE(Util::isValid(reader.readAll(values, offsets)));
+      ASSERT_EQ(7, offsets.size());
+      ASSERT_EQ(6, values.size());
+      int expectedOffsets[] = {0, 0, 3, 3, 3, 5, 6};
+      for(int i = 0; i < 7; i++) {
+         EXPECT_EQ(expectedOffsets[i], offsets[i]);
+      }
+      EXPECT_DOUBLE_EQ(4, values[3]);
+      EXPECT_DOUBLE_EQ(5, values[4]);
+      EXPECT_DOUBLE_EQ(6, values[5]);
+   }
+   TEST_F(TextReaderTest, longLine) {
+      std::stringstream ss;
+      for(int i = 0; i < 20000; i++) {
+         ss << i << " ";
+      }
+      ss << std::endl;
+      writeFile(ss.str());
+      TextReader reader(mFilename);
+      std::vector<double> values;
+      EXPECT_TRUE(reader.readLine(0, values));
+      ASSERT_EQ(20000, values.size());
+      EXPECT_DOUBLE_EQ(19999, values[19999]);
+   }
+   TEST_F(TextReaderTest, invalid) {
+      writeFile("1 2\n3 a\n4 5x\n");
+      TextReader reader(mFilename);
+      std::vector<double> values;
+      EXPECT_TRUE(reader.readLine(0, values));
+      EXPECT_FALSE(reader.readLine(1, values));
+      EXPECT_FALSE(reader.readLine(2, values));
+      std::vector<int> offsets;
+      EXPECT_EQ(1, reader.readAll(values, offsets));
+   }
+   // Check that numbers are parsed the same way as strtod
+   TEST_F(TextReaderTest, parseNumber) {
+      const char* numbers[] = {"0", "-0", "+1", "1.", ".5", "-.5", "3.14159", "1e5", "1E-5", "-2.5e+3",
+         "0.1", "0.000123", "123456789012345", "1234567890123456789", "12345678901234567890123",
+         "0.30000000000000004", "1e-30", "4.9e-324", "1.7976931348623157e308", "1e400",
+         "-99999", "1400000000", "60.1234567", "nan", "inf", "-inf"};
+      for(int i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+         std::string number = numbers[i];
+         const char* pos = number.c_str();
+         double value;
+         ASSERT_TRUE(TextReader::parseNumber(pos, number.c_str() + number.size(), value)) << number;
+         EXPECT_EQ(number.c_str() + number.size(), pos);
+         double expected = strtod(number.c_str(), NULL);
+         if(expected != expected)
+            EXPECT_NE(value, value) << number;
+         else
+            EXPECT_EQ(expected, value) << number;
+      }
+      const char* invalid[] = {"", "-", ".", "e5", "1e", "1e+", "1.2.3", "--1", "1,5", "abc"};
+      for(int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+         std::string number = invalid[i];
+         const char* pos = number.c_str();
+         double value;
+         EXPECT_FALSE(TextReader::parseNumber(pos, number.c_str() + number.size(), value)) << number;
+         EXPECT_EQ(number.c_str(), pos);
+      }
+
+      // Stops at whitespace
+      std::string line = "12.5 7";
+      const char* pos = line.c_str();
+      double value;
+      EXPECT_TRUE(TextReader::parseNumber(pos, line.c_str() + line.size(), value));
+      EXPECT_DOUBLE_EQ(12.5, value);
+      EXPECT_EQ(' ', *pos);
+   }
+}
+int main(int argc, char **argv) {
+     ::testing::InitGoogleTest(&argc, argv);
+       return RUN_ALL_TESTS();
+}
@@ -395,6 +395,25 @@ namespace {
       EXPECT_FLOAT_EQ(Util::MV, Util::calculateStat(hood, Util::StatTypeMean));
       EXPECT_FLOAT_EQ(Util::MV, Util::calculateStat(hood, Util::StatTypeStd));
    }
+   TEST_F(UtilTest, computeArray) {
+      // Quantiles interpolate between the sorted valid values 1 1 2 3 4 5 6 9, for any order of
+      // the values
+      float values[] = {3, Util::MV, 1, 4, 1, 5, Util::MV, 9, 2, 6};
+      std::vector<float> hood(values, values + 10);
+      float quantiles[] = {0, 0.1, 0.25, 0.5, 0.9, 1};
+      float expected[] = {1, 1, 1.75, 3.5, 6.9, 9};
+      for(int q = 0; q < 6; q++) {
+         std::vector<float> array = hood;
+         EXPECT_FLOAT_EQ(expected[q], Util::calculateStat(&array[0], array.size(), Util::StatTypeQuantile, quantiles[q]));
+         array = hood;
+         std::reverse(array.begin(), array.end());
+         EXPECT_FLOAT_EQ(expected[q], Util::calculateStat(&array[0], array.size(), Util::StatTypeQuantile, quantiles[q]));
+         EXPECT_FLOAT_EQ(expected[q], Util::calculateStat(hood, Util::StatTypeQuantile, quantiles[q]));
+      }
+      EXPECT_FLOAT_EQ(3.875, Util::calculateStat(values, 10, Util::StatTypeMean));
+      EXPECT_FLOAT_EQ(Util::MV, Util::calculateStat(values, 0, Util::StatTypeMean));
+      EXPECT_FLOAT_EQ(Util::MV, Util::calculateStat(values + 1, 1, Util::StatTypeQuantile, 0.5));
+   }
    TEST_F(UtilTest, inverse) {
       // Inverse of identity matrix
       {
@@ -474,6 +493,65 @@ namespace {
          EXPECT_FLOAT_EQ(1.0869565, inverse[2][2]);
       }
    }
+   TEST_F(UtilTest, hash) {
+      vec2 values(2, std::vector<float>(3, 1.5));
+      vec2 other = values;
+      EXPECT_EQ(Util::hash(values), Util::hash(other));
+      EXPECT_EQ(16, Util::hashToString(Util::hash(values)).size());
+      other[1][2] = 1.6;
+      EXPECT_NE(Util::hash(values), Util::hash(other));
+      // Same values with different dimensions
+      other = vec2(3, std::vector<float>(2, 1.5));
+      EXPECT_NE(Util::hash(values), Util::hash(other));
+      // Combining hashes depends on the order
+      other[0][0] = 2;
+      EXPECT_NE(Util::hash(values, Util::hash(other)), Util::hash(other, Util::hash(values)));
+      EXPECT_EQ("00000000000000ff", Util::hashToString(255));
+      // Strings use the same FNV-1a hash
+      EXPECT_EQ(0xaf63dc4c8601ec8cULL, Util::hash(std::string("a")));
+      EXPECT_NE(Util::hash(std::string("a")), Util::hash(std::string("a"), Util::hash(values)));
+   }
+   // Compare against a direct search of each window
+   TEST_F(UtilTest, getWindowMinMax) {
+      int nLat = 7;
+      int nLon = 9;
+      std::vector<float> values(nLat*nLon);
+      for(int n = 0; n < nLat*nLon; n++)
+         values[n] = (n * 37) % 23;
+      values[10] = Util::MV;
+      values[11] = Util::MV;
+      for(int radius = 0; radius < 10; radius++) {
+         std::vector<float> min, max;
+         Util::getWindowMinMax(values, nLat, nLon, radius, min, max);
+         ASSERT_EQ(nLat*nLon, min.size());
+         ASSERT_EQ(nLat*nLon, max.size());
+         for(int i = 0; i < nLat; i++) {
+            for(int j = 0; j < nLon; j++) {
+               float expectedMin = Util::MV;
+               float expectedMax = Util::MV;
+               for(int ii = std::max(0, i-radius); ii <= std::min(nLat-1, i+radius); ii++) {
+                  for(int jj = std::max(0, j-radius); jj <= std::min(nLon-1, j+radius); jj++) {
+                     float value = values[ii*nLon + jj];
+                     if(Util::isValid(value)) {
+                        if(!Util::isValid(expectedMin) || value < expectedMin)
+                           expectedMin = value;
+                        if(!Util::isValid(expectedMax) || value > expectedMax)
+                           expectedMax = value;
+                     }
+                  }
+               }
+               EXPECT_FLOAT_EQ(expectedMin, min[i*nLon + j]);
+               EXPECT_FLOAT_EQ(expectedMax, max[i*nLon + j]);
+            }
+         }
+      }
+      // Only missing values in the window
+      std::vector<float> missing(4, Util::MV);
+      std::vector<float> min, max;
+      Util::getWindowMinMax(missing, 2, 2, 1, min, max);
+      EXPECT_FLOAT_EQ(Util::MV, min[3]);
+      EXPECT_FLOAT_EQ(Util::MV, max[0]);
+   }
    TEST_F(UtilTest, gridppVersion) {
       std::string version = Util::gridppVersion();
       EXPECT_NE("", version);
@@ -0,0 +1,261 @@
+#include "TextReader.h"
+#include "Util.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+   inline bool isSpace(char iChar) {
+      return iChar == ' ' || iChar == '\t' || iChar == '\n' || iChar == '\r' || iChar == '\v' || iChar == '\f';
+   }
+   inline bool isDigit(char iChar) {
+      return iChar >= '0' && iChar <= '9';
+   }
+   // Powers of ten that are exactly representable as doubles
+   const double powersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+}
+
+TextReader::TextReader(std::string iFilename) :
+      mFilename(iFilename),
+      mData(NULL),
+      mSize(0),
+      mIsMapped(false),
+      mIsValid(false) {
+   int fd = open(iFilename.c_str(), O_RDONLY);
+   if(fd == -1)
+      return;
+
+   struct stat info;
+   if(fstat(fd, &info) != 0) {
+      close(fd);
+      return;
+   }
+   if(S_ISREG(info.st_mode)) {
+      mSize = info.st_size;
+      if(mSize > 0) {
+         void* map = mmap(NULL, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+         if(map != MAP_FAILED) {
+            mData = static_cast<const char*>(map);
+            mIsMapped = true;
+            madvise(map, mSize, MADV_SEQUENTIAL);
+         }
+      }
+   }
+   close(fd);
+
+   // Files that cannot be mapped (e.g. pipes) are read into memory instead
+   if(!mIsMapped && (mSize > 0 || !S_ISREG(info.st_mode))) {
+      std::ifstream ifs(iFilename.c_str(), std::ifstream::in | std::ifstream::binary);
+      if(!ifs.good())
+         return;
+      std::stringstream ss;
+      ss << ifs.rdbuf();
+      mBuffer = ss.str();
+      mData = mBuffer.c_str();
+      mSize = mBuffer.size();
+   }
+
+   mLineStarts.push_back(0);
+   const char* pos = mData;
+   const char* end = mData + mSize;
+   while(pos < end) {
+      const char* newline = static_cast<const char*>(memchr(pos, '\n', end - pos));
+      if(newline == NULL)
+         break;
+      pos = newline + 1;
+      mLineStarts.push_back(pos - mData);
+   }
+   // The last line does not need to end with a newline
+   if(mLineStarts.back() != mSize)
+      mLineStarts.push_back(mSize);
+   mIsValid = true;
+}
+
+TextReader::~TextReader() {
+   if(mIsMapped)
+      munmap(const_cast<char*>(mData), mSize);
+}
+
+bool TextReader::isValid() const {
+   return mIsValid;
+}
+
+int TextReader::getNumLines() const {
+   if(mLineStarts.size() == 0)
+      return 0;
+   return mLineStarts.size() - 1;
+}
+
+bool TextReader::isEmpty(int iLine) const {
+   const char* pos = mData + mLineStarts[iLine];
+   const char* end = mData + mLineStarts[iLine+1];
+   if(pos < end && *pos == '#')
+      return true;
+   while(pos < end && isSpace(*pos))
+      pos++;
+   return pos == end;
+}
+
+bool TextReader::readLine(int iLine, std::vector<double>& iValues) const {
+   iValues.resize(countValues(iLine));
+   if(iValues.size() == 0)
+      return true;
+   return parseLine(iLine, &iValues[0]);
+}
+
+int TextReader::readAll(std::vector<double>& iValues, std::vector<int>& iOffsets) const {
+   int numLines = getNumLines();
+   iOffsets.resize(numLines + 1);
+   iOffsets[0] = 0;
+   std::vector<int> counts(numLines);
+   #pragma omp parallel for
+   for(int i = 0; i < numLines; i++) {
+      counts[i] = countValues(i);
+   }
+   for(int i = 0; i < numLines; i++) {
+      iOffsets[i+1] = iOffsets[i] + counts[i];
+   }
+
+   iValues.resize(iOffsets[numLines]);
+   std::vector<unsigned char> isValid(numLines, 1);
+   #pragma omp parallel for
+   for(int i = 0; i < numLines; i++) {
+      if(counts[i] > 0)
+         isValid[i] = parseLine(i, &iValues[iOffsets[i]]);
+   }
+   for(int i = 0; i < numLines; i++) {
+      if(!isValid[i])
+         return i;
+   }
+   return Util::MV;
+}
+
+int TextReader::countValues(int iLine) const {
+   const char* pos = mData + mLineStarts[iLine];
+   const char* end = mData + mLineStarts[iLine+1];
+   if(pos < end && *pos == '#')
+      return 0;
+   int count = 0;
+   while(pos < end) {
+      while(pos < end && isSpace(*pos))
+         pos++;
+      if(pos == end)
+         break;
+      count++;
+      while(pos < end && !isSpace(*pos))
+         pos++;
+   }
+   return count;
+}
+
+bool TextReader::parseLine(int iLine, double* iValues) const {
+   const char* pos = mData + mLineStarts[iLine];
+   const char* end = mData + mLineStarts[iLine+1];
+   int count = 0;
+   while(pos < end) {
+      while(pos < end && isSpace(*pos))
+         pos++;
+      if(pos == end)
+         break;
+      if(!parseNumber(pos, end, iValues[count]))
+         return false;
+      count++;
+   }
+   return true;
+}
+
+bool TextReader::parseNumber(const char*& iPos, const char* iEnd, double& iValue) {
+   const char* pos = iPos;
+   bool isNegative = false;
+   if(pos < iEnd && (*pos == '-' || *pos == '+')) {
+      isNegative = *pos == '-';
+      pos++;
+   }
+
+   // Collect up to 19 significant digits, which always fit in 64 bits
+   uint64_t mantissa = 0;
+   int numDigits = 0;
+   int exponent = 0;
+   bool hasDigits = false;
+   while(pos < iEnd && isDigit(*pos)) {
+      hasDigits = true;
+      if(mantissa > 0 || *pos != '0') {
+         if(numDigits < 19) {
+            mantissa = mantissa * 10 + (*pos - '0');
+            numDigits++;
+         }
+         else {
+            exponent++;
+         }
+      }
+      pos++;
+   }
+   if(pos < iEnd && *pos == '.') {
+      pos++;
+      while(pos < iEnd && isDigit(*pos)) {
+         hasDigits = true;
+         if(mantissa > 0 || *pos != '0') {
+            if(numDigits < 19) {
+               mantissa = mantissa * 10 + (*pos - '0');
+               numDigits++;
+               exponent--;
+            }
+         }
+         else {
+            exponent--;
+         }
+         pos++;
+      }
+   }
+   if(hasDigits && pos < iEnd && (*pos == 'e' || *pos == 'E')) {
+      pos++;
+      bool isNegativeExponent = false;
+      if(pos < iEnd && (*pos == '-' || *pos == '+')) {
+         isNegativeExponent = *pos == '-';
+         pos++;
+      }
+      if(pos == iEnd || !isDigit(*pos))
+         hasDigits = false;
+      int value = 0;
+      while(pos < iEnd && isDigit(*pos)) {
+         if(value < 10000)
+            value = value * 10 + (*pos - '0');
+         pos++;
+      }
+      exponent += isNegativeExponent ? -value : value;
+   }
+   bool isTerminated = pos == iEnd || isSpace(*pos);
+
+   // When both the mantissa and the power of ten are exact doubles, one multiplication or division
+   // gives a correctly rounded result. Everything else (long mantissas, large exponents, nan, inf)
+   // is left to strtod.
+   if(hasDigits && isTerminated && numDigits <= 15 && exponent >= -22 && exponent <= 22) {
+      double value = mantissa;
+      if(exponent < 0)
+         value /= powersOfTen[-exponent];
+      else
+         value *= powersOfTen[exponent];
+      iValue = isNegative ? -value : value;
+      iPos = pos;
+      return true;
+   }
+
+   const char* tokenEnd = iPos;
+   while(tokenEnd < iEnd && !isSpace(*tokenEnd))
+      tokenEnd++;
+   std::string token(iPos, tokenEnd);
+   char* parsedEnd;
+   double value = strtod(token.c_str(), &parsedEnd);
+   if(token.size() == 0 || parsedEnd != token.c_str() + token.size())
+      return false;
+   iValue = value;
+   iPos = tokenEnd;
+   return true;
+}
@@ -0,0 +1,51 @@
+#ifndef TEXT_READER_H
+#define TEXT_READER_H
+#include <string>
+#include <vector>
+
+//! Reads text files with whitespace-separated numbers. The file is memory-mapped and numbers are
+//! parsed directly from the mapped memory, so there is no limit on the length of a line. Lines
+//! starting with '#' are comments.
+class TextReader {
+   public:
+      //! Map iFilename into memory. Use isValid() to check if the file could be opened.
+      TextReader(std::string iFilename);
+      ~TextReader();
+      //! Was the file opened successfully?
+      bool isValid() const;
+      //! Number of lines, including empty and comment lines
+      int getNumLines() const;
+      //! Is line iLine empty or a comment?
+      bool isEmpty(int iLine) const;
+      //! Read all numbers on line iLine. Comment lines have no numbers.
+      //! @return false if the line contains something that is not a number
+      bool readLine(int iLine, std::vector<double>& iValues) const;
+
+      //! Read all numbers in the file, parsing lines in parallel
+      //! @param iValues Numbers from all lines, concatenated
+      //! @param iOffsets The numbers on line i are at positions iOffsets[i] to iOffsets[i+1]-1
+      //! @return The first line that contains something that is not a number, or Util::MV
+      int readAll(std::vector<double>& iValues, std::vector<int>& iOffsets) const;
+
+      //! Parse the number starting at iPos, ending at the first whitespace or iEnd. On success,
+      //! iPos is moved past the number.
+      //! @return false if the characters do not form a number
+      static bool parseNumber(const char*& iPos, const char* iEnd, double& iValue);
+   private:
+      TextReader(const TextReader&);
+      TextReader& operator=(const TextReader&);
+      // Count the numbers on line iLine, without parsing them
+      int countValues(int iLine) const;
+      // Parse the numbers on line iLine into iValues. Returns false on invalid numbers.
+      bool parseLine(int iLine, double* iValues) const;
+      std::string mFilename;
+      const char* mData;
+      size_t mSize;
+      bool mIsMapped;
+      // Contents of files that could not be memory-mapped
+      std::string mBuffer;
+      bool mIsValid;
+      // Position of the first character of each line. mLineStarts[numLines] is the end of the file.
+      std::vector<size_t> mLineStarts;
+};
+#endif
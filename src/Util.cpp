@@ -19,6 +19,9 @@ namespace Cglob {
 #include <istream>
 #include <iomanip>
 #include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
 
 #include <boost/numeric/ublas/vector.hpp>
 #include <boost/numeric/ublas/vector_proxy.hpp>
@@ -255,6 +258,58 @@ bool Util::hasChar(std::string iString, char iChar) {
    return iString.find(iChar) != std::string::npos;
 }
 
+void Util::getWindowExtreme(const float* iValues, int iNum, int iStride, int iRadius, bool iUseMax,
+      float* iOutput, int* iQueue) {
+   // Keep a queue of candidate positions whose values are monotonic, so each value is added and
+   // removed once
+   int head = 0;
+   int tail = 0;
+   for(int m = 0; m < iNum + iRadius; m++) {
+      if(m < iNum && Util::isValid(iValues[m*iStride])) {
+         float value = iValues[m*iStride];
+         while(tail > head && (iUseMax ? iValues[iQueue[tail-1]*iStride] <= value : iValues[iQueue[tail-1]*iStride] >= value))
+            tail--;
+         iQueue[tail++] = m;
+      }
+      // Output the window centered on k, once all its values have been added
+      int k = m - iRadius;
+      if(k >= 0) {
+         while(tail > head && iQueue[head] < k - iRadius)
+            head++;
+         iOutput[k*iStride] = tail > head ? iValues[iQueue[head]*iStride] : Util::MV;
+      }
+   }
+}
+
+void Util::getWindowMinMax(const std::vector<float>& iValues, int iNumLat, int iNumLon, int iRadius,
+      std::vector<float>& iMin, std::vector<float>& iMax) {
+   if(iValues.size() != iNumLat * iNumLon)
+      Util::error("Cannot compute window min/max, values do not match the size of the grid");
+   if(iRadius < 0)
+      Util::error("Cannot compute window min/max, radius must be >= 0");
+   iMin.clear();
+   iMax.clear();
+   iMin.resize(iValues.size(), Util::MV);
+   iMax.resize(iValues.size(), Util::MV);
+   if(iValues.size() == 0)
+      return;
+
+   // The window is separable, so compute the extremes along each row and then along each column
+   std::vector<float> rowMin(iValues.size()), rowMax(iValues.size());
+   #pragma omp parallel for
+   for(int i = 0; i < iNumLat; i++) {
+      std::vector<int> queue(iNumLon);
+      getWindowExtreme(&iValues[i*iNumLon], iNumLon, 1, iRadius, false, &rowMin[i*iNumLon], &queue[0]);
+      getWindowExtreme(&iValues[i*iNumLon], iNumLon, 1, iRadius, true, &rowMax[i*iNumLon], &queue[0]);
+   }
+   #pragma omp parallel for
+   for(int j = 0; j < iNumLon; j++) {
+      std::vector<int> queue(iNumLat);
+      getWindowExtreme(&rowMin[j], iNumLat, iNumLon, iRadius, false, &iMin[j], &queue[0]);
+      getWindowExtreme(&rowMax[j], iNumLat, iNumLon, iRadius, true, &iMax[j], &queue[0]);
+   }
+}
+
 bool Util::copy(std::string iFrom, std::string iTo) {
    std::ifstream source(iFrom.c_str(), std::ios::binary);
    std::ofstream dest(iTo.c_str(), std::ios::binary);
@@ -273,6 +328,37 @@ bool Util::remove(std::string iFilename) {
    return !failure;
 }
 
+uint64_t Util::hash(const vec2& iValues, uint64_t iSeed) {
+   const uint64_t prime = 1099511628211ULL;
+   uint64_t hash = iSeed;
+   hash = (hash ^ (uint32_t) iValues.size()) * prime;
+   for(int i = 0; i < iValues.size(); i++) {
+      const std::vector<float>& row = iValues[i];
+      hash = (hash ^ (uint32_t) row.size()) * prime;
+      for(int j = 0; j < row.size(); j++) {
+         uint32_t word;
+         memcpy(&word, &row[j], sizeof(word));
+         hash = (hash ^ word) * prime;
+      }
+   }
+   return hash;
+}
+
+uint64_t Util::hash(const std::string& iValue, uint64_t iSeed) {
+   const uint64_t prime = 1099511628211ULL;
+   uint64_t hash = iSeed;
+   for(int i = 0; i < iValue.size(); i++) {
+      hash = (hash ^ (unsigned char) iValue[i]) * prime;
+   }
+   return hash;
+}
+
+std::string Util::hashToString(uint64_t iHash) {
+   std::stringstream ss;
+   ss << std::hex << std::setw(16) << std::setfill('0') << iHash;
+   return ss.str();
+}
+
 std::string Util::formatDescription(std::string iTitle, std::string iMessage, int iTitleLength, int iMaxLength, int iTitleIndent) {
    // Invalid input
    if(iTitleLength >= iMaxLength ) {
@@ -319,12 +405,19 @@ std::string Util::formatDescription(std::string iTitle, std::string iMessage, in
 }
 
 float Util::calculateStat(const std::vector<float>& iArray, Util::StatType iStatType, float iQuantile) {
+   if(iArray.size() == 0)
+      return Util::MV;
+   std::vector<float> array = iArray;
+   return calculateStat(&array[0], array.size(), iStatType, iQuantile);
+}
+
+float Util::calculateStat(float* iArray, int iLength, Util::StatType iStatType, float iQuantile) {
    // Initialize to missing
    float value = Util::MV;
    if(iStatType == Util::StatTypeMean) {
       float total = 0;
       int count = 0;
-      for(int n = 0; n < iArray.size(); n++) {
+      for(int n = 0; n < iLength; n++) {
          if(Util::isValid(iArray[n])) {
             total += iArray[n];
             count++;
@@ -343,7 +436,7 @@ float Util::calculateStat(const std::vector<float>& iArray, Util::StatType iStat
       float total2 = 0;
       float K = Util::MV;
       int count = 0;
-      for(int n = 0; n < iArray.size(); n++) {
+      for(int n = 0; n < iLength; n++) {
          if(Util::isValid(iArray[n])) {
             if(!Util::isValid(K))
                K = iArray[n];
@@ -368,26 +461,28 @@ float Util::calculateStat(const std::vector<float>& iArray, Util::StatType iStat
       }
    }
    else if(iStatType == Util::StatTypeQuantile) {
-      // Remove missing
-      std::vector<float> cleanHood;
-      cleanHood.reserve(iArray.size());
-      for(int i = 0; i < iArray.size(); i++) {
-         if(Util::isValid(iArray[i]))
-            cleanHood.push_back(iArray[i]);
+      // Move missing values to the end
+      int N = 0;
+      for(int i = 0; i < iLength; i++) {
+         if(Util::isValid(iArray[i])) {
+            std::swap(iArray[N], iArray[i]);
+            N++;
+         }
       }
-      int N = cleanHood.size();
       if(N > 0) {
-         std::sort(cleanHood.begin(), cleanHood.end());
+         // Only the two order statistics surrounding the quantile are needed
          int lowerIndex = floor(iQuantile * (N-1));
          int upperIndex = ceil(iQuantile * (N-1));
          float lowerQuantile = (float) lowerIndex / (N-1);
          float upperQuantile = (float) upperIndex / (N-1);
-         float lowerValue = cleanHood[lowerIndex];
-         float upperValue = cleanHood[upperIndex];
+         std::nth_element(iArray, iArray + lowerIndex, iArray + N);
+         float lowerValue = iArray[lowerIndex];
          if(lowerIndex == upperIndex) {
             value = lowerValue;
          }
          else {
+            // The next order statistic is the smallest value above the lower one
+            float upperValue = *std::min_element(iArray + lowerIndex + 1, iArray + N);
             assert(upperQuantile > lowerQuantile);
             assert(iQuantile >= lowerQuantile);
             float f = (iQuantile - lowerQuantile)/(upperQuantile - lowerQuantile);
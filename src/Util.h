@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <stdint.h>
 
 typedef std::vector<std::vector<float> > vec2; // Lat, Lon
 
@@ -137,6 +138,9 @@ class Util {
 
       //! Applies statistics operator to array. Missing values are ignored.
       static float calculateStat(const std::vector<float>& iArray, Util::StatType iStatType, float iQuantile=Util::MV);
+      //! Applies statistics operator to the iLength values starting at iArray, without allocating
+      //! memory. Missing values are ignored. The values in iArray may be reordered.
+      static float calculateStat(float* iArray, int iLength, Util::StatType iStatType, float iQuantile=Util::MV);
       
       //! \brief Comparator class for sorting pairs using the first entry.
       //! Sorts from smallest to largest
@@ -165,11 +169,33 @@ class Util {
       //! multiple values, the last element is returned.
       static int getUpperIndex(float iX, const std::vector<float>& iValues);
 
+      //! Computes the minimum and maximum within +- iRadius gridpoints in both directions of each
+      //! point in the iNumLat*iNumLon grid iValues (longitude index varying fastest). The window is
+      //! clipped at the edges of the grid and missing values are ignored. The cost per point does
+      //! not depend on the radius.
+      static void getWindowMinMax(const std::vector<float>& iValues, int iNumLat, int iNumLon, int iRadius,
+            std::vector<float>& iMin, std::vector<float>& iMax);
+
+      //! Computes the minimum (or maximum if iUseMax) within +- iRadius of each of the iNum values
+      //! in iValues, which are spaced iStride apart. Results are written with the same spacing to
+      //! iOutput. Missing values are ignored. iQueue is work space for iNum integers.
+      static void getWindowExtreme(const float* iValues, int iNum, int iStride, int iRadius, bool iUseMax,
+            float* iOutput, int* iQueue);
+
       //! Copy the file with filename iFrom to filename iTo. Returns true if successful.
       static bool copy(std::string iFrom, std::string iTo);
      
       //! Remove the file with filename. Returns true if successful.
       static bool remove(std::string iFilename);
+
+      //! Computes a 64-bit hash (FNV-1a) of the dimensions and bit patterns of the values in
+      //! iValues. Hashes of several arrays can be combined by passing the previous hash as iSeed.
+      static uint64_t hash(const vec2& iValues, uint64_t iSeed=14695981039346656037ULL);
+      //! Computes a 64-bit hash (FNV-1a) of the characters in iValue
+      static uint64_t hash(const std::string& iValue, uint64_t iSeed=14695981039346656037ULL);
+
+      //! Returns iHash as a 16 character hexadecimal string
+      static std::string hashToString(uint64_t iHash);
      
       //! \brief Comparator class for sorting pairs using the second entry.
       //! Sorts from smallest to largest
@@ -1,4 +1,5 @@
 // #include <boost/uuid/uuid.hpp>
 // Type for unique id. boost::uuids::uuid isn't always installed
-// with boost, so an int can be used instead.
-typedef int Uuid; // boost::uuids::uuid
+// with boost, so an integer can be used instead. Grid tags are 64-bit hashes.
+#include <stdint.h>
+typedef uint64_t Uuid; // boost::uuids::uuid